@@ -6,6 +6,7 @@
 #include <signal.h>
 #include <stdbool.h>
 #include <time.h>
+#include <endian.h>
 #include "../common/socket_utils.h"
 #include "../common/config.h"
 
@@ -14,11 +15,24 @@ static int server_socket = -1;
 static pthread_t receive_thread;
 static volatile bool running = false;
 static pthread_mutex_t socket_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t next_request_id = 1;
+
+// Request id of the last /new or /resume, so its reply gets printed
+static volatile uint32_t session_request_id = 0;
+
+// Set by /session, /new and /resume: prompts continue a conversation.
+// Off by default so that prompts stand alone and can be answered from
+// the server's caches.
+static bool in_session = false;
+
+// Set by /stats: print where each answer's time went
+static volatile bool show_stats = false;
 
 // Forward declarations
 static void* receive_messages(void *arg);
 static void cleanup(void);
 static char* get_timestamp(void);
+static void print_stats(const generation_stats_t *stats);
 
 // Signal handler for graceful shutdown
 static void handle_signal(int sig) {
@@ -80,6 +94,12 @@ int main(int argc, char *argv[]) {
     }
     
     printf("Connected to LLM Chat Server. Type your message and press Enter. Type 'exit' to quit.\n");
+    printf("Type '/session' to have prompts continue a conversation or stand alone again.\n");
+    printf("Type '/new' to start a new conversation or '/resume ID' to continue an earlier one.\n");
+    printf("Type '/deadline MS' to give up on answers that take longer, '/deadline 0' to wait forever.\n");
+    printf("Type '/embed TEXT' to see the embedding vector of TEXT.\n");
+    printf("Type '/model NAME' to use another model, '/model' for the server's default.\n");
+    printf("Type '/stats' to show or hide where the time of each answer went.\n");
     
     // Start receive thread
     running = true;
@@ -89,20 +109,24 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
-    // Main input loop
-    char input[BUFFER_SIZE];
+    // Main input loop; getline() keeps long pastes in one prompt
+    char *input = NULL;
+    size_t input_size = 0;
+    char *framed = NULL;
+    uint32_t deadline_ms = 0;
+    char model[256] = "";
     while (running) {
         printf("You: ");
         fflush(stdout);
         
-        if (fgets(input, sizeof(input), stdin) == NULL) {
+        ssize_t len = getline(&input, &input_size, stdin);
+        if (len < 0) {
             break;
         }
         
         // Remove trailing newline
-        size_t len = strlen(input);
         if (len > 0 && input[len - 1] == '\n') {
-            input[len - 1] = '\0';
+            input[--len] = '\0';
         }
         
         // Check for exit command
@@ -110,10 +134,98 @@ int main(int argc, char *argv[]) {
             break;
         }
         
+        if (len == 0) {
+            continue;
+        }
+        
+        if (strncmp(input, "/deadline ", 10) == 0) {
+            deadline_ms = (uint32_t)strtoul(input + 10, NULL, 10);
+            if (deadline_ms > 0) {
+                printf("Answers are abandoned after %u ms\n", deadline_ms);
+            } else {
+                printf("Answers are awaited without a deadline\n");
+            }
+            continue;
+        }
+        
+        if (strcmp(input, "/session") == 0) {
+            in_session = !in_session;
+            printf("Prompts %s\n", in_session ? "continue the conversation" : "stand alone");
+            continue;
+        }
+        
+        if (strcmp(input, "/stats") == 0) {
+            show_stats = !show_stats;
+            printf("Generation statistics are %s\n", show_stats ? "shown" : "hidden");
+            continue;
+        }
+        
+        if (strcmp(input, "/model") == 0 || strncmp(input, "/model ", 7) == 0) {
+            const char *name = input[6] ? input + 7 : "";
+            if (strlen(name) > UINT8_MAX) {
+                printf("Model names are at most %d bytes\n", UINT8_MAX);
+            } else if (name[0]) {
+                strcpy(model, name);
+                printf("Using model %s\n", model);
+            } else {
+                model[0] = '\0';
+                printf("Using the server's default model\n");
+            }
+            continue;
+        }
+        
+        // "/new" starts a fresh conversation, "/resume ID" picks up an earlier one
+        uint8_t type = MSG_PROMPT;
+        uint8_t flags = in_session ? MESSAGE_FLAG_SESSION : 0;
+        const char *payload = input;
+        if (strcmp(input, "/new") == 0) {
+            type = MSG_SESSION;
+            payload = "";
+        } else if (strncmp(input, "/resume ", 8) == 0) {
+            type = MSG_SESSION;
+            payload = input + 8;
+        } else if (strncmp(input, "/embed ", 7) == 0) {
+            type = MSG_EMBED;
+            flags = 0;
+            payload = input + 7;
+            len -= 7;
+        }
+        if (type == MSG_SESSION) {
+            flags = 0;
+            in_session = true;
+            len = strlen(payload);
+            session_request_id = next_request_id;
+        } else if ((type == MSG_PROMPT && deadline_ms > 0) || model[0]) {
+            // The budget, then the model, go in front of the text
+            size_t model_length = strlen(model);
+            char *grown = realloc(framed, len + sizeof(uint32_t) + 1 + model_length);
+            if (grown == NULL) {
+                fprintf(stderr, "Failed to allocate message\n");
+                continue;
+            }
+            framed = grown;
+            size_t offset = 0;
+            if (type == MSG_PROMPT && deadline_ms > 0) {
+                uint32_t budget = htonl(deadline_ms);
+                memcpy(framed, &budget, sizeof(budget));
+                offset += sizeof(budget);
+                flags |= MESSAGE_FLAG_DEADLINE;
+            }
+            if (model_length > 0) {
+                framed[offset++] = (char)model_length;
+                memcpy(framed + offset, model, model_length);
+                offset += model_length;
+                flags |= MESSAGE_FLAG_MODEL;
+            }
+            memcpy(framed + offset, payload, len);
+            payload = framed;
+            len += offset;
+        }
+        
         // Send message to server
         pthread_mutex_lock(&socket_mutex);
         if (server_socket >= 0 && running) {
-            if (send_message(server_socket, input) < 0) {
+            if (send_message(server_socket, type, flags, next_request_id++, payload, len) < 0) {
                 fprintf(stderr, "Failed to send message\n");
             }
         } else {
@@ -121,6 +233,8 @@ int main(int argc, char *argv[]) {
         }
         pthread_mutex_unlock(&socket_mutex);
     }
+    free(input);
+    free(framed);
     
     // Clean up
     cleanup();
@@ -129,70 +243,141 @@ int main(int argc, char *argv[]) {
 }
 
 static void* receive_messages(void *arg) {
-    char buffer[BUFFER_SIZE];
-    int consecutive_errors = 0;
-    const int max_consecutive_errors = 5;
+    (void)arg;
+    message_buffer_t buffer;
+    message_t message;
+    
+    // Request whose reply is currently being printed, 0 when idle
+    uint32_t streaming_id = 0;
+    
+    // Statistics arrive just before the DONE they belong to
+    generation_stats_t stats;
+    uint32_t stats_id = 0;
+    
+    message_buffer_init(&buffer);
     
     while (running) {
-        pthread_mutex_lock(&socket_mutex);
-        int local_socket = server_socket; // Get a local copy of the socket
-        pthread_mutex_unlock(&socket_mutex);
-        
-        if (local_socket < 0) {
+        // Blocks until a whole message is in; sending never waits on this
+        int result = receive_message(server_socket, &buffer, &message);
+        if (result <= 0) {
+            if (running) {
+                fprintf(stderr, "\n%s\n", result == 0 ? "Connection closed by server"
+                                                     : "Connection to server lost");
+            }
             running = false;
             break;
         }
         
-        pthread_mutex_lock(&socket_mutex);
-        int bytes_received = receive_message(local_socket, buffer, BUFFER_SIZE);
-        pthread_mutex_unlock(&socket_mutex);
-        
-        if (bytes_received < 0) {
-            consecutive_errors++;
-            if (consecutive_errors >= max_consecutive_errors && running) {
-                // Too many consecutive errors, assume connection is lost
-                fprintf(stderr, "\nConnection to server lost after multiple errors\n");
-                running = false;
+        switch (message.type) {
+            case MSG_INFO:
+                printf("\n%.*s\n", (int)message.length, message.payload);
+                break;
+            case MSG_TOKEN:
+                // Print tokens the moment they arrive, header first
+                if (streaming_id != message.request_id) {
+                    char *timestamp = get_timestamp();
+                    printf("\nLLM (%s): ", timestamp);
+                    free(timestamp);
+                    streaming_id = message.request_id;
+                }
+                fwrite(message.payload, 1, message.length, stdout);
+                fflush(stdout);
+                continue;
+            case MSG_DONE:
+                if (streaming_id == 0) {
+                    char *timestamp = get_timestamp();
+                    printf("\nLLM (%s): ", timestamp);
+                    free(timestamp);
+                }
+                printf("\n");
+                if (show_stats && stats_id == message.request_id) {
+                    print_stats(&stats);
+                }
+                streaming_id = 0;
+                break;
+            case MSG_STATS:
+                generation_stats_decode(message.payload, message.length, &stats);
+                stats_id = message.request_id;
+                continue;
+            case MSG_ERROR:
+                printf("\nError: %.*s%s\n", (int)message.length, message.payload,
+                       (message.flags & MESSAGE_FLAG_UNAVAILABLE) ? " (try again later)" : "");
+                streaming_id = 0;
+                break;
+            case MSG_SESSION:
+                // Sessions the server opened on its own are not announced
+                if (message.request_id != session_request_id) {
+                    continue;
+                }
+                printf("\nConversation %.*s\n", (int)message.length, message.payload);
+                break;
+            case MSG_EMBEDDING: {
+                // Little-endian float32s; show the start of the vector
+                size_t dimensions = message.length / sizeof(uint32_t);
+                printf("\nEmbedding (%zu dimensions):", dimensions);
+                for (size_t i = 0; i < dimensions && i < 8; i++) {
+                    uint32_t bits;
+                    float value;
+                    memcpy(&bits, message.payload + i * sizeof(bits), sizeof(bits));
+                    bits = le32toh(bits);
+                    memcpy(&value, &bits, sizeof(value));
+                    printf(" %.4f", value);
+                }
+                printf("%s\n", dimensions > 8 ? " ..." : "");
                 break;
             }
-            // Small sleep to prevent CPU hogging on errors
-            usleep(100000); // 100ms
-            continue;
-        } else if (bytes_received == 0) {
-            // No data available, just a timeout, which is normal
-            // Reset error counter if we're not getting errors anymore
-            if (consecutive_errors > 0) consecutive_errors--;
-            usleep(50000); // 50ms sleep to prevent CPU hogging
-            continue;
-        } else {
-            // Reset error counter on successful receive
-            consecutive_errors = 0;
-            
-            // Print received message with timestamp
-            char *timestamp = get_timestamp();
-            printf("\nLLM (%s): %s\n", timestamp, buffer);
-            free(timestamp);
-            printf("You: ");
-            fflush(stdout);
+            default:
+                continue;
         }
+        
+        printf("You: ");
+        fflush(stdout);
     }
     
+    message_buffer_free(&buffer);
     return NULL;
 }
 
 static void cleanup(void) {
     running = false;
     
-    // Close socket
+    // Shut the socket down first so the blocked receive thread wakes up
     if (server_socket >= 0) {
-        close(server_socket);
-        server_socket = -1;
+        shutdown(server_socket, SHUT_RDWR);
     }
     
     // Wait for receive thread to finish
     if (pthread_join(receive_thread, NULL) != 0) {
         fprintf(stderr, "Failed to join receive thread\n");
     }
+    
+    // Close socket
+    if (server_socket >= 0) {
+        close(server_socket);
+        server_socket = -1;
+    }
+}
+
+static void print_stats(const generation_stats_t *stats) {
+    printf("(");
+    if (stats->prompt_eval_count >= 0 && stats->prompt_eval_duration >= 0) {
+        printf("prompt %lld tokens in %.0f ms, ", (long long)stats->prompt_eval_count,
+               stats->prompt_eval_duration / 1e6);
+    }
+    if (stats->eval_count >= 0 && stats->eval_duration > 0) {
+        printf("%lld tokens at %.1f tokens/s, ", (long long)stats->eval_count,
+               stats->eval_count * 1e9 / stats->eval_duration);
+    }
+    if (stats->load_duration > 0) {
+        printf("model load %.0f ms, ", stats->load_duration / 1e6);
+    }
+    if (stats->connect_ms > 0) {
+        printf("connect %lld ms, ", (long long)stats->connect_ms);
+    }
+    if (stats->first_byte_ms >= 0) {
+        printf("first byte %lld ms, ", (long long)stats->first_byte_ms);
+    }
+    printf("queued %lld ms)\n", (long long)(stats->queue_ms > 0 ? stats->queue_ms : 0));
 }
 
 static char* get_timestamp(void) {
@@ -13,6 +13,7 @@ static int server_socket = -1;
 static pthread_t receive_thread;
 static volatile bool running = false;
 static pthread_mutex_t socket_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t next_request_id = 1;
 
 // Forward declarations
 static void* receive_messages(void *arg);
@@ -123,69 +124,73 @@ int main(int argc, char *argv[]) {
 }
 
 static void* receive_messages(void *arg) {
-    char buffer[BUFFER_SIZE];
-    int consecutive_errors = 0;
-    const int max_consecutive_errors = 5;
+    (void)arg;
+    message_buffer_t buffer;
+    message_t message;
+    
+    message_buffer_init(&buffer);
     
     while (running) {
-        // Clear buffer before each receive
-        memset(buffer, 0, BUFFER_SIZE);
-        
-        // Use a local copy of the socket to avoid race conditions
-        int local_socket;
-        pthread_mutex_lock(&socket_mutex);
-        local_socket = server_socket;
-        pthread_mutex_unlock(&socket_mutex);
-        
-        // Check if socket is valid
-        if (local_socket < 0) {
+        // Blocks until a whole message is in; sending never waits on this
+        int result = receive_message(server_socket, &buffer, &message);
+        if (result <= 0) {
+            if (running) {
+                gui_show_error(result == 0 ? "Connection closed by server"
+                                           : "Connection to server lost");
+            }
             running = false;
             break;
         }
         
-        // Receive message with mutex protection only during the actual receive call
-        pthread_mutex_lock(&socket_mutex);
-        int bytes_received = receive_message(local_socket, buffer, BUFFER_SIZE);
-        pthread_mutex_unlock(&socket_mutex);
-        
-        if (bytes_received < 0) {
-            consecutive_errors++;
-            if (consecutive_errors >= max_consecutive_errors && running) {
-                // Too many consecutive errors, assume connection is lost
-                gui_show_error("Connection to server lost after multiple errors");
-                running = false;
+        switch (message.type) {
+            case MSG_INFO:
+                // GTK is only touched on the main thread
+                gui_post_message(message.payload, message.length);
+                break;
+            case MSG_TOKEN:
+                // Render each token as soon as it arrives
+                gui_stream_append(message.payload, message.length);
+                break;
+            case MSG_DONE:
+                gui_stream_end();
+                break;
+            case MSG_ERROR: {
+                // Errors end up in the reply bubble, after any partial output
+                char *text = malloc(message.length + 9);
+                if (text) {
+                    int length = snprintf(text, message.length + 9, "\nError: %.*s",
+                                          (int)message.length, message.payload);
+                    gui_stream_append(text, length);
+                    free(text);
+                }
+                gui_stream_end();
                 break;
             }
-            // Small sleep to prevent CPU hogging on errors
-            usleep(100000); // 100ms
-            continue;
-        } else if (bytes_received == 0) {
-            // No data available, just a timeout, which is normal
-            // Reset error counter if we're not getting errors anymore
-            if (consecutive_errors > 0) consecutive_errors--;
-            usleep(50000); // 50ms sleep to prevent CPU hogging
-            continue;
-        } else {
-            // Reset error counter on successful receive
-            consecutive_errors = 0;
-            
-            // No need to create a separate copy since gui_add_message already creates one
-            // Just pass the buffer directly to avoid double memory allocation
-            gui_add_message(buffer, false);
+            default:
+                break;
         }
     }
     
+    message_buffer_free(&buffer);
     return NULL;
 }
 
 static void send_message_callback(const char *message, void *user_data) {
+    (void)user_data;
     pthread_mutex_lock(&socket_mutex);
     if (server_socket >= 0 && running) {
-        if (send_message(server_socket, message) < 0) {
+        // With the conversation on, follow-ups continue the same
+        // server-side session; otherwise prompts stand alone and can be
+        // answered from the server's caches
+        uint8_t flags = gui_conversation_enabled() ? MESSAGE_FLAG_SESSION : 0;
+        if (send_message(server_socket, MSG_PROMPT, flags, next_request_id++,
+                         message, strlen(message)) < 0) {
             gui_show_error("Failed to send message");
+            gui_stream_end();
         }
     } else {
         gui_show_error("Not connected to server");
+        gui_stream_end();
     }
     pthread_mutex_unlock(&socket_mutex);
 }
@@ -193,10 +198,9 @@ static void send_message_callback(const char *message, void *user_data) {
 static void cleanup(void) {
     running = false;
     
-    // Close socket
+    // Shut the socket down first so the blocked receive thread wakes up
     if (server_socket >= 0) {
-        close(server_socket);
-        server_socket = -1;
+        shutdown(server_socket, SHUT_RDWR);
     }
     
     // Wait for receive thread to finish
@@ -204,6 +208,12 @@ static void cleanup(void) {
         fprintf(stderr, "Failed to join receive thread\n");
     }
     
+    // Close socket
+    if (server_socket >= 0) {
+        close(server_socket);
+        server_socket = -1;
+    }
+    
     // Clean up GUI
     gui_cleanup();
 }
@@ -117,6 +117,13 @@ static gui_t gui;
 static gui_config_t current_config;
 static volatile sig_atomic_t shutdown_flag = 0;
 
+// Streamed text waiting to be applied on the GTK main thread. Tokens that
+// arrive between two main loop iterations are coalesced into one update.
+static GMutex stream_mutex;
+static GString *stream_pending = NULL;
+static gboolean stream_end_pending = FALSE;
+static gboolean stream_flush_scheduled = FALSE;
+
 // Signal handler for Ctrl+C
 static void signal_handler(int signum) {
     printf("\nReceived signal %d, shutting down client...\n", signum);
@@ -155,7 +162,9 @@ static void on_send_button_clicked(GtkWidget *widget, gpointer data);
 static gboolean on_key_press(GtkWidget *widget, GdkEventKey *event, gpointer data);
 static void update_chat_view(void);
 static void apply_css(void);
-static GtkWidget* create_message_bubble(const char *text, gboolean is_user);
+static GtkWidget* create_message_bubble(const char *text, gboolean is_user, GtkWidget **label_out);
+static void set_message_text(GtkWidget *message_label, const char *text);
+static gboolean flush_stream(gpointer data);
 static char* format_timestamp(time_t timestamp);
 static char* detect_language(const char *code);
 static char* highlight_code(const char *code, const char *language);
@@ -346,6 +355,11 @@ bool gui_initialize(gui_config_t *config) {
     gtk_box_pack_start(GTK_BOX(title_box), arrow_icon, FALSE, FALSE, 0);
     gtk_box_pack_start(GTK_BOX(header_bar), title_box, FALSE, FALSE, 5);
     
+    // Conversation toggle on the right
+    gui.conversation_check = gtk_check_button_new_with_label("Conversation");
+    gtk_widget_set_tooltip_text(gui.conversation_check, "Let each prompt see the earlier ones");
+    gtk_box_pack_end(GTK_BOX(header_bar), gui.conversation_check, FALSE, FALSE, 5);
+    
     // Create scrolled window for chat messages
     gui.scrolled_window = gtk_scrolled_window_new(NULL, NULL);
     gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(gui.scrolled_window),
@@ -390,6 +404,8 @@ bool gui_initialize(gui_config_t *config) {
     
     // Initialize message history
     gui.messages = g_array_new(FALSE, FALSE, sizeof(chat_message_t));
+    gui.stream_index = -1;
+    gui.stream_label = NULL;
     g_array_set_clear_func(gui.messages, (GDestroyNotify)free);
     
     // Apply CSS styling
@@ -464,11 +480,111 @@ void gui_add_message(const char *text, bool is_user) {
     update_chat_view();
 }
 
+static gboolean add_posted_message(gpointer data) {
+    gui_add_message(data, false);
+    g_free(data);
+    return G_SOURCE_REMOVE;
+}
+
+void gui_post_message(const char *text, size_t length) {
+    if (text == NULL || length == 0) {
+        return;
+    }
+    gdk_threads_add_idle(add_posted_message, g_strndup(text, length));
+}
+
 void gui_set_send_callback(void (*callback)(const char *message, void *user_data), void *user_data) {
     gui.send_callback = callback;
     gui.user_data = user_data;
 }
 
+// Read on the main thread, where the send callback runs
+bool gui_conversation_enabled(void) {
+    return gui.conversation_check != NULL &&
+           gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(gui.conversation_check));
+}
+
+// Hand pending stream updates to the main thread. Caller holds stream_mutex.
+static void schedule_stream_flush(void) {
+    if (!stream_flush_scheduled) {
+        stream_flush_scheduled = TRUE;
+        gdk_threads_add_idle(flush_stream, NULL);
+    }
+}
+
+void gui_stream_append(const char *text, size_t length) {
+    if (text == NULL || length == 0) {
+        return;
+    }
+    
+    g_mutex_lock(&stream_mutex);
+    if (stream_pending == NULL) {
+        stream_pending = g_string_new(NULL);
+    }
+    g_string_append_len(stream_pending, text, length);
+    schedule_stream_flush();
+    g_mutex_unlock(&stream_mutex);
+}
+
+void gui_stream_end(void) {
+    g_mutex_lock(&stream_mutex);
+    stream_end_pending = TRUE;
+    schedule_stream_flush();
+    g_mutex_unlock(&stream_mutex);
+}
+
+// Runs on the GTK main thread: grow the streaming bubble in place instead
+// of rebuilding the whole chat view for every token
+static gboolean flush_stream(gpointer data) {
+    (void)data;
+    
+    g_mutex_lock(&stream_mutex);
+    char *text = NULL;
+    if (stream_pending != NULL && stream_pending->len > 0) {
+        text = g_strdup(stream_pending->str);
+        g_string_truncate(stream_pending, 0);
+    }
+    gboolean end = stream_end_pending;
+    stream_end_pending = FALSE;
+    stream_flush_scheduled = FALSE;
+    g_mutex_unlock(&stream_mutex);
+    
+    if (text != NULL) {
+        if (gui.stream_index < 0) {
+            // First token: start a new assistant message; the chat view
+            // rebuild picks up its label through stream_index
+            gui.stream_index = gui.messages->len;
+            gui_add_message(text, false);
+        } else {
+            chat_message_t *msg = &g_array_index(gui.messages, chat_message_t, gui.stream_index);
+            size_t old_length = strlen(msg->text);
+            size_t add_length = strlen(text);
+            char *grown = realloc(msg->text, old_length + add_length + 1);
+            if (grown != NULL) {
+                memcpy(grown + old_length, text, add_length + 1);
+                msg->text = grown;
+                if (gui.stream_label != NULL) {
+                    set_message_text(gui.stream_label, msg->text);
+                }
+                
+                // Keep the growing reply in view
+                GtkAdjustment *adj = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(gui.scrolled_window));
+                gtk_adjustment_set_value(adj, gtk_adjustment_get_upper(adj));
+            }
+        }
+        g_free(text);
+    }
+    
+    if (end) {
+        gui.stream_index = -1;
+        gui.stream_label = NULL;
+        gui.awaiting_reply = FALSE;
+        gtk_widget_set_sensitive(gui.send_button, TRUE);
+    }
+    
+    return G_SOURCE_REMOVE;
+}
+
 void gui_show_error(const char *message) {
     GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(gui.window),
                                               GTK_DIALOG_DESTROY_WITH_PARENT,
@@ -494,9 +610,16 @@ void gui_show_info(const char *message) {
 static void on_send_button_clicked(GtkWidget *widget, gpointer data) {
     const char *text = gtk_entry_get_text(GTK_ENTRY(gui.message_entry));
     
+    // The next prompt waits until the current reply is done
+    if (gui.awaiting_reply) {
+        return;
+    }
+    
     if (text != NULL && strlen(text) > 0) {
         // Add message to chat
         gui_add_message(text, true);
+        gui.awaiting_reply = TRUE;
+        gtk_widget_set_sensitive(gui.send_button, FALSE);
         
         // Call send callback if set
         if (gui.send_callback) {
@@ -547,45 +670,11 @@ static char* markdown_to_pango(const char *text) {
             g_string_append(escaped, "&gt;");
         } else if (*p == '&') {
             g_string_append(escaped, "&amp;");
-        } else if (*p == '\\' && *(p+1) != '\0') {
-            // Handle escape sequences
-            switch (*(p+1)) {
-                case 'n': 
-                    g_string_append(escaped, "\n");
-                    p++; // Skip the 'n'
-                    break;
-                case 't':
-                    g_string_append(escaped, "    "); // 4-space tab
-                    p++; // Skip the 't'
-                    break;
-                case 'r':
-                    // Ignore carriage returns
-                    p++; // Skip the 'r'
-                    break;
-                case '\\':
-                    g_string_append_c(escaped, '\\');
-                    p++; // Skip the second backslash
-                    break;
-                case 'u':
-                    // Handle Unicode escape sequences like \u2713
-                    if (isxdigit(*(p+2)) && isxdigit(*(p+3)) && isxdigit(*(p+4)) && isxdigit(*(p+5))) {
-                        // Extract 4 hex digits
-                        char hex[5] = {*(p+2), *(p+3), *(p+4), *(p+5), '\0'};
-                        // Convert hex to integer
-                        gunichar unicode_char = (gunichar)strtol(hex, NULL, 16);
-                        // Append the actual Unicode character
-                        g_string_append_unichar(escaped, unicode_char);
-                        p += 5; // Skip 'u' and the 4 hex digits
-                    } else {
-                        // Not a valid Unicode escape, just add \u
-                        g_string_append(escaped, "\\u");
-                        p++; // Skip the 'u'
-                    }
-                    break;
-                default:
-                    // Just add the backslash
-                    g_string_append_c(escaped, *p);
-            }
+        } else if (*p == '\t') {
+            // Text arrives already unescaped from the server
+            g_string_append(escaped, "    "); // 4-space tab
+        } else if (*p == '\r') {
+            // Ignore carriage returns
         } else {
             g_string_append_c(escaped, *p);
         }
@@ -879,7 +968,7 @@ static char* markdown_to_pango(const char *text) {
 
 
 
-static GtkWidget* create_message_bubble(const char *text, gboolean is_user) {
+static GtkWidget* create_message_bubble(const char *text, gboolean is_user, GtkWidget **label_out) {
     // Create a container for the entire message row
     GtkWidget *message_row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
     
@@ -967,9 +1056,6 @@ static GtkWidget* create_message_bubble(const char *text, gboolean is_user) {
         gtk_box_pack_start(GTK_BOX(message_row), message_box, TRUE, TRUE, 0);
     }
     
-    // Convert Markdown to Pango markup
-    char *markup_text = markdown_to_pango(text);
-    
     // Create and style the message text with Markdown support
     GtkWidget *message_label = gtk_label_new(NULL);
     
@@ -980,6 +1066,27 @@ static GtkWidget* create_message_bubble(const char *text, gboolean is_user) {
     gtk_label_set_track_visited_links(GTK_LABEL(message_label), TRUE);
     g_signal_connect(message_label, "activate-link", G_CALLBACK(gtk_show_uri_on_window), NULL);
     
+    set_message_text(message_label, text);
+    
+    gtk_label_set_line_wrap(GTK_LABEL(message_label), TRUE);
+    gtk_label_set_line_wrap_mode(GTK_LABEL(message_label), PANGO_WRAP_WORD_CHAR);
+    gtk_widget_set_halign(message_label, GTK_ALIGN_FILL);
+    gtk_widget_set_size_request(message_label, 100, -1); // Minimum width, helps with wrapping
+    gtk_style_context_add_class(gtk_widget_get_style_context(message_label), "message-text");
+    gtk_container_add(GTK_CONTAINER(message_box), message_label);
+    
+    if (label_out != NULL) {
+        *label_out = message_label;
+    }
+    
+    gtk_widget_show_all(message_row);
+    return message_row;
+}
+
+// Render message text into a label, converting Markdown to Pango markup
+static void set_message_text(GtkWidget *message_label, const char *text) {
+    char *markup_text = markdown_to_pango(text);
+    
     // Safely set markup and handle errors
     GError *error = NULL;
     if (!pango_parse_markup(markup_text, -1, 0, NULL, NULL, NULL, &error)) {
@@ -992,18 +1099,8 @@ static GtkWidget* create_message_bubble(const char *text, gboolean is_user) {
         gtk_label_set_markup(GTK_LABEL(message_label), markup_text);
     }
     
-    gtk_label_set_line_wrap(GTK_LABEL(message_label), TRUE);
-    gtk_label_set_line_wrap_mode(GTK_LABEL(message_label), PANGO_WRAP_WORD_CHAR);
-    gtk_widget_set_halign(message_label, GTK_ALIGN_FILL);
-    gtk_widget_set_size_request(message_label, 100, -1); // Minimum width, helps with wrapping
-    gtk_style_context_add_class(gtk_widget_get_style_context(message_label), "message-text");
-    gtk_container_add(GTK_CONTAINER(message_box), message_label);
-    
     // Free the markup text
     g_free(markup_text);
-    
-    gtk_widget_show_all(message_row);
-    return message_row;
 }
 
 static void update_chat_view() {
@@ -1023,8 +1120,13 @@ static void update_chat_view() {
     for (guint i = 0; i < gui.messages->len; i++) {
         chat_message_t *msg = &g_array_index(gui.messages, chat_message_t, i);
         
-        // Create a message bubble and add it to the chat box
-        GtkWidget *bubble = create_message_bubble(msg->text, msg->is_user);
+        // Create a message bubble and add it to the chat box, remembering
+        // the label of a reply that is still streaming in
+        GtkWidget *label = NULL;
+        GtkWidget *bubble = create_message_bubble(msg->text, msg->is_user, &label);
+        if ((gint)i == gui.stream_index) {
+            gui.stream_label = label;
+        }
         gtk_box_pack_start(GTK_BOX(gui.chat_box), bubble, FALSE, FALSE, 5);
     }
     
@@ -28,11 +28,20 @@ typedef struct {
     GtkWidget *chat_box;        // Container for message bubbles
     GtkWidget *message_entry;
     GtkWidget *send_button;
+    GtkWidget *conversation_check;  // ticked: prompts continue a session
     GtkWidget *scrolled_window;
     
     // Message history
     GArray *messages;
     
+    // Assistant reply that is still streaming in
+    gint stream_index;          // index in messages, -1 when none
+    GtkWidget *stream_label;
+    
+    // A prompt is out and its reply has not ended; replies carry no
+    // request id here, so only one prompt is in flight at a time
+    gboolean awaiting_reply;
+    
     // Callback for sending messages
     void (*send_callback)(const char *message, void *user_data);
     void *user_data;
@@ -45,8 +54,22 @@ void gui_cleanup(void);
 
 // Message handling
 void gui_add_message(const char *text, bool is_user);
+
+// Adds an assistant message from any thread; it is shown once the main
+// loop gets to it, in order with streamed replies
+void gui_post_message(const char *text, size_t length);
 void gui_set_send_callback(void (*callback)(const char *message, void *user_data), void *user_data);
 
+// Whether the user wants follow-ups to continue the conversation. Off by
+// default, so repeated prompts can be answered from the server's caches.
+bool gui_conversation_enabled(void);
+
+// Streaming replies; safe to call from any thread. Text is appended to the
+// current assistant bubble (created on first use) until the stream ends,
+// which also lets the next prompt be sent.
+void gui_stream_append(const char *text, size_t length);
+void gui_stream_end(void);
+
 // Utility functions
 void gui_show_error(const char *message);
 void gui_show_info(const char *message);
@@ -15,6 +15,8 @@ static bool parse_json_value(const char *json, const char *key, char *value, siz
 static bool parse_json_int(const char *json, const char *key, int *value);
 static bool parse_json_float(const char *json, const char *key, float *value);
 static bool parse_json_bool(const char *json, const char *key, bool *value);
+static int parse_json_backends(const char *json, llm_backend_config_t *backends, int max_backends);
+static bool parse_backend_address(const char *address, llm_backend_config_t *backend);
 
 bool config_load(const char *filename, config_t *config) {
     if (config == NULL) {
@@ -41,10 +43,32 @@ bool config_load(const char *filename, config_t *config) {
     // Parse server configuration
     parse_json_value(json, "server_host", config->server_host, sizeof(config->server_host));
     parse_json_int(json, "server_port", &config->server_port);
+    parse_json_int(json, "metrics_port", &config->metrics_port);
+    parse_json_int(json, "trace_sample_percent", &config->trace_sample_percent);
     parse_json_int(json, "max_connections", &config->max_connections);
+    parse_json_int(json, "llm_workers", &config->llm_workers);
+    parse_json_bool(json, "async_upstream", &config->async_upstream);
+    parse_json_int(json, "cache_size_mb", &config->cache_size_mb);
+    parse_json_int(json, "cache_replay_ms", &config->cache_replay_ms);
+    parse_json_bool(json, "cache_deterministic_only", &config->cache_deterministic_only);
+    parse_json_value(json, "disk_cache_path", config->disk_cache_path, sizeof(config->disk_cache_path));
+    parse_json_int(json, "disk_cache_size_mb", &config->disk_cache_size_mb);
+    parse_json_int(json, "max_sessions", &config->max_sessions);
+    parse_json_int(json, "session_ttl", &config->session_ttl);
+    parse_json_int(json, "embed_batch_size", &config->embed_batch_size);
+    parse_json_int(json, "embed_batch_wait_us", &config->embed_batch_wait_us);
+    parse_json_int(json, "model_concurrency", &config->model_concurrency);
+    parse_json_value(json, "model_limits", config->model_limits, sizeof(config->model_limits));
+    parse_json_int(json, "max_generations", &config->max_generations);
+    parse_json_int(json, "model_batch", &config->model_batch);
     parse_json_bool(json, "verbose", &config->verbose);
     
     // Parse LLM configuration
+    char engine_str[32] = {0};
+    if (parse_json_value(json, "engine", engine_str, sizeof(engine_str))) {
+        config->engine = strcmp(engine_str, "synthetic") == 0 ? LLM_ENGINE_SYNTHETIC : LLM_ENGINE_OLLAMA;
+    }
+    
     char llm_type_str[32] = {0};
     if (parse_json_value(json, "llm_type", llm_type_str, sizeof(llm_type_str))) {
         if (strcmp(llm_type_str, "llama") == 0) {
@@ -62,6 +86,27 @@ bool config_load(const char *filename, config_t *config) {
     parse_json_float(json, "temperature", &config->temperature);
     parse_json_int(json, "max_tokens", &config->max_tokens);
     parse_json_int(json, "context_size", &config->context_size);
+    parse_json_int(json, "seed", &config->seed);
+    parse_json_value(json, "ollama_host", config->ollama_host, sizeof(config->ollama_host));
+    parse_json_int(json, "ollama_port", &config->ollama_port);
+    parse_json_value(json, "ollama_socket", config->ollama_socket, sizeof(config->ollama_socket));
+    config->backend_count = parse_json_backends(json, config->backends, LLM_MAX_BACKENDS);
+    parse_json_int(json, "backend_health_interval", &config->backend_health_interval);
+    parse_json_bool(json, "backend_sticky_sessions", &config->backend_sticky_sessions);
+    parse_json_int(json, "connect_timeout_ms", &config->connect_timeout_ms);
+    parse_json_int(json, "first_token_timeout_ms", &config->first_token_timeout_ms);
+    parse_json_int(json, "stall_timeout_ms", &config->stall_timeout_ms);
+    parse_json_int(json, "generation_timeout_ms", &config->generation_timeout_ms);
+    parse_json_int(json, "hedge_percentile", &config->hedge_percentile);
+    parse_json_int(json, "hedge_budget_percent", &config->hedge_budget_percent);
+    parse_json_int(json, "breaker_slow_ms", &config->breaker_slow_ms);
+    parse_json_int(json, "keep_alive", &config->keep_alive);
+    parse_json_bool(json, "warm_up", &config->warm_up);
+    parse_json_int(json, "keep_warm_interval", &config->keep_warm_interval);
+    parse_json_int(json, "model_memory_mb", &config->model_memory_mb);
+    parse_json_int(json, "synthetic_tokens_per_second", &config->synthetic_tokens_per_second);
+    parse_json_int(json, "synthetic_latency_ms", &config->synthetic_latency_ms);
+    parse_json_float(json, "synthetic_jitter", &config->synthetic_jitter);
     
     // Parse client configuration
     parse_json_bool(json, "dark_mode", &config->dark_mode);
@@ -93,10 +138,28 @@ bool config_save(const char *filename, const config_t *config) {
     // Server configuration
     fprintf(fp, "    \"server_host\": \"%s\",\n", config->server_host);
     fprintf(fp, "    \"server_port\": %d,\n", config->server_port);
+    fprintf(fp, "    \"metrics_port\": %d,\n", config->metrics_port);
+    fprintf(fp, "    \"trace_sample_percent\": %d,\n", config->trace_sample_percent);
     fprintf(fp, "    \"max_connections\": %d,\n", config->max_connections);
+    fprintf(fp, "    \"llm_workers\": %d,\n", config->llm_workers);
+    fprintf(fp, "    \"async_upstream\": %s,\n", config->async_upstream ? "true" : "false");
+    fprintf(fp, "    \"cache_size_mb\": %d,\n", config->cache_size_mb);
+    fprintf(fp, "    \"cache_replay_ms\": %d,\n", config->cache_replay_ms);
+    fprintf(fp, "    \"cache_deterministic_only\": %s,\n", config->cache_deterministic_only ? "true" : "false");
+    fprintf(fp, "    \"disk_cache_path\": \"%s\",\n", config->disk_cache_path);
+    fprintf(fp, "    \"disk_cache_size_mb\": %d,\n", config->disk_cache_size_mb);
+    fprintf(fp, "    \"max_sessions\": %d,\n", config->max_sessions);
+    fprintf(fp, "    \"session_ttl\": %d,\n", config->session_ttl);
+    fprintf(fp, "    \"embed_batch_size\": %d,\n", config->embed_batch_size);
+    fprintf(fp, "    \"embed_batch_wait_us\": %d,\n", config->embed_batch_wait_us);
+    fprintf(fp, "    \"model_concurrency\": %d,\n", config->model_concurrency);
+    fprintf(fp, "    \"model_limits\": \"%s\",\n", config->model_limits);
+    fprintf(fp, "    \"max_generations\": %d,\n", config->max_generations);
+    fprintf(fp, "    \"model_batch\": %d,\n", config->model_batch);
     fprintf(fp, "    \"verbose\": %s,\n", config->verbose ? "true" : "false");
     
     // LLM configuration
+    fprintf(fp, "    \"engine\": \"%s\",\n", config->engine == LLM_ENGINE_SYNTHETIC ? "synthetic" : "ollama");
     fprintf(fp, "    \"llm_type\": \"%s\",\n", 
             config->llm_type == LLM_TYPE_LLAMA ? "llama" : 
             config->llm_type == LLM_TYPE_MISTRAL ? "mistral" : 
@@ -105,6 +168,33 @@ bool config_save(const char *filename, const config_t *config) {
     fprintf(fp, "    \"temperature\": %.2f,\n", config->temperature);
     fprintf(fp, "    \"max_tokens\": %d,\n", config->max_tokens);
     fprintf(fp, "    \"context_size\": %d,\n", config->context_size);
+    fprintf(fp, "    \"seed\": %d,\n", config->seed);
+    fprintf(fp, "    \"ollama_host\": \"%s\",\n", config->ollama_host);
+    fprintf(fp, "    \"ollama_port\": %d,\n", config->ollama_port);
+    fprintf(fp, "    \"ollama_socket\": \"%s\",\n", config->ollama_socket);
+    fprintf(fp, "    \"backends\": [");
+    for (int i = 0; i < config->backend_count; i++) {
+        const llm_backend_config_t *backend = &config->backends[i];
+        fprintf(fp, "%s\n        {\"host\": \"%s\", \"port\": %d, \"socket\": \"%s\", \"max_concurrency\": %d}",
+                i > 0 ? "," : "", backend->host, backend->port, backend->socket, backend->max_concurrency);
+    }
+    fprintf(fp, "%s],\n", config->backend_count > 0 ? "\n    " : "");
+    fprintf(fp, "    \"backend_health_interval\": %d,\n", config->backend_health_interval);
+    fprintf(fp, "    \"backend_sticky_sessions\": %s,\n", config->backend_sticky_sessions ? "true" : "false");
+    fprintf(fp, "    \"connect_timeout_ms\": %d,\n", config->connect_timeout_ms);
+    fprintf(fp, "    \"first_token_timeout_ms\": %d,\n", config->first_token_timeout_ms);
+    fprintf(fp, "    \"stall_timeout_ms\": %d,\n", config->stall_timeout_ms);
+    fprintf(fp, "    \"generation_timeout_ms\": %d,\n", config->generation_timeout_ms);
+    fprintf(fp, "    \"hedge_percentile\": %d,\n", config->hedge_percentile);
+    fprintf(fp, "    \"hedge_budget_percent\": %d,\n", config->hedge_budget_percent);
+    fprintf(fp, "    \"breaker_slow_ms\": %d,\n", config->breaker_slow_ms);
+    fprintf(fp, "    \"keep_alive\": %d,\n", config->keep_alive);
+    fprintf(fp, "    \"warm_up\": %s,\n", config->warm_up ? "true" : "false");
+    fprintf(fp, "    \"keep_warm_interval\": %d,\n", config->keep_warm_interval);
+    fprintf(fp, "    \"model_memory_mb\": %d,\n", config->model_memory_mb);
+    fprintf(fp, "    \"synthetic_tokens_per_second\": %d,\n", config->synthetic_tokens_per_second);
+    fprintf(fp, "    \"synthetic_latency_ms\": %d,\n", config->synthetic_latency_ms);
+    fprintf(fp, "    \"synthetic_jitter\": %.2f,\n", config->synthetic_jitter);
     
     // Client configuration
     fprintf(fp, "    \"dark_mode\": %s,\n", config->dark_mode ? "true" : "false");
@@ -127,15 +217,54 @@ void config_set_defaults(config_t *config) {
     // Server defaults
     strcpy(config->server_host, "127.0.0.1");
     config->server_port = 8080;
+    config->metrics_port = 0;
+    config->trace_sample_percent = 0;
     config->max_connections = 10;
+    config->llm_workers = 2;
+    config->async_upstream = true;
+    config->cache_size_mb = 64;
+    config->cache_replay_ms = 0;
+    config->cache_deterministic_only = false;
+    config->disk_cache_path[0] = '\0';
+    config->disk_cache_size_mb = 256;
+    config->max_sessions = 1024;
+    config->session_ttl = 1800;
+    config->embed_batch_size = 32;
+    config->embed_batch_wait_us = 2000;
+    config->model_concurrency = 0;
+    config->model_limits[0] = '\0';
+    config->max_generations = 0;
+    config->model_batch = 4;
     config->verbose = false;
     
     // LLM defaults
+    config->engine = LLM_ENGINE_OLLAMA;
     config->llm_type = LLM_TYPE_CUSTOM;
     config->model_path[0] = '\0';
     config->temperature = 0.7f;
     config->max_tokens = 512;
     config->context_size = 2048;
+    config->seed = -1;
+    strcpy(config->ollama_host, "localhost");
+    config->ollama_port = 11434;
+    config->ollama_socket[0] = '\0';
+    config->backend_count = 0;
+    config->backend_health_interval = 5;
+    config->backend_sticky_sessions = true;
+    config->connect_timeout_ms = 5000;
+    config->first_token_timeout_ms = 120000;
+    config->stall_timeout_ms = 30000;
+    config->generation_timeout_ms = 0;
+    config->hedge_percentile = 0;
+    config->hedge_budget_percent = 5;
+    config->breaker_slow_ms = 60000;
+    config->keep_alive = 300;
+    config->warm_up = true;
+    config->keep_warm_interval = 60;
+    config->model_memory_mb = 0;
+    config->synthetic_tokens_per_second = 50;
+    config->synthetic_latency_ms = 100;
+    config->synthetic_jitter = 0.25f;
     
     // Client defaults
     config->dark_mode = true;
@@ -150,6 +279,9 @@ bool config_parse_args(int argc, char *argv[], config_t *config) {
         return false;
     }
     
+    // --backend replaces the list from the configuration file
+    bool backends_from_args = false;
+    
     for (int i = 1; i < argc; i++) {
         // Server configuration
         if (strcmp(argv[i], "--host") == 0 && i + 1 < argc) {
@@ -158,15 +290,67 @@ bool config_parse_args(int argc, char *argv[], config_t *config) {
         } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
             config->server_port = atoi(argv[i + 1]);
             i++;
+        } else if (strcmp(argv[i], "--metrics-port") == 0 && i + 1 < argc) {
+            config->metrics_port = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--trace-sample") == 0 && i + 1 < argc) {
+            config->trace_sample_percent = atoi(argv[i + 1]);
+            i++;
         } else if (strcmp(argv[i], "--max-connections") == 0 && i + 1 < argc) {
             config->max_connections = atoi(argv[i + 1]);
             i++;
+        } else if (strcmp(argv[i], "--llm-workers") == 0 && i + 1 < argc) {
+            config->llm_workers = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--no-async-upstream") == 0) {
+            config->async_upstream = false;
+        } else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc) {
+            config->cache_size_mb = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--cache-replay-ms") == 0 && i + 1 < argc) {
+            config->cache_replay_ms = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--cache-deterministic-only") == 0) {
+            config->cache_deterministic_only = true;
+        } else if (strcmp(argv[i], "--disk-cache") == 0 && i + 1 < argc) {
+            strncpy(config->disk_cache_path, argv[i + 1], sizeof(config->disk_cache_path) - 1);
+            i++;
+        } else if (strcmp(argv[i], "--disk-cache-size") == 0 && i + 1 < argc) {
+            config->disk_cache_size_mb = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--max-sessions") == 0 && i + 1 < argc) {
+            config->max_sessions = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--session-ttl") == 0 && i + 1 < argc) {
+            config->session_ttl = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--embed-batch") == 0 && i + 1 < argc) {
+            config->embed_batch_size = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--embed-wait") == 0 && i + 1 < argc) {
+            config->embed_batch_wait_us = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--model-concurrency") == 0 && i + 1 < argc) {
+            config->model_concurrency = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--model-limits") == 0 && i + 1 < argc) {
+            strncpy(config->model_limits, argv[i + 1], sizeof(config->model_limits) - 1);
+            i++;
+        } else if (strcmp(argv[i], "--max-generations") == 0 && i + 1 < argc) {
+            config->max_generations = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--model-batch") == 0 && i + 1 < argc) {
+            config->model_batch = atoi(argv[i + 1]);
+            i++;
         } else if (strcmp(argv[i], "--verbose") == 0) {
             config->verbose = true;
         }
         
         // LLM configuration
-        else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
+        else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            config->engine = strcmp(argv[i + 1], "synthetic") == 0 ? LLM_ENGINE_SYNTHETIC : LLM_ENGINE_OLLAMA;
+            i++;
+        } else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) {
             if (strcmp(argv[i + 1], "llama") == 0) {
                 config->llm_type = LLM_TYPE_LLAMA;
             } else if (strcmp(argv[i + 1], "mistral") == 0) {
@@ -189,6 +373,78 @@ bool config_parse_args(int argc, char *argv[], config_t *config) {
         } else if (strcmp(argv[i], "--context-size") == 0 && i + 1 < argc) {
             config->context_size = atoi(argv[i + 1]);
             i++;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            config->seed = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--ollama-host") == 0 && i + 1 < argc) {
+            strncpy(config->ollama_host, argv[i + 1], sizeof(config->ollama_host) - 1);
+            i++;
+        } else if (strcmp(argv[i], "--ollama-port") == 0 && i + 1 < argc) {
+            config->ollama_port = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--ollama-socket") == 0 && i + 1 < argc) {
+            strncpy(config->ollama_socket, argv[i + 1], sizeof(config->ollama_socket) - 1);
+            i++;
+        } else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            if (!backends_from_args) {
+                config->backend_count = 0;
+                backends_from_args = true;
+            }
+            if (config->backend_count == LLM_MAX_BACKENDS) {
+                fprintf(stderr, "Warning: Ignoring backend %s, at most %d are supported\n",
+                        argv[i + 1], LLM_MAX_BACKENDS);
+            } else if (parse_backend_address(argv[i + 1], &config->backends[config->backend_count])) {
+                config->backend_count++;
+            } else {
+                fprintf(stderr, "Warning: Ignoring invalid backend %s\n", argv[i + 1]);
+            }
+            i++;
+        } else if (strcmp(argv[i], "--health-interval") == 0 && i + 1 < argc) {
+            config->backend_health_interval = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--no-sticky-sessions") == 0) {
+            config->backend_sticky_sessions = false;
+        } else if (strcmp(argv[i], "--connect-timeout") == 0 && i + 1 < argc) {
+            config->connect_timeout_ms = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--first-token-timeout") == 0 && i + 1 < argc) {
+            config->first_token_timeout_ms = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--stall-timeout") == 0 && i + 1 < argc) {
+            config->stall_timeout_ms = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--generation-timeout") == 0 && i + 1 < argc) {
+            config->generation_timeout_ms = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--hedge-percentile") == 0 && i + 1 < argc) {
+            config->hedge_percentile = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--hedge-budget") == 0 && i + 1 < argc) {
+            config->hedge_budget_percent = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--breaker-slow") == 0 && i + 1 < argc) {
+            config->breaker_slow_ms = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--keep-alive") == 0 && i + 1 < argc) {
+            config->keep_alive = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--no-warm-up") == 0) {
+            config->warm_up = false;
+        } else if (strcmp(argv[i], "--keep-warm") == 0 && i + 1 < argc) {
+            config->keep_warm_interval = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--model-memory") == 0 && i + 1 < argc) {
+            config->model_memory_mb = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--synthetic-rate") == 0 && i + 1 < argc) {
+            config->synthetic_tokens_per_second = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--synthetic-latency") == 0 && i + 1 < argc) {
+            config->synthetic_latency_ms = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--synthetic-jitter") == 0 && i + 1 < argc) {
+            config->synthetic_jitter = atof(argv[i + 1]);
+            i++;
         }
         
         // Client configuration
@@ -226,10 +482,54 @@ void config_print(const config_t *config) {
     printf("  Server:\n");
     printf("    Host: %s\n", config->server_host);
     printf("    Port: %d\n", config->server_port);
+    if (config->metrics_port > 0) {
+        printf("    Metrics: http://*:%d/metrics\n", config->metrics_port);
+    } else {
+        printf("    Metrics: Off\n");
+    }
+    if (config->trace_sample_percent > 0) {
+        printf("    Tracing: %d%% of prompts\n", config->trace_sample_percent);
+    } else {
+        printf("    Tracing: Off\n");
+    }
     printf("    Max Connections: %d\n", config->max_connections);
+    printf("    LLM Workers: %d\n", config->llm_workers);
+    printf("    Async Upstream: %s\n", config->async_upstream ? "Yes" : "No");
+    printf("    Response Cache: %d MB%s, replay %d ms/token\n", config->cache_size_mb,
+           config->cache_deterministic_only ? " (deterministic only)" : "", config->cache_replay_ms);
+    if (config->disk_cache_path[0]) {
+        printf("    Disk Cache: %s, %d MB\n", config->disk_cache_path, config->disk_cache_size_mb);
+    }
+    printf("    Sessions: %d, idle timeout %d s\n", config->max_sessions, config->session_ttl);
+    printf("    Embedding Batches: up to %d texts, %d us wait\n",
+           config->embed_batch_size, config->embed_batch_wait_us);
+    printf("    Model Scheduling: %d per model%s%s, %d overall, turns of %d\n",
+           config->model_concurrency, config->model_limits[0] ? ", " : "", config->model_limits,
+           config->max_generations, config->model_batch);
     printf("    Verbose: %s\n", config->verbose ? "Yes" : "No");
     
     printf("  LLM:\n");
+    printf("    Timeouts: connect %d ms, first token %d ms, stall %d ms, generation %d ms\n",
+           config->connect_timeout_ms, config->first_token_timeout_ms,
+           config->stall_timeout_ms, config->generation_timeout_ms);
+    const char *no_hedging = config_hedging_unavailable(config);
+    if (no_hedging != NULL) {
+        printf("    Hedging: Off (%s)\n", no_hedging);
+    } else if (config->hedge_percentile > 0) {
+        printf("    Hedging: after the p%d first-token time, for up to %d%% of generations\n",
+               config->hedge_percentile, config->hedge_budget_percent);
+    } else {
+        printf("    Hedging: Off\n");
+    }
+    if (config->breaker_slow_ms > 0) {
+        printf("    Circuit breaker: also opens on answers slower than %d ms\n", config->breaker_slow_ms);
+    } else {
+        printf("    Circuit breaker: errors only\n");
+    }
+    printf("    Residency: keep alive %d s, warm-up %s, keep-warm every %d s, budget %d MB\n",
+           config->keep_alive, config->warm_up ? "Yes" : "No", config->keep_warm_interval,
+           config->model_memory_mb);
+    printf("    Engine: %s\n", config->engine == LLM_ENGINE_SYNTHETIC ? "synthetic" : "ollama");
     printf("    Type: %s\n", 
            config->llm_type == LLM_TYPE_LLAMA ? "LLaMA" : 
            config->llm_type == LLM_TYPE_MISTRAL ? "Mistral" : 
@@ -238,6 +538,31 @@ void config_print(const config_t *config) {
     printf("    Temperature: %.2f\n", config->temperature);
     printf("    Max Tokens: %d\n", config->max_tokens);
     printf("    Context Size: %d\n", config->context_size);
+    printf("    Seed: %d\n", config->seed);
+    if (config->engine == LLM_ENGINE_SYNTHETIC) {
+        printf("    Synthetic: %d tokens/s, first token after %d ms, jitter %.2f\n",
+               config->synthetic_tokens_per_second, config->synthetic_latency_ms, config->synthetic_jitter);
+    } else if (config->backend_count > 0) {
+        for (int i = 0; i < config->backend_count; i++) {
+            const llm_backend_config_t *backend = &config->backends[i];
+            if (backend->socket[0]) {
+                printf("    Ollama: unix:%s", backend->socket);
+            } else {
+                printf("    Ollama: %s:%d", backend->host, backend->port);
+            }
+            if (backend->max_concurrency > 0) {
+                printf(", max %d at once", backend->max_concurrency);
+            }
+            printf("\n");
+        }
+        printf("    Health Checks: %s, sticky sessions %s\n",
+               config->backend_health_interval > 0 ? "active" : "passive only",
+               config->backend_sticky_sessions ? "on" : "off");
+    } else if (config->ollama_socket[0]) {
+        printf("    Ollama: unix:%s\n", config->ollama_socket);
+    } else {
+        printf("    Ollama: %s:%d\n", config->ollama_host, config->ollama_port);
+    }
     
     printf("  Client:\n");
     printf("    Theme: %s\n", config->dark_mode ? "Dark" : "Light");
@@ -245,6 +570,25 @@ void config_print(const config_t *config) {
     printf("    Window Size: %dx%d\n", config->window_width, config->window_height);
 }
 
+const char* config_hedging_unavailable(const config_t *config) {
+    if (config->hedge_percentile <= 0) {
+        return NULL;
+    }
+    
+    // Hedges are run by the event-loop upstream path of the Ollama
+    // engine, and go to a backend other than the slow one
+    if (config->engine == LLM_ENGINE_SYNTHETIC) {
+        return "the synthetic engine does not hedge";
+    }
+    if (!config->async_upstream) {
+        return "not with --no-async-upstream";
+    }
+    if (config->backend_count < 2) {
+        return "needs a second backend";
+    }
+    return NULL;
+}
+
 const char* config_get_default_path(void) {
     static char config_path[512] = {0};
     
@@ -459,3 +803,84 @@ static bool parse_json_bool(const char *json, const char *key, bool *value) {
     
     return false;
 }
+
+// "backends": [{"host": ..., "port": ..., "socket": ..., "max_concurrency": ...}, ...]
+static int parse_json_backends(const char *json, llm_backend_config_t *backends, int max_backends) {
+    const char *key_pos = strstr(json, "\"backends\"");
+    if (key_pos == NULL) {
+        return 0;
+    }
+    
+    const char *pos = strchr(key_pos, '[');
+    const char *array_end = pos ? strchr(pos, ']') : NULL;
+    if (array_end == NULL) {
+        return 0;
+    }
+    
+    int count = 0;
+    while (count < max_backends) {
+        const char *object_start = strchr(pos, '{');
+        if (object_start == NULL || object_start > array_end) {
+            break;
+        }
+        const char *object_end = strchr(object_start, '}');
+        if (object_end == NULL || object_end > array_end) {
+            break;
+        }
+        
+        // Parse each object on its own, so keys cannot match in a neighbour
+        char object[1024];
+        size_t object_length = object_end - object_start + 1;
+        if (object_length >= sizeof(object)) {
+            object_length = sizeof(object) - 1;
+        }
+        memcpy(object, object_start, object_length);
+        object[object_length] = '\0';
+        
+        llm_backend_config_t *backend = &backends[count];
+        memset(backend, 0, sizeof(*backend));
+        strcpy(backend->host, "localhost");
+        backend->port = 11434;
+        parse_json_value(object, "host", backend->host, sizeof(backend->host));
+        parse_json_int(object, "port", &backend->port);
+        parse_json_value(object, "socket", backend->socket, sizeof(backend->socket));
+        parse_json_int(object, "max_concurrency", &backend->max_concurrency);
+        count++;
+        
+        pos = object_end + 1;
+    }
+    
+    return count;
+}
+
+// HOST:PORT or a unix socket /PATH, optionally followed by @MAX_CONCURRENCY
+static bool parse_backend_address(const char *address, llm_backend_config_t *backend) {
+    char buffer[384];
+    strncpy(buffer, address, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+    
+    memset(backend, 0, sizeof(*backend));
+    backend->port = 11434;
+    
+    char *limit = strrchr(buffer, '@');
+    if (limit != NULL) {
+        *limit++ = '\0';
+        backend->max_concurrency = atoi(limit);
+    }
+    
+    if (buffer[0] == '/') {
+        strncpy(backend->socket, buffer, sizeof(backend->socket) - 1);
+        return true;
+    }
+    
+    char *port = strrchr(buffer, ':');
+    if (port != NULL) {
+        *port++ = '\0';
+        backend->port = atoi(port);
+    }
+    if (buffer[0] == '\0' || backend->port <= 0) {
+        return false;
+    }
+    strncpy(backend->host, buffer, sizeof(backend->host) - 1);
+    return true;
+}
@@ -9,15 +9,55 @@ typedef struct {
     // Server configuration
     char server_host[256];
     int server_port;
+    int metrics_port;
+    int trace_sample_percent;
     int max_connections;
+    int llm_workers;
+    bool async_upstream;
+    int cache_size_mb;
+    int cache_replay_ms;
+    bool cache_deterministic_only;
+    char disk_cache_path[256];
+    int disk_cache_size_mb;
+    int max_sessions;
+    int session_ttl;
+    int embed_batch_size;
+    int embed_batch_wait_us;
+    int model_concurrency;
+    char model_limits[256];
+    int max_generations;
+    int model_batch;
     bool verbose;
     
     // LLM configuration
+    llm_engine_t engine;
     llm_type_t llm_type;
     char model_path[256];
     float temperature;
     int max_tokens;
     int context_size;
+    int seed;
+    char ollama_host[256];
+    int ollama_port;
+    char ollama_socket[108];
+    llm_backend_config_t backends[LLM_MAX_BACKENDS];
+    int backend_count;
+    int backend_health_interval;
+    bool backend_sticky_sessions;
+    int connect_timeout_ms;
+    int first_token_timeout_ms;
+    int stall_timeout_ms;
+    int generation_timeout_ms;
+    int hedge_percentile;
+    int hedge_budget_percent;
+    int breaker_slow_ms;
+    int keep_alive;
+    bool warm_up;
+    int keep_warm_interval;
+    int model_memory_mb;
+    int synthetic_tokens_per_second;
+    int synthetic_latency_ms;
+    float synthetic_jitter;
     
     // Client configuration
     bool dark_mode;
@@ -37,4 +77,8 @@ void config_print(const config_t *config);
 // Helper functions
 const char* config_get_default_path(void);
 
+// Why the configured hedging cannot take effect, or NULL if it can (or
+// is off anyway)
+const char* config_hedging_unavailable(const config_t *config);
+
 #endif /* CONFIG_H */
@@ -0,0 +1,157 @@
+#include "protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <arpa/inet.h>
+
+#define MESSAGE_BUFFER_MIN_CAPACITY 8192
+
+void message_encode_header(uint8_t *header, uint8_t type, uint8_t flags,
+                           uint32_t request_id, uint32_t length) {
+    uint32_t id_be = htonl(request_id);
+    uint32_t length_be = htonl(length);
+
+    header[0] = type;
+    header[1] = flags;
+    header[2] = 0;
+    header[3] = 0;
+    memcpy(header + 4, &id_be, sizeof(id_be));
+    memcpy(header + 8, &length_be, sizeof(length_be));
+}
+
+// The fields of generation_stats_t in wire order
+static int64_t* stats_field(generation_stats_t *stats, int index) {
+    int64_t *fields[GENERATION_STATS_FIELDS] = {
+        &stats->prompt_eval_count, &stats->prompt_eval_duration,
+        &stats->eval_count, &stats->eval_duration,
+        &stats->load_duration, &stats->total_duration,
+        &stats->queue_ms, &stats->connect_ms,
+        &stats->first_byte_ms, &stats->last_byte_ms
+    };
+    return fields[index];
+}
+
+void generation_stats_encode(uint8_t *payload, const generation_stats_t *stats) {
+    generation_stats_t copy = *stats;
+    for (int i = 0; i < GENERATION_STATS_FIELDS; i++) {
+        uint64_t value = htobe64((uint64_t)*stats_field(&copy, i));
+        memcpy(payload + i * sizeof(value), &value, sizeof(value));
+    }
+}
+
+void generation_stats_decode(const char *payload, size_t length, generation_stats_t *stats) {
+    *stats = (generation_stats_t)GENERATION_STATS_UNKNOWN;
+    for (int i = 0; i < GENERATION_STATS_FIELDS && (size_t)(i + 1) * 8 <= length; i++) {
+        uint64_t value;
+        memcpy(&value, payload + i * sizeof(value), sizeof(value));
+        *stats_field(stats, i) = (int64_t)be64toh(value);
+    }
+}
+
+const char* message_type_to_string(uint8_t type) {
+    switch (type) {
+        case MSG_PROMPT:
+            return "PROMPT";
+        case MSG_TOKEN:
+            return "TOKEN";
+        case MSG_DONE:
+            return "DONE";
+        case MSG_ERROR:
+            return "ERROR";
+        case MSG_STATS:
+            return "STATS";
+        case MSG_INFO:
+            return "INFO";
+        case MSG_SESSION:
+            return "SESSION";
+        case MSG_EMBED:
+            return "EMBED";
+        case MSG_EMBEDDING:
+            return "EMBEDDING";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+void message_buffer_init(message_buffer_t *buffer) {
+    memset(buffer, 0, sizeof(message_buffer_t));
+}
+
+void message_buffer_free(message_buffer_t *buffer) {
+    free(buffer->data);
+    memset(buffer, 0, sizeof(message_buffer_t));
+}
+
+char* message_buffer_reserve(message_buffer_t *buffer, size_t min_space) {
+    // Slide unparsed bytes to the front once everything before them is consumed
+    if (buffer->offset > 0) {
+        size_t pending = buffer->length - buffer->offset;
+        if (pending > 0) {
+            memmove(buffer->data, buffer->data + buffer->offset, pending);
+        }
+        buffer->length = pending;
+        buffer->offset = 0;
+    }
+
+    if (buffer->capacity - buffer->length < min_space) {
+        size_t new_capacity = buffer->capacity ? buffer->capacity : MESSAGE_BUFFER_MIN_CAPACITY;
+        while (new_capacity - buffer->length < min_space) {
+            new_capacity *= 2;
+        }
+
+        char *new_data = realloc(buffer->data, new_capacity);
+        if (new_data == NULL) {
+            fprintf(stderr, "Error: Failed to grow message buffer\n");
+            return NULL;
+        }
+        buffer->data = new_data;
+        buffer->capacity = new_capacity;
+    }
+
+    return buffer->data + buffer->length;
+}
+
+void message_buffer_commit(message_buffer_t *buffer, size_t length) {
+    buffer->length += length;
+}
+
+int message_buffer_next(message_buffer_t *buffer, message_t *message) {
+    size_t available = buffer->length - buffer->offset;
+    if (available < MESSAGE_HEADER_SIZE) {
+        return 0;
+    }
+
+    const uint8_t *header = (const uint8_t *)buffer->data + buffer->offset;
+    uint32_t id_be, length_be;
+    memcpy(&id_be, header + 4, sizeof(id_be));
+    memcpy(&length_be, header + 8, sizeof(length_be));
+    uint32_t length = ntohl(length_be);
+
+    if (header[2] != 0 || header[3] != 0 || length > MESSAGE_MAX_PAYLOAD) {
+        return -1;
+    }
+
+    if (available - MESSAGE_HEADER_SIZE < length) {
+        // Grow once to fit the whole message so the next reads land in place
+        if (buffer->capacity - buffer->offset < MESSAGE_HEADER_SIZE + (size_t)length) {
+            if (message_buffer_reserve(buffer, MESSAGE_HEADER_SIZE + length - available) == NULL) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    message->type = header[0];
+    message->flags = header[1];
+    message->request_id = ntohl(id_be);
+    message->length = length;
+    message->payload = (const char *)header + MESSAGE_HEADER_SIZE;
+
+    buffer->offset += MESSAGE_HEADER_SIZE + length;
+    if (buffer->offset == buffer->length) {
+        buffer->offset = 0;
+        buffer->length = 0;
+    }
+    return 1;
+}
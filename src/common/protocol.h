@@ -0,0 +1,113 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Wire format
+//
+// Every message is a fixed 12-byte header followed by `length` bytes of
+// payload. All header fields are in network byte order:
+//
+//   uint8  type        message_type_t
+//   uint8  flags       MESSAGE_FLAG_*
+//   uint16 reserved    must be zero
+//   uint32 request_id  chosen by the client, echoed on every reply
+//   uint32 length      payload size in bytes
+#define MESSAGE_HEADER_SIZE 12
+
+// Largest payload either side accepts; ample for a prompt, and small
+// enough that every connection's read buffer stays bounded
+#define MESSAGE_MAX_PAYLOAD (1024u * 1024u)
+
+typedef enum {
+    MSG_PROMPT = 1,   // client -> server: prompt text
+    MSG_TOKEN  = 2,   // server -> client: piece of generated text
+    MSG_DONE   = 3,   // server -> client: generation finished
+    MSG_ERROR  = 4,   // server -> client: request failed, payload is the reason
+    MSG_STATS  = 5,   // server -> client: generation statistics
+    MSG_INFO   = 6,   // server -> client: informational notice (e.g. welcome)
+    MSG_SESSION = 7,  // client -> server: start a session (empty) or resume one (id);
+                      // server -> client: id of the connection's session
+    MSG_EMBED  = 8,   // client -> server: text to embed
+    MSG_EMBEDDING = 9 // server -> client: the text's vector, little-endian float32s
+} message_type_t;
+
+// Header flags
+#define MESSAGE_FLAG_NO_CACHE 0x01    // PROMPT: always generate, bypassing the response cache
+#define MESSAGE_FLAG_SESSION  0x02    // PROMPT: continue the connection's session
+#define MESSAGE_FLAG_DEADLINE 0x04    // PROMPT: payload starts with a uint32 budget in
+                                      // milliseconds (network byte order), then the text
+#define MESSAGE_FLAG_MODEL    0x08    // PROMPT, EMBED: then a uint8 length and that many
+                                      // bytes of model name, then the text
+#define MESSAGE_FLAG_UNAVAILABLE 0x10 // ERROR: no backend can take the request now;
+                                      // the same request may succeed later
+
+// Where the time of one generation went, carried by MSG_STATS. Durations
+// reported by the engine are in nanoseconds, under Ollama's names; the
+// server's own timings are in milliseconds. -1 for anything not known.
+typedef struct {
+    int64_t prompt_eval_count;      // prompt tokens evaluated (prefill)
+    int64_t prompt_eval_duration;
+    int64_t eval_count;             // tokens generated (decode)
+    int64_t eval_duration;
+    int64_t load_duration;          // loading the model
+    int64_t total_duration;
+    int64_t queue_ms;               // from arrival until the generation started
+    int64_t connect_ms;             // opening the upstream connection, 0 if reused
+    int64_t first_byte_ms;          // from sending the request upstream to the first byte back
+    int64_t last_byte_ms;           // ... and to the last
+} generation_stats_t;
+
+// The STATS payload is the fields above in order, each a big-endian
+// int64. Later versions may append fields; readers skip what they do
+// not know and leave what is missing at -1.
+#define GENERATION_STATS_FIELDS 10
+#define GENERATION_STATS_SIZE (GENERATION_STATS_FIELDS * 8)
+
+// Initializer with nothing known
+#define GENERATION_STATS_UNKNOWN { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 }
+
+// Decoded message; payload points into the owning message_buffer_t and
+// stays valid until the next call on that buffer
+typedef struct {
+    uint8_t type;
+    uint8_t flags;
+    uint32_t request_id;
+    uint32_t length;
+    const char *payload;
+} message_t;
+
+// Incremental reassembly buffer: raw bytes go in at the tail, complete
+// messages are parsed from the head without copying
+typedef struct {
+    char *data;
+    size_t offset;      // start of unparsed bytes
+    size_t length;      // end of received bytes
+    size_t capacity;
+} message_buffer_t;
+
+// Header encoding
+void message_encode_header(uint8_t *header, uint8_t type, uint8_t flags,
+                           uint32_t request_id, uint32_t length);
+const char* message_type_to_string(uint8_t type);
+
+// Generation statistics
+void generation_stats_encode(uint8_t *payload, const generation_stats_t *stats);
+void generation_stats_decode(const char *payload, size_t length, generation_stats_t *stats);
+
+// Reassembly buffer
+void message_buffer_init(message_buffer_t *buffer);
+void message_buffer_free(message_buffer_t *buffer);
+
+// Make room for at least `min_space` more bytes and return the write
+// position; call message_buffer_commit() with the number of bytes written
+char* message_buffer_reserve(message_buffer_t *buffer, size_t min_space);
+void message_buffer_commit(message_buffer_t *buffer, size_t length);
+
+// Returns 1 and fills `message` if a complete message is buffered,
+// 0 if more data is needed, -1 on a malformed header
+int message_buffer_next(message_buffer_t *buffer, message_t *message);
+
+#endif /* PROTOCOL_H */
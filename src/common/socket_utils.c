@@ -1,5 +1,7 @@
 #include "socket_utils.h"
 #include <fcntl.h>
+#include <sys/uio.h>
+#include <netinet/tcp.h>
 
 int create_server_socket(int port) {
     int server_fd;
@@ -32,7 +34,7 @@ int create_server_socket(int port) {
     }
     
     // Start listening for connections
-    if (listen(server_fd, 3) < 0) {
+    if (listen(server_fd, SOMAXCONN) < 0) {
         handle_socket_error("Listen failed");
         close(server_fd);
         return -1;
@@ -48,7 +50,10 @@ int accept_client_connection(int server_socket) {
     int client_socket;
     
     if ((client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &addrlen)) < 0) {
-        handle_socket_error("Accept failed");
+        // A non-blocking listener simply has no more pending connections
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            handle_socket_error("Accept failed");
+        }
         return -1;
     }
     
@@ -90,20 +95,31 @@ int connect_to_server(const char *server_address, int port) {
     return sock;
 }
 
-int send_message(int socket, const char *message) {
-    size_t message_len = strlen(message);
-    size_t total_sent = 0;
-    ssize_t bytes_sent;
+int send_message(int socket, uint8_t type, uint8_t flags, uint32_t request_id,
+                 const void *payload, size_t length) {
+    if (length > MESSAGE_MAX_PAYLOAD) {
+        fprintf(stderr, "Message too large: %zu bytes\n", length);
+        return -1;
+    }
+    
+    uint8_t header[MESSAGE_HEADER_SIZE];
+    message_encode_header(header, type, flags, request_id, (uint32_t)length);
     
-    // Add debugging
-    // printf("Attempting to send %zu bytes: '%.50s%s'\n", message_len, message, 
-    //        message_len > 50 ? "..." : "");
+    // Header and payload go out in a single writev so small messages are one segment
+    struct iovec iov[2] = {
+        { .iov_base = header, .iov_len = sizeof(header) },
+        { .iov_base = (void *)payload, .iov_len = length }
+    };
+    int iov_index = 0;
+    int iov_count = length > 0 ? 2 : 1;
+    size_t total_sent = 0;
     
     // Ensure the entire message is sent
-    while (total_sent < message_len) {
-        bytes_sent = send(socket, message + total_sent, message_len - total_sent, 0);
+    while (iov_index < iov_count) {
+        struct msghdr msg = { .msg_iov = iov + iov_index, .msg_iovlen = iov_count - iov_index };
+        ssize_t bytes_sent = sendmsg(socket, &msg, MSG_NOSIGNAL);
         
-        if (bytes_sent <= 0) {
+        if (bytes_sent < 0) {
             if (errno == EINTR) {
                 // Interrupted by signal, try again
                 continue;
@@ -113,64 +129,67 @@ int send_message(int socket, const char *message) {
         }
         
         total_sent += bytes_sent;
+        while (iov_index < iov_count && (size_t)bytes_sent >= iov[iov_index].iov_len) {
+            bytes_sent -= iov[iov_index].iov_len;
+            iov_index++;
+        }
+        if (iov_index < iov_count) {
+            iov[iov_index].iov_base = (char *)iov[iov_index].iov_base + bytes_sent;
+            iov[iov_index].iov_len -= bytes_sent;
+        }
     }
     
-    // Add a brief delay after sending to prevent packet loss
-    usleep(1000);  // 1ms delay
-    
     return (int)total_sent;
 }
 
-int receive_message(int socket, char *buffer, size_t buffer_size) {
-    memset(buffer, 0, buffer_size);
-    
-    // Set socket to non-blocking mode temporarily
-    int flags = fcntl(socket, F_GETFL, 0);
-    fcntl(socket, F_SETFL, flags | O_NONBLOCK);
-    
-    // Use select to wait for data with timeout
-    fd_set read_fds;
-    struct timeval tv;
-    FD_ZERO(&read_fds);
-    FD_SET(socket, &read_fds);
-    tv.tv_sec = 1;  // 1 second timeout
-    tv.tv_usec = 0;
-    
-    int select_result = select(socket + 1, &read_fds, NULL, NULL, &tv);
-    
-    if (select_result < 0) {
-        // Error in select
-        handle_socket_error("Select failed");
-        fcntl(socket, F_SETFL, flags);  // Restore original flags
-        return -1;
-    } else if (select_result == 0) {
-        // Timeout, no data available
-        fcntl(socket, F_SETFL, flags);  // Restore original flags
-        return 0;
-    }
-    
-    // Data is available, receive it
-    ssize_t bytes_received = recv(socket, buffer, buffer_size - 1, 0);
-    
-    // Restore original socket flags
-    fcntl(socket, F_SETFL, flags);
-    
-    if (bytes_received < 0) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            // No data available even though select indicated there was
+int receive_message(int socket, message_buffer_t *buffer, message_t *message) {
+    while (true) {
+        // Serve messages that arrived together with an earlier read first
+        int result = message_buffer_next(buffer, message);
+        if (result < 0) {
+            fprintf(stderr, "Received malformed message\n");
+            return -1;
+        } else if (result > 0) {
+            return 1;
+        }
+        
+        char *space = message_buffer_reserve(buffer, BUFFER_SIZE);
+        if (space == NULL) {
+            return -1;
+        }
+        
+        ssize_t bytes_received = recv(socket, space, buffer->capacity - buffer->length, 0);
+        if (bytes_received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            handle_socket_error("Receive failed");
+            return -1;
+        } else if (bytes_received == 0) {
             return 0;
         }
-        handle_socket_error("Receive failed");
-        return -1;
-    } else if (bytes_received == 0) {
-        printf("Connection closed by peer\n");
-        return 0;
+        
+        message_buffer_commit(buffer, bytes_received);
     }
-    
-    buffer[bytes_received] = '\0';
-    // printf("Received %zd bytes: '%.50s%s'\n", bytes_received, buffer, 
-    //        bytes_received > 50 ? "..." : "");
-    return (int)bytes_received;
+}
+
+bool set_socket_nonblocking(int socket) {
+    int flags = fcntl(socket, F_GETFL, 0);
+    if (flags < 0 || fcntl(socket, F_SETFL, flags | O_NONBLOCK) < 0) {
+        handle_socket_error("Failed to set non-blocking mode");
+        return false;
+    }
+    return true;
+}
+
+bool set_socket_nodelay(int socket) {
+    // Small token messages should go out immediately, not wait for Nagle
+    int opt = 1;
+    if (setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt)) < 0) {
+        handle_socket_error("Failed to set TCP_NODELAY");
+        return false;
+    }
+    return true;
 }
 
 void handle_socket_error(const char *message) {
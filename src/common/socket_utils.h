@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -11,6 +12,7 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <errno.h>
+#include "protocol.h"
 
 #define DEFAULT_PORT 8080
 #define DEFAULT_SERVER "127.0.0.1"
@@ -20,10 +22,16 @@
 int create_server_socket(int port);
 int accept_client_connection(int server_socket);
 int connect_to_server(const char *server_address, int port);
+bool set_socket_nonblocking(int socket);
+bool set_socket_nodelay(int socket);
 
-// Data transmission utilities
-int send_message(int socket, const char *message);
-int receive_message(int socket, char *buffer, size_t buffer_size);
+// Data transmission utilities (framed, see protocol.h)
+int send_message(int socket, uint8_t type, uint8_t flags, uint32_t request_id,
+                 const void *payload, size_t length);
+
+// Blocks until one complete message is available. Returns 1 on success,
+// 0 if the peer closed the connection and -1 on error.
+int receive_message(int socket, message_buffer_t *buffer, message_t *message);
 
 // Error handling
 void handle_socket_error(const char *message);
@@ -0,0 +1,260 @@
+#include "admin_server.h"
+#include "llm_interface.h"
+#include "../common/socket_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+// An admin connection that has not been answered by then is dropped
+#define ADMIN_TIMEOUT_MS 5000
+
+typedef struct admin_client {
+    struct admin_client *prev;
+    struct admin_client *next;
+    admin_server_t *admin;
+    int fd;
+    event_timer_t *timer;
+
+    char request[ADMIN_MAX_REQUEST];
+    size_t request_length;
+
+    // Set once the request is complete
+    bool answered;
+    arena_t response;
+    size_t sent;
+} admin_client_t;
+
+struct admin_server {
+    event_loop_t *loop;
+    int socket;
+    admin_handler_t handler;
+    bool verbose;
+    admin_client_t *clients;
+    arena_t body;                   // reused for every response
+};
+
+static const char* status_text(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 431: return "Request Header Fields Too Large";
+        default:  return "Internal Server Error";
+    }
+}
+
+static void close_client(admin_client_t *client) {
+    admin_server_t *admin = client->admin;
+
+    if (client->timer != NULL) {
+        event_loop_cancel_timer(admin->loop, client->timer);
+    }
+    event_loop_remove(admin->loop, client->fd);
+    close(client->fd);
+
+    if (client->prev) {
+        client->prev->next = client->next;
+    } else {
+        admin->clients = client->next;
+    }
+    if (client->next) {
+        client->next->prev = client->prev;
+    }
+    arena_free(&client->response);
+    free(client);
+}
+
+static void on_timeout(event_loop_t *loop, void *user_data) {
+    (void)loop;
+    admin_client_t *client = user_data;
+    client->timer = NULL;
+    close_client(client);
+}
+
+// Queue the whole response; the connection closes once it is written
+static void respond(admin_client_t *client, int status, const char *content_type, const char *body, size_t length) {
+    arena_reset(&client->response);
+    if (!arena_printf(&client->response,
+                      "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                      status, status_text(status), content_type, length) ||
+        !arena_append(&client->response, body, length)) {
+        arena_reset(&client->response);
+    }
+    client->answered = true;
+}
+
+static void respond_text(admin_client_t *client, int status) {
+    char body[64];
+    int length = snprintf(body, sizeof(body), "%s\n", status_text(status));
+    respond(client, status, "text/plain; charset=utf-8", body, length);
+}
+
+// Parse the request line and have the handler answer it
+static void answer(admin_client_t *client) {
+    admin_server_t *admin = client->admin;
+    char *line_end = strstr(client->request, "\r\n");
+    char *path = strchr(client->request, ' ');
+    if (line_end == NULL || path == NULL || path > line_end) {
+        respond_text(client, 400);
+        return;
+    }
+    *line_end = '\0';
+    *path++ = '\0';
+    path[strcspn(path, " ?")] = '\0';
+
+    if (strcmp(client->request, "GET") != 0) {
+        respond_text(client, 405);
+        return;
+    }
+
+    const char *content_type = "text/plain; charset=utf-8";
+    arena_reset(&admin->body);
+    int status = admin->handler(path, &admin->body, &content_type);
+    if (admin->verbose) {
+        printf("Admin request for %s: %d\n", path, status);
+    }
+    if (status != 200) {
+        respond_text(client, status);
+        return;
+    }
+    respond(client, status, content_type, admin->body.data ? admin->body.data : "", admin->body.length);
+}
+
+// Read what has arrived; false once the connection should be closed
+static bool read_request(admin_client_t *client) {
+    while (true) {
+        size_t space = sizeof(client->request) - 1 - client->request_length;
+        if (space == 0) {
+            respond_text(client, 431);
+            return true;
+        }
+
+        ssize_t received = recv(client->fd, client->request + client->request_length, space, 0);
+        if (received > 0) {
+            client->request_length += received;
+            client->request[client->request_length] = '\0';
+            if (strstr(client->request, "\r\n\r\n") != NULL) {
+                answer(client);
+                return true;
+            }
+            continue;
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        return received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+}
+
+// Write what the socket takes; false when done or failed
+static bool write_response(admin_client_t *client) {
+    while (client->sent < client->response.length) {
+        ssize_t written = send(client->fd, client->response.data + client->sent,
+                               client->response.length - client->sent, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        client->sent += written;
+    }
+    return false;
+}
+
+static void on_client(event_loop_t *loop, int fd, uint32_t events, void *user_data) {
+    (void)loop;
+    (void)fd;
+    admin_client_t *client = user_data;
+
+    if ((events & EVENT_ERROR) || (!client->answered && !read_request(client))) {
+        close_client(client);
+        return;
+    }
+    if (client->answered && !write_response(client)) {
+        close_client(client);
+    }
+}
+
+static void on_accept(event_loop_t *loop, int fd, uint32_t events, void *user_data) {
+    (void)events;
+    admin_server_t *admin = user_data;
+
+    // Edge-triggered: keep accepting until the backlog is empty
+    while (true) {
+        int client_fd = accept(fd, NULL, NULL);
+        if (client_fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        admin_client_t *client = set_socket_nonblocking(client_fd) ? calloc(1, sizeof(admin_client_t)) : NULL;
+        if (client == NULL) {
+            close(client_fd);
+            continue;
+        }
+        client->admin = admin;
+        client->fd = client_fd;
+        arena_init(&client->response);
+
+        if (!event_loop_add(loop, client_fd, EVENT_READ | EVENT_WRITE, on_client, client)) {
+            close(client_fd);
+            free(client);
+            continue;
+        }
+        client->timer = event_loop_add_timer(loop, llm_monotonic_ms() + ADMIN_TIMEOUT_MS, on_timeout, client);
+
+        client->next = admin->clients;
+        if (admin->clients) {
+            admin->clients->prev = client;
+        }
+        admin->clients = client;
+    }
+}
+
+admin_server_t* admin_server_create(event_loop_t *loop, int port, admin_handler_t handler, bool verbose) {
+    admin_server_t *admin = calloc(1, sizeof(admin_server_t));
+    if (admin == NULL) {
+        fprintf(stderr, "Error: Failed to allocate admin listener\n");
+        return NULL;
+    }
+
+    admin->loop = loop;
+    admin->handler = handler;
+    admin->verbose = verbose;
+    arena_init(&admin->body);
+
+    admin->socket = create_server_socket(port);
+    if (admin->socket < 0 || !set_socket_nonblocking(admin->socket) ||
+        !event_loop_add(loop, admin->socket, EVENT_READ, on_accept, admin)) {
+        fprintf(stderr, "Error: Failed to start admin listener on port %d\n", port);
+        if (admin->socket >= 0) {
+            close(admin->socket);
+        }
+        free(admin);
+        return NULL;
+    }
+
+    printf("Admin listener on port %d\n", port);
+    return admin;
+}
+
+void admin_server_destroy(admin_server_t *admin) {
+    if (admin == NULL) {
+        return;
+    }
+
+    while (admin->clients != NULL) {
+        close_client(admin->clients);
+    }
+    event_loop_remove(admin->loop, admin->socket);
+    close(admin->socket);
+    arena_free(&admin->body);
+    free(admin);
+}
@@ -0,0 +1,25 @@
+#ifndef ADMIN_SERVER_H
+#define ADMIN_SERVER_H
+
+#include <stdbool.h>
+#include "arena.h"
+#include "event_loop.h"
+
+// Longest admin request head read before the connection is dropped
+#define ADMIN_MAX_REQUEST 4096
+
+// Fills in the body for a GET of `path` (query string removed) and sets
+// its content type. Returns the HTTP status: 200, or 404 for an unknown
+// path. Runs on the loop thread.
+typedef int (*admin_handler_t)(const char *path, arena_t *body, const char **content_type);
+
+// Admin HTTP listener on the event loop
+//
+// Answers one GET per connection, then closes it. Meant for scrapers
+// and operators, not for load: requests are small and handled inline.
+typedef struct admin_server admin_server_t;
+
+admin_server_t* admin_server_create(event_loop_t *loop, int port, admin_handler_t handler, bool verbose);
+void admin_server_destroy(admin_server_t *admin);
+
+#endif /* ADMIN_SERVER_H */
@@ -0,0 +1,118 @@
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+// Capacity of an arena's first block
+#define ARENA_MIN_CAPACITY 4096
+
+void arena_init(arena_t *arena) {
+    arena->data = NULL;
+    arena->length = 0;
+    arena->capacity = 0;
+}
+
+void arena_free(arena_t *arena) {
+    free(arena->data);
+    arena_init(arena);
+}
+
+void arena_reset(arena_t *arena) {
+    arena->length = 0;
+}
+
+bool arena_reserve(arena_t *arena, size_t extra) {
+    if (arena->capacity - arena->length > extra) {
+        return true;
+    }
+
+    // One spare byte keeps room for the NUL that vsnprintf() writes
+    size_t capacity = arena->capacity > 0 ? arena->capacity : ARENA_MIN_CAPACITY;
+    while (capacity - arena->length <= extra) {
+        capacity *= 2;
+    }
+    char *grown = realloc(arena->data, capacity);
+    if (grown == NULL) {
+        return false;
+    }
+    arena->data = grown;
+    arena->capacity = capacity;
+    return true;
+}
+
+bool arena_append(arena_t *arena, const char *data, size_t length) {
+    if (!arena_reserve(arena, length)) {
+        return false;
+    }
+    memcpy(arena->data + arena->length, data, length);
+    arena->length += length;
+    return true;
+}
+
+bool arena_append_string(arena_t *arena, const char *text) {
+    return arena_append(arena, text, strlen(text));
+}
+
+bool arena_printf(arena_t *arena, const char *format, ...) {
+    va_list args;
+
+    // Most calls fit in the space already there
+    va_start(args, format);
+    int needed = arena->data
+        ? vsnprintf(arena->data + arena->length, arena->capacity - arena->length, format, args)
+        : vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (needed < 0) {
+        return false;
+    }
+    if (arena->data == NULL || (size_t)needed >= arena->capacity - arena->length) {
+        if (!arena_reserve(arena, needed)) {
+            return false;
+        }
+        va_start(args, format);
+        vsnprintf(arena->data + arena->length, arena->capacity - arena->length, format, args);
+        va_end(args);
+    }
+    arena->length += needed;
+    return true;
+}
+
+bool arena_append_json_string(arena_t *arena, const char *text) {
+    // Room for the common case, where nothing needs escaping
+    size_t length = strlen(text);
+    if (!arena_reserve(arena, length + 2) || !arena_append(arena, "\"", 1)) {
+        return false;
+    }
+
+    // Copy runs of plain bytes at once, escaping the bytes between them
+    const char *run = text;
+    for (const char *p = text; ; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        if (!arena_append(arena, run, p - run)) {
+            return false;
+        }
+        if (c == '\0') {
+            break;
+        }
+
+        char escape[8];
+        int escape_length;
+        switch (c) {
+            case '"':  escape_length = snprintf(escape, sizeof(escape), "\\\""); break;
+            case '\\': escape_length = snprintf(escape, sizeof(escape), "\\\\"); break;
+            case '\n': escape_length = snprintf(escape, sizeof(escape), "\\n"); break;
+            case '\r': escape_length = snprintf(escape, sizeof(escape), "\\r"); break;
+            case '\t': escape_length = snprintf(escape, sizeof(escape), "\\t"); break;
+            default:   escape_length = snprintf(escape, sizeof(escape), "\\u%04x", c); break;
+        }
+        if (!arena_append(arena, escape, escape_length)) {
+            return false;
+        }
+        run = p + 1;
+    }
+    return arena_append(arena, "\"", 1);
+}
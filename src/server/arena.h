@@ -0,0 +1,36 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Scratch space for building one upstream request
+//
+// Everything appended lands in one contiguous block that grows by
+// doubling. Resetting keeps the block, so an arena that is reused from
+// request to request stops allocating once it has seen the largest one.
+// Append calls return false when out of memory, leaving what was there.
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} arena_t;
+
+void arena_init(arena_t *arena);
+void arena_free(arena_t *arena);
+
+// Forget the contents but keep the memory
+void arena_reset(arena_t *arena);
+
+// Make room for at least `extra` more bytes in one allocation
+bool arena_reserve(arena_t *arena, size_t extra);
+
+bool arena_append(arena_t *arena, const char *data, size_t length);
+bool arena_append_string(arena_t *arena, const char *text);
+bool arena_printf(arena_t *arena, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// Append text as a quoted JSON string, escaping quotes, backslashes and
+// control characters. Other bytes, UTF-8 included, are copied as they are.
+bool arena_append_json_string(arena_t *arena, const char *text);
+
+#endif /* ARENA_H */
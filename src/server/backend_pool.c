@@ -0,0 +1,444 @@
+#include "backend_pool.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// How often a request waiting for a free slot rechecks its cancel flag
+#define SLOT_WAIT_MS 100
+
+struct backend_pool {
+    pthread_mutex_t mutex;
+    pthread_cond_t slot_freed;
+    backend_t *backends;
+    int count;
+    unsigned int next;          // rotates the scan so ties spread evenly
+    int slow_ms;                // 0 = latency never opens a breaker
+    bool verbose;
+
+    // Active health checks, and probes of open breakers
+    int health_interval;
+    pthread_t checker;
+    bool checker_running;
+    bool stopping;
+    pthread_cond_t checker_cond;    // signalled on stop and when a breaker opens
+};
+
+static const char* backend_name(const backend_t *backend) {
+    const upstream_config_t *config = &backend->upstream->config;
+    return config->socket_path[0] ? config->socket_path : backend->upstream->host_header;
+}
+
+// Caller holds the pool mutex
+static void close_breaker(backend_t *backend) {
+    printf("Ollama backend %s is back up\n", backend_name(backend));
+    backend->breaker = BREAKER_CLOSED;
+    backend->outcomes = 0;
+    backend->outcome_count = 0;
+    backend->failures = 0;
+    backend->probe_failures = 0;
+    backend->open_ms = BREAKER_OPEN_MS;
+}
+
+// The reason is only reported when the breaker was not open already
+static void open_breaker(backend_pool_t *pool, backend_t *backend, const char *reason) {
+    if (backend->breaker != BREAKER_OPEN) {
+        fprintf(stderr, "Warning: Ollama backend %s is down (%s), retrying in %d s\n",
+                backend_name(backend), reason, backend->open_ms / 1000);
+        backend->trips++;
+    }
+    backend->breaker = BREAKER_OPEN;
+    backend->open_until = llm_monotonic_ms() + backend->open_ms;
+    backend->trials = 0;
+    backend->trial_successes = 0;
+    pthread_cond_signal(&pool->checker_cond);
+}
+
+// A probe or a trial request failed: open again, for twice as long
+static void reopen_breaker(backend_pool_t *pool, backend_t *backend) {
+    backend->open_ms = backend->open_ms * 2 < BREAKER_MAX_OPEN_MS ? backend->open_ms * 2 : BREAKER_MAX_OPEN_MS;
+    backend->breaker = BREAKER_OPEN;
+    open_breaker(pool, backend, NULL);
+    if (pool->verbose) {
+        printf("Ollama backend %s is still down, retrying in %d s\n", backend_name(backend), backend->open_ms / 1000);
+    }
+}
+
+static void half_open_breaker(backend_pool_t *pool, backend_t *backend) {
+    if (pool->verbose) {
+        printf("Ollama backend %s answers again; letting trial requests through\n", backend_name(backend));
+    }
+    backend->breaker = BREAKER_HALF_OPEN;
+    backend->trials = 0;
+    backend->trial_successes = 0;
+}
+
+static int popcount32(uint32_t bits) {
+    int count = 0;
+    for (; bits != 0; bits &= bits - 1) {
+        count++;
+    }
+    return count;
+}
+
+// Count the outcome of one call against the backend's breaker
+static void record_outcome(backend_pool_t *pool, backend_t *backend, bool trial, bool failed, bool slow) {
+    if (backend->breaker == BREAKER_OPEN) {
+        // A call from before the breaker opened; the probes decide now
+        return;
+    }
+    if (backend->breaker == BREAKER_HALF_OPEN) {
+        // Only the trials tell whether the backend is back; a call reserved
+        // while the breaker was still closed says nothing about it
+        if (!trial) {
+            return;
+        }
+        if (backend->trials > 0) {
+            backend->trials--;
+        }
+        if (failed) {
+            reopen_breaker(pool, backend);
+        } else if (++backend->trial_successes >= BREAKER_TRIAL_SUCCESSES) {
+            close_breaker(backend);
+        }
+        return;
+    }
+
+    backend->outcomes = backend->outcomes << 1 | (failed ? 1u : 0u);
+    if (backend->outcome_count < BREAKER_WINDOW) {
+        backend->outcome_count++;
+    }
+    backend->failures = failed ? backend->failures + 1 : 0;
+
+    int errors = popcount32(backend->outcomes);
+    if (backend->failures >= BACKEND_MAX_FAILURES) {
+        open_breaker(pool, backend, slow ? "too slow" : "failing");
+    } else if (backend->outcome_count >= BREAKER_MIN_CALLS &&
+               errors * 100 >= backend->outcome_count * BREAKER_ERROR_PERCENT) {
+        open_breaker(pool, backend, slow ? "too slow" : "high error rate");
+    }
+}
+
+// Caller holds the pool mutex. Whether the breaker lets a request through.
+static bool breaker_admits(const backend_pool_t *pool, const backend_t *backend, int64_t now) {
+    switch (backend->breaker) {
+        case BREAKER_CLOSED:
+            return true;
+        case BREAKER_HALF_OPEN:
+            return backend->trials < BREAKER_TRIALS;
+        case BREAKER_OPEN:
+            // Without a checker to probe it, a request is the probe
+            return !pool->checker_running && now >= backend->open_until;
+    }
+    return false;
+}
+
+static void* health_checker(void *arg) {
+    backend_pool_t *pool = arg;
+    int64_t next_round = llm_monotonic_ms() + (int64_t)pool->health_interval * 1000;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->stopping) {
+        // Sleep until the next round of checks or the first open breaker is due
+        int64_t wake = next_round;
+        for (int i = 0; i < pool->count; i++) {
+            const backend_t *backend = &pool->backends[i];
+            if (backend->breaker == BREAKER_OPEN && backend->open_until < wake) {
+                wake = backend->open_until;
+            }
+        }
+        struct timespec deadline = { .tv_sec = wake / 1000, .tv_nsec = (wake % 1000) * 1000000L };
+        if (pthread_cond_timedwait(&pool->checker_cond, &pool->mutex, &deadline) == 0) {
+            // Stopping, or a breaker opened and the wake time may be earlier
+            continue;
+        }
+
+        int64_t now = llm_monotonic_ms();
+        bool round = now >= next_round;
+        if (round) {
+            next_round = now + (int64_t)pool->health_interval * 1000;
+        }
+
+        for (int i = 0; i < pool->count && !pool->stopping; i++) {
+            backend_t *backend = &pool->backends[i];
+            bool due = backend->breaker == BREAKER_OPEN && now >= backend->open_until;
+            if (backend->breaker == BREAKER_OPEN ? !due : !round) {
+                continue;
+            }
+
+            // Probe without the lock; the upstream pool has its own
+            pthread_mutex_unlock(&pool->mutex);
+            bool ok = upstream_pool_health_check(backend->upstream);
+            pthread_mutex_lock(&pool->mutex);
+
+            if (backend->breaker == BREAKER_OPEN && ok) {
+                half_open_breaker(pool, backend);
+            } else if (backend->breaker != BREAKER_CLOSED && !ok) {
+                reopen_breaker(pool, backend);
+            } else if (backend->breaker == BREAKER_CLOSED) {
+                // One missed probe may be a blip; requests still get their verdict
+                backend->probe_failures = ok ? 0 : backend->probe_failures + 1;
+                if (backend->probe_failures >= BREAKER_PROBE_FAILURES) {
+                    open_breaker(pool, backend, "not answering health checks");
+                }
+            }
+        }
+        pthread_cond_broadcast(&pool->slot_freed);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+backend_pool_t* backend_pool_create(const llm_backend_config_t *configs, int count,
+                                    int health_interval, int connect_timeout_ms, int slow_ms, bool verbose) {
+    if (count <= 0 || count > LLM_MAX_BACKENDS) {
+        fprintf(stderr, "Error: Between 1 and %d Ollama backends are supported\n", LLM_MAX_BACKENDS);
+        return NULL;
+    }
+
+    backend_pool_t *pool = calloc(1, sizeof(backend_pool_t));
+    backend_t *backends = calloc(count, sizeof(backend_t));
+    if (pool == NULL || backends == NULL) {
+        free(pool);
+        free(backends);
+        return NULL;
+    }
+
+    pool->backends = backends;
+    pool->verbose = verbose;
+    pool->health_interval = health_interval;
+    pool->slow_ms = slow_ms > 0 ? slow_ms : 0;
+    pthread_mutex_init(&pool->mutex, NULL);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&pool->slot_freed, &attr);
+    pthread_cond_init(&pool->checker_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    for (int i = 0; i < count; i++) {
+        upstream_config_t upstream_config;
+        memset(&upstream_config, 0, sizeof(upstream_config));
+        strncpy(upstream_config.host, configs[i].host, sizeof(upstream_config.host) - 1);
+        upstream_config.port = configs[i].port;
+        strncpy(upstream_config.socket_path, configs[i].socket, sizeof(upstream_config.socket_path) - 1);
+        upstream_config.connect_timeout_ms = connect_timeout_ms;
+
+        backends[i].index = i;
+        backends[i].max_concurrency = configs[i].max_concurrency > 0 ? configs[i].max_concurrency : 0;
+        backends[i].breaker = BREAKER_CLOSED;
+        backends[i].open_ms = BREAKER_OPEN_MS;
+        backends[i].upstream = upstream_pool_create(&upstream_config);
+        if (backends[i].upstream == NULL) {
+            fprintf(stderr, "Error: Failed to set up Ollama backend %d\n", i + 1);
+            backend_pool_destroy(pool);
+            return NULL;
+        }
+        pool->count++;
+
+        // Not fatal: Ollama may simply be started after the server. Until
+        // a probe finds it up, prompts fail fast instead of each trying
+        // to connect.
+        if (!upstream_pool_health_check(backends[i].upstream)) {
+            open_breaker(pool, &backends[i], "not answering");
+        } else if (verbose) {
+            printf("Ollama backend %s is up (max concurrency %d)\n",
+                   backend_name(&backends[i]), backends[i].max_concurrency);
+        }
+    }
+
+    if (health_interval > 0) {
+        pool->checker_running = pthread_create(&pool->checker, NULL, health_checker, pool) == 0;
+        if (!pool->checker_running) {
+            fprintf(stderr, "Warning: Failed to start the backend health checker\n");
+        }
+    }
+
+    return pool;
+}
+
+void backend_pool_destroy(backend_pool_t *pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    if (pool->checker_running) {
+        pthread_mutex_lock(&pool->mutex);
+        pool->stopping = true;
+        pthread_cond_signal(&pool->checker_cond);
+        pthread_mutex_unlock(&pool->mutex);
+        pthread_join(pool->checker, NULL);
+    }
+
+    for (int i = 0; i < pool->count; i++) {
+        if (pool->verbose) {
+            printf("Ollama backend %s served %lu requests, breaker opened %lu times\n",
+                   backend_name(&pool->backends[i]), pool->backends[i].served, pool->backends[i].trips);
+        }
+        upstream_pool_destroy(pool->backends[i].upstream);
+    }
+
+    pthread_cond_destroy(&pool->slot_freed);
+    pthread_cond_destroy(&pool->checker_cond);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->backends);
+    free(pool);
+}
+
+int backend_pool_count(const backend_pool_t *pool) {
+    return pool->count;
+}
+
+backend_t* backend_pool_get(backend_pool_t *pool, int index) {
+    return &pool->backends[index];
+}
+
+// Rendezvous weight of a backend for a key (splitmix64 finalizer)
+static uint64_t affinity_weight(uint64_t affinity, int index) {
+    uint64_t x = affinity ^ ((uint64_t)(index + 1) * 0x9E3779B97F4A7C15ULL);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static bool has_slot(const backend_t *backend) {
+    return backend->max_concurrency == 0 || backend->outstanding < backend->max_concurrency;
+}
+
+// Outstanding requests per unit of capacity; unlimited backends count as one
+static bool less_loaded(const backend_t *a, const backend_t *b) {
+    int a_weight = a->max_concurrency > 0 ? a->max_concurrency : 1;
+    int b_weight = b->max_concurrency > 0 ? b->max_concurrency : 1;
+    return (long)a->outstanding * b_weight < (long)b->outstanding * a_weight;
+}
+
+// Best backend with a free slot, or NULL; *any_usable tells whether one
+// is merely full. Caller holds the pool mutex.
+static backend_t* pick_backend(backend_pool_t *pool, uint64_t affinity, uint32_t exclude, bool *any_usable) {
+    int64_t now = llm_monotonic_ms();
+    backend_t *least = NULL;
+    backend_t *preferred = NULL;
+    *any_usable = false;
+
+    for (int i = 0; i < pool->count; i++) {
+        backend_t *backend = &pool->backends[(pool->next + i) % pool->count];
+        if ((exclude & (1u << backend->index)) || !breaker_admits(pool, backend, now)) {
+            continue;
+        }
+        *any_usable = true;
+
+        if (affinity != 0 && (preferred == NULL ||
+            affinity_weight(affinity, backend->index) > affinity_weight(affinity, preferred->index))) {
+            preferred = backend;
+        }
+        if (has_slot(backend) && (least == NULL || less_loaded(backend, least))) {
+            least = backend;
+        }
+    }
+
+    // A busy preferred backend costs the conversation its warm cache,
+    // which still beats waiting for it
+    return preferred != NULL && has_slot(preferred) ? preferred : least;
+}
+
+// Caller holds the pool mutex. Returns whether the call is a trial.
+static bool take_slot(backend_pool_t *pool, backend_t *chosen) {
+    if (chosen->breaker == BREAKER_OPEN) {
+        half_open_breaker(pool, chosen);
+    }
+    bool trial = chosen->breaker == BREAKER_HALF_OPEN;
+    if (trial) {
+        chosen->trials++;
+    }
+    chosen->outstanding++;
+    chosen->served++;
+    pool->next++;
+    metrics_add(METRIC_UPSTREAM_STARTED, 1);
+    return trial;
+}
+
+backend_t* backend_pool_acquire(backend_pool_t *pool, uint64_t affinity, uint32_t exclude,
+                                const atomic_bool *cancelled, int64_t deadline_ms, bool *trial) {
+    backend_t *chosen = NULL;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (chosen == NULL) {
+        bool any_usable;
+        chosen = pick_backend(pool, affinity, exclude, &any_usable);
+        if (chosen == NULL) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            bool expired = deadline_ms > 0 &&
+                           (int64_t)deadline.tv_sec * 1000 + deadline.tv_nsec / 1000000 >= deadline_ms;
+            if (!any_usable || atomic_load(cancelled) || expired) {
+                break;
+            }
+
+            deadline.tv_nsec += SLOT_WAIT_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&pool->slot_freed, &pool->mutex, &deadline);
+        }
+    }
+
+    *trial = chosen != NULL && take_slot(pool, chosen);
+    pthread_mutex_unlock(&pool->mutex);
+
+    return chosen;
+}
+
+backend_t* backend_pool_try_acquire(backend_pool_t *pool, uint64_t affinity, uint32_t exclude,
+                                    bool *busy, bool *trial) {
+    bool any_usable;
+
+    pthread_mutex_lock(&pool->mutex);
+    backend_t *chosen = pick_backend(pool, affinity, exclude, &any_usable);
+    *trial = chosen != NULL && take_slot(pool, chosen);
+    pthread_mutex_unlock(&pool->mutex);
+
+    *busy = chosen == NULL && any_usable;
+    return chosen;
+}
+
+void backend_pool_release(backend_pool_t *pool, backend_t *backend, bool trial, bool ok) {
+    backend_pool_release_timed(pool, backend, trial, ok, -1);
+}
+
+void backend_pool_release_timed(backend_pool_t *pool, backend_t *backend, bool trial, bool ok,
+                                int64_t latency_ms) {
+    bool slow = ok && pool->slow_ms > 0 && latency_ms > pool->slow_ms;
+
+    pthread_mutex_lock(&pool->mutex);
+    backend->outstanding--;
+    record_outcome(pool, backend, trial, !ok || slow, slow);
+    pthread_cond_broadcast(&pool->slot_freed);
+    pthread_mutex_unlock(&pool->mutex);
+    metrics_add(METRIC_UPSTREAM_FINISHED, 1);
+}
+
+void backend_pool_release_unjudged(backend_pool_t *pool, backend_t *backend, bool trial) {
+    pthread_mutex_lock(&pool->mutex);
+    backend->outstanding--;
+    if (trial && backend->breaker == BREAKER_HALF_OPEN && backend->trials > 0) {
+        backend->trials--;
+    }
+    pthread_cond_broadcast(&pool->slot_freed);
+    pthread_mutex_unlock(&pool->mutex);
+    metrics_add(METRIC_UPSTREAM_FINISHED, 1);
+}
+
+bool backend_pool_available(backend_pool_t *pool) {
+    int64_t now = llm_monotonic_ms();
+    bool available = false;
+
+    pthread_mutex_lock(&pool->mutex);
+    for (int i = 0; i < pool->count && !available; i++) {
+        available = breaker_admits(pool, &pool->backends[i], now);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return available;
+}
@@ -0,0 +1,117 @@
+#ifndef BACKEND_POOL_H
+#define BACKEND_POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "llm_interface.h"
+#include "upstream_pool.h"
+
+// Consecutive failures that open a backend's circuit breaker
+#define BACKEND_MAX_FAILURES 3
+
+// Recent calls over which a backend's error rate is judged, the fewest
+// that give a rate worth acting on, and the rate that opens the breaker
+#define BREAKER_WINDOW 32
+#define BREAKER_MIN_CALLS 10
+#define BREAKER_ERROR_PERCENT 50
+
+// How long an open breaker first keeps a backend out of rotation; the
+// time doubles with every failed probe, up to the maximum
+#define BREAKER_OPEN_MS 10000
+#define BREAKER_MAX_OPEN_MS 160000
+
+// Failed health checks in a row that take a backend out of rotation
+#define BREAKER_PROBE_FAILURES 2
+
+// Trial requests a half-open breaker lets through at once, and the
+// successes in a row that close it again
+#define BREAKER_TRIALS 1
+#define BREAKER_TRIAL_SUCCESSES 3
+
+typedef enum {
+    BREAKER_CLOSED,             // in rotation
+    BREAKER_OPEN,               // out of rotation, requests fail at once
+    BREAKER_HALF_OPEN           // trial requests decide whether it is back
+} breaker_state_t;
+
+// One Ollama instance and its load
+typedef struct {
+    int index;
+    upstream_pool_t *upstream;
+    int max_concurrency;        // 0 = unlimited
+
+    // Guarded by the pool mutex
+    int outstanding;
+    breaker_state_t breaker;
+    uint32_t outcomes;          // the last calls, newest in bit 0, set for a failure
+    int outcome_count;          // calls in outcomes, up to BREAKER_WINDOW
+    int failures;               // consecutive
+    int probe_failures;         // consecutive failed health checks while closed
+    int trials;                 // trial calls in flight while half-open
+    int trial_successes;
+    int64_t open_until;         // CLOCK_MONOTONIC ms; when an open backend is probed
+    int open_ms;                // how long the breaker stays open when it next opens
+    unsigned long served;
+    unsigned long trips;
+} backend_t;
+
+// Load balancer over several Ollama instances
+//
+// Each request goes to the healthy backend with the lowest load relative
+// to its concurrency limit, or, when it carries an affinity key, to the
+// backend rendezvous hashing assigns that key to, so a conversation keeps
+// hitting the instance that holds its KV cache. A request waits while
+// every backend is at its limit.
+//
+// Every backend has a circuit breaker. Repeated failures, a high error
+// rate over the recent calls, answers slower than slow_ms or a failed
+// GET /api/version (active checks, run by a background thread) open it,
+// and requests stop going there at all. Once the open period is over a
+// probe that succeeds makes it half-open, and a few trial requests in a
+// row that succeed close it; a failure opens it again for twice as long.
+typedef struct backend_pool backend_pool_t;
+
+backend_pool_t* backend_pool_create(const llm_backend_config_t *configs, int count,
+                                    int health_interval, int connect_timeout_ms, int slow_ms, bool verbose);
+void backend_pool_destroy(backend_pool_t *pool);
+
+// Reserve a slot on a backend. Backends whose bit is set in `exclude`
+// are skipped. Returns NULL if no backend is usable, or if `cancelled`
+// is set or the CLOCK_MONOTONIC `deadline_ms` (0 = none) passes while
+// waiting for a free slot. *trial tells whether the half-open breaker
+// let the call through as a trial; it goes back with the slot.
+backend_t* backend_pool_acquire(backend_pool_t *pool, uint64_t affinity, uint32_t exclude,
+                                const atomic_bool *cancelled, int64_t deadline_ms, bool *trial);
+
+// The same without waiting, for callers on the event loop: NULL with
+// *busy set means every usable backend is at its limit right now
+backend_t* backend_pool_try_acquire(backend_pool_t *pool, uint64_t affinity, uint32_t exclude,
+                                    bool *busy, bool *trial);
+
+// Give the slot back; ok=false counts as a failure of the backend itself
+// (unreachable, connection dropped, 5xx), not of the request. While the
+// breaker is half-open only trial calls count.
+void backend_pool_release(backend_pool_t *pool, backend_t *backend, bool trial, bool ok);
+
+// The same for a call whose response took latency_ms to start (-1 if
+// it never did); a backend slower than slow_ms counts as failing
+void backend_pool_release_timed(backend_pool_t *pool, backend_t *backend, bool trial, bool ok,
+                                int64_t latency_ms);
+
+// Give the slot back without a verdict on the backend, for calls that
+// were cancelled, dropped or never sent. A trial slot is freed for the
+// next trial.
+void backend_pool_release_unjudged(backend_pool_t *pool, backend_t *backend, bool trial);
+
+// Whether any backend's breaker lets requests through; false means a
+// request would fail right away, so it need not be tried
+bool backend_pool_available(backend_pool_t *pool);
+
+int backend_pool_count(const backend_pool_t *pool);
+
+// Backend by index, for calls that go to every instance; holds no slot
+backend_t* backend_pool_get(backend_pool_t *pool, int index);
+
+#endif /* BACKEND_POOL_H */
@@ -0,0 +1,265 @@
+#include "connection.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#define CONNECTION_READ_CHUNK 4096
+
+client_connection_t* connection_create(int client_socket, int slot) {
+    client_connection_t *conn = calloc(1, sizeof(client_connection_t));
+    if (conn == NULL) {
+        fprintf(stderr, "Error: Failed to allocate client connection\n");
+        return NULL;
+    }
+
+    conn->client_socket = client_socket;
+    conn->slot = slot;
+    atomic_init(&conn->active, true);
+    atomic_init(&conn->refcount, 1);
+    pthread_mutex_init(&conn->write_mutex, NULL);
+    message_buffer_init(&conn->read_buffer);
+    return conn;
+}
+
+void connection_retain(client_connection_t *conn) {
+    atomic_fetch_add(&conn->refcount, 1);
+}
+
+void connection_release(client_connection_t *conn) {
+    if (conn == NULL) {
+        return;
+    }
+
+    if (atomic_fetch_sub(&conn->refcount, 1) != 1) {
+        return;
+    }
+
+    close(conn->client_socket);
+    pthread_mutex_destroy(&conn->write_mutex);
+    message_buffer_free(&conn->read_buffer);
+    free(conn->write_buffer);
+    free(conn);
+}
+
+void connection_close(client_connection_t *conn) {
+    if (atomic_exchange(&conn->active, false)) {
+        // Wake up anyone blocked on the socket; the fd itself stays open
+        // until the last reference is released
+        shutdown(conn->client_socket, SHUT_RDWR);
+    }
+}
+
+connection_read_t connection_read_available(client_connection_t *conn) {
+    message_buffer_t *buffer = &conn->read_buffer;
+    size_t budget = CONNECTION_READ_BUDGET;
+
+    while (true) {
+        // A complete message fits in the cap, so there is always
+        // something to parse once it is reached
+        size_t pending = buffer->length - buffer->offset;
+        if (pending >= CONNECTION_MAX_PENDING_READ || budget == 0) {
+            return CONNECTION_MORE;
+        }
+
+        char *space = message_buffer_reserve(buffer, CONNECTION_READ_CHUNK);
+        if (space == NULL) {
+            return CONNECTION_CLOSED;
+        }
+
+        size_t wanted = buffer->capacity - buffer->length;
+        if (wanted > CONNECTION_MAX_PENDING_READ - pending) {
+            wanted = CONNECTION_MAX_PENDING_READ - pending;
+        }
+        if (wanted > budget) {
+            wanted = budget;
+        }
+
+        ssize_t bytes_received = recv(conn->client_socket, space, wanted, 0);
+        if (bytes_received > 0) {
+            message_buffer_commit(buffer, bytes_received);
+            metrics_add(METRIC_BYTES_RECEIVED, bytes_received);
+            budget -= bytes_received;
+            continue;
+        }
+
+        if (bytes_received == 0) {
+            return CONNECTION_CLOSED;
+        }
+
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return CONNECTION_DRAINED;
+        }
+        return CONNECTION_CLOSED;
+    }
+}
+
+// Write as much of the queued data as the socket accepts. Caller holds write_mutex.
+static bool flush_locked(client_connection_t *conn) {
+    while (conn->write_offset < conn->write_length) {
+        ssize_t bytes_sent = send(conn->client_socket, conn->write_buffer + conn->write_offset,
+                                  conn->write_length - conn->write_offset, MSG_NOSIGNAL);
+        if (bytes_sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            }
+            return false;
+        }
+        conn->write_offset += bytes_sent;
+        metrics_add(METRIC_BYTES_SENT, bytes_sent);
+    }
+
+    conn->write_offset = 0;
+    conn->write_length = 0;
+    return true;
+}
+
+static bool append_locked(client_connection_t *conn, const char *data, size_t length) {
+    // Compact before growing so a steady stream does not keep reallocating
+    if (conn->write_offset > 0) {
+        memmove(conn->write_buffer, conn->write_buffer + conn->write_offset,
+                conn->write_length - conn->write_offset);
+        conn->write_length -= conn->write_offset;
+        conn->write_offset = 0;
+    }
+
+    if (conn->write_length + length > CONNECTION_MAX_PENDING_WRITE) {
+        fprintf(stderr, "Error: Client on slot %d is not reading, dropping connection\n", conn->slot);
+        return false;
+    }
+
+    if (conn->write_length + length > conn->write_capacity) {
+        size_t new_capacity = conn->write_capacity ? conn->write_capacity : CONNECTION_READ_CHUNK;
+        while (new_capacity < conn->write_length + length) {
+            new_capacity *= 2;
+        }
+        char *new_buffer = realloc(conn->write_buffer, new_capacity);
+        if (new_buffer == NULL) {
+            fprintf(stderr, "Error: Failed to grow write buffer\n");
+            return false;
+        }
+        conn->write_buffer = new_buffer;
+        conn->write_capacity = new_capacity;
+    }
+
+    memcpy(conn->write_buffer + conn->write_length, data, length);
+    conn->write_length += length;
+    return true;
+}
+
+int connection_sendv(client_connection_t *conn, const struct iovec *iov, int iov_count) {
+    if (conn == NULL || !atomic_load(&conn->active)) {
+        return -1;
+    }
+
+    size_t length = 0;
+    for (int i = 0; i < iov_count; i++) {
+        length += iov[i].iov_len;
+    }
+
+    size_t total_sent = 0;
+    bool ok = true;
+
+    pthread_mutex_lock(&conn->write_mutex);
+
+    // Fast path: nothing queued, try writing straight to the socket
+    if (conn->write_length == 0) {
+        while (total_sent < length) {
+            struct msghdr msg = { .msg_iov = (struct iovec *)iov, .msg_iovlen = iov_count };
+            ssize_t bytes_sent = sendmsg(conn->client_socket, &msg, MSG_NOSIGNAL);
+            if (bytes_sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    ok = false;
+                }
+            } else {
+                total_sent = bytes_sent;
+                metrics_add(METRIC_BYTES_SENT, bytes_sent);
+            }
+            break;
+        }
+    }
+
+    // Queue the rest; the loop flushes it on the next writable edge
+    size_t skip = total_sent;
+    for (int i = 0; ok && i < iov_count; i++) {
+        if (skip >= iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+        ok = append_locked(conn, (const char *)iov[i].iov_base + skip, iov[i].iov_len - skip);
+        skip = 0;
+    }
+
+    pthread_mutex_unlock(&conn->write_mutex);
+
+    if (!ok) {
+        connection_close(conn);
+        return -1;
+    }
+
+    return (int)length;
+}
+
+int connection_send_message(client_connection_t *conn, uint8_t type, uint32_t request_id,
+                            const void *payload, size_t length) {
+    return connection_send_flagged(conn, type, 0, request_id, payload, length);
+}
+
+int connection_send_flagged(client_connection_t *conn, uint8_t type, uint8_t flags, uint32_t request_id,
+                            const void *payload, size_t length) {
+    if (length > MESSAGE_MAX_PAYLOAD) {
+        fprintf(stderr, "Error: Message for slot %d too large (%zu bytes)\n", conn->slot, length);
+        return -1;
+    }
+
+    uint8_t header[MESSAGE_HEADER_SIZE];
+    message_encode_header(header, type, flags, request_id, (uint32_t)length);
+
+    struct iovec iov[2] = {
+        { .iov_base = header, .iov_len = sizeof(header) },
+        { .iov_base = (void *)payload, .iov_len = length }
+    };
+    return connection_sendv(conn, iov, length > 0 ? 2 : 1);
+}
+
+bool connection_flush(client_connection_t *conn) {
+    pthread_mutex_lock(&conn->write_mutex);
+    bool ok = flush_locked(conn);
+    pthread_mutex_unlock(&conn->write_mutex);
+
+    if (!ok) {
+        connection_close(conn);
+    }
+    return ok;
+}
+
+int connection_send_text(client_connection_t *conn, uint32_t request_id, const char *text, size_t length) {
+    while (length > MESSAGE_MAX_PAYLOAD) {
+        // Back up over UTF-8 continuation bytes
+        size_t chunk = MESSAGE_MAX_PAYLOAD;
+        while (chunk > 0 && ((unsigned char)text[chunk] & 0xC0) == 0x80) {
+            chunk--;
+        }
+        if (chunk == 0) {
+            chunk = MESSAGE_MAX_PAYLOAD;
+        }
+        if (connection_send_message(conn, MSG_TOKEN, request_id, text, chunk) < 0) {
+            return -1;
+        }
+        text += chunk;
+        length -= chunk;
+    }
+    return connection_send_message(conn, MSG_TOKEN, request_id, text, length);
+}
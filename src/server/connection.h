@@ -0,0 +1,79 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "../common/protocol.h"
+
+// Upper bound on bytes queued for a slow reader before we drop it
+#define CONNECTION_MAX_PENDING_WRITE (16 * 1024 * 1024)
+
+// Most unparsed bytes held for a client: one message of the largest size
+#define CONNECTION_MAX_PENDING_READ (MESSAGE_HEADER_SIZE + MESSAGE_MAX_PAYLOAD)
+
+// Bytes read from one client per wakeup, so a fast sender cannot keep
+// the loop thread from the other connections
+#define CONNECTION_READ_BUDGET (256 * 1024)
+
+typedef enum {
+    CONNECTION_DRAINED,         // read until the socket would block
+    CONNECTION_MORE,            // stopped early; data is left in the socket
+    CONNECTION_CLOSED           // the peer closed, or a hard error
+} connection_read_t;
+
+// Client connection data
+//
+// Connections are reference counted: the event loop owns one reference
+// while the socket is registered, and anything that answers the client
+// from another thread holds its own. The fd is only closed when the
+// last reference goes away, so it can never be reused underneath a
+// pending send.
+typedef struct client_connection {
+    int client_socket;
+    int slot;
+    uint32_t trace_id;          // names the connection in traces, assigned at accept
+    atomic_bool active;
+    atomic_int refcount;
+
+    // Read side, only touched by the event loop thread
+    message_buffer_t read_buffer;
+
+    // Write side, shared between the loop and responders
+    pthread_mutex_t write_mutex;
+    char *write_buffer;
+    size_t write_offset;
+    size_t write_length;
+    size_t write_capacity;
+} client_connection_t;
+
+// Lifecycle
+client_connection_t* connection_create(int client_socket, int slot);
+void connection_retain(client_connection_t *conn);
+void connection_release(client_connection_t *conn);
+void connection_close(client_connection_t *conn);
+
+// Read until the socket would block, the read buffer holds
+// CONNECTION_MAX_PENDING_READ unparsed bytes or CONNECTION_READ_BUDGET
+// bytes came in. On CONNECTION_MORE the caller parses what is buffered
+// and re-arms the fd to be called again.
+connection_read_t connection_read_available(client_connection_t *conn);
+
+// Thread-safe send. Data that cannot be written immediately is queued
+// and flushed by connection_flush() when the socket becomes writable.
+// The buffers of one call are never interleaved with another sender's.
+int connection_sendv(client_connection_t *conn, const struct iovec *iov, int iov_count);
+int connection_send_message(client_connection_t *conn, uint8_t type, uint32_t request_id,
+                            const void *payload, size_t length);
+int connection_send_flagged(client_connection_t *conn, uint8_t type, uint8_t flags, uint32_t request_id,
+                            const void *payload, size_t length);
+bool connection_flush(client_connection_t *conn);
+
+// Send text as TOKEN messages, split at character boundaries where it
+// is longer than one message may carry
+int connection_send_text(client_connection_t *conn, uint32_t request_id, const char *text, size_t length);
+
+#endif /* CONNECTION_H */
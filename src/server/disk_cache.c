@@ -0,0 +1,727 @@
+#include "disk_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define FILE_MAGIC "LLMCACH1"
+#define FILE_VERSION 1
+#define FILE_HEADER_SIZE 64
+#define RECORD_MAGIC 0x44524352u        // "RCRD"
+
+// Appends can only tear the end of the file, so only records this close
+// to the end are checksummed while opening
+#define TAIL_VERIFY_BYTES (1024 * 1024)
+
+// How often the compactor checks for dead space
+#define COMPACT_INTERVAL_SECONDS 30
+
+// Compaction keeps the most recently used records up to this share of the budget
+#define COMPACT_TARGET_PERCENT 75
+
+#define INITIAL_BUCKETS 1024
+
+// On-disk record, followed by token_ends, the key and the text, padded to 8 bytes
+typedef struct {
+    uint32_t magic;
+    uint32_t crc;           // CRC-32 of everything after this field
+    uint64_t key_hash;
+    uint32_t key_length;
+    uint32_t text_length;
+    uint32_t token_count;
+    uint32_t reserved;
+} record_header_t;
+
+struct disk_cache_mapping {
+    int fd;
+    char *base;
+    size_t size;
+    atomic_int refcount;
+};
+
+typedef struct index_entry {
+    uint64_t hash;
+    uint64_t offset;
+    uint32_t size;
+    atomic_bool verified;
+    atomic_bool corrupt;
+    atomic_ullong last_used;     // value of the cache's use clock at the last hit
+    struct index_entry *next;
+} index_entry_t;
+
+typedef struct {
+    index_entry_t **buckets;
+    size_t bucket_count;
+    size_t entries;
+} index_table_t;
+
+struct disk_cache {
+    char path[512];
+    size_t max_bytes;
+    bool verbose;
+
+    // Index and current mapping; lookups share it, appends and compaction take it exclusively
+    pthread_rwlock_t lock;
+    disk_cache_mapping_t *mapping;
+    index_table_t index;
+    size_t file_size;
+    size_t live_bytes;
+
+    // Serializes writers; compaction holds it for the whole rewrite
+    pthread_mutex_t append_mutex;
+
+    pthread_t compactor;
+    pthread_mutex_t compactor_mutex;
+    pthread_cond_t compactor_cond;
+    bool compact_requested;
+    bool stopping;
+
+    // Ticks on every append and hit; orders records by recent use
+    atomic_ullong use_clock;
+
+    atomic_ullong hits;
+    atomic_ullong misses;
+    atomic_ullong appends;
+    atomic_ullong compactions;
+};
+
+static void* compactor_thread(void *arg);
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc32(const void *data, size_t length) {
+    const unsigned char *p = data;
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++) {
+        c = crc_table[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+    }
+    return c ^ 0xFFFFFFFFu;
+}
+
+static size_t record_data_size(const record_header_t *header) {
+    return sizeof(record_header_t) + (size_t)header->token_count * sizeof(uint32_t) +
+           header->key_length + header->text_length;
+}
+
+static size_t record_size(const record_header_t *header) {
+    return (record_data_size(header) + 7) & ~(size_t)7;
+}
+
+static uint32_t record_crc(const record_header_t *header) {
+    const char *start = (const char *)header + offsetof(record_header_t, key_hash);
+    return crc32(start, record_data_size(header) - offsetof(record_header_t, key_hash));
+}
+
+// Mapping
+
+// The mapping reserves room for growth up front; appends become visible
+// through it without remapping because the file is mapped shared
+static disk_cache_mapping_t* mapping_create(int fd, size_t size) {
+    long page = sysconf(_SC_PAGESIZE);
+    size = (size + page - 1) & ~(size_t)(page - 1);
+
+    void *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Error: Failed to map disk cache: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    disk_cache_mapping_t *mapping = malloc(sizeof(disk_cache_mapping_t));
+    if (mapping == NULL) {
+        munmap(base, size);
+        return NULL;
+    }
+
+    mapping->fd = fd;
+    mapping->base = base;
+    mapping->size = size;
+    atomic_init(&mapping->refcount, 1);
+    return mapping;
+}
+
+static void mapping_release(disk_cache_mapping_t *mapping) {
+    if (mapping != NULL && atomic_fetch_sub(&mapping->refcount, 1) == 1) {
+        munmap(mapping->base, mapping->size);
+        close(mapping->fd);
+        free(mapping);
+    }
+}
+
+// Index
+
+static bool index_init(index_table_t *index) {
+    index->bucket_count = INITIAL_BUCKETS;
+    index->entries = 0;
+    index->buckets = calloc(INITIAL_BUCKETS, sizeof(index_entry_t *));
+    return index->buckets != NULL;
+}
+
+static void index_free(index_table_t *index) {
+    for (size_t i = 0; i < index->bucket_count; i++) {
+        index_entry_t *entry = index->buckets[i];
+        while (entry) {
+            index_entry_t *next = entry->next;
+            free(entry);
+            entry = next;
+        }
+    }
+    free(index->buckets);
+    index->buckets = NULL;
+}
+
+static void index_grow(index_table_t *index) {
+    size_t new_count = index->bucket_count * 2;
+    index_entry_t **new_buckets = calloc(new_count, sizeof(index_entry_t *));
+    if (new_buckets == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < index->bucket_count; i++) {
+        index_entry_t *entry = index->buckets[i];
+        while (entry) {
+            index_entry_t *next = entry->next;
+            entry->next = new_buckets[entry->hash & (new_count - 1)];
+            new_buckets[entry->hash & (new_count - 1)] = entry;
+            entry = next;
+        }
+    }
+    free(index->buckets);
+    index->buckets = new_buckets;
+    index->bucket_count = new_count;
+}
+
+static const record_header_t* record_at(const disk_cache_mapping_t *mapping, uint64_t offset) {
+    return (const record_header_t *)(mapping->base + offset);
+}
+
+static bool record_matches(const record_header_t *header, const response_cache_key_t *key) {
+    const char *key_data = (const char *)(header + 1) + (size_t)header->token_count * sizeof(uint32_t);
+    return header->key_hash == key->hash && header->key_length == key->length &&
+           memcmp(key_data, key->data, key->length) == 0;
+}
+
+static index_entry_t** index_find(index_table_t *index, const disk_cache_mapping_t *mapping,
+                                  const response_cache_key_t *key) {
+    index_entry_t **slot = &index->buckets[key->hash & (index->bucket_count - 1)];
+    while (*slot) {
+        if ((*slot)->hash == key->hash && record_matches(record_at(mapping, (*slot)->offset), key)) {
+            break;
+        }
+        slot = &(*slot)->next;
+    }
+    return slot;
+}
+
+// Add a record, replacing an older record for the same key. Returns the
+// size of the record it superseded, which is now dead space.
+static size_t index_put(index_table_t *index, const disk_cache_mapping_t *mapping,
+                        uint64_t offset, uint32_t size, bool verified, uint64_t last_used) {
+    const record_header_t *header = record_at(mapping, offset);
+    const char *key_data = (const char *)(header + 1) + (size_t)header->token_count * sizeof(uint32_t);
+    response_cache_key_t key = { header->key_hash, (char *)key_data, header->key_length };
+
+    size_t superseded = 0;
+    index_entry_t **slot = index_find(index, mapping, &key);
+    index_entry_t *entry = *slot;
+    if (entry) {
+        superseded = entry->size;
+    } else {
+        entry = calloc(1, sizeof(index_entry_t));
+        if (entry == NULL) {
+            return 0;
+        }
+        entry->next = index->buckets[key.hash & (index->bucket_count - 1)];
+        index->buckets[key.hash & (index->bucket_count - 1)] = entry;
+        index->entries++;
+    }
+
+    entry->hash = key.hash;
+    entry->offset = offset;
+    entry->size = size;
+    atomic_store(&entry->verified, verified);
+    atomic_store(&entry->corrupt, false);
+    atomic_store(&entry->last_used, last_used);
+
+    if (index->entries > index->bucket_count) {
+        index_grow(index);
+    }
+    return superseded;
+}
+
+// File handling
+
+static bool write_all(int fd, const void *data, size_t length, off_t offset) {
+    const char *p = data;
+    while (length > 0) {
+        ssize_t written = pwrite(fd, p, length, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += written;
+        length -= written;
+        offset += written;
+    }
+    return true;
+}
+
+static bool write_file_header(int fd) {
+    char header[FILE_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, FILE_MAGIC, 8);
+    uint32_t version = FILE_VERSION;
+    memcpy(header + 8, &version, sizeof(version));
+    return write_all(fd, header, sizeof(header), 0);
+}
+
+// Rebuild the index from record headers. Payloads are not read, except
+// near the end of the file where a crash may have left a torn append.
+static size_t scan_records(disk_cache_t *cache, size_t file_size) {
+    size_t offset = FILE_HEADER_SIZE;
+
+    while (offset + sizeof(record_header_t) <= file_size) {
+        const record_header_t *header = record_at(cache->mapping, offset);
+        if (header->magic != RECORD_MAGIC) {
+            break;
+        }
+
+        size_t size = record_size(header);
+        if (size > file_size - offset) {
+            break;
+        }
+
+        bool verified = false;
+        if (offset + TAIL_VERIFY_BYTES >= file_size) {
+            if (record_crc(header) != header->crc) {
+                break;
+            }
+            verified = true;
+        }
+
+        cache->live_bytes += size;
+        cache->live_bytes -= index_put(&cache->index, cache->mapping, offset, (uint32_t)size, verified,
+                                       atomic_fetch_add(&cache->use_clock, 1));
+        offset += size;
+    }
+    return offset;
+}
+
+disk_cache_t* disk_cache_open(const char *path, size_t max_bytes, bool verbose) {
+    pthread_once(&crc_once, crc_init);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Failed to open disk cache %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+    size_t file_size = st.st_size;
+
+    if (file_size == 0) {
+        if (!write_file_header(fd)) {
+            fprintf(stderr, "Error: Failed to initialize disk cache %s\n", path);
+            close(fd);
+            return NULL;
+        }
+        file_size = FILE_HEADER_SIZE;
+    } else {
+        char magic[8];
+        if (file_size < FILE_HEADER_SIZE || pread(fd, magic, sizeof(magic), 0) != sizeof(magic) ||
+            memcmp(magic, FILE_MAGIC, sizeof(magic)) != 0) {
+            // Never overwrite a file we did not create
+            fprintf(stderr, "Error: %s is not a response cache file\n", path);
+            close(fd);
+            return NULL;
+        }
+    }
+
+    disk_cache_t *cache = calloc(1, sizeof(disk_cache_t));
+    if (cache == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    strncpy(cache->path, path, sizeof(cache->path) - 1);
+    cache->max_bytes = max_bytes;
+    cache->verbose = verbose;
+    pthread_rwlock_init(&cache->lock, NULL);
+    pthread_mutex_init(&cache->append_mutex, NULL);
+    pthread_mutex_init(&cache->compactor_mutex, NULL);
+    pthread_cond_init(&cache->compactor_cond, NULL);
+
+    // Twice the budget leaves room to append until the next compaction
+    size_t map_size = max_bytes * 2 > file_size ? max_bytes * 2 : file_size;
+    cache->mapping = mapping_create(fd, map_size);
+    if (cache->mapping == NULL || !index_init(&cache->index)) {
+        if (cache->mapping == NULL) {
+            close(fd);
+        }
+        mapping_release(cache->mapping);
+        free(cache->index.buckets);
+        free(cache);
+        return NULL;
+    }
+
+    size_t valid = scan_records(cache, file_size);
+    if (valid < file_size) {
+        fprintf(stderr, "Warning: Discarding %zu bytes of incomplete records at the end of %s\n",
+                file_size - valid, path);
+        if (ftruncate(fd, valid) < 0) {
+            fprintf(stderr, "Warning: Failed to truncate %s: %s\n", path, strerror(errno));
+        }
+    }
+    cache->file_size = valid;
+
+    if (pthread_create(&cache->compactor, NULL, compactor_thread, cache) != 0) {
+        fprintf(stderr, "Error: Failed to start disk cache compactor\n");
+        index_free(&cache->index);
+        mapping_release(cache->mapping);
+        free(cache);
+        return NULL;
+    }
+
+    printf("Disk cache %s: %zu responses, %zu bytes\n", path, cache->index.entries, cache->file_size);
+    return cache;
+}
+
+// Lookup
+
+static bool verify_entry(const disk_cache_mapping_t *mapping, index_entry_t *entry) {
+    if (atomic_load(&entry->verified)) {
+        return true;
+    }
+    if (atomic_load(&entry->corrupt)) {
+        return false;
+    }
+
+    const record_header_t *header = record_at(mapping, entry->offset);
+    bool ok = record_crc(header) == header->crc;
+    atomic_store(ok ? &entry->verified : &entry->corrupt, true);
+    return ok;
+}
+
+bool disk_cache_lookup(disk_cache_t *cache, const response_cache_key_t *key, disk_cache_hit_t *hit) {
+    bool found = false;
+
+    pthread_rwlock_rdlock(&cache->lock);
+    index_entry_t *entry = *index_find(&cache->index, cache->mapping, key);
+    if (entry && verify_entry(cache->mapping, entry)) {
+        const record_header_t *header = record_at(cache->mapping, entry->offset);
+        const uint32_t *token_ends = (const uint32_t *)(header + 1);
+
+        hit->token_ends = token_ends;
+        hit->token_count = header->token_count;
+        hit->text = (const char *)(token_ends + header->token_count) + header->key_length;
+        hit->text_length = header->text_length;
+        hit->mapping = cache->mapping;
+        atomic_fetch_add(&cache->mapping->refcount, 1);
+        atomic_store(&entry->last_used, atomic_fetch_add(&cache->use_clock, 1));
+        found = true;
+    }
+    pthread_rwlock_unlock(&cache->lock);
+
+    atomic_fetch_add(found ? &cache->hits : &cache->misses, 1);
+    return found;
+}
+
+void disk_cache_hit_release(disk_cache_hit_t *hit) {
+    mapping_release(hit->mapping);
+    hit->mapping = NULL;
+}
+
+static void request_compaction(disk_cache_t *cache) {
+    pthread_mutex_lock(&cache->compactor_mutex);
+    cache->compact_requested = true;
+    pthread_cond_signal(&cache->compactor_cond);
+    pthread_mutex_unlock(&cache->compactor_mutex);
+}
+
+bool disk_cache_append(disk_cache_t *cache, const response_cache_key_t *key,
+                       const char *text, size_t text_length,
+                       const uint32_t *token_ends, size_t token_count) {
+    record_header_t header = {
+        .magic = RECORD_MAGIC,
+        .key_hash = key->hash,
+        .key_length = (uint32_t)key->length,
+        .text_length = (uint32_t)text_length,
+        .token_count = (uint32_t)token_count
+    };
+    size_t size = record_size(&header);
+    if (size > cache->max_bytes) {
+        return false;
+    }
+
+    // The whole record goes out in one write; a crash part way through
+    // leaves a tail that fails its checksum and is dropped on open
+    char *record = calloc(1, size);
+    if (record == NULL) {
+        return false;
+    }
+    char *p = record + sizeof(header);
+    memcpy(p, token_ends, token_count * sizeof(uint32_t));
+    p += token_count * sizeof(uint32_t);
+    memcpy(p, key->data, key->length);
+    p += key->length;
+    memcpy(p, text, text_length);
+    memcpy(record, &header, sizeof(header));
+    ((record_header_t *)record)->crc = record_crc((record_header_t *)record);
+
+    if (pthread_mutex_trylock(&cache->append_mutex) != 0) {
+        free(record);
+        return false;
+    }
+
+    bool ok = false;
+    size_t offset = cache->file_size;
+    if (offset + size > cache->mapping->size) {
+        request_compaction(cache);
+    } else if (!write_all(cache->mapping->fd, record, size, offset)) {
+        fprintf(stderr, "Warning: Failed to append to disk cache: %s\n", strerror(errno));
+        if (ftruncate(cache->mapping->fd, offset) < 0) {
+            // The torn record is dropped on the next open anyway
+        }
+    } else {
+        pthread_rwlock_wrlock(&cache->lock);
+        cache->live_bytes += size;
+        cache->live_bytes -= index_put(&cache->index, cache->mapping, offset, (uint32_t)size,
+                                       true, atomic_fetch_add(&cache->use_clock, 1));
+        cache->file_size = offset + size;
+        pthread_rwlock_unlock(&cache->lock);
+
+        atomic_fetch_add(&cache->appends, 1);
+        ok = true;
+        if (cache->file_size > cache->max_bytes) {
+            request_compaction(cache);
+        }
+    }
+
+    pthread_mutex_unlock(&cache->append_mutex);
+    free(record);
+    return ok;
+}
+
+// Compaction
+
+typedef struct {
+    uint64_t offset;
+    uint32_t size;
+    uint64_t last_used;
+} live_record_t;
+
+static int by_recent_use(const void *a, const void *b) {
+    const live_record_t *x = a;
+    const live_record_t *y = b;
+    return (y->last_used > x->last_used) - (y->last_used < x->last_used);
+}
+
+// Rewrite the file with only live records, most recently used first,
+// dropping the coldest ones once the budget is exceeded
+static void compact(disk_cache_t *cache) {
+    pthread_mutex_lock(&cache->append_mutex);
+
+    // Nothing else changes the index or mapping while append_mutex is held
+    disk_cache_mapping_t *old_mapping = cache->mapping;
+    size_t count = 0;
+    live_record_t *records = malloc((cache->index.entries + 1) * sizeof(live_record_t));
+    if (records == NULL) {
+        pthread_mutex_unlock(&cache->append_mutex);
+        return;
+    }
+
+    pthread_rwlock_rdlock(&cache->lock);
+    for (size_t i = 0; i < cache->index.bucket_count; i++) {
+        for (index_entry_t *entry = cache->index.buckets[i]; entry; entry = entry->next) {
+            if (!atomic_load(&entry->corrupt)) {
+                records[count].offset = entry->offset;
+                records[count].size = entry->size;
+                records[count].last_used = atomic_load(&entry->last_used);
+                count++;
+            }
+        }
+    }
+    size_t old_file_size = cache->file_size;
+    pthread_rwlock_unlock(&cache->lock);
+
+    qsort(records, count, sizeof(live_record_t), by_recent_use);
+
+    char temp_path[sizeof(cache->path) + 8];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", cache->path);
+    int fd = open(temp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || !write_file_header(fd)) {
+        fprintf(stderr, "Warning: Disk cache compaction failed: %s\n", strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+            unlink(temp_path);
+        }
+        free(records);
+        pthread_mutex_unlock(&cache->append_mutex);
+        return;
+    }
+
+    // Keep the most recently used records that fit the budget...
+    size_t budget = cache->max_bytes / 100 * COMPACT_TARGET_PERCENT;
+    size_t kept = 0;
+    size_t kept_bytes = 0;
+    while (kept < count && kept_bytes + records[kept].size <= budget) {
+        kept_bytes += records[kept].size;
+        kept++;
+    }
+
+    // ...and write them oldest first, so a later open sees the same order
+    size_t offset = FILE_HEADER_SIZE;
+    size_t written = 0;
+    bool ok = true;
+    for (size_t i = kept; i-- > 0 && ok;) {
+        const record_header_t *header = record_at(old_mapping, records[i].offset);
+        if (record_crc(header) != header->crc) {
+            continue;
+        }
+        ok = write_all(fd, header, records[i].size, offset);
+        records[i].offset = offset;
+        offset += records[i].size;
+        records[count - 1 - written++] = records[i];
+    }
+    disk_cache_mapping_t *new_mapping = NULL;
+    index_table_t new_index;
+    if (ok && fsync(fd) == 0 && rename(temp_path, cache->path) == 0 && index_init(&new_index)) {
+        size_t map_size = cache->max_bytes * 2 > offset ? cache->max_bytes * 2 : offset;
+        new_mapping = mapping_create(fd, map_size);
+        if (new_mapping == NULL) {
+            index_free(&new_index);
+        }
+    }
+
+    if (new_mapping == NULL) {
+        fprintf(stderr, "Warning: Disk cache compaction failed\n");
+        close(fd);
+        unlink(temp_path);
+        free(records);
+        pthread_mutex_unlock(&cache->append_mutex);
+        return;
+    }
+
+    for (size_t i = count - written; i < count; i++) {
+        index_put(&new_index, new_mapping, records[i].offset, records[i].size, true, records[i].last_used);
+    }
+
+    pthread_rwlock_wrlock(&cache->lock);
+    index_table_t old_index = cache->index;
+    cache->index = new_index;
+    cache->mapping = new_mapping;
+    cache->file_size = offset;
+    cache->live_bytes = offset - FILE_HEADER_SIZE;
+    pthread_rwlock_unlock(&cache->lock);
+
+    // Hits still being replayed keep the old mapping alive until released
+    index_free(&old_index);
+    mapping_release(old_mapping);
+    free(records);
+    atomic_fetch_add(&cache->compactions, 1);
+
+    pthread_mutex_unlock(&cache->append_mutex);
+
+    if (cache->verbose) {
+        printf("Compacted disk cache: %zu -> %zu bytes, %zu of %zu responses kept\n",
+               old_file_size, offset, written, count);
+    }
+}
+
+static bool needs_compaction(disk_cache_t *cache) {
+    pthread_rwlock_rdlock(&cache->lock);
+    size_t data = cache->file_size - FILE_HEADER_SIZE;
+    bool needed = cache->file_size > cache->max_bytes ||
+                  (data > cache->max_bytes / 4 && cache->live_bytes < data / 2);
+    pthread_rwlock_unlock(&cache->lock);
+    return needed;
+}
+
+static void* compactor_thread(void *arg) {
+    disk_cache_t *cache = (disk_cache_t *)arg;
+
+    pthread_mutex_lock(&cache->compactor_mutex);
+    while (!cache->stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += COMPACT_INTERVAL_SECONDS;
+        while (!cache->stopping && !cache->compact_requested) {
+            if (pthread_cond_timedwait(&cache->compactor_cond, &cache->compactor_mutex, &deadline) != 0) {
+                break;
+            }
+        }
+        if (cache->stopping) {
+            break;
+        }
+        cache->compact_requested = false;
+        pthread_mutex_unlock(&cache->compactor_mutex);
+
+        if (needs_compaction(cache)) {
+            compact(cache);
+        }
+
+        pthread_mutex_lock(&cache->compactor_mutex);
+    }
+    pthread_mutex_unlock(&cache->compactor_mutex);
+    return NULL;
+}
+
+void disk_cache_close(disk_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->compactor_mutex);
+    cache->stopping = true;
+    pthread_cond_signal(&cache->compactor_cond);
+    pthread_mutex_unlock(&cache->compactor_mutex);
+    pthread_join(cache->compactor, NULL);
+
+    if (fsync(cache->mapping->fd) < 0) {
+        fprintf(stderr, "Warning: Failed to sync disk cache: %s\n", strerror(errno));
+    }
+
+    index_free(&cache->index);
+    mapping_release(cache->mapping);
+    pthread_rwlock_destroy(&cache->lock);
+    pthread_mutex_destroy(&cache->append_mutex);
+    pthread_mutex_destroy(&cache->compactor_mutex);
+    pthread_cond_destroy(&cache->compactor_cond);
+    free(cache);
+}
+
+void disk_cache_get_stats(disk_cache_t *cache, disk_cache_stats_t *stats) {
+    stats->hits = atomic_load(&cache->hits);
+    stats->misses = atomic_load(&cache->misses);
+    stats->appends = atomic_load(&cache->appends);
+    stats->compactions = atomic_load(&cache->compactions);
+
+    pthread_rwlock_rdlock(&cache->lock);
+    stats->entries = cache->index.entries;
+    stats->file_bytes = cache->file_size;
+    stats->live_bytes = cache->live_bytes;
+    pthread_rwlock_unlock(&cache->lock);
+}
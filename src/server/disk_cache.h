@@ -0,0 +1,58 @@
+#ifndef DISK_CACHE_H
+#define DISK_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "response_cache.h"
+
+// Persistent response cache
+//
+// Responses are appended to a single file as CRC-protected records and
+// the file is mapped read-only, so a hit is served straight from the page
+// cache. Only record headers are read at startup to rebuild the in-memory
+// index; payload checksums are verified on first use. A torn record at
+// the end of the file (crash during an append) is cut off on open.
+// A background thread rewrites the file without dead or cold records
+// when it outgrows its budget.
+
+typedef struct disk_cache disk_cache_t;
+typedef struct disk_cache_mapping disk_cache_mapping_t;
+
+// A hit; the pointers refer into the mapped file and stay valid until
+// the hit is released, even if the file is compacted meanwhile
+typedef struct {
+    const char *text;
+    size_t text_length;
+    const uint32_t *token_ends;
+    size_t token_count;
+    disk_cache_mapping_t *mapping;
+} disk_cache_hit_t;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t appends;
+    uint64_t compactions;
+    size_t entries;
+    size_t file_bytes;
+    size_t live_bytes;
+} disk_cache_stats_t;
+
+// Open or create the cache file. max_bytes bounds the live data kept.
+disk_cache_t* disk_cache_open(const char *path, size_t max_bytes, bool verbose);
+void disk_cache_close(disk_cache_t *cache);
+
+// Returns true and fills `hit` when the key is stored
+bool disk_cache_lookup(disk_cache_t *cache, const response_cache_key_t *key, disk_cache_hit_t *hit);
+void disk_cache_hit_release(disk_cache_hit_t *hit);
+
+// Append a finished response. Best effort: skipped while a compaction
+// is rewriting the file.
+bool disk_cache_append(disk_cache_t *cache, const response_cache_key_t *key,
+                       const char *text, size_t text_length,
+                       const uint32_t *token_ends, size_t token_count);
+
+void disk_cache_get_stats(disk_cache_t *cache, disk_cache_stats_t *stats);
+
+#endif /* DISK_CACHE_H */
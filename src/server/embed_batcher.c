@@ -0,0 +1,269 @@
+#include "embed_batcher.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+typedef struct embed_item {
+    struct embed_item *next;
+    char *model;                // NULL: the configured model
+    char *text;
+    struct timespec queued;     // CLOCK_MONOTONIC
+    embed_callback_t callback;
+    void *user_data;
+} embed_item_t;
+
+struct embed_batcher {
+    llm_handle_t *llm;
+    size_t max_batch;
+    int max_wait_us;
+    bool verbose;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t arrived;
+    embed_item_t *head;
+    embed_item_t *tail;
+    size_t pending;
+    bool stopping;
+    pthread_t thread;
+
+    embed_batcher_stats_t stats;
+};
+
+static bool same_model(const char *a, const char *b) {
+    if (a == NULL || b == NULL) {
+        return a == b;
+    }
+    return strcmp(a, b) == 0;
+}
+
+static void free_item(embed_item_t *item) {
+    free(item->model);
+    free(item->text);
+    free(item);
+}
+
+// Caller holds the mutex. True once the head's batch is complete.
+static bool batch_ready(const embed_batcher_t *batcher) {
+    size_t matching = 0;
+    for (const embed_item_t *item = batcher->head; item != NULL; item = item->next) {
+        if (same_model(item->model, batcher->head->model) && ++matching >= batcher->max_batch) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Caller holds the mutex. Unlinks up to max_batch items for the head's
+// model, oldest first; texts for other models keep their places. The
+// model string stays valid throughout: the head becomes batch[0].
+static size_t take_batch(embed_batcher_t *batcher, embed_item_t **batch) {
+    const char *model = batcher->head->model;
+    embed_item_t **link = &batcher->head;
+    embed_item_t *previous = NULL;
+    size_t count = 0;
+
+    while (*link != NULL && count < batcher->max_batch) {
+        embed_item_t *item = *link;
+        if (!same_model(item->model, model)) {
+            previous = item;
+            link = &item->next;
+            continue;
+        }
+        *link = item->next;
+        item->next = NULL;
+        batch[count++] = item;
+        if (batcher->tail == item) {
+            batcher->tail = previous;
+        }
+    }
+
+    batcher->pending -= count;
+    return count;
+}
+
+static void run_batch(embed_batcher_t *batcher, embed_item_t **batch, size_t count) {
+    const char **inputs = malloc(count * sizeof(*inputs));
+    llm_embeddings_t embeddings = {0};
+    const char *error = "Out of memory";
+    bool ok = false;
+
+    if (inputs != NULL) {
+        for (size_t i = 0; i < count; i++) {
+            inputs[i] = batch[i]->text;
+        }
+        ok = llm_embed(batcher->llm, batch[0]->model, inputs, count, &embeddings, &error);
+        free(inputs);
+    }
+    if (ok && embeddings.count != count) {
+        ok = false;
+        error = "Engine returned the wrong number of embeddings";
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (ok) {
+            batch[i]->callback(embeddings.vectors + i * embeddings.dimensions, embeddings.dimensions,
+                               NULL, batch[i]->user_data);
+        } else {
+            batch[i]->callback(NULL, 0, error, batch[i]->user_data);
+        }
+        free_item(batch[i]);
+    }
+    free(embeddings.vectors);
+
+    if (!ok && batcher->verbose) {
+        printf("Embedding batch of %zu failed: %s\n", count, error);
+    }
+}
+
+static void* batcher_main(void *arg) {
+    embed_batcher_t *batcher = arg;
+    embed_item_t **batch = malloc(batcher->max_batch * sizeof(*batch));
+
+    pthread_mutex_lock(&batcher->mutex);
+    while (batch != NULL && !batcher->stopping) {
+        if (batcher->head == NULL) {
+            pthread_cond_wait(&batcher->arrived, &batcher->mutex);
+            continue;
+        }
+
+        // Give the oldest text until its wait runs out to gather company
+        if (!batch_ready(batcher)) {
+            struct timespec deadline = batcher->head->queued;
+            long nsec = deadline.tv_nsec + (long)(batcher->max_wait_us % 1000000) * 1000;
+            deadline.tv_sec += batcher->max_wait_us / 1000000 + nsec / 1000000000;
+            deadline.tv_nsec = nsec % 1000000000;
+            if (pthread_cond_timedwait(&batcher->arrived, &batcher->mutex, &deadline) == 0) {
+                continue;
+            }
+        }
+
+        size_t count = take_batch(batcher, batch);
+        batcher->stats.texts += count;
+        batcher->stats.batches++;
+        if (count > batcher->stats.largest_batch) {
+            batcher->stats.largest_batch = count;
+        }
+
+        pthread_mutex_unlock(&batcher->mutex);
+        run_batch(batcher, batch, count);
+        pthread_mutex_lock(&batcher->mutex);
+    }
+    pthread_mutex_unlock(&batcher->mutex);
+
+    free(batch);
+    return NULL;
+}
+
+embed_batcher_t* embed_batcher_create(llm_handle_t *llm, size_t max_batch, int max_wait_us, bool verbose) {
+    if (llm == NULL || max_batch == 0 || max_wait_us < 0) {
+        fprintf(stderr, "Error: Invalid embedding batcher configuration\n");
+        return NULL;
+    }
+
+    embed_batcher_t *batcher = calloc(1, sizeof(embed_batcher_t));
+    if (batcher == NULL) {
+        fprintf(stderr, "Error: Failed to allocate embedding batcher\n");
+        return NULL;
+    }
+
+    batcher->llm = llm;
+    batcher->max_batch = max_batch;
+    batcher->max_wait_us = max_wait_us;
+    batcher->verbose = verbose;
+
+    pthread_mutex_init(&batcher->mutex, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&batcher->arrived, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&batcher->thread, NULL, batcher_main, batcher) != 0) {
+        fprintf(stderr, "Error: Failed to create embedding batcher thread\n");
+        pthread_cond_destroy(&batcher->arrived);
+        pthread_mutex_destroy(&batcher->mutex);
+        free(batcher);
+        return NULL;
+    }
+
+    return batcher;
+}
+
+void embed_batcher_destroy(embed_batcher_t *batcher) {
+    if (batcher == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&batcher->mutex);
+    batcher->stopping = true;
+    pthread_cond_signal(&batcher->arrived);
+    pthread_mutex_unlock(&batcher->mutex);
+    pthread_join(batcher->thread, NULL);
+
+    // The thread is gone; nothing else touches the queue now
+    embed_item_t *item = batcher->head;
+    while (item != NULL) {
+        embed_item_t *next = item->next;
+        item->callback(NULL, 0, "Server is shutting down", item->user_data);
+        free_item(item);
+        item = next;
+    }
+
+    if (batcher->verbose && batcher->stats.batches > 0) {
+        printf("Embedded %llu texts in %llu batches (largest %zu)\n",
+               (unsigned long long)batcher->stats.texts,
+               (unsigned long long)batcher->stats.batches,
+               batcher->stats.largest_batch);
+    }
+
+    pthread_cond_destroy(&batcher->arrived);
+    pthread_mutex_destroy(&batcher->mutex);
+    free(batcher);
+}
+
+bool embed_batcher_submit(embed_batcher_t *batcher, const char *model, const char *text, size_t length,
+                          embed_callback_t callback, void *user_data) {
+    embed_item_t *item = calloc(1, sizeof(embed_item_t));
+    if (item == NULL) {
+        return false;
+    }
+
+    item->text = malloc(length + 1);
+    item->model = model ? strdup(model) : NULL;
+    if (item->text == NULL || (model != NULL && item->model == NULL)) {
+        free_item(item);
+        return false;
+    }
+    memcpy(item->text, text, length);
+    item->text[length] = '\0';
+    item->callback = callback;
+    item->user_data = user_data;
+    clock_gettime(CLOCK_MONOTONIC, &item->queued);
+
+    pthread_mutex_lock(&batcher->mutex);
+    if (batcher->stopping || batcher->pending >= EMBED_BATCHER_MAX_PENDING) {
+        pthread_mutex_unlock(&batcher->mutex);
+        free_item(item);
+        return false;
+    }
+
+    if (batcher->tail != NULL) {
+        batcher->tail->next = item;
+    } else {
+        batcher->head = item;
+    }
+    batcher->tail = item;
+    batcher->pending++;
+
+    pthread_cond_signal(&batcher->arrived);
+    pthread_mutex_unlock(&batcher->mutex);
+    return true;
+}
+
+void embed_batcher_get_stats(embed_batcher_t *batcher, embed_batcher_stats_t *stats) {
+    pthread_mutex_lock(&batcher->mutex);
+    *stats = batcher->stats;
+    pthread_mutex_unlock(&batcher->mutex);
+}
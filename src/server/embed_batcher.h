@@ -0,0 +1,45 @@
+#ifndef EMBED_BATCHER_H
+#define EMBED_BATCHER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "llm_interface.h"
+
+// Texts waiting to be embedded before new ones are turned away
+#define EMBED_BATCHER_MAX_PENDING 4096
+
+// Micro-batching of embedding requests
+//
+// Texts that arrive close together go to the engine as one call with an
+// array of inputs. A batch is sent once it holds max_batch texts, or once
+// its oldest text has waited max_wait_us. One batch is in flight at a
+// time; the texts that arrive meanwhile make up the next one, so batches
+// grow by themselves under load.
+
+typedef struct embed_batcher embed_batcher_t;
+
+// Called once per text, on the batcher thread (or in destroy): the vector,
+// valid during the call, on success; otherwise NULL and the reason
+typedef void (*embed_callback_t)(const float *vector, size_t dimensions, const char *error, void *user_data);
+
+embed_batcher_t* embed_batcher_create(llm_handle_t *llm, size_t max_batch, int max_wait_us, bool verbose);
+
+// Texts still queued are answered with an error
+void embed_batcher_destroy(embed_batcher_t *batcher);
+
+// Queue a copy of the text for the model (NULL for the default one).
+// Texts for different models never share a batch. Returns false if the
+// queue is full; the callback is not called then.
+bool embed_batcher_submit(embed_batcher_t *batcher, const char *model, const char *text, size_t length,
+                          embed_callback_t callback, void *user_data);
+
+typedef struct {
+    uint64_t texts;
+    uint64_t batches;
+    size_t largest_batch;
+} embed_batcher_stats_t;
+
+void embed_batcher_get_stats(embed_batcher_t *batcher, embed_batcher_stats_t *stats);
+
+#endif /* EMBED_BATCHER_H */
@@ -0,0 +1,401 @@
+#include "event_loop.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+// One registration per fd; epoll hands the pointer back in data.ptr
+typedef struct event_watcher {
+    int fd;
+    bool removed;
+    event_callback_t callback;
+    void *user_data;
+    struct event_watcher *next_free;
+} event_watcher_t;
+
+struct event_timer {
+    int64_t deadline_ms;
+    size_t index;               // position in the heap
+    event_timer_callback_t callback;
+    void *user_data;
+};
+
+struct event_loop {
+    int epoll_fd;
+    int wakeup_fd;
+    volatile bool running;
+    int max_events;
+    struct epoll_event *events;
+
+    // fd -> watcher table, grown on demand
+    pthread_mutex_t watchers_mutex;
+    event_watcher_t **watchers;
+    int watchers_capacity;
+
+    // Watchers removed during a dispatch round are freed after it,
+    // since the current epoll batch may still reference them
+    event_watcher_t *free_list;
+
+    // Pending timers, a binary min-heap on deadline
+    event_timer_t **timers;
+    size_t timer_count;
+    size_t timer_capacity;
+};
+
+static int64_t monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static uint32_t to_epoll_events(uint32_t events) {
+    uint32_t result = EPOLLET | EPOLLRDHUP;
+    if (events & EVENT_READ) result |= EPOLLIN;
+    if (events & EVENT_WRITE) result |= EPOLLOUT;
+    return result;
+}
+
+static uint32_t from_epoll_events(uint32_t events) {
+    uint32_t result = 0;
+    if (events & (EPOLLIN | EPOLLRDHUP)) result |= EVENT_READ;
+    if (events & EPOLLOUT) result |= EVENT_WRITE;
+    if (events & (EPOLLERR | EPOLLHUP)) result |= EVENT_ERROR | EVENT_READ;
+    return result;
+}
+
+event_loop_t* event_loop_create(int max_events) {
+    event_loop_t *loop = calloc(1, sizeof(event_loop_t));
+    if (loop == NULL) {
+        fprintf(stderr, "Error: Failed to allocate event loop\n");
+        return NULL;
+    }
+
+    loop->max_events = max_events > 0 ? max_events : 256;
+    loop->events = calloc(loop->max_events, sizeof(struct epoll_event));
+    pthread_mutex_init(&loop->watchers_mutex, NULL);
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    loop->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->events == NULL || loop->epoll_fd < 0 || loop->wakeup_fd < 0) {
+        fprintf(stderr, "Error: Failed to create event loop: %s\n", strerror(errno));
+        event_loop_destroy(loop);
+        return NULL;
+    }
+
+    // The wakeup eventfd is level-triggered and identified by a NULL pointer
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wakeup_fd, &ev) < 0) {
+        fprintf(stderr, "Error: Failed to register wakeup fd: %s\n", strerror(errno));
+        event_loop_destroy(loop);
+        return NULL;
+    }
+
+    return loop;
+}
+
+static void free_removed_watchers(event_loop_t *loop) {
+    pthread_mutex_lock(&loop->watchers_mutex);
+    event_watcher_t *watcher = loop->free_list;
+    loop->free_list = NULL;
+    pthread_mutex_unlock(&loop->watchers_mutex);
+
+    while (watcher) {
+        event_watcher_t *next = watcher->next_free;
+        free(watcher);
+        watcher = next;
+    }
+}
+
+void event_loop_destroy(event_loop_t *loop) {
+    if (loop == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < loop->watchers_capacity; i++) {
+        free(loop->watchers[i]);
+    }
+    free(loop->watchers);
+    free_removed_watchers(loop);
+
+    for (size_t i = 0; i < loop->timer_count; i++) {
+        free(loop->timers[i]);
+    }
+    free(loop->timers);
+
+    if (loop->epoll_fd >= 0) close(loop->epoll_fd);
+    if (loop->wakeup_fd >= 0) close(loop->wakeup_fd);
+    pthread_mutex_destroy(&loop->watchers_mutex);
+    free(loop->events);
+    free(loop);
+}
+
+static void swap_timers(event_loop_t *loop, size_t a, size_t b) {
+    event_timer_t *timer = loop->timers[a];
+    loop->timers[a] = loop->timers[b];
+    loop->timers[b] = timer;
+    loop->timers[a]->index = a;
+    loop->timers[b]->index = b;
+}
+
+static void sift_up(event_loop_t *loop, size_t index) {
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (loop->timers[parent]->deadline_ms <= loop->timers[index]->deadline_ms) {
+            break;
+        }
+        swap_timers(loop, parent, index);
+        index = parent;
+    }
+}
+
+static void sift_down(event_loop_t *loop, size_t index) {
+    for (;;) {
+        size_t smallest = index;
+        size_t left = 2 * index + 1;
+        size_t right = left + 1;
+        if (left < loop->timer_count && loop->timers[left]->deadline_ms < loop->timers[smallest]->deadline_ms) {
+            smallest = left;
+        }
+        if (right < loop->timer_count && loop->timers[right]->deadline_ms < loop->timers[smallest]->deadline_ms) {
+            smallest = right;
+        }
+        if (smallest == index) {
+            return;
+        }
+        swap_timers(loop, index, smallest);
+        index = smallest;
+    }
+}
+
+// Take a timer out of the heap without freeing it
+static void unlink_timer(event_loop_t *loop, event_timer_t *timer) {
+    size_t index = timer->index;
+    loop->timer_count--;
+    if (index == loop->timer_count) {
+        return;
+    }
+    loop->timers[index] = loop->timers[loop->timer_count];
+    loop->timers[index]->index = index;
+    sift_down(loop, index);
+    sift_up(loop, index);
+}
+
+// Fire every timer whose deadline has passed, including ones that
+// their predecessors' callbacks added already expired
+static void run_due_timers(event_loop_t *loop) {
+    int64_t now = monotonic_ms();
+    while (loop->timer_count > 0 && loop->timers[0]->deadline_ms <= now) {
+        event_timer_t *timer = loop->timers[0];
+        unlink_timer(loop, timer);
+        timer->callback(loop, timer->user_data);
+        free(timer);
+    }
+}
+
+bool event_loop_run_once(event_loop_t *loop, int timeout_ms) {
+    // Sleep no longer than the nearest timer allows
+    if (loop->timer_count > 0) {
+        int64_t wait = loop->timers[0]->deadline_ms - monotonic_ms();
+        if (wait < 0) {
+            wait = 0;
+        }
+        if (timeout_ms < 0 || wait < timeout_ms) {
+            timeout_ms = (int)wait;
+        }
+    }
+
+    int count = epoll_wait(loop->epoll_fd, loop->events, loop->max_events, timeout_ms);
+    if (count < 0) {
+        if (errno == EINTR) {
+            return true;
+        }
+        fprintf(stderr, "Error: epoll_wait failed: %s\n", strerror(errno));
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        event_watcher_t *watcher = loop->events[i].data.ptr;
+
+        if (watcher == NULL) {
+            // Drain the wakeup counter; the running flag says why we woke
+            uint64_t value;
+            while (read(loop->wakeup_fd, &value, sizeof(value)) > 0) {
+            }
+            continue;
+        }
+
+        if (watcher->removed) {
+            continue;
+        }
+
+        watcher->callback(loop, watcher->fd, from_epoll_events(loop->events[i].events),
+                          watcher->user_data);
+    }
+
+    run_due_timers(loop);
+    free_removed_watchers(loop);
+    return true;
+}
+
+bool event_loop_run(event_loop_t *loop) {
+    loop->running = true;
+
+    while (loop->running) {
+        if (!event_loop_run_once(loop, -1)) {
+            loop->running = false;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void event_loop_stop(event_loop_t *loop) {
+    if (loop == NULL) {
+        return;
+    }
+
+    loop->running = false;
+
+    // write() is async-signal-safe, so this may run inside a signal handler
+    uint64_t one = 1;
+    ssize_t ignored = write(loop->wakeup_fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+static bool ensure_watcher_capacity(event_loop_t *loop, int fd) {
+    if (fd < loop->watchers_capacity) {
+        return true;
+    }
+
+    int new_capacity = loop->watchers_capacity > 0 ? loop->watchers_capacity : 64;
+    while (new_capacity <= fd) {
+        new_capacity *= 2;
+    }
+
+    event_watcher_t **new_watchers = realloc(loop->watchers, new_capacity * sizeof(event_watcher_t *));
+    if (new_watchers == NULL) {
+        return false;
+    }
+
+    memset(new_watchers + loop->watchers_capacity, 0,
+           (new_capacity - loop->watchers_capacity) * sizeof(event_watcher_t *));
+    loop->watchers = new_watchers;
+    loop->watchers_capacity = new_capacity;
+    return true;
+}
+
+bool event_loop_add(event_loop_t *loop, int fd, uint32_t events,
+                    event_callback_t callback, void *user_data) {
+    if (loop == NULL || fd < 0 || callback == NULL) {
+        return false;
+    }
+
+    event_watcher_t *watcher = calloc(1, sizeof(event_watcher_t));
+    if (watcher == NULL) {
+        fprintf(stderr, "Error: Failed to allocate event watcher\n");
+        return false;
+    }
+    watcher->fd = fd;
+    watcher->callback = callback;
+    watcher->user_data = user_data;
+
+    pthread_mutex_lock(&loop->watchers_mutex);
+    if (!ensure_watcher_capacity(loop, fd) || loop->watchers[fd] != NULL) {
+        pthread_mutex_unlock(&loop->watchers_mutex);
+        fprintf(stderr, "Error: Cannot register fd %d with event loop\n", fd);
+        free(watcher);
+        return false;
+    }
+
+    struct epoll_event ev = { .events = to_epoll_events(events), .data.ptr = watcher };
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        pthread_mutex_unlock(&loop->watchers_mutex);
+        fprintf(stderr, "Error: epoll_ctl add failed for fd %d: %s\n", fd, strerror(errno));
+        free(watcher);
+        return false;
+    }
+
+    loop->watchers[fd] = watcher;
+    pthread_mutex_unlock(&loop->watchers_mutex);
+    return true;
+}
+
+void event_loop_remove(event_loop_t *loop, int fd) {
+    if (loop == NULL || fd < 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&loop->watchers_mutex);
+    if (fd < loop->watchers_capacity && loop->watchers[fd] != NULL) {
+        event_watcher_t *watcher = loop->watchers[fd];
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        watcher->removed = true;
+        watcher->next_free = loop->free_list;
+        loop->free_list = watcher;
+        loop->watchers[fd] = NULL;
+    }
+    pthread_mutex_unlock(&loop->watchers_mutex);
+}
+
+bool event_loop_rearm(event_loop_t *loop, int fd, uint32_t events) {
+    if (loop == NULL || fd < 0) {
+        return false;
+    }
+
+    // Modifying an edge-triggered registration re-checks readiness
+    bool ok = false;
+    pthread_mutex_lock(&loop->watchers_mutex);
+    if (fd < loop->watchers_capacity && loop->watchers[fd] != NULL) {
+        struct epoll_event ev = { .events = to_epoll_events(events), .data.ptr = loop->watchers[fd] };
+        ok = epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, fd, &ev) == 0;
+    }
+    pthread_mutex_unlock(&loop->watchers_mutex);
+    return ok;
+}
+
+event_timer_t* event_loop_add_timer(event_loop_t *loop, int64_t deadline_ms,
+                                    event_timer_callback_t callback, void *user_data) {
+    if (loop == NULL || callback == NULL) {
+        return NULL;
+    }
+
+    if (loop->timer_count == loop->timer_capacity) {
+        size_t new_capacity = loop->timer_capacity ? loop->timer_capacity * 2 : 64;
+        event_timer_t **new_timers = realloc(loop->timers, new_capacity * sizeof(event_timer_t *));
+        if (new_timers == NULL) {
+            fprintf(stderr, "Error: Failed to grow timer heap\n");
+            return NULL;
+        }
+        loop->timers = new_timers;
+        loop->timer_capacity = new_capacity;
+    }
+
+    event_timer_t *timer = malloc(sizeof(event_timer_t));
+    if (timer == NULL) {
+        fprintf(stderr, "Error: Failed to allocate timer\n");
+        return NULL;
+    }
+    timer->deadline_ms = deadline_ms;
+    timer->callback = callback;
+    timer->user_data = user_data;
+    timer->index = loop->timer_count;
+
+    loop->timers[loop->timer_count++] = timer;
+    sift_up(loop, timer->index);
+    return timer;
+}
+
+void event_loop_cancel_timer(event_loop_t *loop, event_timer_t *timer) {
+    if (loop == NULL || timer == NULL) {
+        return;
+    }
+
+    unlink_timer(loop, timer);
+    free(timer);
+}
@@ -0,0 +1,53 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Readiness flags passed to event callbacks
+#define EVENT_READ   0x01
+#define EVENT_WRITE  0x02
+#define EVENT_ERROR  0x04
+
+typedef struct event_loop event_loop_t;
+
+// Called on the loop thread whenever a registered fd becomes ready.
+// Registrations are edge-triggered: the callback must drain the fd
+// (read/write until EAGAIN) or it will not be woken again.
+typedef void (*event_callback_t)(event_loop_t *loop, int fd, uint32_t events, void *user_data);
+
+// One-shot timer, called on the loop thread once its deadline passes
+typedef struct event_timer event_timer_t;
+typedef void (*event_timer_callback_t)(event_loop_t *loop, void *user_data);
+
+// Event loop lifecycle
+event_loop_t* event_loop_create(int max_events);
+void event_loop_destroy(event_loop_t *loop);
+
+// Run until event_loop_stop() is called. Returns false on a fatal epoll error.
+bool event_loop_run(event_loop_t *loop);
+
+// Wait at most timeout_ms (-1 = until something happens) and dispatch
+// one round of ready fds and due timers. Returns false on a fatal epoll error.
+bool event_loop_run_once(event_loop_t *loop, int timeout_ms);
+
+// Safe to call from any thread and from signal handlers
+void event_loop_stop(event_loop_t *loop);
+
+// File descriptor registration (fds must already be non-blocking)
+bool event_loop_add(event_loop_t *loop, int fd, uint32_t events,
+                    event_callback_t callback, void *user_data);
+void event_loop_remove(event_loop_t *loop, int fd);
+
+// Have an fd reported again if it is still ready, for a callback that
+// stopped before draining it
+bool event_loop_rearm(event_loop_t *loop, int fd, uint32_t events);
+
+// Timers, on the loop thread only. deadline_ms is CLOCK_MONOTONIC
+// milliseconds. A timer is freed once it fires or is cancelled, so the
+// caller must forget it in its callback.
+event_timer_t* event_loop_add_timer(event_loop_t *loop, int64_t deadline_ms,
+                                    event_timer_callback_t callback, void *user_data);
+void event_loop_cancel_timer(event_loop_t *loop, event_timer_t *timer);
+
+#endif /* EVENT_LOOP_H */
@@ -0,0 +1,299 @@
+#define _GNU_SOURCE
+#include "http_parser.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+
+void http_parser_init(http_parser_t *parser) {
+    parser->state = HTTP_STATE_STATUS_LINE;
+    parser->status_code = 0;
+    parser->version_minor = 1;
+    parser->chunked = false;
+    parser->keep_alive = true;
+    parser->content_length = -1;
+    parser->remaining = 0;
+    parser->body_received = 0;
+    parser->line_length = 0;
+    parser->error = NULL;
+}
+
+static bool fail(http_parser_t *parser, const char *error) {
+    parser->state = HTTP_STATE_ERROR;
+    parser->error = error;
+    return false;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// "HTTP/1.1 200 OK"
+static bool parse_status_line(http_parser_t *parser, const char *line) {
+    if (strncmp(line, "HTTP/1.", 7) != 0 || !isdigit((unsigned char)line[7]) || line[8] != ' ' ||
+        !isdigit((unsigned char)line[9]) || !isdigit((unsigned char)line[10]) ||
+        !isdigit((unsigned char)line[11])) {
+        return fail(parser, "Malformed HTTP status line");
+    }
+
+    parser->version_minor = line[7] - '0';
+    parser->status_code = (line[9] - '0') * 100 + (line[10] - '0') * 10 + (line[11] - '0');
+    parser->keep_alive = parser->version_minor >= 1;
+    return true;
+}
+
+static bool parse_header_line(http_parser_t *parser, char *line) {
+    char *colon = strchr(line, ':');
+    if (colon == NULL) {
+        return fail(parser, "Malformed HTTP header");
+    }
+    *colon = '\0';
+
+    char *value = colon + 1;
+    while (*value == ' ' || *value == '\t') {
+        value++;
+    }
+
+    if (strcasecmp(line, "Content-Length") == 0) {
+        char *end;
+        errno = 0;
+        long long length = strtoll(value, &end, 10);
+        if (errno != 0 || end == value || length < 0) {
+            return fail(parser, "Invalid Content-Length");
+        }
+        parser->content_length = length;
+    } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+        parser->chunked = strcasestr(value, "chunked") != NULL;
+    } else if (strcasecmp(line, "Connection") == 0) {
+        if (strcasestr(value, "close") != NULL) {
+            parser->keep_alive = false;
+        } else if (strcasestr(value, "keep-alive") != NULL) {
+            parser->keep_alive = true;
+        }
+    }
+    return true;
+}
+
+// Decide how the body is delimited once the blank line after the headers arrives
+static void start_body(http_parser_t *parser) {
+    if (parser->status_code >= 100 && parser->status_code < 200) {
+        // Interim response (e.g. 100 Continue); the real one follows
+        int version_minor = parser->version_minor;
+        http_parser_init(parser);
+        parser->version_minor = version_minor;
+        return;
+    }
+
+    if (parser->status_code == 204 || parser->status_code == 304) {
+        parser->state = HTTP_STATE_COMPLETE;
+    } else if (parser->chunked) {
+        // Chunked framing overrides any Content-Length
+        parser->remaining = 0;
+        parser->line_length = 0;
+        parser->state = HTTP_STATE_CHUNK_SIZE;
+    } else if (parser->content_length >= 0) {
+        parser->remaining = (uint64_t)parser->content_length;
+        parser->state = parser->remaining > 0 ? HTTP_STATE_BODY_IDENTITY : HTTP_STATE_COMPLETE;
+    } else {
+        parser->keep_alive = false;
+        parser->state = HTTP_STATE_BODY_UNTIL_EOF;
+    }
+}
+
+// Collect one CRLF-terminated line. Returns true with the line (minus CRLF)
+// in parser->line once it is complete.
+static bool collect_line(http_parser_t *parser, char c) {
+    if (c == '\n') {
+        if (parser->line_length > 0 && parser->line[parser->line_length - 1] == '\r') {
+            parser->line_length--;
+        }
+        parser->line[parser->line_length] = '\0';
+        return true;
+    }
+
+    if (parser->line_length >= HTTP_PARSER_MAX_LINE - 1) {
+        fail(parser, "HTTP header line too long");
+        return false;
+    }
+    parser->line[parser->line_length++] = c;
+    return false;
+}
+
+// Hand a run of body bytes straight from the input to the caller
+static bool deliver(http_parser_t *parser, const char *data, size_t length,
+                    http_body_callback_t on_body, void *user_data) {
+    parser->body_received += length;
+    return on_body == NULL || on_body(data, length, user_data);
+}
+
+long http_parser_feed(http_parser_t *parser, const char *data, size_t length,
+                      http_body_callback_t on_body, void *user_data) {
+    size_t i = 0;
+
+    while (i < length) {
+        char c = data[i];
+
+        switch (parser->state) {
+            case HTTP_STATE_STATUS_LINE:
+            case HTTP_STATE_HEADER_LINE:
+            case HTTP_STATE_TRAILER_LINE:
+                i++;
+                if (!collect_line(parser, c)) {
+                    if (parser->state == HTTP_STATE_ERROR) {
+                        return -1;
+                    }
+                    break;
+                }
+
+                if (parser->state == HTTP_STATE_STATUS_LINE) {
+                    if (!parse_status_line(parser, parser->line)) {
+                        return -1;
+                    }
+                    parser->state = HTTP_STATE_HEADER_LINE;
+                } else if (parser->line_length == 0) {
+                    if (parser->state == HTTP_STATE_TRAILER_LINE) {
+                        parser->state = HTTP_STATE_COMPLETE;
+                        return (long)i;
+                    }
+                    start_body(parser);
+                    if (parser->state == HTTP_STATE_COMPLETE) {
+                        return (long)i;
+                    }
+                } else if (parser->state == HTTP_STATE_HEADER_LINE &&
+                           !parse_header_line(parser, parser->line)) {
+                    return -1;
+                }
+                parser->line_length = 0;
+                break;
+
+            case HTTP_STATE_BODY_IDENTITY:
+            case HTTP_STATE_CHUNK_DATA: {
+                size_t run = length - i;
+                if (run > parser->remaining) {
+                    run = (size_t)parser->remaining;
+                }
+                parser->remaining -= run;
+                bool keep_going = deliver(parser, data + i, run, on_body, user_data);
+                i += run;
+
+                if (parser->remaining == 0) {
+                    if (parser->state == HTTP_STATE_CHUNK_DATA) {
+                        parser->state = HTTP_STATE_CHUNK_DATA_CR;
+                    } else {
+                        parser->state = HTTP_STATE_COMPLETE;
+                        return (long)i;
+                    }
+                }
+                if (!keep_going) {
+                    return (long)i;
+                }
+                break;
+            }
+
+            case HTTP_STATE_BODY_UNTIL_EOF: {
+                size_t run = length - i;
+                bool keep_going = deliver(parser, data + i, run, on_body, user_data);
+                i += run;
+                if (!keep_going) {
+                    return (long)i;
+                }
+                break;
+            }
+
+            case HTTP_STATE_CHUNK_SIZE: {
+                int digit = hex_value(c);
+                i++;
+                if (digit >= 0) {
+                    if (parser->remaining > (UINT64_MAX >> 4)) {
+                        fail(parser, "Chunk size too large");
+                        return -1;
+                    }
+                    parser->remaining = (parser->remaining << 4) | (uint64_t)digit;
+                    parser->line_length++;
+                    break;
+                }
+                if (parser->line_length == 0) {
+                    fail(parser, "Missing chunk size");
+                    return -1;
+                }
+                if (c == ';' || c == ' ' || c == '\t') {
+                    parser->state = HTTP_STATE_CHUNK_EXTENSION;
+                } else if (c == '\r') {
+                    parser->state = HTTP_STATE_CHUNK_SIZE_LF;
+                } else if (c == '\n') {
+                    parser->state = HTTP_STATE_CHUNK_SIZE_LF;
+                    i--;    // let the LF state see it
+                } else {
+                    fail(parser, "Invalid chunk size");
+                    return -1;
+                }
+                break;
+            }
+
+            case HTTP_STATE_CHUNK_EXTENSION:
+                // Extensions carry nothing we use; skip to the end of the line
+                i++;
+                if (c == '\n') {
+                    i--;
+                    parser->state = HTTP_STATE_CHUNK_SIZE_LF;
+                }
+                break;
+
+            case HTTP_STATE_CHUNK_SIZE_LF:
+                i++;
+                if (c != '\n') {
+                    fail(parser, "Invalid chunk size line");
+                    return -1;
+                }
+                parser->line_length = 0;
+                parser->state = parser->remaining > 0 ? HTTP_STATE_CHUNK_DATA : HTTP_STATE_TRAILER_LINE;
+                break;
+
+            case HTTP_STATE_CHUNK_DATA_CR:
+                i++;
+                if (c == '\r') {
+                    parser->state = HTTP_STATE_CHUNK_DATA_LF;
+                } else if (c == '\n') {
+                    parser->state = HTTP_STATE_CHUNK_SIZE;
+                } else {
+                    fail(parser, "Missing CRLF after chunk data");
+                    return -1;
+                }
+                break;
+
+            case HTTP_STATE_CHUNK_DATA_LF:
+                i++;
+                if (c != '\n') {
+                    fail(parser, "Missing CRLF after chunk data");
+                    return -1;
+                }
+                parser->state = HTTP_STATE_CHUNK_SIZE;
+                break;
+
+            case HTTP_STATE_COMPLETE:
+                return (long)i;
+
+            case HTTP_STATE_ERROR:
+                return -1;
+        }
+    }
+
+    return (long)i;
+}
+
+bool http_parser_finish(http_parser_t *parser) {
+    if (parser->state == HTTP_STATE_BODY_UNTIL_EOF) {
+        parser->state = HTTP_STATE_COMPLETE;
+        return true;
+    }
+
+    if (parser->state != HTTP_STATE_COMPLETE) {
+        fail(parser, "Connection closed before the response was complete");
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest status or header line we accept
+#define HTTP_PARSER_MAX_LINE 8192
+
+typedef enum {
+    HTTP_STATE_STATUS_LINE,
+    HTTP_STATE_HEADER_LINE,
+    HTTP_STATE_BODY_IDENTITY,   // Content-Length body
+    HTTP_STATE_BODY_UNTIL_EOF,  // no length given, body ends when the peer closes
+    HTTP_STATE_CHUNK_SIZE,
+    HTTP_STATE_CHUNK_EXTENSION,
+    HTTP_STATE_CHUNK_SIZE_LF,
+    HTTP_STATE_CHUNK_DATA,
+    HTTP_STATE_CHUNK_DATA_CR,
+    HTTP_STATE_CHUNK_DATA_LF,
+    HTTP_STATE_TRAILER_LINE,
+    HTTP_STATE_COMPLETE,
+    HTTP_STATE_ERROR
+} http_parser_state_t;
+
+// Receives decoded body bytes. The pointer refers into the buffer that
+// was passed to http_parser_feed() and is only valid during the call.
+// Return false to stop parsing.
+typedef bool (*http_body_callback_t)(const char *data, size_t length, void *user_data);
+
+// Incremental HTTP/1.1 response parser
+//
+// Bytes can be fed at arbitrary boundaries; every byte is examined once.
+// Status and header lines are assembled in a small fixed buffer, body
+// bytes are handed to the callback in place with chunk framing removed.
+typedef struct {
+    http_parser_state_t state;
+
+    int status_code;
+    int version_minor;
+    bool chunked;
+    bool keep_alive;
+    int64_t content_length;     // -1 when not given
+    uint64_t remaining;         // body or chunk bytes still expected
+    uint64_t body_received;     // decoded body bytes delivered so far
+
+    char line[HTTP_PARSER_MAX_LINE];
+    size_t line_length;
+    const char *error;
+} http_parser_t;
+
+// Prepare for a new response
+void http_parser_init(http_parser_t *parser);
+
+// Feed received bytes. Returns the number consumed, which is less than
+// `length` only when the response completed (any remainder belongs to
+// the next response) or the callback asked to stop. Returns -1 on a
+// protocol error, with parser->error describing it.
+long http_parser_feed(http_parser_t *parser, const char *data, size_t length,
+                      http_body_callback_t on_body, void *user_data);
+
+// Tell the parser the peer closed the connection. Returns true if that
+// ends the response cleanly (the body was delimited by EOF).
+bool http_parser_finish(http_parser_t *parser);
+
+static inline bool http_parser_headers_done(const http_parser_t *parser) {
+    return parser->state > HTTP_STATE_HEADER_LINE;
+}
+
+static inline bool http_parser_complete(const http_parser_t *parser) {
+    return parser->state == HTTP_STATE_COMPLETE;
+}
+
+#endif /* HTTP_PARSER_H */
@@ -0,0 +1,240 @@
+#include "inflight.h"
+#include "llm_interface.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// Running flights are bounded by the job queue, so the table never grows
+#define INFLIGHT_BUCKETS 256
+
+typedef struct {
+    client_connection_t *client;
+    uint32_t request_id;
+} subscriber_t;
+
+struct flight {
+    response_cache_key_t key;
+    bool listed;                // reachable through the table; guarded by the table mutex
+    struct flight *next;
+
+    pthread_mutex_t mutex;
+    char *text;                 // output so far, replayed to late subscribers
+    size_t text_length;
+    size_t text_capacity;
+    bool truncated;             // ran out of memory, so the backlog is incomplete
+    subscriber_t *subscribers;
+    size_t subscriber_count;
+    size_t subscriber_capacity;
+};
+
+struct inflight_table {
+    pthread_mutex_t mutex;
+    flight_t *buckets[INFLIGHT_BUCKETS];
+    uint64_t joined;
+};
+
+inflight_table_t* inflight_create(void) {
+    inflight_table_t *table = calloc(1, sizeof(inflight_table_t));
+    if (table == NULL) {
+        fprintf(stderr, "Error: Failed to allocate in-flight table\n");
+        return NULL;
+    }
+    pthread_mutex_init(&table->mutex, NULL);
+    return table;
+}
+
+void inflight_destroy(inflight_table_t *table) {
+    if (table == NULL) {
+        return;
+    }
+
+    // Flights belong to their leaders, which have all finished by now
+    pthread_mutex_destroy(&table->mutex);
+    free(table);
+}
+
+static flight_t** find_slot(inflight_table_t *table, const response_cache_key_t *key) {
+    flight_t **slot = &table->buckets[key->hash % INFLIGHT_BUCKETS];
+    while (*slot && !((*slot)->key.hash == key->hash && (*slot)->key.length == key->length &&
+                      memcmp((*slot)->key.data, key->data, key->length) == 0)) {
+        slot = &(*slot)->next;
+    }
+    return slot;
+}
+
+static void unlist(inflight_table_t *table, flight_t *flight) {
+    if (flight->listed) {
+        flight_t **slot = find_slot(table, &flight->key);
+        *slot = flight->next;
+        flight->listed = false;
+    }
+}
+
+static flight_t* flight_create(const response_cache_key_t *key) {
+    flight_t *flight = calloc(1, sizeof(flight_t));
+    if (flight == NULL) {
+        return NULL;
+    }
+
+    flight->key.data = malloc(key->length);
+    if (flight->key.data == NULL) {
+        free(flight);
+        return NULL;
+    }
+    memcpy(flight->key.data, key->data, key->length);
+    flight->key.length = key->length;
+    flight->key.hash = key->hash;
+    pthread_mutex_init(&flight->mutex, NULL);
+    return flight;
+}
+
+static bool add_subscriber(flight_t *flight, client_connection_t *client, uint32_t request_id) {
+    if (flight->subscriber_count == flight->subscriber_capacity) {
+        size_t new_capacity = flight->subscriber_capacity ? flight->subscriber_capacity * 2 : 4;
+        subscriber_t *new_subscribers = realloc(flight->subscribers, new_capacity * sizeof(subscriber_t));
+        if (new_subscribers == NULL) {
+            return false;
+        }
+        flight->subscribers = new_subscribers;
+        flight->subscriber_capacity = new_capacity;
+    }
+
+    connection_retain(client);
+    flight->subscribers[flight->subscriber_count].client = client;
+    flight->subscribers[flight->subscriber_count].request_id = request_id;
+    flight->subscriber_count++;
+    return true;
+}
+
+bool inflight_join(inflight_table_t *table, const response_cache_key_t *key,
+                   client_connection_t *client, uint32_t request_id, flight_t **led) {
+    *led = NULL;
+
+    pthread_mutex_lock(&table->mutex);
+    flight_t **slot = find_slot(table, key);
+    flight_t *flight = *slot;
+
+    if (flight == NULL) {
+        flight = flight_create(key);
+        if (flight != NULL) {
+            flight->listed = true;
+            *slot = flight;
+        }
+        pthread_mutex_unlock(&table->mutex);
+        *led = flight;
+        return false;
+    }
+
+    // Catch the subscriber up under the flight lock, so no token published
+    // meanwhile can overtake the backlog
+    pthread_mutex_lock(&flight->mutex);
+    bool joined = !flight->truncated && add_subscriber(flight, client, request_id);
+    if (joined) {
+        table->joined++;
+        if (flight->text_length > 0) {
+            connection_send_text(client, request_id, flight->text, flight->text_length);
+        }
+    }
+    pthread_mutex_unlock(&flight->mutex);
+    pthread_mutex_unlock(&table->mutex);
+
+    return joined;
+}
+
+bool flight_publish(flight_t *flight, const char *token, size_t length) {
+    bool listening = false;
+
+    pthread_mutex_lock(&flight->mutex);
+
+    if (flight->text_length + length > flight->text_capacity) {
+        size_t new_capacity = flight->text_capacity ? flight->text_capacity * 2 : 4096;
+        while (new_capacity < flight->text_length + length) {
+            new_capacity *= 2;
+        }
+        char *new_text = realloc(flight->text, new_capacity);
+        if (new_text != NULL) {
+            flight->text = new_text;
+            flight->text_capacity = new_capacity;
+        }
+    }
+    if (flight->text_length + length <= flight->text_capacity) {
+        memcpy(flight->text + flight->text_length, token, length);
+        flight->text_length += length;
+    } else {
+        flight->truncated = true;
+    }
+
+    for (size_t i = 0; i < flight->subscriber_count; i++) {
+        subscriber_t *subscriber = &flight->subscribers[i];
+        if (connection_send_message(subscriber->client, MSG_TOKEN, subscriber->request_id, token, length) >= 0) {
+            listening = true;
+        }
+    }
+
+    pthread_mutex_unlock(&flight->mutex);
+    return listening;
+}
+
+bool flight_abandon(inflight_table_t *table, flight_t *flight) {
+    pthread_mutex_lock(&table->mutex);
+    pthread_mutex_lock(&flight->mutex);
+
+    bool abandoned = true;
+    for (size_t i = 0; i < flight->subscriber_count; i++) {
+        if (atomic_load(&flight->subscribers[i].client->active)) {
+            abandoned = false;
+            break;
+        }
+    }
+    if (abandoned) {
+        unlist(table, flight);
+    }
+
+    pthread_mutex_unlock(&flight->mutex);
+    pthread_mutex_unlock(&table->mutex);
+    return abandoned;
+}
+
+void flight_finish(inflight_table_t *table, flight_t *flight, const generation_stats_t *stats,
+                   const char *error) {
+    pthread_mutex_lock(&table->mutex);
+    unlist(table, flight);
+    pthread_mutex_unlock(&table->mutex);
+
+    // Subscribers see the same frames as the leader's own client
+    uint8_t payload[GENERATION_STATS_SIZE];
+    if (error == NULL && stats != NULL) {
+        generation_stats_encode(payload, stats);
+    }
+
+    // Unlisted, so nobody else can reach the flight any more
+    for (size_t i = 0; i < flight->subscriber_count; i++) {
+        subscriber_t *subscriber = &flight->subscribers[i];
+        if (error == NULL) {
+            if (stats != NULL) {
+                connection_send_message(subscriber->client, MSG_STATS, subscriber->request_id,
+                                        payload, sizeof(payload));
+            }
+            connection_send_message(subscriber->client, MSG_DONE, subscriber->request_id, NULL, 0);
+        } else {
+            connection_send_flagged(subscriber->client, MSG_ERROR,
+                                    error == llm_unavailable_error ? MESSAGE_FLAG_UNAVAILABLE : 0,
+                                    subscriber->request_id, error, strlen(error));
+        }
+        connection_release(subscriber->client);
+    }
+
+    pthread_mutex_destroy(&flight->mutex);
+    free(flight->subscribers);
+    free(flight->text);
+    free(flight->key.data);
+    free(flight);
+}
+
+uint64_t inflight_joined(inflight_table_t *table) {
+    pthread_mutex_lock(&table->mutex);
+    uint64_t joined = table->joined;
+    pthread_mutex_unlock(&table->mutex);
+    return joined;
+}
@@ -0,0 +1,45 @@
+#ifndef INFLIGHT_H
+#define INFLIGHT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "connection.h"
+#include "response_cache.h"
+
+// Coalescing of identical in-flight prompts
+//
+// The first request for a key leads a flight and runs the generation;
+// identical requests that arrive while it is running subscribe to it
+// instead of starting their own. A subscriber is sent everything
+// generated so far as soon as it joins, then each new token as the
+// leader publishes it, then the leader's STATS and DONE, or its ERROR.
+
+typedef struct flight flight_t;
+typedef struct inflight_table inflight_table_t;
+
+inflight_table_t* inflight_create(void);
+void inflight_destroy(inflight_table_t *table);
+
+// Subscribe the client to a running flight for `key` and return true.
+// Otherwise start a flight led by the caller, store it in *led (NULL if
+// out of memory) and return false.
+bool inflight_join(inflight_table_t *table, const response_cache_key_t *key,
+                   client_connection_t *client, uint32_t request_id, flight_t **led);
+
+// Forward a token to the subscribers. Returns whether any is still connected.
+bool flight_publish(flight_t *flight, const char *token, size_t length);
+
+// Close the flight to new subscribers if it has none, so the leader may
+// cancel its generation. Returns false if someone is still waiting on it.
+bool flight_abandon(inflight_table_t *table, flight_t *flight);
+
+// End the flight: subscribers get the leader's STATS (unless `stats` is
+// NULL) and DONE, or ERROR carrying `error`. The flight is freed.
+void flight_finish(inflight_table_t *table, flight_t *flight, const generation_stats_t *stats,
+                   const char *error);
+
+// Requests answered by joining a flight so far
+uint64_t inflight_joined(inflight_table_t *table);
+
+#endif /* INFLIGHT_H */
@@ -0,0 +1,384 @@
+#include "json_reader.h"
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    EXPECT_VALUE,
+    EXPECT_KEY_OR_END,      // just after '{'
+    EXPECT_KEY,             // after ',' inside an object
+    EXPECT_VALUE_OR_END,    // just after '['
+    EXPECT_COMMA_OR_END,    // after a value inside a container
+    EXPECT_DONE             // the top-level value is complete
+};
+
+#define REPLACEMENT_CHARACTER 0xFFFD
+
+void json_reader_init(json_reader_t *reader, const char *data, size_t length) {
+    memset(reader, 0, sizeof(json_reader_t));
+    reader->data = data;
+    reader->length = length;
+    reader->expect = EXPECT_VALUE;
+}
+
+static void skip_space(json_reader_t *reader) {
+    while (reader->pos < reader->length) {
+        char c = reader->data[reader->pos];
+        if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+            break;
+        }
+        reader->pos++;
+    }
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static void after_value(json_reader_t *reader) {
+    reader->expect = reader->depth == 0 ? EXPECT_DONE : EXPECT_COMMA_OR_END;
+}
+
+static bool close_container(json_reader_t *reader, char c, json_token_t *token) {
+    if (reader->depth == 0) {
+        return false;
+    }
+    char open = reader->stack[reader->depth - 1];
+    if ((open == '{' && c != '}') || (open == '[' && c != ']')) {
+        return false;
+    }
+
+    reader->pos++;
+    reader->depth--;
+    token->type = c == '}' ? JSON_OBJECT_END : JSON_ARRAY_END;
+    after_value(reader);
+    return true;
+}
+
+// reader->pos is at the opening quote
+static bool scan_string(json_reader_t *reader, json_token_t *token) {
+    const char *data = reader->data;
+    size_t i = reader->pos + 1;
+
+    while (i < reader->length) {
+        unsigned char c = (unsigned char)data[i];
+        if (c == '"') {
+            token->start = data + reader->pos + 1;
+            token->length = i - reader->pos - 1;
+            reader->pos = i + 1;
+            return true;
+        }
+        if (c < 0x20) {
+            return false;
+        }
+        if (c != '\\') {
+            i++;
+            continue;
+        }
+
+        token->escaped = true;
+        if (++i == reader->length) {
+            return false;
+        }
+        switch (data[i]) {
+            case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+                i++;
+                break;
+            case 'u':
+                if (i + 4 >= reader->length) {
+                    return false;
+                }
+                for (int k = 1; k <= 4; k++) {
+                    if (hex_value(data[i + k]) < 0) {
+                        return false;
+                    }
+                }
+                i += 5;
+                break;
+            default:
+                return false;
+        }
+    }
+    return false;
+}
+
+static bool scan_number(json_reader_t *reader, json_token_t *token) {
+    const char *data = reader->data;
+    size_t length = reader->length;
+    size_t i = reader->pos;
+
+    if (data[i] == '-') {
+        i++;
+    }
+    if (i < length && data[i] == '0') {
+        i++;
+    } else if (i < length && is_digit(data[i])) {
+        while (i < length && is_digit(data[i])) {
+            i++;
+        }
+    } else {
+        return false;
+    }
+
+    if (i < length && data[i] == '.') {
+        if (++i == length || !is_digit(data[i])) {
+            return false;
+        }
+        while (i < length && is_digit(data[i])) {
+            i++;
+        }
+    }
+    if (i < length && (data[i] == 'e' || data[i] == 'E')) {
+        i++;
+        if (i < length && (data[i] == '+' || data[i] == '-')) {
+            i++;
+        }
+        if (i == length || !is_digit(data[i])) {
+            return false;
+        }
+        while (i < length && is_digit(data[i])) {
+            i++;
+        }
+    }
+
+    token->type = JSON_NUMBER;
+    token->start = data + reader->pos;
+    token->length = i - reader->pos;
+    reader->pos = i;
+    return true;
+}
+
+static bool scan_literal(json_reader_t *reader, const char *literal, json_token_type_t type,
+                         json_token_t *token) {
+    size_t length = strlen(literal);
+    if (reader->length - reader->pos < length || memcmp(reader->data + reader->pos, literal, length) != 0) {
+        return false;
+    }
+    reader->pos += length;
+    token->type = type;
+    return true;
+}
+
+static bool scan_value(json_reader_t *reader, char c, json_token_t *token) {
+    bool ok;
+
+    switch (c) {
+        case '{':
+        case '[':
+            if (reader->depth == JSON_MAX_DEPTH) {
+                return false;
+            }
+            reader->stack[reader->depth++] = c;
+            reader->pos++;
+            token->type = c == '{' ? JSON_OBJECT_START : JSON_ARRAY_START;
+            reader->expect = c == '{' ? EXPECT_KEY_OR_END : EXPECT_VALUE_OR_END;
+            return true;
+        case '"':
+            ok = scan_string(reader, token);
+            token->type = JSON_STRING;
+            break;
+        case 't':
+            ok = scan_literal(reader, "true", JSON_TRUE, token);
+            break;
+        case 'f':
+            ok = scan_literal(reader, "false", JSON_FALSE, token);
+            break;
+        case 'n':
+            ok = scan_literal(reader, "null", JSON_NULL, token);
+            break;
+        default:
+            ok = scan_number(reader, token);
+            break;
+    }
+
+    if (ok) {
+        after_value(reader);
+    }
+    return ok;
+}
+
+bool json_reader_next(json_reader_t *reader, json_token_t *token) {
+    memset(token, 0, sizeof(json_token_t));
+    skip_space(reader);
+
+    if (reader->expect == EXPECT_DONE) {
+        token->type = JSON_END;
+        return reader->pos == reader->length;
+    }
+    if (reader->pos == reader->length) {
+        return false;
+    }
+
+    char c = reader->data[reader->pos];
+    if (reader->expect == EXPECT_COMMA_OR_END) {
+        if (c != ',') {
+            return close_container(reader, c, token);
+        }
+        reader->pos++;
+        reader->expect = reader->stack[reader->depth - 1] == '{' ? EXPECT_KEY : EXPECT_VALUE;
+        skip_space(reader);
+        if (reader->pos == reader->length) {
+            return false;
+        }
+        c = reader->data[reader->pos];
+    } else if ((reader->expect == EXPECT_KEY_OR_END && c == '}') ||
+               (reader->expect == EXPECT_VALUE_OR_END && c == ']')) {
+        return close_container(reader, c, token);
+    }
+
+    if (reader->expect == EXPECT_KEY || reader->expect == EXPECT_KEY_OR_END) {
+        if (c != '"' || !scan_string(reader, token)) {
+            return false;
+        }
+        skip_space(reader);
+        if (reader->pos == reader->length || reader->data[reader->pos] != ':') {
+            return false;
+        }
+        reader->pos++;
+        token->type = JSON_KEY;
+        reader->expect = EXPECT_VALUE;
+        return true;
+    }
+    return scan_value(reader, c, token);
+}
+
+bool json_reader_skip_value(json_reader_t *reader) {
+    json_token_t token;
+    if (!json_reader_next(reader, &token)) {
+        return false;
+    }
+    if (token.type != JSON_OBJECT_START && token.type != JSON_ARRAY_START) {
+        return token.type != JSON_OBJECT_END && token.type != JSON_ARRAY_END &&
+               token.type != JSON_KEY && token.type != JSON_END;
+    }
+
+    int depth = reader->depth - 1;
+    while (reader->depth > depth) {
+        if (!json_reader_next(reader, &token)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool json_token_is(const json_token_t *token, const char *text) {
+    return !token->escaped && strlen(text) == token->length && memcmp(token->start, text, token->length) == 0;
+}
+
+static uint32_t hex4(const char *p) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value = (value << 4) | (uint32_t)hex_value(p[i]);
+    }
+    return value;
+}
+
+static size_t encode_utf8(uint32_t cp, char *utf8) {
+    if (cp < 0x80) {
+        utf8[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        utf8[0] = (char)(0xC0 | (cp >> 6));
+        utf8[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        utf8[0] = (char)(0xE0 | (cp >> 12));
+        utf8[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        utf8[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    utf8[0] = (char)(0xF0 | (cp >> 18));
+    utf8[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    utf8[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    utf8[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+// The tokenizer has checked the escapes, so they are complete here
+void json_token_string(const json_token_t *token, char *out, size_t size) {
+    const char *s = token->start;
+    size_t written = 0;
+    bool truncated = false;
+
+    if (size == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < token->length; ) {
+        char bytes[4];
+        size_t n = 1;
+
+        if (s[i] != '\\') {
+            bytes[0] = s[i++];
+        } else {
+            char escape = s[i + 1];
+            i += 2;
+            switch (escape) {
+                case 'b': bytes[0] = '\b'; break;
+                case 'f': bytes[0] = '\f'; break;
+                case 'n': bytes[0] = '\n'; break;
+                case 'r': bytes[0] = '\r'; break;
+                case 't': bytes[0] = '\t'; break;
+                case 'u': {
+                    uint32_t cp = hex4(s + i);
+                    i += 4;
+                    if (cp >= 0xD800 && cp <= 0xDBFF && i + 6 <= token->length && s[i] == '\\' && s[i + 1] == 'u') {
+                        uint32_t low = hex4(s + i + 2);
+                        if (low >= 0xDC00 && low <= 0xDFFF) {
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                            i += 6;
+                        }
+                    }
+                    // A surrogate without its other half becomes U+FFFD
+                    if (cp >= 0xD800 && cp <= 0xDFFF) {
+                        cp = REPLACEMENT_CHARACTER;
+                    }
+                    n = encode_utf8(cp, bytes);
+                    break;
+                }
+                default:
+                    bytes[0] = escape;
+                    break;
+            }
+        }
+
+        if (written + n > size - 1) {
+            truncated = true;
+            break;
+        }
+        memcpy(out + written, bytes, n);
+        written += n;
+    }
+
+    // A character of the input cut in the middle is dropped whole
+    if (truncated) {
+        size_t lead = written;
+        while (lead > 0 && ((unsigned char)out[lead - 1] & 0xC0) == 0x80) {
+            lead--;
+        }
+        if (lead > 0 && (unsigned char)out[lead - 1] >= 0xC0) {
+            unsigned char b = (unsigned char)out[lead - 1];
+            size_t expected = (b & 0xE0) == 0xC0 ? 2 : (b & 0xF0) == 0xE0 ? 3 : 4;
+            if (written - (lead - 1) < expected) {
+                written = lead - 1;
+            }
+        }
+    }
+    out[written] = '\0';
+}
+
+double json_token_number(const json_token_t *token) {
+    char buffer[128];
+    size_t length = token->length < sizeof(buffer) - 1 ? token->length : sizeof(buffer) - 1;
+    memcpy(buffer, token->start, length);
+    buffer[length] = '\0';
+    return strtod(buffer, NULL);
+}
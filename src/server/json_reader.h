@@ -0,0 +1,66 @@
+#ifndef JSON_READER_H
+#define JSON_READER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Deepest nesting a document may have
+#define JSON_MAX_DEPTH 32
+
+typedef enum {
+    JSON_OBJECT_START,
+    JSON_OBJECT_END,
+    JSON_ARRAY_START,
+    JSON_ARRAY_END,
+    JSON_KEY,                   // an object key, its ':' already consumed
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_TRUE,
+    JSON_FALSE,
+    JSON_NULL,
+    JSON_END                    // the document is complete
+} json_token_type_t;
+
+// Strings and numbers point into the document, undecoded; strings
+// without the quotes
+typedef struct {
+    json_token_type_t type;
+    const char *start;
+    size_t length;
+    bool escaped;               // a string that contains backslash escapes
+} json_token_t;
+
+// Pull tokenizer over a complete JSON document in memory
+//
+// The whole grammar is checked as the tokens are read: a document that
+// is not valid JSON makes json_reader_next() fail at the first bad byte,
+// and nothing after it is returned. Nothing is allocated.
+typedef struct {
+    const char *data;
+    size_t length;
+    size_t pos;
+    int expect;
+    int depth;
+    char stack[JSON_MAX_DEPTH];     // '{' or '[' for each open container
+} json_reader_t;
+
+void json_reader_init(json_reader_t *reader, const char *data, size_t length);
+
+// The next token. Returns false on malformed JSON.
+bool json_reader_next(json_reader_t *reader, json_token_t *token);
+
+// Read past the next value, containers included
+bool json_reader_skip_value(json_reader_t *reader);
+
+// Whether a key or string token is exactly text
+bool json_token_is(const json_token_t *token, const char *text);
+
+// Decode a key or string token into out as UTF-8, cut to size - 1 bytes
+// on a character boundary and NUL-terminated
+void json_token_string(const json_token_t *token, char *out, size_t size);
+
+// The value of a number token
+double json_token_number(const json_token_t *token);
+
+#endif /* JSON_READER_H */
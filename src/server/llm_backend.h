@@ -0,0 +1,57 @@
+#ifndef LLM_BACKEND_H
+#define LLM_BACKEND_H
+
+#include "llm_interface.h"
+
+// Engine behind an llm_handle_t
+//
+// init receives the handle's configuration and returns the engine's
+// state, or NULL on failure; every other call gets that state back.
+// Calls arrive from many worker threads at once.
+typedef struct {
+    const char *name;
+    void* (*init)(const llm_config_t *config);
+
+    // Generate a resolved request: on_token for each token as it is
+    // produced, then on_done exactly once. Must stop promptly once
+    // request->cancelled is set; request->cancel_fd becomes readable at
+    // the same moment, for engines that block in poll().
+    bool (*generate_stream)(void *state, llm_request_t *request,
+                            llm_token_callback_t on_token, llm_done_callback_t on_done,
+                            void *user_ctx);
+
+    // Optional: the same without blocking. Runs on the loop thread and
+    // returns at once; the engine watches its own sockets, the request's
+    // deadline and request->cancel_fd on the loop until it calls on_done.
+    void (*start_stream)(void *state, event_loop_t *loop, llm_request_t *request,
+                         llm_token_callback_t on_token, llm_done_callback_t on_done,
+                         void *user_ctx);
+
+    // Optional: called by llm_request_cancel() while the request runs,
+    // for engines that have more to stop than their own loop
+    void (*cancel)(void *state, llm_request_t *request);
+
+    // Optional: one vector per input, all of the same length
+    bool (*embed)(void *state, const char *model, const char *const *inputs, size_t count,
+                  llm_embeddings_t *out, const char **error);
+    
+    // Optional: model residency, see llm_load_model() and llm_list_models()
+    bool (*load_model)(void *state, const char *model, int keep_alive, int cancel_fd,
+                       const char **error);
+    bool (*list_models)(void *state, bool running, llm_model_list_t *out, int cancel_fd,
+                        const char **error);
+
+    // Optional: whether a request could be served right now, for engines
+    // that can tell quickly that it would fail; missing means always
+    bool (*available)(void *state);
+
+    void (*cleanup)(void *state);
+} llm_backend_ops_t;
+
+// Ollama over HTTP (ollama_backend.c)
+extern const llm_backend_ops_t ollama_backend_ops;
+
+// Deterministic text at a configured pace, no model needed (synthetic_backend.c)
+extern const llm_backend_ops_t synthetic_backend_ops;
+
+#endif /* LLM_BACKEND_H */
@@ -1,460 +1,479 @@
 #include "llm_interface.h"
+#include "llm_backend.h"
+#include "residency.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <netdb.h>
-#include <errno.h>
-#include <ctype.h>
 #include <time.h>
-#include <fcntl.h>
+#include <sys/eventfd.h>
 
-// Internal state
-static bool is_initialized = false;
-static llm_config_t current_config;
+// Everything one generation needs; shared by all requests on the handle
+struct llm_handle {
+    llm_config_t config;
+    const llm_backend_ops_t *ops;
+    void *state;
+    residency_t *residency;     // NULL unless the engine can load models
+};
 
-// For this implementation, we'll use a simple command-line approach to interact with Ollama
-// In a production environment, you might want to use a proper C binding for your LLM
+// Handle behind the single-instance llm_initialize() API
+static llm_handle_t *default_handle = NULL;
 
-bool llm_initialize(llm_config_t *config) {
+const char llm_unavailable_error[] = "No backend is available right now";
+
+static const char* default_model(const llm_config_t *config);
+
+llm_handle_t* llm_handle_create(const llm_config_t *config) {
     if (config == NULL) {
         fprintf(stderr, "Error: NULL configuration provided\n");
-        return false;
-    }
-    
-    // Store configuration
-    memcpy(&current_config, config, sizeof(llm_config_t));
-    
-    // Check if model path exists for local models
-    if (config->type != LLM_TYPE_CUSTOM) {
-        if (access(config->model_path, F_OK) == -1) {
-            fprintf(stderr, "Error: Model file not found at %s\n", config->model_path);
-            return false;
-        }
+        return NULL;
     }
     
-    printf("Initialized LLM interface with model type: %s\n", llm_type_to_string(config->type));
-    is_initialized = true;
-    return true;
-}
-
-char* llm_generate_response(const char *prompt) {
-    if (!is_initialized) {
-        fprintf(stderr, "Error: LLM interface not initialized\n");
-        return strdup("Error: LLM not initialized");
+    llm_handle_t *handle = calloc(1, sizeof(llm_handle_t));
+    if (handle == NULL) {
+        fprintf(stderr, "Error: Failed to allocate LLM handle\n");
+        return NULL;
     }
     
-    if (prompt == NULL || strlen(prompt) == 0) {
-        return strdup("Error: Empty prompt");
-    }
-    
-    // Ollama API endpoint
-    const char *host = "localhost";
-    const int port = 11434;
-    const char *endpoint = "/api/generate";
-    
-    // Create socket
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) {
-        fprintf(stderr, "Error: Failed to create socket: %s\n", strerror(errno));
-        return strdup("Error: Failed to connect to Ollama");
-    }
-    
-    // Set up server address
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port);
-    
-    // Convert hostname to IP address
-    struct hostent *he = gethostbyname(host);
-    if (he == NULL) {
-        fprintf(stderr, "Error: Could not resolve hostname %s: %s\n", host, strerror(errno));
-        close(sock);
-        return strdup("Error: Could not resolve Ollama hostname");
+    // Store configuration
+    memcpy(&handle->config, config, sizeof(llm_config_t));
+    
+    handle->ops = config->engine == LLM_ENGINE_SYNTHETIC ? &synthetic_backend_ops : &ollama_backend_ops;
+    handle->state = handle->ops->init(&handle->config);
+    if (handle->state == NULL) {
+        fprintf(stderr, "Error: Failed to start the %s engine\n", handle->ops->name);
+        free(handle);
+        return NULL;
     }
     
-    memcpy(&server_addr.sin_addr, he->h_addr_list[0], he->h_length);
-    
-    // Connect to server
-    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        fprintf(stderr, "Error: Failed to connect to %s:%d: %s\n", host, port, strerror(errno));
-        close(sock);
-        return strdup("Error: Failed to connect to Ollama server");
+    // Ollama models are names, not files; whether one loads is only known
+    // by loading it, which the residency manager does before the first request
+    if (handle->ops->load_model != NULL && handle->ops->list_models != NULL &&
+        (config->warm_up || config->keep_warm_interval > 0)) {
+        handle->residency = residency_create(handle, default_model(config), config);
     }
     
-    if (current_config.verbose) {
-        printf("Connected to Ollama server at %s:%d\n", host, port);
+    printf("Initialized LLM interface with model type: %s (%s engine)\n",
+           llm_type_to_string(config->type), handle->ops->name);
+    return handle;
+}
+
+void llm_handle_destroy(llm_handle_t *handle) {
+    if (handle == NULL) {
+        return;
     }
     
-    // Prepare JSON request
-    // Escape quotes in the prompt
-    char *escaped_prompt = malloc(strlen(prompt) * 2 + 1);
-    if (!escaped_prompt) {
-        close(sock);
-        return strdup("Error: Memory allocation failed");
+    residency_destroy(handle->residency);
+    handle->ops->cleanup(handle->state);
+    free(handle);
+}
+
+llm_request_t* llm_request_create(const char *prompt) {
+    llm_request_t *request = calloc(1, sizeof(llm_request_t));
+    if (request == NULL) {
+        return NULL;
     }
     
-    const char *src = prompt;
-    char *dst = escaped_prompt;
-    while (*src) {
-        if (*src == '"' || *src == '\\') {
-            *dst++ = '\\';
+    request->prompt = strdup(prompt ? prompt : "");
+    request->cancel_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (request->prompt == NULL || request->cancel_fd < 0) {
+        free(request->prompt);
+        if (request->cancel_fd >= 0) {
+            close(request->cancel_fd);
         }
-        *dst++ = *src++;
+        free(request);
+        return NULL;
     }
-    *dst = '\0';
     
-    // Determine model name based on type
-    const char *model_name;
-    switch (current_config.type) {
+    request->temperature = -1.0f;
+    request->max_tokens = -1;
+    request->context_size = -1;
+    request->seed = LLM_SEED_DEFAULT;
+    request->created_ms = llm_monotonic_ms();
+    atomic_init(&request->cancelled, false);
+    atomic_init(&request->running_on, NULL);
+    return request;
+}
+
+// Ollama model name for the configured model type
+static const char* default_model(const llm_config_t *config) {
+    switch (config->type) {
         case LLM_TYPE_LLAMA:
-            model_name = "llama3"; // Updated to use the modern name format
-            break;
+            return "llama3"; // Updated to use the modern name format
         case LLM_TYPE_MISTRAL:
-            model_name = "mistral"; // Try to use mistral directly
-            break;
+            return "mistral"; // Try to use mistral directly
         case LLM_TYPE_GPT_J:
-            model_name = "phi3"; // Try to use phi3 as an available alternative
-            break;
+            return "phi3"; // Try to use phi3 as an available alternative
         case LLM_TYPE_CUSTOM:
         default:
             // Use model path if provided, otherwise default to llama3
-            model_name = (strlen(current_config.model_path) > 0) ? 
-                          current_config.model_path : "llama3";
-            break;
+            return (strlen(config->model_path) > 0) ? config->model_path : "llama3";
     }
+}
+
+void llm_request_resolve(const llm_handle_t *handle, llm_request_t *request) {
+    const llm_config_t *config = &handle->config;
     
-    if (current_config.verbose) {
-        printf("Using Ollama model: %s\n", model_name);
+    if (request->model == NULL) {
+        request->model = default_model(config);
     }
-    
-    // Build JSON request
-    char *json_request = malloc(strlen(escaped_prompt) + 512);
-    if (!json_request) {
-        free(escaped_prompt);
-        close(sock);
-        return strdup("Error: Memory allocation failed");
+    if (request->temperature < 0) {
+        request->temperature = config->temperature;
+    }
+    if (request->max_tokens <= 0) {
+        request->max_tokens = config->max_tokens;
+    }
+    if (request->context_size <= 0) {
+        request->context_size = config->context_size;
+    }
+    if (request->seed == LLM_SEED_DEFAULT) {
+        request->seed = config->seed;
+    }
+}
+
+void llm_request_cancel(llm_request_t *request) {
+    if (request == NULL || atomic_exchange(&request->cancelled, true)) {
+        return;
     }
     
-    // Build more complete JSON request according to Ollama API docs
-    sprintf(json_request, "{\"model\":\"%s\",\"prompt\":\"%s\",\"stream\":true,\"temperature\":%.2f,\"max_tokens\":%d,\"options\":{\"num_ctx\":%d}}", 
-            model_name, escaped_prompt, current_config.temperature, current_config.max_tokens, current_config.context_size);
+    // Wake a generation blocked waiting for the engine
+    uint64_t one = 1;
+    ssize_t written = write(request->cancel_fd, &one, sizeof(one));
+    (void)written;
     
-    free(escaped_prompt);
+    llm_handle_t *handle = atomic_load(&request->running_on);
+    if (handle != NULL && handle->ops->cancel != NULL) {
+        handle->ops->cancel(handle->state, request);
+    }
+}
+
+int64_t llm_monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+void llm_request_set_timeout(llm_request_t *request, int64_t timeout_ms) {
+    request->deadline_ms = llm_monotonic_ms() + timeout_ms;
+}
+
+bool llm_request_is_cancelled(const llm_request_t *request) {
+    return atomic_load(&request->cancelled);
+}
+
+void llm_request_free(llm_request_t *request) {
+    if (request == NULL) {
+        return;
+    }
     
-    // Build HTTP request with correct headers and format
-    char http_request[8192];
-    snprintf(http_request, sizeof(http_request),
-        "POST /api/generate HTTP/1.1\r\n"
-        "Host: %s:%d\r\n"
-        "Content-Type: application/json\r\n"
-        "Accept: application/json\r\n"
-        "Content-Length: %zu\r\n"
-        "Connection: close\r\n\r\n"
-        "%s",
-        host, port, strlen(json_request), json_request);
+    close(request->cancel_fd);
+    free(request->prompt);
+    free(request);
+}
+
+// Caller's callbacks, as the engine sees them; the result passes the
+// cancellation check on the way back
+typedef struct {
+    llm_request_t *request;
+    llm_token_callback_t on_token;
+    llm_done_callback_t on_done;
+    void *user_ctx;
+    bool success;
+    bool async;                 // heap-allocated, and finished by report_done
+    int64_t started_ms;         // when the generation left the queue
+} stream_adapter_t;
+
+static bool report_token(const char *token, size_t length, void *user_ctx) {
+    stream_adapter_t *adapter = user_ctx;
+    return adapter->on_token(token, length, adapter->user_ctx);
+}
+
+static void report_done(const llm_result_t *engine_result, void *user_ctx) {
+    stream_adapter_t *adapter = user_ctx;
+    llm_result_t result = *engine_result;
     
-    if (current_config.verbose) {
-        printf("\n=======================================\n");
-        printf("Sending request to Ollama:\n%s\n", http_request);
-        printf("=======================================\n");
+    result.cancelled = adapter->request != NULL && atomic_load(&adapter->request->cancelled);
+    if (adapter->request != NULL && adapter->started_ms > 0) {
+        result.stats.queue_ms = adapter->started_ms - adapter->request->created_ms;
     }
+    if (result.cancelled && !result.success) {
+        result.error = "Generation cancelled";
+    }
+    adapter->success = result.success;
     
-    // Save the JSON request for debugging
-    char *json_copy = strdup(json_request);
-    free(json_request);
+    // The caller may free the request in on_done
+    if (adapter->async && adapter->request != NULL) {
+        atomic_store(&adapter->request->running_on, NULL);
+    }
+    if (adapter->on_done) {
+        adapter->on_done(&result, adapter->user_ctx);
+    }
+    if (adapter->async) {
+        free(adapter);
+    }
+}
+
+// Checks shared by both ways of generating. Returns false once the
+// request has been answered without reaching the engine.
+static bool start_generation(llm_handle_t *handle, llm_request_t *request, stream_adapter_t *adapter) {
+    adapter->started_ms = llm_monotonic_ms();
+    
+    // Published before the cancel check, so a concurrent cancel either
+    // stops us here or reaches the engine
+    atomic_store(&request->running_on, handle);
+    if (atomic_load(&request->cancelled)) {
+        llm_result_t result = { .error = "Generation cancelled", .stats = GENERATION_STATS_UNKNOWN };
+        report_done(&result, adapter);
+        return false;
+    }
+    if (request->deadline_ms > 0 && llm_monotonic_ms() >= request->deadline_ms) {
+        // Waited in the queue past the client's deadline; nobody wants it now
+        llm_result_t result = { .error = "Deadline expired before generation started",
+                                .stats = GENERATION_STATS_UNKNOWN };
+        report_done(&result, adapter);
+        return false;
+    }
     
-    if (current_config.verbose) {
-        printf("JSON payload: %s\n", json_copy);
+    llm_request_resolve(handle, request);
+    residency_note_demand(handle->residency, request->model);
+    
+    // The server's own limit counts from here, the client's from arrival
+    int64_t limit = handle->config.generation_timeout_ms;
+    if (limit > 0 && (request->deadline_ms == 0 || llm_monotonic_ms() + limit < request->deadline_ms)) {
+        llm_request_set_timeout(request, limit);
+    }
+    return true;
+}
+
+bool llm_generate_stream(llm_handle_t *handle, llm_request_t *request,
+                         llm_token_callback_t on_token, llm_done_callback_t on_done,
+                         void *user_ctx) {
+    stream_adapter_t adapter = { request, on_token, on_done, user_ctx, false, false, 0 };
+    
+    if (handle == NULL || request == NULL) {
+        llm_result_t result = { .error = "LLM not initialized", .stats = GENERATION_STATS_UNKNOWN };
+        report_done(&result, &adapter);
+        return false;
     }
     
-    // Send request
-    if (send(sock, http_request, strlen(http_request), 0) < 0) {
-        if (current_config.verbose) {
-            printf("Failed to send request: %s\n", strerror(errno));
-        }
-        close(sock);
-        free(json_copy);
-        return strdup("Error: Failed to send request to Ollama");
+    if (start_generation(handle, request, &adapter)) {
+        handle->ops->generate_stream(handle->state, request, report_token, report_done, &adapter);
     }
+    atomic_store(&request->running_on, NULL);
     
-    if (current_config.verbose) {
-        printf("Request sent successfully, waiting for response...\n");
+    return adapter.success;
+}
+
+bool llm_generate_async(llm_handle_t *handle, event_loop_t *loop, llm_request_t *request,
+                        llm_token_callback_t on_token, llm_done_callback_t on_done,
+                        void *user_ctx) {
+    if (handle == NULL || request == NULL || loop == NULL || handle->ops->start_stream == NULL) {
+        return false;
     }
     
-    // Receive response
-    char buffer[4096];
-    char *response = malloc(1);
-    if (!response) {
-        close(sock);
-        free(json_copy);
-        return strdup("Error: Memory allocation failed");
+    stream_adapter_t *adapter = malloc(sizeof(stream_adapter_t));
+    if (adapter == NULL) {
+        return false;
+    }
+    *adapter = (stream_adapter_t){ request, on_token, on_done, user_ctx, false, true, 0 };
+    
+    if (start_generation(handle, request, adapter)) {
+        handle->ops->start_stream(handle->state, loop, request, report_token, report_done, adapter);
+    }
+    return true;
+}
+
+bool llm_embed(llm_handle_t *handle, const char *model, const char *const *inputs, size_t count,
+               llm_embeddings_t *out, const char **error) {
+    const char *ignored_error;
+    if (error == NULL) {
+        error = &ignored_error;
     }
-    response[0] = '\0';
+    memset(out, 0, sizeof(*out));
     
-    size_t total_size = 1;
-    ssize_t bytes_received;
+    if (handle == NULL) {
+        *error = "LLM not initialized";
+        return false;
+    }
+    if (handle->ops->embed == NULL) {
+        *error = "This engine does not support embeddings";
+        return false;
+    }
+    if (count == 0) {
+        return true;
+    }
     
-    if (current_config.verbose) {
-        printf("\n=== STARTING OLLAMA RESPONSE RECEPTION ===\n");
+    model = model ? model : default_model(&handle->config);
+    residency_note_demand(handle->residency, model);
+    return handle->ops->embed(handle->state, model, inputs, count, out, error);
+}
+
+bool llm_load_model(llm_handle_t *handle, const char *model, int keep_alive, int cancel_fd,
+                    const char **error) {
+    const char *ignored_error;
+    if (error == NULL) {
+        error = &ignored_error;
     }
     
-    // Set socket to non-blocking mode
-    int flags = fcntl(sock, F_GETFL, 0);
-    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    if (handle == NULL) {
+        *error = "LLM not initialized";
+        return false;
+    }
+    if (handle->ops->load_model == NULL) {
+        *error = "This engine does not load models";
+        return false;
+    }
     
-    // Receive with timeout
-    fd_set readfds;
-    struct timeval tv;
-    int ready;
+    return handle->ops->load_model(handle->state, model ? model : default_model(&handle->config),
+                                   keep_alive, cancel_fd, error);
+}
+
+bool llm_list_models(llm_handle_t *handle, bool running, llm_model_list_t *out, int cancel_fd,
+                     const char **error) {
+    const char *ignored_error;
+    if (error == NULL) {
+        error = &ignored_error;
+    }
+    memset(out, 0, sizeof(*out));
     
-    // Try to receive for up to 30 seconds
-    time_t start_time = time(NULL);
-    int wait_count = 0;
-    bool headers_done = false;
-    char *body_start = NULL;
-    while (time(NULL) - start_time < 30) {
-        FD_ZERO(&readfds);
-        FD_SET(sock, &readfds);
-        
-        // Set timeout to 1 second
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
-        
-        if (current_config.verbose && wait_count % 5 == 0) {
-            printf("Waiting for Ollama response... (elapsed: %ld seconds)\n", time(NULL) - start_time);
-        }
-        wait_count++;
-        
-        ready = select(sock + 1, &readfds, NULL, NULL, &tv);
-        
-        if (ready < 0) {
-            if (current_config.verbose) {
-                printf("Select error: %s\n", strerror(errno));
-            }
-            break;
-        } else if (ready == 0) {
-            // Timeout, try again
-            continue;
-        }
-        
-        if (current_config.verbose) {
-            printf("Data available to read from Ollama\n");
-        }
-        
-        memset(buffer, 0, sizeof(buffer));
-        bytes_received = recv(sock, buffer, sizeof(buffer) - 1, 0);
-        
-        if (bytes_received < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                // No data available, try again
-                continue;
-            }
-            if (current_config.verbose) {
-                printf("Error receiving data: %s\n", strerror(errno));
-            }
-            free(response);
-            free(json_copy);
-            close(sock);
-            return strdup("Error: Failed to receive data from Ollama");
-        } else if (bytes_received == 0) {
-            // Connection closed by server
-            if (current_config.verbose) {
-                printf("Connection closed by Ollama server\n");
-            }
-            break;
-        }
-        
-        buffer[bytes_received] = '\0';
-        
-        if (current_config.verbose) {
-            printf("Received %zd bytes from Ollama:\n%.100s%s\n", 
-                   bytes_received, buffer, strlen(buffer) > 100 ? "..." : "");
-        }
-        
-        // Look for the end of HTTP headers if we haven't found it yet
-        if (!headers_done) {
-            char *headers_end = strstr(buffer, "\r\n\r\n");
-            if (headers_end) {
-                headers_done = true;
-                body_start = headers_end + 4; // Skip \r\n\r\n
-                if (current_config.verbose) {
-                    printf("Found end of HTTP headers, body starts with: %.50s%s\n", 
-                           body_start, strlen(body_start) > 50 ? "..." : "");
-                }
-                
-                // Only append the body part
-                char *new_response = realloc(response, total_size + strlen(body_start) + 1);
-                if (!new_response) {
-                    free(response);
-                    free(json_copy);
-                    close(sock);
-                    return strdup("Error: Memory allocation failed");
-                }
-                response = new_response;
-                strcat(response, body_start);
-                total_size += strlen(body_start);
-            } else {
-                // No headers end found yet, don't append anything
-                if (current_config.verbose) {
-                    printf("Still looking for end of HTTP headers...\n");
-                }
-                continue;
-            }
-        } else {
-            // Headers already processed, append the whole buffer
-            char *new_response = realloc(response, total_size + bytes_received + 1);
-            if (!new_response) {
-                free(response);
-                free(json_copy);
-                close(sock);
-                return strdup("Error: Memory allocation failed");
-            }
-            response = new_response;
-            strcat(response, buffer);
-            total_size += bytes_received;
-            
-            if (current_config.verbose) {
-                printf("Appended %zd bytes to response, total size: %zu bytes\n", 
-                       bytes_received, total_size);
-            }
-        }
+    if (handle == NULL) {
+        *error = "LLM not initialized";
+        return false;
+    }
+    if (handle->ops->list_models == NULL) {
+        *error = "This engine does not list models";
+        return false;
     }
     
-    if (current_config.verbose) {
-        printf("Received raw response from Ollama (first 200 chars): %.200s\n", response);
+    return handle->ops->list_models(handle->state, running, out, cancel_fd, error);
+}
+
+bool llm_available(llm_handle_t *handle) {
+    return handle != NULL && (handle->ops->available == NULL || handle->ops->available(handle->state));
+}
+
+bool llm_same_model(const char *a, const char *b) {
+    size_t a_length = strlen(a);
+    size_t b_length = strlen(b);
+    if (a_length > b_length) {
+        return llm_same_model(b, a);
     }
     
-    // For streaming responses from Ollama, we need to extract and concatenate all response chunks
-    // Each chunk is in the format: {"model":"...","created_at":"...","response":"...","done":false/true}
+    // An untagged name means the :latest tag
+    return strncmp(a, b, a_length) == 0 &&
+           (a_length == b_length || strcmp(b + a_length, ":latest") == 0);
+}
+
+// Adapter for the single-instance API
+typedef struct {
+    llm_token_callback_t on_token;
+    void *user_data;
+    const char *error;
+} legacy_stream_t;
+
+static bool legacy_token(const char *token, size_t length, void *user_ctx) {
+    legacy_stream_t *legacy = user_ctx;
+    return legacy->on_token(token, length, legacy->user_data);
+}
+
+static void legacy_done(const llm_result_t *result, void *user_ctx) {
+    legacy_stream_t *legacy = user_ctx;
+    legacy->error = result->error;
+}
+
+bool llm_generate_response_stream(const char *prompt, llm_token_callback_t on_token,
+                                  void *user_data, const char **error) {
+    const char *ignored_error;
+    if (error == NULL) {
+        error = &ignored_error;
+    }
+    *error = NULL;
     
-    char *full_response = malloc(8192); // Start with a larger buffer size
-    if (!full_response) {
-        free(response);
-        free(json_copy);
-        return strdup("Error: Memory allocation failed");
+    if (default_handle == NULL) {
+        fprintf(stderr, "Error: LLM interface not initialized\n");
+        *error = "LLM not initialized";
+        return false;
     }
-    full_response[0] = '\0';
-    size_t full_response_size = 8192;
-    size_t full_response_len = 0;
     
-    // Process each line of the response
-    char *line = response;
-    char *next_line;
-    bool found_valid_response = false;
+    if (prompt == NULL || strlen(prompt) == 0) {
+        *error = "Empty prompt";
+        return false;
+    }
     
-    if (current_config.verbose) {
-        printf("Starting to process Ollama streaming response...");
+    llm_request_t *request = llm_request_create(prompt);
+    if (request == NULL) {
+        *error = "Memory allocation failed";
+        return false;
     }
     
-    while (line && *line) {
-        // Find the end of the current line
-        next_line = strstr(line, "\n");
-        if (next_line) {
-            *next_line = '\0'; // Temporarily terminate the line
-            next_line++; // Move to the start of the next line
-        }
-        
-        // Skip empty lines
-        if (*line == '\0') {
-            line = next_line;
-            continue;
-        }
-        
-        // Skip chunk size lines (hex numbers) - common in HTTP chunked encoding
-        if (isxdigit(*line)) {
-            // Check if this line only contains hex digits and possibly a CR (carriage return)
-            char *p = line;
-            bool only_hex = true;
-            while (*p) {
-                if (!(isxdigit(*p) || *p == '\r')) {
-                    only_hex = false;
-                    break;
-                }
-                p++;
-            }
-            if (only_hex) {
-                line = next_line;
-                continue;
-            }
+    legacy_stream_t legacy = { on_token, user_data, NULL };
+    bool ok = llm_generate_stream(default_handle, request, legacy_token, legacy_done, &legacy);
+    *error = legacy.error;
+    
+    llm_request_free(request);
+    return ok;
+}
+
+// Collects streamed tokens into one growing string
+typedef struct {
+    char *text;
+    size_t length;
+    size_t capacity;
+} response_builder_t;
+
+static bool append_token(const char *token, size_t length, void *user_data) {
+    response_builder_t *builder = (response_builder_t *)user_data;
+    
+    if (builder->length + length + 1 > builder->capacity) {
+        size_t new_capacity = builder->capacity ? builder->capacity * 2 : 8192;
+        while (new_capacity < builder->length + length + 1) {
+            new_capacity *= 2;
         }
-        
-        // Check if this line contains a valid JSON object
-        if (*line == '{') {
-            // Look for response field in this JSON object
-            char *content_start = strstr(line, "\"response\":\"");
-            if (content_start) {
-                content_start += 12; // Skip "response":"
-                char *content_end = strstr(content_start, "\"");
-                if (content_end) {
-                    // Extract the response fragment
-                    size_t content_length = content_end - content_start;
-                    found_valid_response = true;
-                    
-                    // Ensure we have enough space in the buffer
-                    if (full_response_len + content_length + 1 > full_response_size) {
-                        full_response_size = full_response_len + content_length + 4096; // Add more space
-                        char *new_buffer = realloc(full_response, full_response_size);
-                        if (!new_buffer) {
-                            free(full_response);
-                            free(response);
-                            free(json_copy);
-                            return strdup("Error: Memory allocation failed");
-                        }
-                        full_response = new_buffer;
-                    }
-                    
-                    // Append this fragment to the full response
-                    strncat(full_response + full_response_len, content_start, content_length);
-                    full_response_len += content_length;
-                    full_response[full_response_len] = '\0';
-                    
-                    if (current_config.verbose) {
-                        printf("Extracted response fragment: %.20s%s\n", 
-                               content_start, content_length > 20 ? "..." : "");
-                    }
-                }
-            }
-            
-            // Check if this is the last message
-            char *done_field = strstr(line, "\"done\":true");
-            if (done_field && current_config.verbose) {
-                printf("Reached final response message\n");
-            }
+        char *new_text = realloc(builder->text, new_capacity);
+        if (!new_text) {
+            return false;
         }
-        
-        // Move to the next line
-        line = next_line;
+        builder->text = new_text;
+        builder->capacity = new_capacity;
     }
     
-    // Free the original response and JSON copy
-    free(response);
-    free(json_copy);
+    memcpy(builder->text + builder->length, token, length);
+    builder->length += length;
+    builder->text[builder->length] = '\0';
+    return true;
+}
+
+char* llm_generate_response(const char *prompt) {
+    response_builder_t builder = { NULL, 0, 0 };
+    const char *error = NULL;
     
-    if (full_response_len == 0 || !found_valid_response) {
-        free(full_response);
-        if (current_config.verbose) {
-            printf("Failed to extract valid response from Ollama. Raw response:\n%s\n", response);
+    if (!llm_generate_response_stream(prompt, append_token, &builder, &error)) {
+        free(builder.text);
+        
+        char *message = malloc(strlen(error) + 8);
+        if (message) {
+            sprintf(message, "Error: %s", error);
         }
-        return strdup("No valid response received from Ollama. Please check if Ollama is running correctly.");
+        return message;
     }
     
-    if (current_config.verbose) {
-        printf("Successfully extracted complete response from Ollama: %.50s%s\n", 
-               full_response, strlen(full_response) > 50 ? "..." : "");
+    return builder.text ? builder.text : strdup("");
+}
+
+bool llm_initialize(llm_config_t *config) {
+    if (default_handle != NULL) {
+        return true;
     }
     
-    return full_response;
+    default_handle = llm_handle_create(config);
+    return default_handle != NULL;
 }
 
 void llm_cleanup(void) {
-    if (is_initialized) {
+    if (default_handle != NULL) {
         printf("Cleaning up LLM interface\n");
-        is_initialized = false;
+        llm_handle_destroy(default_handle);
+        default_handle = NULL;
     }
 }
 
@@ -473,6 +492,17 @@ const char* llm_type_to_string(llm_type_t type) {
     }
 }
 
+const char* llm_engine_to_string(llm_engine_t engine) {
+    switch (engine) {
+        case LLM_ENGINE_OLLAMA:
+            return "ollama";
+        case LLM_ENGINE_SYNTHETIC:
+            return "synthetic";
+        default:
+            return "unknown";
+    }
+}
+
 bool llm_is_initialized(void) {
-    return is_initialized;
+    return default_handle != NULL;
 }
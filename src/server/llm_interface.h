@@ -5,6 +5,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "event_loop.h"
+#include "../common/protocol.h"
 
 // LLM model types
 typedef enum {
@@ -14,23 +18,218 @@ typedef enum {
     LLM_TYPE_CUSTOM
 } llm_type_t;
 
+// Engine that runs the generations
+typedef enum {
+    LLM_ENGINE_OLLAMA,
+    LLM_ENGINE_SYNTHETIC
+} llm_engine_t;
+
+// Most Ollama instances one handle can spread requests over
+#define LLM_MAX_BACKENDS 16
+
+// One Ollama instance; socket (a unix socket path) wins over host/port
+typedef struct {
+    char host[256];
+    int port;
+    char socket[108];
+    int max_concurrency;        // generations at once, 0 = unlimited
+} llm_backend_config_t;
+
 // LLM configuration
 typedef struct {
+    llm_engine_t engine;
     llm_type_t type;
     char model_path[256];
     int context_size;
     float temperature;
     int max_tokens;
+    int seed;                   // negative: let Ollama pick one per request
     bool verbose;
+    
+    // Ollama endpoint; ollama_socket (a unix socket path) wins when set
+    char ollama_host[256];
+    int ollama_port;
+    char ollama_socket[108];
+    
+    // Several Ollama instances instead of the endpoint above
+    llm_backend_config_t backends[LLM_MAX_BACKENDS];
+    int backend_count;
+    int health_interval;        // seconds between active health checks, 0 = passive only
+    int breaker_slow_ms;        // a response slower to start counts as a failure, 0 = never
+    bool sticky_sessions;       // keep a conversation on one backend
+    
+    // Upstream time limits in milliseconds, 0 = none
+    int connect_timeout_ms;             // opening a connection to Ollama
+    int first_token_timeout_ms;         // from sending the request to the first token
+    int stall_timeout_ms;               // between two tokens
+    int generation_timeout_ms;          // whole generation, unless the client asks for less
+    
+    // Hedging: a generation whose first token is later than this
+    // percentile of recent ones is also sent to another backend
+    int hedge_percentile;       // 0 = never hedge
+    int hedge_budget_percent;   // hedges as a share of generations
+    
+    // Model residency
+    int keep_alive;             // seconds Ollama keeps a model loaded after use, negative = forever
+    bool warm_up;               // load the default model at startup
+    int keep_warm_interval;     // seconds between keep-warm pings and residency checks, 0 = none
+    size_t model_memory_bytes;  // budget for loaded models, 0 = unlimited
+    
+    // Synthetic engine pace. Each delay is a fixed part plus an
+    // exponential tail; jitter is the tail's share of the mean.
+    int synthetic_tokens_per_second;    // 0 = as fast as possible
+    int synthetic_latency_ms;           // mean time to the first token
+    float synthetic_jitter;             // 0 = fixed delays, 1 = fully exponential
 } llm_config_t;
 
-// LLM interface functions
+// Connection to the LLM backends. Handles carry no per-call state, so
+// several threads can generate on the same handle at once.
+typedef struct llm_handle llm_handle_t;
+
+// Request seed meaning "use the handle's configured seed"
+#define LLM_SEED_DEFAULT (-2)
+
+// One generation. Fields left at their defaults (NULL / negative) take
+// the handle's configuration. Any thread may cancel it at any time.
+typedef struct {
+    char *prompt;
+    const char *model;
+    float temperature;
+    int max_tokens;
+    int context_size;
+    int seed;
+    
+    // Context of the previous turn, sent back so Ollama continues the
+    // conversation; borrowed, must outlive the generation
+    const int *context;
+    size_t context_length;
+    
+    // Requests with the same non-zero affinity prefer the same backend
+    uint64_t affinity;
+    
+    // CLOCK_MONOTONIC milliseconds by which the generation must end, 0 = none
+    int64_t deadline_ms;
+    
+    // CLOCK_MONOTONIC milliseconds of creation, where the queue wait starts
+    int64_t created_ms;
+    
+    // Spans of the generation are traced under this id, 0 = not traced
+    uint64_t trace_id;
+    
+    atomic_bool cancelled;
+    int cancel_fd;              // eventfd, readable once cancelled
+    _Atomic(llm_handle_t *) running_on;     // set while generating
+} llm_request_t;
+
+// Outcome of a generation, passed to the done callback. Pointers are
+// only valid during the callback.
+typedef struct {
+    bool success;
+    bool cancelled;
+    const char *error;          // static description when !success
+    generation_stats_t stats;   // queue_ms is filled in on the way back
+    const int *context;         // Ollama context for continuing the conversation
+    size_t context_length;
+} llm_result_t;
+
+// Error of a request that no backend could take; retrying later may work.
+// Compare the pointer, not the text.
+extern const char llm_unavailable_error[];
+
+// Called for each token as it arrives; return false to stop generation
+typedef bool (*llm_token_callback_t)(const char *token, size_t length, void *user_data);
+
+// Called exactly once when a generation ends, successfully or not
+typedef void (*llm_done_callback_t)(const llm_result_t *result, void *user_ctx);
+
+// Models the engine has, or has loaded
+#define LLM_MAX_MODELS 64
+
+typedef struct {
+    char name[128];
+    uint64_t size;              // bytes: in memory when loaded, on disk otherwise
+} llm_model_info_t;
+
+typedef struct {
+    llm_model_info_t models[LLM_MAX_MODELS];
+    size_t count;
+} llm_model_list_t;
+
+// Embedding vectors, row after row; free vectors with free()
+typedef struct {
+    float *vectors;
+    size_t count;
+    size_t dimensions;
+} llm_embeddings_t;
+
+// Handle lifecycle
+llm_handle_t* llm_handle_create(const llm_config_t *config);
+void llm_handle_destroy(llm_handle_t *handle);
+
+// Request lifecycle; the prompt is copied
+llm_request_t* llm_request_create(const char *prompt);
+void llm_request_cancel(llm_request_t *request);
+
+// Give the request `timeout_ms` from now to finish
+void llm_request_set_timeout(llm_request_t *request, int64_t timeout_ms);
+int64_t llm_monotonic_ms(void);
+bool llm_request_is_cancelled(const llm_request_t *request);
+void llm_request_free(llm_request_t *request);
+
+// Fill every parameter left at its default from the handle's
+// configuration, so the request states exactly what will be generated
+void llm_request_resolve(const llm_handle_t *handle, llm_request_t *request);
+
+// Stream tokens to on_token while the engine is still generating, then call
+// on_done. Blocks the calling thread; returns the result's success flag.
+bool llm_generate_stream(llm_handle_t *handle, llm_request_t *request,
+                         llm_token_callback_t on_token, llm_done_callback_t on_done,
+                         void *user_ctx);
+
+// Run the generation on the event loop instead of a thread of its own,
+// if the engine can: on_token and on_done are then called on the loop
+// thread, possibly before this returns. Call it on the loop thread.
+// Returns false, having called nothing, for engines that can only block.
+bool llm_generate_async(llm_handle_t *handle, event_loop_t *loop, llm_request_t *request,
+                        llm_token_callback_t on_token, llm_done_callback_t on_done,
+                        void *user_ctx);
+
+// Embed `count` inputs with `model` (NULL: the configured model). Blocks;
+// on failure returns false and points *error at a static description.
+bool llm_embed(llm_handle_t *handle, const char *model, const char *const *inputs, size_t count,
+               llm_embeddings_t *out, const char **error);
+
+// Load `model` (NULL: the configured model) and keep it loaded for
+// keep_alive seconds: 0 unloads it, negative keeps it until told
+// otherwise. Blocks until done or until cancel_fd (-1 for none) becomes
+// readable; on failure points *error at a static description.
+bool llm_load_model(llm_handle_t *handle, const char *model, int keep_alive, int cancel_fd,
+                    const char **error);
+
+// Models loaded right now (running) or available to load
+bool llm_list_models(llm_handle_t *handle, bool running, llm_model_list_t *out, int cancel_fd,
+                     const char **error);
+
+// False when a request would fail at once because no backend can take it
+// now, so it can be answered with llm_unavailable_error without a try
+bool llm_available(llm_handle_t *handle);
+
+// Whether two engine model names mean the same model ("llama3" is "llama3:latest")
+bool llm_same_model(const char *a, const char *b);
+
+// Single-instance interface on top of a process-wide default handle
 bool llm_initialize(llm_config_t *config);
 char* llm_generate_response(const char *prompt);
+
+// Streams tokens to on_token while Ollama is still generating. On failure
+// returns false and points *error at a static description.
+bool llm_generate_response_stream(const char *prompt, llm_token_callback_t on_token,
+                                  void *user_data, const char **error);
 void llm_cleanup(void);
 
 // Helper functions
 const char* llm_type_to_string(llm_type_t type);
+const char* llm_engine_to_string(llm_engine_t engine);
 bool llm_is_initialized(void);
 
 #endif /* LLM_INTERFACE_H */
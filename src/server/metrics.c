@@ -0,0 +1,198 @@
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#define CACHE_LINE 64
+
+typedef struct {
+    _Atomic uint64_t buckets[METRICS_BUCKETS + 1];  // the last one is +Inf
+    _Atomic uint64_t sum;                           // microseconds
+} shard_histogram_t;
+
+// One thread's counts. Only that thread writes them; renderers read them.
+typedef struct metrics_shard {
+    struct metrics_shard *next;
+    _Atomic uint64_t counters[METRIC_COUNT];
+    shard_histogram_t histograms[HISTOGRAM_COUNT];
+} metrics_shard_t;
+
+static pthread_mutex_t shards_mutex = PTHREAD_MUTEX_INITIALIZER;
+static metrics_shard_t *shards = NULL;
+static __thread metrics_shard_t *local_shard = NULL;
+
+static const struct {
+    const char *name;
+    const char *help;
+} counter_info[METRIC_COUNT] = {
+    [METRIC_CONNECTIONS_ACCEPTED] = { "llm_connections_accepted_total", "Client connections accepted." },
+    [METRIC_CONNECTIONS_CLOSED] = { "llm_connections_closed_total", "Client connections closed." },
+    [METRIC_CONNECTIONS_REFUSED] = { "llm_connections_refused_total", "Client connections refused over the connection limit." },
+    [METRIC_BYTES_RECEIVED] = { "llm_received_bytes_total", "Bytes received from clients." },
+    [METRIC_BYTES_SENT] = { "llm_sent_bytes_total", "Bytes sent to clients." },
+    [METRIC_PROMPTS] = { "llm_prompts_total", "Prompts received." },
+    [METRIC_CACHE_HITS] = { "llm_cache_hits_total", "Prompts answered from the response caches." },
+    [METRIC_COALESCED] = { "llm_coalesced_total", "Prompts that joined an identical generation in progress." },
+    [METRIC_REJECTED] = { "llm_rejected_total", "Prompts turned away because the server was busy or no backend was available." },
+    [METRIC_GENERATIONS] = { "llm_generations_total", "Generations that completed." },
+    [METRIC_GENERATION_ERRORS] = { "llm_generation_errors_total", "Generations that failed." },
+    [METRIC_TOKENS] = { "llm_tokens_total", "Tokens streamed to clients by generations." },
+    [METRIC_EMBEDDINGS] = { "llm_embeddings_total", "Texts received for embedding." },
+    [METRIC_UPSTREAM_STARTED] = { "llm_upstream_requests_total", "Requests sent to Ollama." },
+    [METRIC_UPSTREAM_FINISHED] = { NULL, NULL },
+};
+
+static const struct {
+    const char *name;
+    const char *help;
+} histogram_info[HISTOGRAM_COUNT] = {
+    [HISTOGRAM_QUEUE_WAIT] = { "llm_queue_wait_seconds", "Time from a prompt's arrival until its generation started." },
+    [HISTOGRAM_TTFT] = { "llm_time_to_first_token_seconds", "Time from a prompt's arrival until its first token was sent." },
+    [HISTOGRAM_INTER_TOKEN] = { "llm_inter_token_seconds", "Time between two tokens of a generation." },
+    [HISTOGRAM_TOTAL] = { "llm_generation_seconds", "Time from a prompt's arrival until its generation ended." },
+};
+
+// The calling thread's shard, made and registered on first use; NULL if
+// out of memory, in which case the sample is dropped
+static metrics_shard_t* get_shard(void) {
+    if (local_shard != NULL) {
+        return local_shard;
+    }
+
+    // A line of its own, so threads never write to each other's lines
+    size_t size = (sizeof(metrics_shard_t) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    metrics_shard_t *shard = aligned_alloc(CACHE_LINE, size);
+    if (shard == NULL) {
+        return NULL;
+    }
+    memset(shard, 0, size);
+
+    pthread_mutex_lock(&shards_mutex);
+    shard->next = shards;
+    shards = shard;
+    pthread_mutex_unlock(&shards_mutex);
+
+    local_shard = shard;
+    return shard;
+}
+
+// Single writer: a plain load and store, no locked instruction
+static inline void bump(_Atomic uint64_t *value, uint64_t amount) {
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + amount,
+                          memory_order_relaxed);
+}
+
+void metrics_add(metric_counter_t counter, uint64_t amount) {
+    metrics_shard_t *shard = get_shard();
+    if (shard != NULL) {
+        bump(&shard->counters[counter], amount);
+    }
+}
+
+// Smallest bucket whose bound, 2^(METRICS_MIN_SHIFT + i) us, holds the value
+static int bucket_of(uint64_t microseconds) {
+    int bits = microseconds > 1 ? 64 - __builtin_clzll(microseconds - 1) : 0;
+    int bucket = bits - METRICS_MIN_SHIFT;
+    if (bucket < 0) {
+        return 0;
+    }
+    return bucket < METRICS_BUCKETS ? bucket : METRICS_BUCKETS;
+}
+
+void metrics_observe(metric_histogram_t histogram, int64_t microseconds) {
+    metrics_shard_t *shard = get_shard();
+    if (shard == NULL) {
+        return;
+    }
+
+    uint64_t value = microseconds > 0 ? (uint64_t)microseconds : 0;
+    shard_histogram_t *target = &shard->histograms[histogram];
+    bump(&target->buckets[bucket_of(value)], 1);
+    bump(&target->sum, value);
+}
+
+int64_t metrics_now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static bool render_value(arena_t *out, const char *name, const char *help, const char *type, uint64_t value) {
+    return arena_printf(out, "# HELP %s %s\n# TYPE %s %s\n%s %llu\n",
+                        name, help, name, type, name, (unsigned long long)value);
+}
+
+static bool render_histogram(arena_t *out, const char *name, const char *help,
+                             const uint64_t *buckets, uint64_t sum) {
+    if (!arena_printf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name)) {
+        return false;
+    }
+
+    // Prometheus buckets are cumulative
+    uint64_t count = 0;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        count += buckets[i];
+        double bound = (double)(1ULL << (METRICS_MIN_SHIFT + i)) / 1e6;
+        if (!arena_printf(out, "%s_bucket{le=\"%.6f\"} %llu\n", name, bound, (unsigned long long)count)) {
+            return false;
+        }
+    }
+    count += buckets[METRICS_BUCKETS];
+    return arena_printf(out, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.6f\n%s_count %llu\n",
+                        name, (unsigned long long)count, name, (double)sum / 1e6,
+                        name, (unsigned long long)count);
+}
+
+bool metrics_render(arena_t *out, const metrics_gauges_t *gauges) {
+    uint64_t counters[METRIC_COUNT] = {0};
+    uint64_t buckets[HISTOGRAM_COUNT][METRICS_BUCKETS + 1] = {{0}};
+    uint64_t sums[HISTOGRAM_COUNT] = {0};
+
+    // Merge the shards; a sample recorded meanwhile shows up next time
+    pthread_mutex_lock(&shards_mutex);
+    for (metrics_shard_t *shard = shards; shard != NULL; shard = shard->next) {
+        for (int i = 0; i < METRIC_COUNT; i++) {
+            counters[i] += atomic_load_explicit(&shard->counters[i], memory_order_relaxed);
+        }
+        for (int h = 0; h < HISTOGRAM_COUNT; h++) {
+            for (int i = 0; i <= METRICS_BUCKETS; i++) {
+                buckets[h][i] += atomic_load_explicit(&shard->histograms[h].buckets[i], memory_order_relaxed);
+            }
+            sums[h] += atomic_load_explicit(&shard->histograms[h].sum, memory_order_relaxed);
+        }
+    }
+    pthread_mutex_unlock(&shards_mutex);
+
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        if (counter_info[i].name != NULL &&
+            !render_value(out, counter_info[i].name, counter_info[i].help, "counter", counters[i])) {
+            return false;
+        }
+    }
+
+    // Shards are read one after the other, so a request that ends meanwhile
+    // may be counted as finished but not yet as started
+    uint64_t upstream = counters[METRIC_UPSTREAM_STARTED] > counters[METRIC_UPSTREAM_FINISHED]
+        ? counters[METRIC_UPSTREAM_STARTED] - counters[METRIC_UPSTREAM_FINISHED] : 0;
+    if (!render_value(out, "llm_connections", "Client connections open.", "gauge",
+                      gauges->connections > 0 ? (uint64_t)gauges->connections : 0) ||
+        !render_value(out, "llm_queued_generations", "Generations waiting for their model's turn.", "gauge",
+                      gauges->queued) ||
+        !render_value(out, "llm_running_generations", "Generations started and not yet finished.", "gauge",
+                      gauges->running > 0 ? (uint64_t)gauges->running : 0) ||
+        !render_value(out, "llm_worker_queue_depth", "Jobs waiting for a worker thread.", "gauge",
+                      gauges->worker_queue) ||
+        !render_value(out, "llm_upstream_in_flight", "Requests to Ollama in progress.", "gauge", upstream)) {
+        return false;
+    }
+
+    for (int h = 0; h < HISTOGRAM_COUNT; h++) {
+        if (!render_histogram(out, histogram_info[h].name, histogram_info[h].help, buckets[h], sums[h])) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+// Histogram buckets: bucket i holds values up to 2^(METRICS_MIN_SHIFT + i)
+// microseconds, from 128 us to about 67 s, plus one for anything longer
+#define METRICS_MIN_SHIFT 7
+#define METRICS_BUCKETS 20
+
+// Content type of metrics_render() output
+#define METRICS_CONTENT_TYPE "text/plain; version=0.0.4; charset=utf-8"
+
+typedef enum {
+    METRIC_CONNECTIONS_ACCEPTED,
+    METRIC_CONNECTIONS_CLOSED,
+    METRIC_CONNECTIONS_REFUSED,     // over --max-connections
+    METRIC_BYTES_RECEIVED,          // from clients
+    METRIC_BYTES_SENT,              // to clients
+    METRIC_PROMPTS,
+    METRIC_CACHE_HITS,
+    METRIC_COALESCED,               // prompts that joined a generation in progress
+    METRIC_REJECTED,                // prompts turned away as busy or unavailable
+    METRIC_GENERATIONS,
+    METRIC_GENERATION_ERRORS,
+    METRIC_TOKENS,
+    METRIC_EMBEDDINGS,
+    METRIC_UPSTREAM_STARTED,        // requests to Ollama that took a backend slot
+    METRIC_UPSTREAM_FINISHED,
+    METRIC_COUNT
+} metric_counter_t;
+
+typedef enum {
+    HISTOGRAM_QUEUE_WAIT,           // prompt arrival to generation start
+    HISTOGRAM_TTFT,                 // prompt arrival to first token
+    HISTOGRAM_INTER_TOKEN,          // between two tokens of a generation
+    HISTOGRAM_TOTAL,                // prompt arrival to the end of its generation
+    HISTOGRAM_COUNT
+} metric_histogram_t;
+
+// Process-wide counters and latency histograms
+//
+// Every thread records into a shard of its own with plain relaxed
+// stores, so the hot paths never share a cache line or take a lock.
+// Shards are summed only when the metrics are rendered, and outlive
+// their threads so nothing recorded is lost. All calls are thread-safe.
+void metrics_add(metric_counter_t counter, uint64_t amount);
+void metrics_observe(metric_histogram_t histogram, int64_t microseconds);
+
+// CLOCK_MONOTONIC in microseconds
+int64_t metrics_now_us(void);
+
+// Values the caller samples at render time
+typedef struct {
+    int connections;
+    size_t queued;                  // generations waiting for their model's turn
+    int running;                    // generations dispatched and not yet finished
+    size_t worker_queue;            // jobs waiting for a worker thread
+} metrics_gauges_t;
+
+// Append everything in the Prometheus text exposition format
+bool metrics_render(arena_t *out, const metrics_gauges_t *gauges);
+
+#endif /* METRICS_H */
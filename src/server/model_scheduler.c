@@ -0,0 +1,251 @@
+#include "model_scheduler.h"
+#include "llm_interface.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef struct queued_job {
+    struct queued_job *next;
+    void *job;
+    int64_t deadline_ms;
+} queued_job_t;
+
+typedef struct {
+    char *name;                 // NULL: free entry
+    int limit;                  // 0 = unlimited
+    bool own_limit;             // set by model_scheduler_set_limit()
+    int running;
+    queued_job_t *head;
+    queued_job_t *tail;
+} model_entry_t;
+
+struct model_scheduler {
+    pthread_mutex_t mutex;
+    model_entry_t models[MODEL_SCHEDULER_MAX_MODELS];
+    int model_limit;
+    int total_limit;
+    int batch;
+
+    int current;                // model whose turn it is, -1 before the first
+    int turn;                   // jobs dispatched in the current turn
+    size_t queued;
+    int running;
+    uint64_t dispatched;
+    uint64_t switches;
+};
+
+// Caller holds the mutex. Finds the model's entry or makes one, reusing
+// an idle entry when the table is full; NULL if every entry is busy.
+static model_entry_t* find_model(model_scheduler_t *scheduler, const char *name, bool create) {
+    model_entry_t *free_entry = NULL;
+    model_entry_t *idle = NULL;
+    for (int i = 0; i < MODEL_SCHEDULER_MAX_MODELS; i++) {
+        model_entry_t *model = &scheduler->models[i];
+        if (model->name == NULL) {
+            free_entry = free_entry ? free_entry : model;
+        } else if (llm_same_model(model->name, name)) {
+            return model;
+        } else if (idle == NULL && model->head == NULL && model->running == 0 && !model->own_limit) {
+            idle = model;
+        }
+    }
+
+    model_entry_t *spare = free_entry ? free_entry : idle;
+    if (!create || spare == NULL) {
+        return NULL;
+    }
+
+    char *copy = strdup(name);
+    if (copy == NULL) {
+        return NULL;
+    }
+    free(spare->name);
+    memset(spare, 0, sizeof(*spare));
+    spare->name = copy;
+    spare->limit = scheduler->model_limit;
+    return spare;
+}
+
+static bool can_run(const model_entry_t *model) {
+    return model->head != NULL && (model->limit == 0 || model->running < model->limit);
+}
+
+// Caller holds the mutex. Which model to dispatch from now, or -1.
+static int pick_model(model_scheduler_t *scheduler) {
+    // Jobs about to miss their deadline go first, most pressing first
+    int64_t urgent_before = llm_monotonic_ms() + MODEL_SCHEDULER_URGENT_MS;
+    int urgent = -1;
+    for (int i = 0; i < MODEL_SCHEDULER_MAX_MODELS; i++) {
+        const model_entry_t *model = &scheduler->models[i];
+        int64_t deadline = model->head ? model->head->deadline_ms : 0;
+        if (can_run(model) && deadline > 0 && deadline < urgent_before &&
+            (urgent < 0 || deadline < scheduler->models[urgent].head->deadline_ms)) {
+            urgent = i;
+        }
+    }
+    if (urgent >= 0) {
+        return urgent;
+    }
+
+    // The current model keeps its turn while it has work and room
+    if (scheduler->current >= 0 && can_run(&scheduler->models[scheduler->current]) &&
+        (scheduler->batch <= 0 || scheduler->turn < scheduler->batch)) {
+        return scheduler->current;
+    }
+
+    // Otherwise the next model round-robin, or the current one again
+    for (int step = 1; step <= MODEL_SCHEDULER_MAX_MODELS; step++) {
+        int i = (scheduler->current + step) % MODEL_SCHEDULER_MAX_MODELS;
+        if (can_run(&scheduler->models[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Caller holds the mutex
+static void* dequeue(model_scheduler_t *scheduler, model_entry_t *model) {
+    queued_job_t *queued = model->head;
+    model->head = queued->next;
+    if (model->head == NULL) {
+        model->tail = NULL;
+    }
+    scheduler->queued--;
+
+    void *job = queued->job;
+    free(queued);
+    return job;
+}
+
+model_scheduler_t* model_scheduler_create(int model_limit, int total_limit, int batch) {
+    model_scheduler_t *scheduler = calloc(1, sizeof(model_scheduler_t));
+    if (scheduler == NULL) {
+        fprintf(stderr, "Error: Failed to allocate model scheduler\n");
+        return NULL;
+    }
+
+    pthread_mutex_init(&scheduler->mutex, NULL);
+    scheduler->model_limit = model_limit > 0 ? model_limit : 0;
+    scheduler->total_limit = total_limit > 0 ? total_limit : 0;
+    scheduler->batch = batch;
+    scheduler->current = -1;
+    return scheduler;
+}
+
+void model_scheduler_destroy(model_scheduler_t *scheduler) {
+    if (scheduler == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < MODEL_SCHEDULER_MAX_MODELS; i++) {
+        model_entry_t *model = &scheduler->models[i];
+        while (model->head != NULL) {
+            dequeue(scheduler, model);
+        }
+        free(model->name);
+    }
+    pthread_mutex_destroy(&scheduler->mutex);
+    free(scheduler);
+}
+
+bool model_scheduler_set_limit(model_scheduler_t *scheduler, const char *model, int limit) {
+    pthread_mutex_lock(&scheduler->mutex);
+    model_entry_t *entry = find_model(scheduler, model, true);
+    if (entry != NULL) {
+        entry->limit = limit > 0 ? limit : 0;
+        entry->own_limit = true;
+    }
+    pthread_mutex_unlock(&scheduler->mutex);
+    return entry != NULL;
+}
+
+bool model_scheduler_push(model_scheduler_t *scheduler, const char *model, int64_t deadline_ms, void *job) {
+    queued_job_t *queued = malloc(sizeof(queued_job_t));
+    if (queued == NULL) {
+        return false;
+    }
+    queued->next = NULL;
+    queued->job = job;
+    queued->deadline_ms = deadline_ms;
+
+    pthread_mutex_lock(&scheduler->mutex);
+    model_entry_t *entry = scheduler->queued < MODEL_SCHEDULER_MAX_QUEUED
+        ? find_model(scheduler, model, true) : NULL;
+    if (entry == NULL) {
+        pthread_mutex_unlock(&scheduler->mutex);
+        free(queued);
+        return false;
+    }
+
+    if (entry->tail != NULL) {
+        entry->tail->next = queued;
+    } else {
+        entry->head = queued;
+    }
+    entry->tail = queued;
+    scheduler->queued++;
+    pthread_mutex_unlock(&scheduler->mutex);
+    return true;
+}
+
+void* model_scheduler_next(model_scheduler_t *scheduler) {
+    void *job = NULL;
+
+    pthread_mutex_lock(&scheduler->mutex);
+    if (scheduler->total_limit == 0 || scheduler->running < scheduler->total_limit) {
+        int index = pick_model(scheduler);
+        if (index >= 0) {
+            model_entry_t *model = &scheduler->models[index];
+            if (index != scheduler->current) {
+                if (scheduler->current >= 0) {
+                    scheduler->switches++;
+                }
+                scheduler->current = index;
+                scheduler->turn = 0;
+            } else if (scheduler->batch > 0 && scheduler->turn >= scheduler->batch) {
+                // Nobody else was waiting; a fresh turn for the same model
+                scheduler->turn = 0;
+            }
+            scheduler->turn++;
+            model->running++;
+            scheduler->running++;
+            scheduler->dispatched++;
+            job = dequeue(scheduler, model);
+        }
+    }
+    pthread_mutex_unlock(&scheduler->mutex);
+    return job;
+}
+
+void model_scheduler_finish(model_scheduler_t *scheduler, const char *model) {
+    pthread_mutex_lock(&scheduler->mutex);
+    model_entry_t *entry = find_model(scheduler, model, false);
+    if (entry != NULL && entry->running > 0) {
+        entry->running--;
+        scheduler->running--;
+    }
+    pthread_mutex_unlock(&scheduler->mutex);
+}
+
+void* model_scheduler_take_any(model_scheduler_t *scheduler) {
+    void *job = NULL;
+
+    pthread_mutex_lock(&scheduler->mutex);
+    for (int i = 0; i < MODEL_SCHEDULER_MAX_MODELS && job == NULL; i++) {
+        if (scheduler->models[i].head != NULL) {
+            job = dequeue(scheduler, &scheduler->models[i]);
+        }
+    }
+    pthread_mutex_unlock(&scheduler->mutex);
+    return job;
+}
+
+void model_scheduler_get_stats(model_scheduler_t *scheduler, model_scheduler_stats_t *stats) {
+    pthread_mutex_lock(&scheduler->mutex);
+    stats->dispatched = scheduler->dispatched;
+    stats->switches = scheduler->switches;
+    stats->queued = scheduler->queued;
+    stats->running = scheduler->running;
+    pthread_mutex_unlock(&scheduler->mutex);
+}
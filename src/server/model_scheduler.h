@@ -0,0 +1,55 @@
+#ifndef MODEL_SCHEDULER_H
+#define MODEL_SCHEDULER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Jobs waiting over all models before new ones are turned away
+#define MODEL_SCHEDULER_MAX_QUEUED 4096
+
+// Most models with their own queue at once
+#define MODEL_SCHEDULER_MAX_MODELS 64
+
+// A queued job this close to its deadline is started out of turn
+#define MODEL_SCHEDULER_URGENT_MS 2000
+
+// Per-model queues with fair dispatch
+//
+// Every model has a FIFO of jobs and a limit on how many of them run at
+// once, under an overall limit. Models take turns round-robin, and a turn
+// lasts up to `batch` jobs, so a backend keeps serving the model it has
+// loaded instead of switching back and forth between several. A waiting
+// job of another model whose deadline is close cuts the turn short.
+// All calls are thread-safe.
+typedef struct model_scheduler model_scheduler_t;
+
+// Limits of 0 mean unlimited
+model_scheduler_t* model_scheduler_create(int model_limit, int total_limit, int batch);
+void model_scheduler_destroy(model_scheduler_t *scheduler);
+
+// Give one model a limit of its own instead of model_limit
+bool model_scheduler_set_limit(model_scheduler_t *scheduler, const char *model, int limit);
+
+// Queue a job for the model. deadline_ms is CLOCK_MONOTONIC, 0 for none.
+// Returns false if the queue is full.
+bool model_scheduler_push(model_scheduler_t *scheduler, const char *model, int64_t deadline_ms, void *job);
+
+// The next job whose turn it is and that its limits allow, or NULL. The
+// job counts as running until model_scheduler_finish() for its model.
+void* model_scheduler_next(model_scheduler_t *scheduler);
+void model_scheduler_finish(model_scheduler_t *scheduler, const char *model);
+
+// Take any queued job regardless of turns and limits, for shutdown
+void* model_scheduler_take_any(model_scheduler_t *scheduler);
+
+typedef struct {
+    uint64_t dispatched;
+    uint64_t switches;          // dispatches of a different model than the one before
+    size_t queued;
+    int running;
+} model_scheduler_stats_t;
+
+void model_scheduler_get_stats(model_scheduler_t *scheduler, model_scheduler_stats_t *stats);
+
+#endif /* MODEL_SCHEDULER_H */
@@ -0,0 +1,196 @@
+#include "model_stats.h"
+#include "llm_interface.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// Totals exported by model_stats_render(): a field of the sums and the
+// factor that turns it into the exported unit
+static const struct {
+    const char *name;
+    const char *help;
+    size_t offset;
+    double scale;
+} exported[] = {
+    {"llm_model_prompt_tokens_total", "Prompt tokens evaluated (prefill).",
+     offsetof(generation_stats_t, prompt_eval_count), 1.0},
+    {"llm_model_prefill_seconds_total", "Time spent evaluating prompts.",
+     offsetof(generation_stats_t, prompt_eval_duration), 1e-9},
+    {"llm_model_decode_tokens_total", "Tokens generated (decode).",
+     offsetof(generation_stats_t, eval_count), 1.0},
+    {"llm_model_decode_seconds_total", "Time spent generating tokens.",
+     offsetof(generation_stats_t, eval_duration), 1e-9},
+    {"llm_model_load_seconds_total", "Time spent loading the model.",
+     offsetof(generation_stats_t, load_duration), 1e-9},
+    {"llm_model_queue_seconds_total", "Time generations waited before starting.",
+     offsetof(generation_stats_t, queue_ms), 1e-3},
+    {"llm_model_first_byte_seconds_total", "Time from sending a request to Ollama to its first byte.",
+     offsetof(generation_stats_t, first_byte_ms), 1e-3}
+};
+
+struct model_stats {
+    pthread_mutex_t mutex;
+    model_stats_entry_t models[MODEL_STATS_MAX_MODELS];
+    size_t count;
+};
+
+model_stats_t* model_stats_create(void) {
+    model_stats_t *stats = calloc(1, sizeof(model_stats_t));
+    if (stats == NULL) {
+        fprintf(stderr, "Error: Failed to allocate model statistics\n");
+        return NULL;
+    }
+    pthread_mutex_init(&stats->mutex, NULL);
+    return stats;
+}
+
+void model_stats_destroy(model_stats_t *stats) {
+    if (stats == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&stats->mutex);
+    free(stats);
+}
+
+// Caller holds the mutex
+static model_stats_entry_t* find_model(model_stats_t *stats, const char *model) {
+    for (size_t i = 0; i < stats->count; i++) {
+        if (llm_same_model(stats->models[i].name, model)) {
+            return &stats->models[i];
+        }
+    }
+    if (stats->count == MODEL_STATS_MAX_MODELS) {
+        return NULL;
+    }
+
+    model_stats_entry_t *entry = &stats->models[stats->count++];
+    memset(entry, 0, sizeof(*entry));
+    strncpy(entry->name, model, sizeof(entry->name) - 1);
+    return entry;
+}
+
+static void add(int64_t *sum, int64_t *reported, int64_t value) {
+    if (value >= 0) {
+        *sum += value;
+        (*reported)++;
+    }
+}
+
+void model_stats_record(model_stats_t *stats, const char *model, const generation_stats_t *generation) {
+    pthread_mutex_lock(&stats->mutex);
+    model_stats_entry_t *entry = find_model(stats, model);
+    if (entry != NULL) {
+        generation_stats_t *sum = &entry->sum;
+        generation_stats_t *reported = &entry->reported;
+        entry->generations++;
+        add(&sum->prompt_eval_count, &reported->prompt_eval_count, generation->prompt_eval_count);
+        add(&sum->prompt_eval_duration, &reported->prompt_eval_duration, generation->prompt_eval_duration);
+        add(&sum->eval_count, &reported->eval_count, generation->eval_count);
+        add(&sum->eval_duration, &reported->eval_duration, generation->eval_duration);
+        add(&sum->load_duration, &reported->load_duration, generation->load_duration);
+        add(&sum->total_duration, &reported->total_duration, generation->total_duration);
+        add(&sum->queue_ms, &reported->queue_ms, generation->queue_ms);
+        add(&sum->connect_ms, &reported->connect_ms, generation->connect_ms);
+        add(&sum->first_byte_ms, &reported->first_byte_ms, generation->first_byte_ms);
+        add(&sum->last_byte_ms, &reported->last_byte_ms, generation->last_byte_ms);
+    }
+    pthread_mutex_unlock(&stats->mutex);
+}
+
+size_t model_stats_snapshot(model_stats_t *stats, model_stats_entry_t *out, size_t max) {
+    pthread_mutex_lock(&stats->mutex);
+    size_t count = stats->count < max ? stats->count : max;
+    memcpy(out, stats->models, count * sizeof(model_stats_entry_t));
+    pthread_mutex_unlock(&stats->mutex);
+    return count;
+}
+
+static double average(int64_t sum, int64_t reported) {
+    return reported > 0 ? (double)sum / reported : 0.0;
+}
+
+// Tokens per second of a count over a duration in nanoseconds
+static double rate(int64_t tokens, int64_t duration) {
+    return duration > 0 ? tokens * 1e9 / duration : 0.0;
+}
+
+void model_stats_print(model_stats_t *stats) {
+    model_stats_entry_t models[MODEL_STATS_MAX_MODELS];
+    size_t count = model_stats_snapshot(stats, models, MODEL_STATS_MAX_MODELS);
+
+    for (size_t i = 0; i < count; i++) {
+        const model_stats_entry_t *model = &models[i];
+        const generation_stats_t *sum = &model->sum;
+        const generation_stats_t *reported = &model->reported;
+
+        // Which side of the engine's time dominates
+        int64_t engine_ns = sum->prompt_eval_duration + sum->eval_duration;
+        double prefill_share = engine_ns > 0 ? 100.0 * sum->prompt_eval_duration / engine_ns : 0.0;
+
+        printf("Model %s: %llu generations\n", model->name, (unsigned long long)model->generations);
+        printf("  prefill %.0f tokens/s, %.0f ms on average (%.0f%% of engine time)\n",
+               rate(sum->prompt_eval_count, sum->prompt_eval_duration),
+               average(sum->prompt_eval_duration, reported->prompt_eval_duration) / 1e6, prefill_share);
+        printf("  decode %.1f tokens/s, %.0f ms on average; model load %.0f ms on average\n",
+               rate(sum->eval_count, sum->eval_duration),
+               average(sum->eval_duration, reported->eval_duration) / 1e6,
+               average(sum->load_duration, reported->load_duration) / 1e6);
+        printf("  queue %.0f ms, connect %.0f ms, first byte %.0f ms, last byte %.0f ms on average\n",
+               average(sum->queue_ms, reported->queue_ms), average(sum->connect_ms, reported->connect_ms),
+               average(sum->first_byte_ms, reported->first_byte_ms),
+               average(sum->last_byte_ms, reported->last_byte_ms));
+    }
+}
+
+// Model name as a label value: backslash, quote and newline escaped
+static void escape_label(const char *name, char *out, size_t size) {
+    size_t length = 0;
+    for (const char *c = name; *c && length + 3 <= size; c++) {
+        if (*c == '\\' || *c == '"' || *c == '\n') {
+            out[length++] = '\\';
+            out[length++] = *c == '\n' ? 'n' : *c;
+        } else {
+            out[length++] = *c;
+        }
+    }
+    out[length] = '\0';
+}
+
+bool model_stats_render(model_stats_t *stats, arena_t *out) {
+    model_stats_entry_t models[MODEL_STATS_MAX_MODELS];
+    char labels[MODEL_STATS_MAX_MODELS][2 * sizeof(models[0].name)];
+    size_t count = model_stats_snapshot(stats, models, MODEL_STATS_MAX_MODELS);
+
+    for (size_t i = 0; i < count; i++) {
+        escape_label(models[i].name, labels[i], sizeof(labels[i]));
+    }
+
+    if (!arena_printf(out, "# HELP llm_model_generations_total Generations finished, by model.\n"
+                           "# TYPE llm_model_generations_total counter\n")) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!arena_printf(out, "llm_model_generations_total{model=\"%s\"} %llu\n",
+                          labels[i], (unsigned long long)models[i].generations)) {
+            return false;
+        }
+    }
+
+    for (size_t m = 0; m < sizeof(exported) / sizeof(exported[0]); m++) {
+        if (!arena_printf(out, "# HELP %s %s\n# TYPE %s counter\n",
+                          exported[m].name, exported[m].help, exported[m].name)) {
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            int64_t value;
+            memcpy(&value, (const char *)&models[i].sum + exported[m].offset, sizeof(value));
+            if (!arena_printf(out, "%s{model=\"%s\"} %.15g\n", exported[m].name, labels[i],
+                              value * exported[m].scale)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
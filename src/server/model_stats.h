@@ -0,0 +1,46 @@
+#ifndef MODEL_STATS_H
+#define MODEL_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+#include "../common/protocol.h"
+
+// Most models with totals of their own; later ones are not counted
+#define MODEL_STATS_MAX_MODELS 64
+
+// Totals of one model's generations. Each figure of `sum` adds up the
+// generations that reported it, and the same figure of `reported`
+// counts them, so an average leaves out the generations that did not.
+typedef struct {
+    char name[128];
+    uint64_t generations;
+    generation_stats_t sum;
+    generation_stats_t reported;
+} model_stats_entry_t;
+
+// Per-model totals of finished generations
+//
+// Prefill (prompt evaluation) and decode time are kept apart, with the
+// server's own queue and upstream timings, so slowness can be traced to
+// long prompts, slow token generation, model loads or waiting.
+// All calls are thread-safe.
+typedef struct model_stats model_stats_t;
+
+model_stats_t* model_stats_create(void);
+void model_stats_destroy(model_stats_t *stats);
+
+void model_stats_record(model_stats_t *stats, const char *model, const generation_stats_t *generation);
+
+// Copy up to `max` models' totals; returns how many were copied
+size_t model_stats_snapshot(model_stats_t *stats, model_stats_entry_t *out, size_t max);
+
+// One line per model, for the shutdown summary
+void model_stats_print(model_stats_t *stats);
+
+// Append the totals as Prometheus counters labelled by model, so the
+// prefill and decode rates can be watched while the server runs
+bool model_stats_render(model_stats_t *stats, arena_t *out);
+
+#endif /* MODEL_STATS_H */
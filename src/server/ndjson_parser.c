@@ -0,0 +1,523 @@
+#include "ndjson_parser.h"
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    STATE_RECORD,           // between objects
+    STATE_KEY_OR_END,       // just after '{'
+    STATE_KEY_START,        // after ',' inside an object
+    STATE_KEY,
+    STATE_KEY_ESCAPE,
+    STATE_COLON,
+    STATE_VALUE,
+    STATE_STRING,
+    STATE_STRING_ESCAPE,
+    STATE_STRING_UNICODE,
+    STATE_NUMBER,
+    STATE_LITERAL,
+    STATE_CONTEXT,          // inside the "context" array
+    STATE_SKIP,             // inside a nested value we do not use
+    STATE_AFTER_VALUE
+};
+
+enum {
+    FIELD_NONE,
+    FIELD_RESPONSE,
+    FIELD_DONE,
+    FIELD_CONTEXT,
+    FIELD_EVAL_COUNT,
+    FIELD_EVAL_DURATION,
+    FIELD_PROMPT_EVAL_COUNT,
+    FIELD_PROMPT_EVAL_DURATION,
+    FIELD_LOAD_DURATION,
+    FIELD_TOTAL_DURATION,
+    FIELD_ERROR
+};
+
+#define REPLACEMENT_CHARACTER 0xFFFD
+
+static const struct {
+    const char *name;
+    int field;
+} known_fields[] = {
+    { "response", FIELD_RESPONSE },
+    { "done", FIELD_DONE },
+    { "context", FIELD_CONTEXT },
+    { "eval_count", FIELD_EVAL_COUNT },
+    { "eval_duration", FIELD_EVAL_DURATION },
+    { "prompt_eval_count", FIELD_PROMPT_EVAL_COUNT },
+    { "prompt_eval_duration", FIELD_PROMPT_EVAL_DURATION },
+    { "load_duration", FIELD_LOAD_DURATION },
+    { "total_duration", FIELD_TOTAL_DURATION },
+    { "error", FIELD_ERROR }
+};
+
+void ndjson_parser_init(ndjson_parser_t *parser, ndjson_token_callback_t on_token, void *user_data) {
+    memset(parser, 0, sizeof(ndjson_parser_t));
+    parser->on_token = on_token;
+    parser->user_data = user_data;
+    parser->eval_count = -1;
+    parser->eval_duration = -1;
+    parser->prompt_eval_count = -1;
+    parser->prompt_eval_duration = -1;
+    parser->load_duration = -1;
+    parser->total_duration = -1;
+    parser->state = STATE_RECORD;
+}
+
+void ndjson_parser_free(ndjson_parser_t *parser) {
+    free(parser->context);
+    free(parser->error);
+    free(parser->text);
+    parser->context = NULL;
+    parser->error = NULL;
+    parser->text = NULL;
+}
+
+static bool fail(ndjson_parser_t *parser, const char *error) {
+    parser->parse_error = error;
+    return false;
+}
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool collecting(const ndjson_parser_t *parser) {
+    return parser->field == FIELD_RESPONSE || parser->field == FIELD_ERROR;
+}
+
+static bool append_text(ndjson_parser_t *parser, const char *data, size_t length) {
+    if (length == 0) {
+        return true;
+    }
+    if (parser->text_length + length > parser->text_capacity) {
+        size_t new_capacity = parser->text_capacity ? parser->text_capacity * 2 : 256;
+        while (new_capacity < parser->text_length + length) {
+            new_capacity *= 2;
+        }
+        char *new_text = realloc(parser->text, new_capacity);
+        if (new_text == NULL) {
+            return fail(parser, "Out of memory");
+        }
+        parser->text = new_text;
+        parser->text_capacity = new_capacity;
+    }
+    memcpy(parser->text + parser->text_length, data, length);
+    parser->text_length += length;
+    return true;
+}
+
+static bool append_code_point(ndjson_parser_t *parser, uint32_t cp) {
+    if (!collecting(parser)) {
+        return true;
+    }
+
+    char utf8[4];
+    size_t length;
+    if (cp < 0x80) {
+        utf8[0] = (char)cp;
+        length = 1;
+    } else if (cp < 0x800) {
+        utf8[0] = (char)(0xC0 | (cp >> 6));
+        utf8[1] = (char)(0x80 | (cp & 0x3F));
+        length = 2;
+    } else if (cp < 0x10000) {
+        utf8[0] = (char)(0xE0 | (cp >> 12));
+        utf8[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        utf8[2] = (char)(0x80 | (cp & 0x3F));
+        length = 3;
+    } else {
+        utf8[0] = (char)(0xF0 | (cp >> 18));
+        utf8[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        utf8[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        utf8[3] = (char)(0x80 | (cp & 0x3F));
+        length = 4;
+    }
+    return append_text(parser, utf8, length);
+}
+
+// A high surrogate not followed by a low one becomes U+FFFD
+static bool flush_surrogate(ndjson_parser_t *parser) {
+    if (parser->high_surrogate == 0) {
+        return true;
+    }
+    parser->high_surrogate = 0;
+    return append_code_point(parser, REPLACEMENT_CHARACTER);
+}
+
+static bool decode_unicode_escape(ndjson_parser_t *parser, uint32_t cp) {
+    if (parser->high_surrogate != 0) {
+        if (cp >= 0xDC00 && cp <= 0xDFFF) {
+            uint32_t combined = 0x10000 + ((parser->high_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+            parser->high_surrogate = 0;
+            return append_code_point(parser, combined);
+        }
+        if (!flush_surrogate(parser)) {
+            return false;
+        }
+    }
+
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+        parser->high_surrogate = cp;
+        return true;
+    }
+    if (cp >= 0xDC00 && cp <= 0xDFFF) {
+        return append_code_point(parser, REPLACEMENT_CHARACTER);
+    }
+    return append_code_point(parser, cp);
+}
+
+// The closing quote of a string value
+static bool finish_string(ndjson_parser_t *parser, const char *end) {
+    if (!collecting(parser)) {
+        return true;
+    }
+
+    const char *text;
+    size_t length;
+    if (parser->text_length == 0) {
+        // No escapes and no read boundary inside: use the input bytes in place
+        text = parser->span;
+        length = end - parser->span;
+    } else {
+        if (!append_text(parser, parser->span, end - parser->span)) {
+            return false;
+        }
+        text = parser->text;
+        length = parser->text_length;
+    }
+    parser->text_length = 0;
+
+    if (parser->field == FIELD_ERROR) {
+        free(parser->error);
+        parser->error = strndup(text, length);
+        return true;
+    }
+
+    if (length > 0 && !parser->on_token(text, length, parser->user_data)) {
+        return false;
+    }
+    return true;
+}
+
+static void finish_number(ndjson_parser_t *parser) {
+    int64_t value = parser->number_negative ? -parser->number : parser->number;
+
+    if (!parser->number_integer) {
+        return;
+    }
+    switch (parser->field) {
+        case FIELD_EVAL_COUNT:           parser->eval_count = value; break;
+        case FIELD_EVAL_DURATION:        parser->eval_duration = value; break;
+        case FIELD_PROMPT_EVAL_COUNT:    parser->prompt_eval_count = value; break;
+        case FIELD_PROMPT_EVAL_DURATION: parser->prompt_eval_duration = value; break;
+        case FIELD_LOAD_DURATION:        parser->load_duration = value; break;
+        case FIELD_TOTAL_DURATION:       parser->total_duration = value; break;
+    }
+}
+
+static bool push_context(ndjson_parser_t *parser) {
+    if (parser->context_length == parser->context_capacity) {
+        size_t new_capacity = parser->context_capacity ? parser->context_capacity * 2 : 256;
+        int *new_context = realloc(parser->context, new_capacity * sizeof(int));
+        if (new_context == NULL) {
+            return fail(parser, "Out of memory");
+        }
+        parser->context = new_context;
+        parser->context_capacity = new_capacity;
+    }
+    parser->context[parser->context_length++] =
+        (int)(parser->number_negative ? -parser->number : parser->number);
+    return true;
+}
+
+static int lookup_field(const ndjson_parser_t *parser) {
+    if (parser->key_length >= NDJSON_MAX_KEY) {
+        return FIELD_NONE;
+    }
+    for (size_t i = 0; i < sizeof(known_fields) / sizeof(known_fields[0]); i++) {
+        if (strlen(known_fields[i].name) == parser->key_length &&
+            memcmp(known_fields[i].name, parser->key, parser->key_length) == 0) {
+            return known_fields[i].field;
+        }
+    }
+    return FIELD_NONE;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool ndjson_parser_feed(ndjson_parser_t *parser, const char *data, size_t length) {
+    size_t i = 0;
+
+    // A string value may continue from the previous read
+    parser->span = data;
+
+    while (i < length) {
+        char c = data[i];
+
+        switch (parser->state) {
+            case STATE_RECORD:
+                if (c == '{') {
+                    // Nothing of the previous object carries over
+                    parser->done = false;
+                    parser->done_pending = false;
+                    parser->field = FIELD_NONE;
+                    parser->high_surrogate = 0;
+                    parser->text_length = 0;
+                    parser->state = STATE_KEY_OR_END;
+                } else if (!is_space(c)) {
+                    return fail(parser, "Expected a JSON object");
+                }
+                i++;
+                break;
+
+            case STATE_KEY_OR_END:
+            case STATE_KEY_START:
+            case STATE_AFTER_VALUE:
+                i++;
+                if (is_space(c)) {
+                    break;
+                }
+                if (c == '"' && parser->state != STATE_AFTER_VALUE) {
+                    parser->key_length = 0;
+                    parser->state = STATE_KEY;
+                } else if (c == ',' && parser->state == STATE_AFTER_VALUE) {
+                    parser->state = STATE_KEY_START;
+                } else if (c == '}' && parser->state != STATE_KEY_START) {
+                    parser->objects++;
+                    parser->done = parser->done_pending;
+                    parser->field = FIELD_NONE;
+                    parser->state = STATE_RECORD;
+                } else {
+                    return fail(parser, "Malformed JSON object");
+                }
+                break;
+
+            case STATE_KEY:
+                i++;
+                if (c == '"') {
+                    parser->field = lookup_field(parser);
+                    parser->state = STATE_COLON;
+                } else if (c == '\\') {
+                    // None of the keys we match contain escapes
+                    parser->key_length = NDJSON_MAX_KEY;
+                    parser->state = STATE_KEY_ESCAPE;
+                } else if (parser->key_length < NDJSON_MAX_KEY) {
+                    parser->key[parser->key_length++] = c;
+                }
+                break;
+
+            case STATE_KEY_ESCAPE:
+                i++;
+                parser->state = STATE_KEY;
+                break;
+
+            case STATE_COLON:
+                i++;
+                if (c == ':') {
+                    parser->state = STATE_VALUE;
+                } else if (!is_space(c)) {
+                    return fail(parser, "Expected ':' after key");
+                }
+                break;
+
+            case STATE_VALUE:
+                i++;
+                if (is_space(c)) {
+                    break;
+                }
+                if (c == '"') {
+                    parser->text_length = 0;
+                    parser->span = data + i;
+                    parser->state = STATE_STRING;
+                } else if (c == '[' && parser->field == FIELD_CONTEXT) {
+                    parser->context_length = 0;
+                    parser->number = 0;
+                    parser->number_negative = false;
+                    parser->number_integer = false;
+                    parser->state = STATE_CONTEXT;
+                } else if (c == '{' || c == '[') {
+                    parser->skip_depth = 1;
+                    parser->skip_in_string = false;
+                    parser->skip_escape = false;
+                    parser->state = STATE_SKIP;
+                } else if (c == '-' || (c >= '0' && c <= '9')) {
+                    parser->number_negative = c == '-';
+                    parser->number_integer = true;
+                    parser->number = c == '-' ? 0 : c - '0';
+                    parser->state = STATE_NUMBER;
+                } else if (c == 't' || c == 'f' || c == 'n') {
+                    if (parser->field == FIELD_DONE) {
+                        parser->done_pending = c == 't';
+                    }
+                    parser->state = STATE_LITERAL;
+                } else {
+                    return fail(parser, "Invalid JSON value");
+                }
+                break;
+
+            case STATE_STRING: {
+                if (parser->high_surrogate != 0 && c != '\\') {
+                    if (!flush_surrogate(parser)) {
+                        return false;
+                    }
+                }
+
+                // Plain bytes are not touched again until the string ends
+                while (i < length && data[i] != '"' && data[i] != '\\') {
+                    i++;
+                }
+                if (i == length) {
+                    break;
+                }
+
+                if (data[i] == '"') {
+                    if (!finish_string(parser, data + i)) {
+                        return false;
+                    }
+                    parser->state = STATE_AFTER_VALUE;
+                } else {
+                    if (collecting(parser) &&
+                        !append_text(parser, parser->span, data + i - parser->span)) {
+                        return false;
+                    }
+                    parser->state = STATE_STRING_ESCAPE;
+                }
+                i++;
+                break;
+            }
+
+            case STATE_STRING_ESCAPE: {
+                i++;
+                if (c != 'u' && !flush_surrogate(parser)) {
+                    return false;
+                }
+
+                char decoded;
+                switch (c) {
+                    case '"':  decoded = '"';  break;
+                    case '\\': decoded = '\\'; break;
+                    case '/':  decoded = '/';  break;
+                    case 'b':  decoded = '\b'; break;
+                    case 'f':  decoded = '\f'; break;
+                    case 'n':  decoded = '\n'; break;
+                    case 'r':  decoded = '\r'; break;
+                    case 't':  decoded = '\t'; break;
+                    case 'u':
+                        parser->unicode_digits = 0;
+                        parser->unicode_value = 0;
+                        parser->state = STATE_STRING_UNICODE;
+                        continue;
+                    default:
+                        return fail(parser, "Invalid escape sequence");
+                }
+
+                if (collecting(parser) && !append_text(parser, &decoded, 1)) {
+                    return false;
+                }
+                parser->span = data + i;
+                parser->state = STATE_STRING;
+                break;
+            }
+
+            case STATE_STRING_UNICODE: {
+                i++;
+                int digit = hex_value(c);
+                if (digit < 0) {
+                    return fail(parser, "Invalid \\u escape");
+                }
+                parser->unicode_value = (parser->unicode_value << 4) | (uint32_t)digit;
+                if (++parser->unicode_digits < 4) {
+                    break;
+                }
+
+                if (!decode_unicode_escape(parser, parser->unicode_value)) {
+                    return false;
+                }
+                parser->span = data + i;
+                parser->state = STATE_STRING;
+                break;
+            }
+
+            case STATE_NUMBER:
+                if (c >= '0' && c <= '9') {
+                    if (parser->number < INT64_MAX / 10) {
+                        parser->number = parser->number * 10 + (c - '0');
+                    }
+                    i++;
+                } else if (c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+                    parser->number_integer = false;
+                    i++;
+                } else {
+                    // The delimiter is handled by the next state
+                    finish_number(parser);
+                    parser->state = STATE_AFTER_VALUE;
+                }
+                break;
+
+            case STATE_LITERAL:
+                if (c >= 'a' && c <= 'z') {
+                    i++;
+                } else {
+                    parser->state = STATE_AFTER_VALUE;
+                }
+                break;
+
+            case STATE_CONTEXT:
+                if (c >= '0' && c <= '9') {
+                    parser->number = parser->number < INT64_MAX / 10 ? parser->number * 10 + (c - '0')
+                                                                      : parser->number;
+                    parser->number_integer = true;
+                } else if (c == ',' || c == ']' || is_space(c)) {
+                    if (parser->number_integer && !push_context(parser)) {
+                        return false;
+                    }
+                    parser->number = 0;
+                    parser->number_negative = false;
+                    parser->number_integer = false;
+                    if (c == ']') {
+                        parser->state = STATE_AFTER_VALUE;
+                    }
+                } else if (c == '-') {
+                    parser->number_negative = true;
+                } else {
+                    return fail(parser, "Invalid context array");
+                }
+                i++;
+                break;
+
+            case STATE_SKIP:
+                i++;
+                if (parser->skip_in_string) {
+                    if (parser->skip_escape) {
+                        parser->skip_escape = false;
+                    } else if (c == '\\') {
+                        parser->skip_escape = true;
+                    } else if (c == '"') {
+                        parser->skip_in_string = false;
+                    }
+                } else if (c == '"') {
+                    parser->skip_in_string = true;
+                } else if (c == '{' || c == '[') {
+                    parser->skip_depth++;
+                } else if ((c == '}' || c == ']') && --parser->skip_depth == 0) {
+                    parser->state = STATE_AFTER_VALUE;
+                }
+                break;
+        }
+    }
+
+    // Keep the undecoded tail of a string that continues in the next read
+    if (parser->state == STATE_STRING && collecting(parser) &&
+        !append_text(parser, parser->span, data + length - parser->span)) {
+        return false;
+    }
+
+    return true;
+}
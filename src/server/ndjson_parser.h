@@ -0,0 +1,72 @@
+#ifndef NDJSON_PARSER_H
+#define NDJSON_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest object key we need to recognise; longer keys are skipped
+#define NDJSON_MAX_KEY 32
+
+// Receives the decoded "response" text of one streamed object. The
+// pointer is only valid during the call. Return false to stop parsing.
+typedef bool (*ndjson_token_callback_t)(const char *text, size_t length, void *user_data);
+
+// Streaming parser for Ollama's newline-delimited JSON responses
+//
+// Body bytes are fed as they arrive, split anywhere. Each byte is looked
+// at once: the top-level keys we care about are picked out on the fly,
+// and string values are unescaped (including \uXXXX surrogate pairs)
+// straight into the output buffer. A token with no escapes that arrives
+// in one piece is passed to the callback without being copied at all.
+typedef struct {
+    ndjson_token_callback_t on_token;
+    void *user_data;
+
+    // Fields of the streamed objects
+    bool done;                  // the object carrying "done": true is complete
+    int64_t eval_count;         // -1 until reported, like the counts and durations below
+    int64_t eval_duration;      // nanoseconds
+    int64_t prompt_eval_count;
+    int64_t prompt_eval_duration;
+    int64_t load_duration;
+    int64_t total_duration;
+    int *context;               // "context" of the final object
+    size_t context_length;
+    size_t context_capacity;
+    char *error;                // "error" message, if Ollama sent one
+    unsigned long objects;      // complete objects parsed
+
+    // Parser state
+    int state;
+    int field;                  // which known key the current value belongs to
+    int skip_depth;             // nesting level inside a value we ignore
+    bool skip_in_string;
+    bool skip_escape;
+    char key[NDJSON_MAX_KEY];
+    size_t key_length;
+    bool number_negative;
+    bool number_integer;
+    int64_t number;
+    int unicode_digits;
+    uint32_t unicode_value;
+    uint32_t high_surrogate;    // pending first half of a surrogate pair
+
+    // Decoded string being built when it could not be passed in place
+    char *text;
+    size_t text_length;
+    size_t text_capacity;
+    const char *span;           // undecoded run inside the current input
+
+    bool done_pending;          // "done": true seen, object still open
+    const char *parse_error;
+} ndjson_parser_t;
+
+void ndjson_parser_init(ndjson_parser_t *parser, ndjson_token_callback_t on_token, void *user_data);
+void ndjson_parser_free(ndjson_parser_t *parser);
+
+// Feed body bytes. Returns false on malformed JSON (parse_error says why)
+// or when the token callback asked to stop.
+bool ndjson_parser_feed(ndjson_parser_t *parser, const char *data, size_t length);
+
+#endif /* NDJSON_PARSER_H */
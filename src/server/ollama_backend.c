@@ -0,0 +1,1919 @@
+#include "llm_backend.h"
+#include "backend_pool.h"
+#include "http_parser.h"
+#include "ndjson_parser.h"
+#include "json_reader.h"
+#include "arena.h"
+#include "metrics.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+
+// Longest non-streamed reply accepted (/api/embed, /api/ps, /api/tags)
+#define REPLY_MAX_BYTES (64 * 1024 * 1024)
+
+// How long each kind of non-streamed request may go without an answer
+#define EMBED_TIMEOUT_MS 30000
+#define MODEL_LOAD_TIMEOUT_MS 600000
+#define MODEL_LIST_TIMEOUT_MS 5000
+
+// How often generations on the event loop that wait for a backend slot
+// look again, since a slot freed on another thread does not wake the loop
+#define SLOT_RETRY_MS 100
+
+// Request arenas kept for reuse; one that grew past ARENA_KEEP_BYTES for
+// an unusually large request is freed instead
+#define SPARE_ARENAS 16
+#define ARENA_KEEP_BYTES (1024 * 1024)
+
+// Hedging: first-token times kept for the percentile, how many are needed
+// before any generation is hedged, and how many hedges the budget saves up
+#define HEDGE_SAMPLES 256
+#define HEDGE_MIN_SAMPLES 20
+#define HEDGE_BURST 10.0
+
+// Room reserved behind a request body for the HTTP head
+#define REQUEST_HEAD_BYTES (sizeof(((upstream_pool_t *)0)->host_header) + 256)
+
+typedef struct ollama_exchange ollama_exchange_t;
+
+// Ollama over HTTP: /api/generate streams tokens, /api/embed returns vectors
+typedef struct {
+    llm_config_t config;
+    backend_pool_t *backends;
+    
+    // Event loop generations waiting for a backend slot, oldest first;
+    // only touched on the loop thread
+    event_loop_t *loop;
+    ollama_exchange_t *waiting_head;
+    ollama_exchange_t *waiting_tail;
+    event_timer_t *retry_timer;
+    bool waking;
+    
+    // Hedging, also only on the loop thread. Every generation adds
+    // hedge_budget_percent / 100 to the credit and a hedge takes 1.
+    int first_token_ms[HEDGE_SAMPLES];  // ring of recent first-token times
+    uint64_t first_token_count;
+    int64_t hedge_delay_ms;             // their percentile, 0 until there are enough
+    double hedge_credit;
+    uint64_t hedges;
+    uint64_t hedges_won;
+    
+    // Arenas of finished requests, ready for the next ones
+    pthread_mutex_t arenas_mutex;
+    arena_t spare_arenas[SPARE_ARENAS];
+    int spare_arena_count;
+} ollama_backend_t;
+
+// An HTTP request laid out in an arena: the body at the start, then the
+// head, so the head can be redone for another backend while the body
+// stays put. Sent head first, in one sendmsg() where the socket allows.
+typedef struct {
+    struct iovec iov[2];
+    size_t length;
+} request_vector_t;
+
+static void take_arena(ollama_backend_t *ollama, arena_t *arena) {
+    pthread_mutex_lock(&ollama->arenas_mutex);
+    if (ollama->spare_arena_count > 0) {
+        *arena = ollama->spare_arenas[--ollama->spare_arena_count];
+    } else {
+        arena_init(arena);
+    }
+    pthread_mutex_unlock(&ollama->arenas_mutex);
+}
+
+static void give_back_arena(ollama_backend_t *ollama, arena_t *arena) {
+    arena_reset(arena);
+    pthread_mutex_lock(&ollama->arenas_mutex);
+    if (arena->capacity <= ARENA_KEEP_BYTES && ollama->spare_arena_count < SPARE_ARENAS) {
+        ollama->spare_arenas[ollama->spare_arena_count++] = *arena;
+        arena_init(arena);
+    }
+    pthread_mutex_unlock(&ollama->arenas_mutex);
+    arena_free(arena);
+}
+
+// Append the head for the body_length bytes at the start of the arena,
+// replacing any earlier head, and lay the request out for sending. The
+// connection stays open afterwards so the next request can reuse it.
+static bool format_request(arena_t *arena, size_t body_length, const upstream_pool_t *upstream,
+                           const char *method, const char *path, request_vector_t *request) {
+    arena->length = body_length;
+    bool ok = body_length > 0
+        ? arena_printf(arena,
+                       "%s %s HTTP/1.1\r\n"
+                       "Host: %s\r\n"
+                       "Content-Type: application/json\r\n"
+                       "Accept: application/json\r\n"
+                       "Content-Length: %zu\r\n"
+                       "Connection: keep-alive\r\n\r\n",
+                       method, path, upstream->host_header, body_length)
+        : arena_printf(arena,
+                       "%s %s HTTP/1.1\r\n"
+                       "Host: %s\r\n"
+                       "Accept: application/json\r\n"
+                       "Connection: keep-alive\r\n\r\n",
+                       method, path, upstream->host_header);
+    if (!ok) {
+        return false;
+    }
+    
+    request->iov[0].iov_base = arena->data + body_length;
+    request->iov[0].iov_len = arena->length - body_length;
+    request->iov[1].iov_base = arena->data;
+    request->iov[1].iov_len = body_length;
+    request->length = arena->length;
+    return true;
+}
+
+static void log_request(const request_vector_t *request) {
+    printf("\n=======================================\n");
+    printf("Sending request to Ollama:\n%.*s%.*s\n",
+           (int)request->iov[0].iov_len, (const char *)request->iov[0].iov_base,
+           (int)request->iov[1].iov_len, (const char *)request->iov[1].iov_base);
+    printf("=======================================\n");
+}
+
+// Send the request from byte *sent on, for as long as the socket takes
+// it; on a blocking socket that is all of it. Returns false on an error.
+static bool send_request_bytes(int fd, const request_vector_t *request, size_t *sent) {
+    while (*sent < request->length) {
+        struct iovec rest[2];
+        int count = 0;
+        size_t skip = *sent;
+        for (int i = 0; i < 2; i++) {
+            if (skip >= request->iov[i].iov_len) {
+                skip -= request->iov[i].iov_len;
+                continue;
+            }
+            rest[count].iov_base = (char *)request->iov[i].iov_base + skip;
+            rest[count].iov_len = request->iov[i].iov_len - skip;
+            count++;
+            skip = 0;
+        }
+        
+        struct msghdr message = { .msg_iov = rest, .msg_iovlen = count };
+        ssize_t bytes_sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (bytes_sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        *sent += bytes_sent;
+    }
+    return true;
+}
+
+// Write the whole request, retrying short writes
+static bool send_all(int fd, const request_vector_t *request) {
+    size_t sent = 0;
+    return send_request_bytes(fd, request, &sent) && sent == request->length;
+}
+
+// State of one streamed /api/generate response
+typedef struct {
+    ndjson_parser_t json;
+    llm_request_t *request;
+    ollama_exchange_t *exchange;    // NULL off the event loop
+    llm_token_callback_t on_token;
+    void *user_ctx;
+    bool stopped;               // malformed JSON, or the caller cancelled
+    size_t tokens;              // received so far, for the stall deadline
+    int64_t first_token_ms;
+    int64_t last_token_ms;
+    
+    // Upstream timings for the stats, CLOCK_MONOTONIC ms, 0 until they happen
+    int64_t connect_ms;         // spent connecting, 0 on a pooled connection
+    int64_t sent_at;            // the request went out
+    int64_t first_byte_at;
+    int64_t last_byte_at;
+    
+    // Tracing: the id spans go under, 0 if not traced, and where the
+    // current span began, metrics_now_us() clock
+    uint64_t trace_id;
+    int64_t trace_mark;
+} generate_stream_t;
+
+static void exchange_first_token(ollama_exchange_t *exchange);
+
+static void trace_start(generate_stream_t *stream, uint64_t trace_id) {
+    stream->trace_id = trace_id;
+    stream->trace_mark = trace_id != 0 ? metrics_now_us() : 0;
+}
+
+// End the current span of a traced request under this name; the next
+// one begins
+static void trace_phase(generate_stream_t *stream, const char *name) {
+    if (stream->trace_id != 0) {
+        int64_t now = metrics_now_us();
+        trace_span(stream->trace_id, name, stream->trace_mark, now);
+        stream->trace_mark = now;
+    }
+}
+
+// The last span runs until the response is over
+static void trace_finish(generate_stream_t *stream) {
+    if (stream->trace_id != 0) {
+        trace_span_arg(stream->trace_id, stream->tokens > 0 ? "decode" : "response", stream->trace_mark,
+                       metrics_now_us(), "tokens", (int64_t)stream->tokens);
+        stream->trace_id = 0;
+    }
+}
+
+// Tokens stop flowing as soon as the request is cancelled
+static bool forward_token(const char *token, size_t length, void *user_data) {
+    generate_stream_t *stream = user_data;
+    
+    if (atomic_load(&stream->request->cancelled)) {
+        return false;
+    }
+    if (stream->tokens == 0 && stream->exchange != NULL) {
+        exchange_first_token(stream->exchange);
+    }
+    stream->tokens++;
+    stream->last_token_ms = llm_monotonic_ms();
+    if (stream->tokens == 1) {
+        stream->first_token_ms = stream->last_token_ms;
+        trace_phase(stream, "prefill");
+    }
+    return stream->on_token(token, length, stream->user_ctx);
+}
+
+// Body callback: decoded HTTP body bytes go straight into the JSON parser,
+// which hands each token to the caller as soon as its object is parsed
+static bool handle_body(const char *data, size_t length, void *user_data) {
+    generate_stream_t *stream = user_data;
+    
+    if (!ndjson_parser_feed(&stream->json, data, length)) {
+        stream->stopped = true;
+        return false;
+    }
+    
+    // After the last object keep consuming, so the HTTP parser reaches the
+    // end of the body and the connection can be reused
+    return true;
+}
+
+static void* ollama_init(const llm_config_t *config) {
+    ollama_backend_t *ollama = calloc(1, sizeof(ollama_backend_t));
+    if (ollama == NULL) {
+        return NULL;
+    }
+    memcpy(&ollama->config, config, sizeof(llm_config_t));
+    pthread_mutex_init(&ollama->arenas_mutex, NULL);
+    
+    // Without a backend list, the single ollama_* address is the only backend
+    llm_backend_config_t single;
+    const llm_backend_config_t *backends = config->backends;
+    int backend_count = config->backend_count;
+    if (backend_count == 0) {
+        memset(&single, 0, sizeof(single));
+        strncpy(single.host, config->ollama_host, sizeof(single.host) - 1);
+        single.port = config->ollama_port;
+        strncpy(single.socket, config->ollama_socket, sizeof(single.socket) - 1);
+        backends = &single;
+        backend_count = 1;
+    }
+    
+    // Resolve the backends once; requests then reuse pooled connections
+    ollama->backends = backend_pool_create(backends, backend_count, config->health_interval,
+                                           config->connect_timeout_ms, config->breaker_slow_ms,
+                                           config->verbose);
+    if (ollama->backends == NULL) {
+        fprintf(stderr, "Error: Failed to set up Ollama upstream\n");
+        pthread_mutex_destroy(&ollama->arenas_mutex);
+        free(ollama);
+        return NULL;
+    }
+    
+    return ollama;
+}
+
+static void ollama_cleanup(void *state) {
+    ollama_backend_t *ollama = state;
+    
+    if (ollama->config.verbose && ollama->hedges > 0) {
+        printf("Hedged %llu generations, %llu won by the hedge\n",
+               (unsigned long long)ollama->hedges, (unsigned long long)ollama->hedges_won);
+    }
+    backend_pool_destroy(ollama->backends);
+    for (int i = 0; i < ollama->spare_arena_count; i++) {
+        arena_free(&ollama->spare_arenas[i]);
+    }
+    pthread_mutex_destroy(&ollama->arenas_mutex);
+    free(ollama);
+}
+
+// JSON body of an /api/generate request, appended to the arena with the
+// prompt escaped in place
+static bool build_generate_body(const ollama_backend_t *ollama, const llm_request_t *request, arena_t *arena) {
+    const llm_config_t *config = &ollama->config;
+    
+    const char *model_name = request->model;
+    if (config->verbose) {
+        printf("Using Ollama model: %s\n", model_name);
+    }
+    
+    // One allocation at most for a new arena, unless escaping grows the prompt
+    size_t estimate = strlen(request->prompt) + strlen(model_name) + request->context_length * 12 + 256;
+    if (!arena_reserve(arena, estimate + REQUEST_HEAD_BYTES)) {
+        return false;
+    }
+    
+    bool ok = arena_append_string(arena, "{\"model\":") &&
+              arena_append_json_string(arena, model_name) &&
+              arena_append_string(arena, ",\"prompt\":") &&
+              arena_append_json_string(arena, request->prompt) &&
+              arena_append_string(arena, ",\"stream\":true");
+    
+    // Previous turn's context, as ,"context":[...]
+    if (request->context_length > 0) {
+        ok = ok && arena_append_string(arena, ",\"context\":[");
+        for (size_t i = 0; ok && i < request->context_length; i++) {
+            ok = arena_printf(arena, "%s%d", i > 0 ? "," : "", request->context[i]);
+        }
+        ok = ok && arena_append_string(arena, "]");
+    }
+    
+    // Sampling parameters belong in "options"; a negative seed leaves it random
+    ok = ok && arena_printf(arena, ",\"keep_alive\":%d,\"options\":{\"temperature\":%.2f,\"num_predict\":%d,\"num_ctx\":%d",
+                            config->keep_alive, request->temperature, request->max_tokens, request->context_size);
+    if (request->seed >= 0) {
+        ok = ok && arena_printf(arena, ",\"seed\":%d", request->seed);
+    }
+    return ok && arena_append_string(arena, "}}");
+}
+
+// Nearest deadline of a request whose HTTP request went out at sent_at:
+// the first token, then the next one, and the end of the whole
+// generation. Returns 0 if none applies; *expiry says what it means.
+static int64_t next_deadline(const llm_config_t *config, const llm_request_t *request,
+                             const generate_stream_t *stream, int64_t sent_at, const char **expiry) {
+    int64_t deadline = 0;
+    *expiry = NULL;
+    if (stream->tokens == 0 && config->first_token_timeout_ms > 0) {
+        deadline = sent_at + config->first_token_timeout_ms;
+        *expiry = "Ollama did not start answering in time";
+    } else if (stream->tokens > 0 && config->stall_timeout_ms > 0) {
+        deadline = stream->last_token_ms + config->stall_timeout_ms;
+        *expiry = "Ollama stopped sending tokens";
+    }
+    if (request->deadline_ms > 0 && (deadline == 0 || request->deadline_ms <= deadline)) {
+        deadline = request->deadline_ms;
+        *expiry = "Generation deadline exceeded";
+    }
+    return deadline;
+}
+
+// Why no backend could be reserved for the request
+static const char* acquire_failure(const llm_request_t *request) {
+    if (atomic_load(&request->cancelled)) {
+        return "Generation cancelled";
+    }
+    if (request->deadline_ms > 0 && llm_monotonic_ms() >= request->deadline_ms) {
+        return "Generation deadline exceeded";
+    }
+    return llm_unavailable_error;
+}
+
+// Settle a finished exchange: return the connection and the backend slot,
+// then judge the response; the time from sending the request to the first
+// token tells whether the backend is slow. On failure returns false and
+// points *error at a static description.
+static bool finish_exchange(ollama_backend_t *ollama, llm_request_t *request, generate_stream_t *stream,
+                            backend_t *backend, bool trial, upstream_connection_t *conn, const http_parser_t *parser,
+                            const char *timed_out, const char **error) {
+    const llm_config_t *config = &ollama->config;
+    
+    // Return the connection to the pool if it is clean; the socket is only
+    // positioned at the next response once the whole body has been read
+    upstream_pool_release(backend->upstream, conn, http_parser_complete(parser) && parser->keep_alive);
+    
+    // A cancelled request says nothing about the backend, and neither does
+    // the client's own deadline once the backend was answering. A deadline
+    // that ran out before the first byte counts against it, as the
+    // first-token timeout would; so does a 5xx or a silent backend.
+    bool cancelled = stream->stopped && stream->json.parse_error == NULL;
+    bool expired = timed_out != NULL && request->deadline_ms > 0 && llm_monotonic_ms() >= request->deadline_ms;
+    if (cancelled || (expired && stream->first_byte_at > 0)) {
+        backend_pool_release_unjudged(ollama->backends, backend, trial);
+    } else {
+        bool healthy = timed_out == NULL && http_parser_headers_done(parser) && parser->status_code < 500;
+        int64_t latency_ms = stream->tokens > 0 ? stream->first_token_ms - stream->sent_at : -1;
+        backend_pool_release_timed(ollama->backends, backend, trial, healthy, latency_ms);
+    }
+    
+    bool ok = false;
+    if (timed_out != NULL) {
+        if (config->verbose) {
+            printf("%s after %zu tokens\n", timed_out, stream->tokens);
+        }
+        *error = timed_out;
+    } else if (stream->stopped && stream->json.parse_error == NULL) {
+        *error = "Generation cancelled";
+    } else if (stream->stopped) {
+        if (config->verbose) {
+            printf("Malformed JSON from Ollama: %s\n", stream->json.parse_error);
+        }
+        *error = "Ollama sent a malformed response";
+    } else if (stream->json.error != NULL) {
+        fprintf(stderr, "Error: Ollama: %s\n", stream->json.error);
+        *error = "Ollama reported an error";
+    } else if (http_parser_headers_done(parser) && parser->status_code != 200) {
+        if (config->verbose) {
+            printf("Ollama answered with HTTP status %d\n", parser->status_code);
+        }
+        *error = "Ollama rejected the request";
+    } else if (stream->json.objects == 0) {
+        if (config->verbose) {
+            printf("Failed to extract valid response from Ollama\n");
+        }
+        *error = "No valid response received from Ollama. Please check if Ollama is running correctly.";
+    } else if (!stream->json.done) {
+        *error = "Ollama response was incomplete";
+    } else {
+        ok = true;
+    }
+    
+    if (ok && config->verbose) {
+        printf("Ollama generated %lld tokens in %.3f s\n",
+               (long long)stream->json.eval_count, stream->json.eval_duration / 1e9);
+        printf("Successfully streamed complete response from Ollama\n");
+    }
+    return ok;
+}
+
+// Run one request against Ollama, feeding the response into stream->json.
+// On failure returns false and points *error at a static description.
+static bool generate(ollama_backend_t *ollama, llm_request_t *request,
+                     generate_stream_t *stream, const char **error) {
+    const llm_config_t *config = &ollama->config;
+    
+    if (strlen(request->prompt) == 0) {
+        *error = "Empty prompt";
+        return false;
+    }
+    
+    arena_t arena;
+    take_arena(ollama, &arena);
+    if (!build_generate_body(ollama, request, &arena)) {
+        give_back_arena(ollama, &arena);
+        *error = "Memory allocation failed";
+        return false;
+    }
+    size_t body_length = arena.length;
+    request_vector_t http_request;
+    
+    // Try backends until one takes the request. A backend that cannot be
+    // reached, or drops the connection before answering, is skipped; once
+    // any response byte arrived the request is committed to that backend.
+    uint32_t tried = 0;
+    backend_t *backend = NULL;
+    bool trial = false;
+    upstream_connection_t *conn = NULL;
+    http_parser_t parser;
+    const char *timed_out = NULL;   // which deadline passed, if one did
+    
+    for (;;) {
+        backend = backend_pool_acquire(ollama->backends, request->affinity, tried,
+                                       &request->cancelled, request->deadline_ms, &trial);
+        if (backend == NULL) {
+            give_back_arena(ollama, &arena);
+            *error = acquire_failure(request);
+            return false;
+        }
+        tried |= 1u << backend->index;
+        upstream_pool_t *upstream = backend->upstream;
+        trace_phase(stream, "backend slot");
+        
+        if (!format_request(&arena, body_length, upstream, "POST", "/api/generate", &http_request)) {
+            backend_pool_release_unjudged(ollama->backends, backend, trial);
+            give_back_arena(ollama, &arena);
+            *error = "Memory allocation failed";
+            return false;
+        }
+        
+        if (config->verbose) {
+            log_request(&http_request);
+        }
+        // Take a pooled keep-alive connection (or open one) and send the request
+        int64_t connect_started = llm_monotonic_ms();
+        conn = upstream_pool_acquire(upstream);
+        if (conn == NULL) {
+            if (config->verbose) {
+                printf("Failed to connect to Ollama at %s\n", upstream->host_header);
+            }
+            backend_pool_release(ollama->backends, backend, trial, false);
+            continue;
+        }
+        
+        stream->connect_ms = conn->reused ? 0 : llm_monotonic_ms() - connect_started;
+        if (config->verbose) {
+            printf("%s Ollama connection to %s (%lu earlier requests)\n",
+                   conn->reused ? "Reusing" : "Opened", upstream->host_header, conn->requests);
+        }
+        
+        bool sent = send_all(conn->fd, &http_request);
+        if (!sent && conn->reused) {
+            // The upstream may have dropped an idle keep-alive socket; retry once fresh
+            upstream_pool_release(upstream, conn, false);
+            conn = upstream_pool_connect(upstream);
+            sent = conn != NULL && send_all(conn->fd, &http_request);
+        }
+        
+        if (!sent) {
+            if (config->verbose) {
+                printf("Failed to send request: %s\n", strerror(errno));
+            }
+            upstream_pool_release(upstream, conn, false);
+            backend_pool_release(ollama->backends, backend, trial, false);
+            continue;
+        }
+        
+        if (config->verbose) {
+            printf("Request sent successfully, waiting for response...\n");
+        }
+        trace_phase(stream, "connect");
+        
+        // Receive the streamed response and hand each token on as soon as its
+        // JSON object is parsed, instead of waiting for the whole body
+        char buffer[4096];
+        http_parser_init(&parser);
+        
+        size_t total_received = 0;
+        bool lost = false;          // connection failed before any response byte
+        
+        if (config->verbose) {
+            printf("\n=== STARTING OLLAMA RESPONSE RECEPTION ===\n");
+        }
+        
+        // Wait for data against the nearest deadline
+        stream->sent_at = llm_monotonic_ms();
+        while (!http_parser_complete(&parser) && !stream->stopped) {
+            const char *expiry;
+            int64_t deadline = next_deadline(config, request, stream, stream->sent_at, &expiry);
+            
+            int timeout_ms = -1;
+            if (deadline > 0) {
+                int64_t now = llm_monotonic_ms();
+                if (now >= deadline) {
+                    timed_out = expiry;
+                    break;
+                }
+                timeout_ms = (int)(deadline - now);
+            }
+            
+            struct pollfd pfds[2] = {
+                { .fd = conn->fd, .events = POLLIN },
+                { .fd = request->cancel_fd, .events = POLLIN }
+            };
+            int ready = poll(pfds, 2, timeout_ms);
+            
+            if (ready < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (config->verbose) {
+                    printf("Poll error: %s\n", strerror(errno));
+                }
+                break;
+            } else if (ready == 0) {
+                // A deadline passed; the top of the loop says which
+                continue;
+            }
+            
+            if (pfds[1].revents & POLLIN) {
+                // Cancelled from another thread; the half-read response makes
+                // this connection unusable, so it is not returned to the pool
+                stream->stopped = true;
+                break;
+            }
+            
+            ssize_t bytes_received = recv(conn->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            
+            if (bytes_received < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    // No data available, try again
+                    continue;
+                }
+                if (config->verbose) {
+                    printf("Error receiving data: %s\n", strerror(errno));
+                }
+                if (total_received == 0) {
+                    lost = true;
+                    break;
+                }
+                upstream_pool_release(upstream, conn, false);
+                backend_pool_release(ollama->backends, backend, trial, false);
+                give_back_arena(ollama, &arena);
+                *error = "Failed to receive data from Ollama";
+                return false;
+            } else if (bytes_received == 0) {
+                if (total_received == 0 && conn->reused) {
+                    // Stale keep-alive socket closed under us: resend on a fresh one
+                    upstream_pool_release(upstream, conn, false);
+                    conn = upstream_pool_connect(upstream);
+                    if (conn != NULL && send_all(conn->fd, &http_request)) {
+                        continue;
+                    }
+                    lost = true;
+                    break;
+                }
+                
+                // Connection closed by server
+                if (config->verbose) {
+                    printf("Connection closed by Ollama server\n");
+                }
+                if (total_received == 0) {
+                    lost = true;
+                    break;
+                }
+                http_parser_finish(&parser);
+                break;
+            }
+            
+            stream->last_byte_at = llm_monotonic_ms();
+            if (total_received == 0) {
+                stream->first_byte_at = stream->last_byte_at;
+            }
+            total_received += bytes_received;
+            if (config->verbose) {
+                printf("Received %zd bytes from Ollama\n", bytes_received);
+            }
+            
+            // The parser strips HTTP and chunk framing and hands body bytes to
+            // handle_body, wherever the read boundaries fall
+            if (http_parser_feed(&parser, buffer, bytes_received, handle_body, stream) < 0) {
+                if (config->verbose) {
+                    printf("Invalid HTTP response from Ollama: %s\n", parser.error);
+                }
+                break;
+            }
+        }
+        
+        if (lost) {
+            // Nothing reached the caller yet, so another backend may answer instead
+            upstream_pool_release(upstream, conn, false);
+            backend_pool_release(ollama->backends, backend, trial, false);
+            continue;
+        }
+        break;
+    }
+    
+    give_back_arena(ollama, &arena);
+    
+    return finish_exchange(ollama, request, stream, backend, trial, conn, &parser, timed_out, error);
+}
+
+// Counts and durations from the final chunk, with the upstream timings
+static void fill_stats(const generate_stream_t *stream, generation_stats_t *stats) {
+    *stats = (generation_stats_t)GENERATION_STATS_UNKNOWN;
+    stats->prompt_eval_count = stream->json.prompt_eval_count;
+    stats->prompt_eval_duration = stream->json.prompt_eval_duration;
+    stats->eval_count = stream->json.eval_count;
+    stats->eval_duration = stream->json.eval_duration;
+    stats->load_duration = stream->json.load_duration;
+    stats->total_duration = stream->json.total_duration;
+    
+    if (stream->sent_at > 0) {
+        stats->connect_ms = stream->connect_ms;
+        stats->first_byte_ms = stream->first_byte_at > 0 ? stream->first_byte_at - stream->sent_at : -1;
+        stats->last_byte_ms = stream->last_byte_at > 0 ? stream->last_byte_at - stream->sent_at : -1;
+    }
+}
+
+static bool ollama_generate_stream(void *state, llm_request_t *request,
+                                   llm_token_callback_t on_token, llm_done_callback_t on_done,
+                                   void *user_ctx) {
+    generate_stream_t stream = {
+        .request = request,
+        .on_token = on_token,
+        .user_ctx = user_ctx,
+        .stopped = false
+    };
+    ndjson_parser_init(&stream.json, forward_token, &stream);
+    trace_start(&stream, request->trace_id);
+    
+    llm_result_t result;
+    memset(&result, 0, sizeof(result));
+    result.success = generate(state, request, &stream, &result.error);
+    trace_finish(&stream);
+    fill_stats(&stream, &result.stats);
+    result.context = stream.json.context;
+    result.context_length = stream.json.context_length;
+    
+    on_done(&result, user_ctx);
+    
+    ndjson_parser_free(&stream.json);
+    return result.success;
+}
+
+// Where an exchange on the event loop stands
+typedef enum {
+    EXCHANGE_WAITING,           // for a backend slot
+    EXCHANGE_CONNECTING,
+    EXCHANGE_SENDING,
+    EXCHANGE_RECEIVING
+} exchange_phase_t;
+
+// Expiry of a connect that took too long; the next backend gets a try
+static const char connect_expiry[] = "Connection timed out";
+
+// Expiry of the wait for a first token after which a hedge goes out
+static const char hedge_expiry[] = "Time to hedge";
+
+// One /api/generate request driven by the event loop. The same steps as
+// generate(), but every wait is a readiness event or a timer, so a single
+// thread carries any number of them.
+struct ollama_exchange {
+    ollama_backend_t *ollama;
+    event_loop_t *loop;
+    llm_request_t *request;
+    llm_done_callback_t on_done;
+    void *user_ctx;
+    generate_stream_t stream;
+    exchange_phase_t phase;
+    int64_t phase_started;      // when the connect or the request began
+    
+    arena_t arena;              // body, then the head for the current backend
+    size_t body_length;
+    request_vector_t http_request;
+    size_t sent;
+    
+    uint32_t tried;             // backends already tried, by bit
+    backend_t *backend;
+    bool trial;                 // the backend's breaker let this call through as a trial
+    upstream_connection_t *conn;
+    http_parser_t parser;
+    size_t received;
+    const char *timed_out;
+    event_timer_t *timer;
+    
+    ollama_exchange_t *prev_waiting;
+    ollama_exchange_t *next_waiting;
+    
+    // A hedged generation runs as two exchanges, each the other's twin,
+    // until one of them produces a token. Only one watches the cancel fd.
+    ollama_exchange_t *twin;
+    bool is_hedge;              // the duplicate, which never waits for a slot
+    bool hedged;                // a hedge was considered once already
+    bool owns_cancel;
+};
+
+static void exchange_attempt(ollama_exchange_t *exchange);
+static void wake_waiting(ollama_backend_t *ollama);
+
+// Deadline of the exchange's current phase, 0 if none; *expiry says
+// what passing it means
+static int64_t exchange_deadline(const ollama_exchange_t *exchange, const char **expiry) {
+    const llm_config_t *config = &exchange->ollama->config;
+    const llm_request_t *request = exchange->request;
+    
+    if (exchange->phase == EXCHANGE_SENDING || exchange->phase == EXCHANGE_RECEIVING) {
+        int64_t deadline = next_deadline(config, request, &exchange->stream, exchange->phase_started, expiry);
+        
+        // A generation slow to start is hedged before any limit runs out
+        int64_t hedge_delay = exchange->ollama->hedge_delay_ms;
+        if (exchange->phase == EXCHANGE_RECEIVING && exchange->stream.tokens == 0 && hedge_delay > 0 &&
+            !exchange->is_hedge && !exchange->hedged &&
+            (deadline == 0 || exchange->phase_started + hedge_delay < deadline)) {
+            deadline = exchange->phase_started + hedge_delay;
+            *expiry = hedge_expiry;
+        }
+        return deadline;
+    }
+    
+    int64_t deadline = 0;
+    *expiry = NULL;
+    if (exchange->phase == EXCHANGE_CONNECTING && config->connect_timeout_ms > 0) {
+        deadline = exchange->phase_started + config->connect_timeout_ms;
+        *expiry = connect_expiry;
+    }
+    if (request->deadline_ms > 0 && (deadline == 0 || request->deadline_ms <= deadline)) {
+        deadline = request->deadline_ms;
+        *expiry = "Generation deadline exceeded";
+    }
+    return deadline;
+}
+
+static void on_exchange_timer(event_loop_t *loop, void *user_data);
+
+// The timer is armed lazily: a token that moves the stall deadline does
+// not touch it, the timer just finds the deadline moved when it fires
+static void arm_exchange_timer(ollama_exchange_t *exchange) {
+    const char *expiry;
+    int64_t deadline = exchange_deadline(exchange, &expiry);
+    
+    event_loop_cancel_timer(exchange->loop, exchange->timer);
+    exchange->timer = deadline > 0 ? event_loop_add_timer(exchange->loop, deadline, on_exchange_timer, exchange) : NULL;
+}
+
+static void unlink_waiting(ollama_exchange_t *exchange) {
+    ollama_backend_t *ollama = exchange->ollama;
+    
+    if (exchange->prev_waiting) {
+        exchange->prev_waiting->next_waiting = exchange->next_waiting;
+    } else {
+        ollama->waiting_head = exchange->next_waiting;
+    }
+    if (exchange->next_waiting) {
+        exchange->next_waiting->prev_waiting = exchange->prev_waiting;
+    } else {
+        ollama->waiting_tail = exchange->prev_waiting;
+    }
+    exchange->prev_waiting = NULL;
+    exchange->next_waiting = NULL;
+}
+
+static void on_exchange_cancel(event_loop_t *loop, int fd, uint32_t events, void *user_data);
+
+// Free an exchange without reporting anything, giving back whatever it
+// still holds; a connection in mid-response cannot be reused
+static void exchange_free(ollama_exchange_t *exchange) {
+    ollama_backend_t *ollama = exchange->ollama;
+    
+    event_loop_cancel_timer(exchange->loop, exchange->timer);
+    if (exchange->prev_waiting != NULL || exchange->next_waiting != NULL || ollama->waiting_head == exchange) {
+        unlink_waiting(exchange);
+    }
+    if (exchange->conn != NULL) {
+        event_loop_remove(exchange->loop, exchange->conn->fd);
+        upstream_pool_release(exchange->backend->upstream, exchange->conn, false);
+    }
+    if (exchange->backend != NULL) {
+        backend_pool_release_unjudged(ollama->backends, exchange->backend, exchange->trial);
+    }
+    if (exchange->owns_cancel) {
+        event_loop_remove(exchange->loop, exchange->request->cancel_fd);
+    }
+    
+    ndjson_parser_free(&exchange->stream.json);
+    give_back_arena(ollama, &exchange->arena);
+    free(exchange);
+}
+
+// One leg of a hedged generation goes on alone and the other is dropped
+static void exchange_separate(ollama_exchange_t *survivor) {
+    ollama_exchange_t *dropped = survivor->twin;
+    survivor->twin = NULL;
+    dropped->twin = NULL;
+    
+    if (dropped->owns_cancel) {
+        event_loop_remove(dropped->loop, dropped->request->cancel_fd);
+        dropped->owns_cancel = false;
+        survivor->owns_cancel = event_loop_add(survivor->loop, survivor->request->cancel_fd, EVENT_READ,
+                                               on_exchange_cancel, survivor);
+    }
+    exchange_free(dropped);
+}
+
+// Report the outcome and free the exchange. Its connection and backend
+// slot must have been given back already.
+static void exchange_done(ollama_exchange_t *exchange, bool ok, const char *error) {
+    ollama_backend_t *ollama = exchange->ollama;
+    
+    trace_finish(&exchange->stream);
+    
+    // A failed leg of a hedged generation bows out; its twin answers
+    if (exchange->twin != NULL) {
+        ollama_exchange_t *twin = exchange->twin;
+        if (!ok) {
+            if (ollama->config.verbose) {
+                printf("A leg of a hedged generation failed (%s); the other carries on\n", error);
+            }
+            exchange_separate(twin);
+            wake_waiting(ollama);
+            return;
+        }
+        exchange_separate(exchange);
+    }
+    
+    event_loop_cancel_timer(exchange->loop, exchange->timer);
+    if (exchange->owns_cancel) {
+        event_loop_remove(exchange->loop, exchange->request->cancel_fd);
+    }
+    
+    llm_result_t result;
+    memset(&result, 0, sizeof(result));
+    result.success = ok;
+    result.error = ok ? NULL : error;
+    fill_stats(&exchange->stream, &result.stats);
+    result.context = exchange->stream.json.context;
+    result.context_length = exchange->stream.json.context_length;
+    exchange->on_done(&result, exchange->user_ctx);
+    
+    ndjson_parser_free(&exchange->stream.json);
+    give_back_arena(ollama, &exchange->arena);
+    free(exchange);
+    
+    // A slot may have come free
+    wake_waiting(ollama);
+}
+
+// The response is over, one way or another
+static void exchange_complete(ollama_exchange_t *exchange) {
+    const char *error = NULL;
+    
+    event_loop_remove(exchange->loop, exchange->conn->fd);
+    bool ok = finish_exchange(exchange->ollama, exchange->request, &exchange->stream, exchange->backend,
+                              exchange->trial, exchange->conn, &exchange->parser, exchange->timed_out, &error);
+    exchange->conn = NULL;
+    exchange->backend = NULL;
+    exchange_done(exchange, ok, error);
+}
+
+// The connection failed before any response byte: nothing reached the
+// caller yet, so another backend may answer instead
+static void exchange_lost(ollama_exchange_t *exchange) {
+    event_loop_remove(exchange->loop, exchange->conn->fd);
+    upstream_pool_release(exchange->backend->upstream, exchange->conn, false);
+    backend_pool_release(exchange->ollama->backends, exchange->backend, exchange->trial, false);
+    exchange->conn = NULL;
+    exchange->backend = NULL;
+    exchange_attempt(exchange);
+}
+
+static void on_upstream_ready(event_loop_t *loop, int fd, uint32_t events, void *user_data);
+
+// Watch a fresh or pooled connection and start over on it
+static bool watch_connection(ollama_exchange_t *exchange) {
+    http_parser_init(&exchange->parser);
+    exchange->sent = 0;
+    exchange->received = 0;
+    exchange->phase = exchange->conn->connecting ? EXCHANGE_CONNECTING : EXCHANGE_SENDING;
+    exchange->phase_started = llm_monotonic_ms();
+    exchange->stream.connect_ms = 0;
+    
+    if (!event_loop_add(exchange->loop, exchange->conn->fd, EVENT_READ | EVENT_WRITE,
+                        on_upstream_ready, exchange)) {
+        return false;
+    }
+    arm_exchange_timer(exchange);
+    return true;
+}
+
+// The upstream may have dropped an idle keep-alive socket; retry once fresh
+static void exchange_reconnect(ollama_exchange_t *exchange) {
+    upstream_pool_t *upstream = exchange->backend->upstream;
+    
+    event_loop_remove(exchange->loop, exchange->conn->fd);
+    upstream_pool_release(upstream, exchange->conn, false);
+    exchange->conn = upstream_pool_connect_nonblocking(upstream);
+    if (exchange->conn == NULL) {
+        backend_pool_release(exchange->ollama->backends, exchange->backend, exchange->trial, false);
+        exchange->backend = NULL;
+        exchange_attempt(exchange);
+    } else if (!watch_connection(exchange)) {
+        exchange_lost(exchange);
+    }
+}
+
+// Open a connection to the chosen backend. Returns false, with the slot
+// given back, if not even that was possible.
+static bool exchange_connect(ollama_exchange_t *exchange, backend_t *backend, bool trial) {
+    ollama_backend_t *ollama = exchange->ollama;
+    const llm_config_t *config = &ollama->config;
+    upstream_pool_t *upstream = backend->upstream;
+    
+    trace_phase(&exchange->stream, "backend slot");
+    exchange->backend = backend;
+    exchange->trial = trial;
+    exchange->tried |= 1u << backend->index;
+    if (!format_request(&exchange->arena, exchange->body_length, upstream, "POST", "/api/generate",
+                        &exchange->http_request)) {
+        backend_pool_release_unjudged(ollama->backends, backend, trial);
+        exchange->backend = NULL;
+        return false;
+    }
+    
+    if (config->verbose) {
+        log_request(&exchange->http_request);
+    }
+    
+    exchange->conn = upstream_pool_acquire_nonblocking(upstream);
+    if (exchange->conn == NULL) {
+        if (config->verbose) {
+            printf("Failed to connect to Ollama at %s\n", upstream->host_header);
+        }
+        backend_pool_release(ollama->backends, backend, trial, false);
+        exchange->backend = NULL;
+        return false;
+    }
+    
+    if (config->verbose) {
+        printf("%s Ollama connection to %s (%lu earlier requests)\n",
+               exchange->conn->reused ? "Reusing" : "Opened", upstream->host_header, exchange->conn->requests);
+    }
+    
+    if (!watch_connection(exchange)) {
+        upstream_pool_release(upstream, exchange->conn, false);
+        backend_pool_release_unjudged(ollama->backends, backend, trial);
+        exchange->conn = NULL;
+        exchange->backend = NULL;
+        return false;
+    }
+    return true;
+}
+
+// Reserve a backend and connect, or queue up behind the other waiters
+static void exchange_attempt(ollama_exchange_t *exchange) {
+    ollama_backend_t *ollama = exchange->ollama;
+    
+    for (;;) {
+        // Nobody overtakes a generation that is already waiting
+        bool busy = ollama->waiting_head != NULL;
+        bool trial = false;
+        backend_t *backend = NULL;
+        if (!busy && !atomic_load(&exchange->request->cancelled)) {
+            backend = backend_pool_try_acquire(ollama->backends, exchange->request->affinity,
+                                               exchange->tried, &busy, &trial);
+        }
+        
+        if (backend == NULL && busy && !exchange->is_hedge) {
+            exchange->phase = EXCHANGE_WAITING;
+            exchange->prev_waiting = ollama->waiting_tail;
+            if (ollama->waiting_tail) {
+                ollama->waiting_tail->next_waiting = exchange;
+            } else {
+                ollama->waiting_head = exchange;
+            }
+            ollama->waiting_tail = exchange;
+            arm_exchange_timer(exchange);
+            wake_waiting(ollama);
+            return;
+        }
+        if (backend == NULL) {
+            exchange_done(exchange, false, exchange->is_hedge ? "No backend for the hedge" : acquire_failure(exchange->request));
+            return;
+        }
+        if (exchange_connect(exchange, backend, trial)) {
+            return;
+        }
+    }
+}
+
+static void on_retry_timer(event_loop_t *loop, void *user_data) {
+    (void)loop;
+    ollama_backend_t *ollama = user_data;
+    
+    ollama->retry_timer = NULL;
+    wake_waiting(ollama);
+}
+
+// Hand free slots to waiting exchanges in arrival order
+static void wake_waiting(ollama_backend_t *ollama) {
+    if (ollama->waking) {
+        return;
+    }
+    ollama->waking = true;
+    
+    while (ollama->waiting_head != NULL) {
+        ollama_exchange_t *exchange = ollama->waiting_head;
+        bool busy;
+        bool trial;
+        backend_t *backend = backend_pool_try_acquire(ollama->backends, exchange->request->affinity,
+                                                      exchange->tried, &busy, &trial);
+        if (backend == NULL && busy) {
+            break;
+        }
+        
+        unlink_waiting(exchange);
+        
+        // A backend it cannot reach is in tried now; the others are tried
+        // without the exchange losing its place in the queue
+        while (backend != NULL && !exchange_connect(exchange, backend, trial)) {
+            backend = backend_pool_try_acquire(ollama->backends, exchange->request->affinity,
+                                               exchange->tried, &busy, &trial);
+        }
+        if (backend != NULL) {
+            continue;
+        }
+        if (!busy) {
+            exchange_done(exchange, false, acquire_failure(exchange->request));
+            continue;
+        }
+        
+        exchange->phase = EXCHANGE_WAITING;
+        exchange->next_waiting = ollama->waiting_head;
+        if (ollama->waiting_head) {
+            ollama->waiting_head->prev_waiting = exchange;
+        } else {
+            ollama->waiting_tail = exchange;
+        }
+        ollama->waiting_head = exchange;
+        arm_exchange_timer(exchange);
+        break;
+    }
+    
+    if (ollama->waiting_head != NULL && ollama->retry_timer == NULL) {
+        ollama->retry_timer = event_loop_add_timer(ollama->loop, llm_monotonic_ms() + SLOT_RETRY_MS,
+                                                   on_retry_timer, ollama);
+    } else if (ollama->waiting_head == NULL && ollama->retry_timer != NULL) {
+        event_loop_cancel_timer(ollama->loop, ollama->retry_timer);
+        ollama->retry_timer = NULL;
+    }
+    ollama->waking = false;
+}
+
+static int compare_ints(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Keep a first-token time for the hedge delay, which is refreshed every
+// few samples rather than sorted for every generation
+static void record_first_token(ollama_backend_t *ollama, int64_t elapsed_ms) {
+    const llm_config_t *config = &ollama->config;
+    if (config->hedge_percentile <= 0) {
+        return;
+    }
+    
+    ollama->first_token_ms[ollama->first_token_count++ % HEDGE_SAMPLES] = (int)elapsed_ms;
+    if (ollama->first_token_count < HEDGE_MIN_SAMPLES || ollama->first_token_count % 16 != 0) {
+        return;
+    }
+    
+    int sorted[HEDGE_SAMPLES];
+    size_t count = ollama->first_token_count < HEDGE_SAMPLES ? ollama->first_token_count : HEDGE_SAMPLES;
+    memcpy(sorted, ollama->first_token_ms, count * sizeof(int));
+    qsort(sorted, count, sizeof(int), compare_ints);
+    
+    int percentile = config->hedge_percentile < 100 ? config->hedge_percentile : 99;
+    int delay = sorted[(count - 1) * percentile / 100];
+    ollama->hedge_delay_ms = delay > 0 ? delay : 1;
+}
+
+// The first token decides a hedged generation: the leg that produced it
+// streams on, the other is dropped
+static void exchange_first_token(ollama_exchange_t *exchange) {
+    ollama_backend_t *ollama = exchange->ollama;
+    
+    record_first_token(ollama, llm_monotonic_ms() - exchange->phase_started);
+    if (exchange->twin == NULL) {
+        return;
+    }
+    if (exchange->is_hedge) {
+        ollama->hedges_won++;
+    }
+    if (ollama->config.verbose) {
+        printf("The %s of a hedged generation answered first\n", exchange->is_hedge ? "hedge" : "original");
+    }
+    exchange_separate(exchange);
+}
+
+// Send a copy of a generation that is slow to start to another backend,
+// if the budget allows and a slot is free right away
+static void start_hedge(ollama_exchange_t *exchange) {
+    ollama_backend_t *ollama = exchange->ollama;
+    
+    exchange->hedged = true;
+    if (ollama->hedge_credit < 1.0 || ollama->waiting_head != NULL ||
+        atomic_load(&exchange->request->cancelled)) {
+        return;
+    }
+    bool busy;
+    bool trial;
+    backend_t *backend = backend_pool_try_acquire(ollama->backends, exchange->request->affinity,
+                                                  exchange->tried, &busy, &trial);
+    if (backend == NULL) {
+        return;
+    }
+    
+    ollama_exchange_t *hedge = calloc(1, sizeof(ollama_exchange_t));
+    if (hedge != NULL) {
+        take_arena(ollama, &hedge->arena);
+        if (!arena_append(&hedge->arena, exchange->arena.data, exchange->body_length)) {
+            give_back_arena(ollama, &hedge->arena);
+            free(hedge);
+            hedge = NULL;
+        }
+    }
+    if (hedge == NULL) {
+        backend_pool_release_unjudged(ollama->backends, backend, trial);
+        return;
+    }
+    
+    hedge->ollama = ollama;
+    hedge->loop = exchange->loop;
+    hedge->request = exchange->request;
+    hedge->on_done = exchange->on_done;
+    hedge->user_ctx = exchange->user_ctx;
+    hedge->body_length = exchange->body_length;
+    hedge->stream = (generate_stream_t){
+        .request = exchange->request,
+        .exchange = hedge,
+        .on_token = exchange->stream.on_token,
+        .user_ctx = exchange->stream.user_ctx
+    };
+    ndjson_parser_init(&hedge->stream.json, forward_token, &hedge->stream);
+    trace_start(&hedge->stream, exchange->request->trace_id != 0 ? TRACE_HEDGE(exchange->request->trace_id) : 0);
+    hedge->tried = exchange->tried;
+    hedge->is_hedge = true;
+    hedge->twin = exchange;
+    exchange->twin = hedge;
+    
+    ollama->hedge_credit -= 1.0;
+    ollama->hedges++;
+    if (ollama->config.verbose) {
+        printf("No first token after %lld ms; hedging on %s\n",
+               (long long)ollama->hedge_delay_ms, backend->upstream->host_header);
+    }
+    if (!exchange_connect(hedge, backend, trial)) {
+        exchange->twin = NULL;
+        exchange_free(hedge);
+    }
+}
+
+static void on_exchange_timer(event_loop_t *loop, void *user_data) {
+    (void)loop;
+    ollama_exchange_t *exchange = user_data;
+    
+    exchange->timer = NULL;
+    const char *expiry;
+    int64_t deadline = exchange_deadline(exchange, &expiry);
+    if (deadline == 0 || llm_monotonic_ms() < deadline) {
+        arm_exchange_timer(exchange);
+        return;
+    }
+    
+    if (expiry == hedge_expiry) {
+        start_hedge(exchange);
+        arm_exchange_timer(exchange);
+    } else if (exchange->phase == EXCHANGE_WAITING) {
+        unlink_waiting(exchange);
+        exchange_done(exchange, false, expiry);
+    } else if (expiry == connect_expiry) {
+        fprintf(stderr, "Error: Failed to connect to %s: %s\n",
+                exchange->backend->upstream->host_header, connect_expiry);
+        exchange_lost(exchange);
+    } else {
+        exchange->timed_out = expiry;
+        exchange_complete(exchange);
+    }
+}
+
+static void on_exchange_cancel(event_loop_t *loop, int fd, uint32_t events, void *user_data) {
+    (void)loop;
+    (void)fd;
+    (void)events;
+    ollama_exchange_t *exchange = user_data;
+    
+    if (exchange->twin != NULL) {
+        exchange_separate(exchange);
+    }
+    if (exchange->phase == EXCHANGE_WAITING) {
+        unlink_waiting(exchange);
+        exchange_done(exchange, false, "Generation cancelled");
+        return;
+    }
+    
+    // The half-read response makes the connection unusable, so it is not
+    // returned to the pool
+    exchange->stream.stopped = true;
+    exchange_complete(exchange);
+}
+
+// Write what the socket takes of the request. Returns false once the
+// exchange has moved on (reconnected, lost, or finished).
+static bool send_request(ollama_exchange_t *exchange) {
+    const llm_config_t *config = &exchange->ollama->config;
+    upstream_connection_t *conn = exchange->conn;
+    
+    if (!send_request_bytes(conn->fd, &exchange->http_request, &exchange->sent)) {
+        if (config->verbose) {
+            printf("Failed to send request: %s\n", strerror(errno));
+        }
+        if (conn->reused) {
+            exchange_reconnect(exchange);
+        } else {
+            exchange_lost(exchange);
+        }
+        return false;
+    }
+    if (exchange->sent < exchange->http_request.length) {
+        return true;
+    }
+    
+    if (config->verbose) {
+        printf("Request sent successfully, waiting for response...\n");
+    }
+    trace_phase(&exchange->stream, "connect");
+    exchange->phase = EXCHANGE_RECEIVING;
+    exchange->phase_started = llm_monotonic_ms();
+    exchange->stream.sent_at = exchange->phase_started;
+    arm_exchange_timer(exchange);
+    return true;
+}
+
+// Readiness of the upstream socket drives the exchange forward
+static void on_upstream_ready(event_loop_t *loop, int fd, uint32_t events, void *user_data) {
+    (void)loop;
+    ollama_exchange_t *exchange = user_data;
+    const llm_config_t *config = &exchange->ollama->config;
+    upstream_connection_t *conn = exchange->conn;
+    
+    if (exchange->phase == EXCHANGE_CONNECTING) {
+        if (!(events & (EVENT_WRITE | EVENT_ERROR))) {
+            return;
+        }
+        if (!upstream_pool_finish_connect(exchange->backend->upstream, conn)) {
+            exchange_lost(exchange);
+            return;
+        }
+        exchange->stream.connect_ms = llm_monotonic_ms() - exchange->phase_started;
+        exchange->phase = EXCHANGE_SENDING;
+        exchange->phase_started = llm_monotonic_ms();
+        arm_exchange_timer(exchange);
+    }
+    
+    if (exchange->phase == EXCHANGE_SENDING) {
+        if (!send_request(exchange) || exchange->phase == EXCHANGE_SENDING) {
+            return;
+        }
+    }
+    
+    // Edge-triggered: read until the socket runs dry
+    char buffer[4096];
+    bool waiting_first = exchange->stream.tokens == 0;
+    for (;;) {
+        ssize_t bytes_received = recv(fd, buffer, sizeof(buffer), 0);
+        
+        if (bytes_received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // The stall limit may be shorter than the first token's
+                if (waiting_first && exchange->stream.tokens > 0) {
+                    arm_exchange_timer(exchange);
+                }
+                return;
+            }
+            if (config->verbose) {
+                printf("Error receiving data: %s\n", strerror(errno));
+            }
+            if (exchange->received == 0) {
+                exchange_lost(exchange);
+                return;
+            }
+            event_loop_remove(exchange->loop, fd);
+            upstream_pool_release(exchange->backend->upstream, conn, false);
+            backend_pool_release(exchange->ollama->backends, exchange->backend, exchange->trial, false);
+            exchange->conn = NULL;
+            exchange->backend = NULL;
+            exchange_done(exchange, false, "Failed to receive data from Ollama");
+            return;
+        }
+        
+        if (bytes_received == 0) {
+            if (exchange->received == 0 && conn->reused) {
+                // Stale keep-alive socket closed under us: resend on a fresh one
+                exchange_reconnect(exchange);
+                return;
+            }
+            if (config->verbose) {
+                printf("Connection closed by Ollama server\n");
+            }
+            if (exchange->received == 0) {
+                exchange_lost(exchange);
+                return;
+            }
+            http_parser_finish(&exchange->parser);
+            exchange_complete(exchange);
+            return;
+        }
+        
+        exchange->stream.last_byte_at = llm_monotonic_ms();
+        if (exchange->received == 0) {
+            exchange->stream.first_byte_at = exchange->stream.last_byte_at;
+        }
+        exchange->received += bytes_received;
+        if (config->verbose) {
+            printf("Received %zd bytes from Ollama\n", bytes_received);
+        }
+        
+        if (http_parser_feed(&exchange->parser, buffer, bytes_received, handle_body, &exchange->stream) < 0) {
+            if (config->verbose) {
+                printf("Invalid HTTP response from Ollama: %s\n", exchange->parser.error);
+            }
+            exchange_complete(exchange);
+            return;
+        }
+        if (http_parser_complete(&exchange->parser) || exchange->stream.stopped) {
+            exchange_complete(exchange);
+            return;
+        }
+    }
+}
+
+static void ollama_start_stream(void *state, event_loop_t *loop, llm_request_t *request,
+                                llm_token_callback_t on_token, llm_done_callback_t on_done,
+                                void *user_ctx) {
+    ollama_backend_t *ollama = state;
+    llm_result_t failed = { .stats = GENERATION_STATS_UNKNOWN };
+    
+    if (request->prompt[0] == '\0') {
+        failed.error = "Empty prompt";
+        on_done(&failed, user_ctx);
+        return;
+    }
+    
+    ollama_exchange_t *exchange = calloc(1, sizeof(ollama_exchange_t));
+    if (exchange != NULL) {
+        take_arena(ollama, &exchange->arena);
+        if (!build_generate_body(ollama, request, &exchange->arena)) {
+            give_back_arena(ollama, &exchange->arena);
+            free(exchange);
+            exchange = NULL;
+        }
+    }
+    if (exchange == NULL) {
+        failed.error = "Memory allocation failed";
+        on_done(&failed, user_ctx);
+        return;
+    }
+    
+    exchange->ollama = ollama;
+    exchange->body_length = exchange->arena.length;
+    exchange->loop = loop;
+    exchange->request = request;
+    exchange->on_done = on_done;
+    exchange->user_ctx = user_ctx;
+    exchange->stream.request = request;
+    exchange->stream.exchange = exchange;
+    exchange->stream.on_token = on_token;
+    exchange->stream.user_ctx = user_ctx;
+    ndjson_parser_init(&exchange->stream.json, forward_token, &exchange->stream);
+    trace_start(&exchange->stream, request->trace_id);
+    ollama->loop = loop;
+    if (ollama->config.hedge_percentile > 0 && ollama->hedge_credit < HEDGE_BURST) {
+        ollama->hedge_credit += ollama->config.hedge_budget_percent / 100.0;
+    }
+    
+    // A cancel from any thread makes the eventfd readable
+    if (!event_loop_add(loop, request->cancel_fd, EVENT_READ, on_exchange_cancel, exchange)) {
+        exchange_done(exchange, false, "Failed to watch the request");
+        return;
+    }
+    exchange->owns_cancel = true;
+    exchange_attempt(exchange);
+}
+
+// Reply of a non-streamed request, collected whole and NUL-terminated
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} body_buffer_t;
+
+static bool collect_body(const char *data, size_t length, void *user_data) {
+    body_buffer_t *body = user_data;
+    
+    if (body->length + length + 1 > body->capacity) {
+        size_t new_capacity = body->capacity ? body->capacity * 2 : 8192;
+        while (new_capacity < body->length + length + 1) {
+            new_capacity *= 2;
+        }
+        if (new_capacity > REPLY_MAX_BYTES) {
+            return false;
+        }
+        char *new_data = realloc(body->data, new_capacity);
+        if (!new_data) {
+            return false;
+        }
+        body->data = new_data;
+        body->capacity = new_capacity;
+    }
+    
+    memcpy(body->data + body->length, data, length);
+    body->length += length;
+    body->data[body->length] = '\0';
+    return true;
+}
+
+// Read the rows of "embeddings": [[...], ...]; every row must have the
+// length of the first
+static bool parse_embedding_rows(json_reader_t *reader, llm_embeddings_t *out) {
+    json_token_t token;
+    if (!json_reader_next(reader, &token) || token.type != JSON_ARRAY_START) {
+        return false;
+    }
+    
+    float *vectors = NULL;
+    size_t capacity = 0;
+    size_t length = 0;
+    size_t dimensions = 0;
+    size_t rows = 0;
+    
+    while (json_reader_next(reader, &token) && token.type == JSON_ARRAY_START) {
+        size_t row_length = 0;
+        while (json_reader_next(reader, &token) && token.type == JSON_NUMBER) {
+            if (length == capacity) {
+                capacity = capacity ? capacity * 2 : 1024;
+                float *new_vectors = realloc(vectors, capacity * sizeof(float));
+                if (!new_vectors) {
+                    free(vectors);
+                    return false;
+                }
+                vectors = new_vectors;
+            }
+            vectors[length++] = (float)json_token_number(&token);
+            row_length++;
+        }
+        if (token.type != JSON_ARRAY_END) {
+            free(vectors);
+            return false;
+        }
+        
+        if (rows++ == 0) {
+            dimensions = row_length;
+        }
+        if (row_length != dimensions || dimensions == 0) {
+            free(vectors);
+            return false;
+        }
+    }
+    if (token.type != JSON_ARRAY_END) {
+        free(vectors);
+        return false;
+    }
+    
+    free(out->vectors);
+    out->vectors = vectors;
+    out->count = rows;
+    out->dimensions = dimensions;
+    return true;
+}
+
+// Pull "embeddings" out of an /api/embed reply, one row per input
+static bool parse_embeddings(const char *json, size_t json_length, size_t count, llm_embeddings_t *out) {
+    json_reader_t reader;
+    json_token_t token;
+    llm_embeddings_t parsed = {0};
+    bool found = false;
+    
+    json_reader_init(&reader, json, json_length);
+    bool ok = json_reader_next(&reader, &token) && token.type == JSON_OBJECT_START;
+    while (ok && json_reader_next(&reader, &token) && token.type == JSON_KEY) {
+        if (json_token_is(&token, "embeddings")) {
+            ok = parse_embedding_rows(&reader, &parsed);
+            found = ok;
+        } else {
+            ok = json_reader_skip_value(&reader);
+        }
+    }
+    ok = ok && token.type == JSON_OBJECT_END && json_reader_next(&reader, &token) &&
+         found && parsed.count == count;
+    
+    if (!ok) {
+        free(parsed.vectors);
+        return false;
+    }
+    *out = parsed;
+    return true;
+}
+
+// Send a request on a pooled connection and read the whole reply into
+// body, giving up after timeout_ms of silence or once cancel_fd (-1 for
+// none) becomes readable. Returns false if the request could not be sent;
+// otherwise the parser tells how far the reply got.
+static bool exchange_blocking(upstream_pool_t *upstream, const request_vector_t *request,
+                              int timeout_ms, int cancel_fd, http_parser_t *parser, body_buffer_t *body) {
+    upstream_connection_t *conn = upstream_pool_acquire(upstream);
+    bool sent = conn != NULL && send_all(conn->fd, request);
+    if (!sent && conn != NULL && conn->reused) {
+        // The upstream may have dropped an idle keep-alive socket; retry once fresh
+        upstream_pool_release(upstream, conn, false);
+        conn = upstream_pool_connect(upstream);
+        sent = conn != NULL && send_all(conn->fd, request);
+    }
+    if (!sent) {
+        upstream_pool_release(upstream, conn, false);
+        return false;
+    }
+    
+    http_parser_init(parser);
+    char buffer[4096];
+    
+    while (!http_parser_complete(parser)) {
+        struct pollfd pfds[2] = {
+            { .fd = conn->fd, .events = POLLIN },
+            { .fd = cancel_fd, .events = POLLIN }
+        };
+        int ready = poll(pfds, cancel_fd >= 0 ? 2 : 1, timeout_ms);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0 || (cancel_fd >= 0 && pfds[1].revents)) {
+            break;
+        }
+        
+        ssize_t bytes_received = recv(conn->fd, buffer, sizeof(buffer), 0);
+        if (bytes_received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_received <= 0) {
+            http_parser_finish(parser);
+            break;
+        }
+        if (http_parser_feed(parser, buffer, bytes_received, collect_body, body) < 0) {
+            break;
+        }
+    }
+    
+    upstream_pool_release(upstream, conn, http_parser_complete(parser) && parser->keep_alive);
+    return true;
+}
+
+static bool ollama_embed(void *state, const char *model, const char *const *inputs, size_t count,
+                         llm_embeddings_t *out, const char **error) {
+    ollama_backend_t *ollama = state;
+    const llm_config_t *config = &ollama->config;
+    
+    // {"model":"...","input":["...",...],"keep_alive":N}
+    arena_t arena;
+    take_arena(ollama, &arena);
+    bool built = arena_append_string(&arena, "{\"model\":") &&
+                 arena_append_json_string(&arena, model) &&
+                 arena_append_string(&arena, ",\"input\":[");
+    for (size_t i = 0; built && i < count; i++) {
+        built = (i == 0 || arena_append_string(&arena, ",")) && arena_append_json_string(&arena, inputs[i]);
+    }
+    built = built && arena_printf(&arena, "],\"keep_alive\":%d}", config->keep_alive);
+    if (!built) {
+        give_back_arena(ollama, &arena);
+        *error = "Memory allocation failed";
+        return false;
+    }
+    
+    // Like a generation, the batch moves on to the next backend while the
+    // one it got cannot be reached or fails with a 5xx or a cut-off reply
+    size_t body_length = arena.length;
+    atomic_bool never_cancelled = false;
+    uint32_t tried = 0;
+    body_buffer_t body = { NULL, 0, 0 };
+    http_parser_t parser;
+    *error = llm_unavailable_error;
+    
+    for (;;) {
+        bool trial;
+        backend_t *backend = backend_pool_acquire(ollama->backends, 0, tried, &never_cancelled, 0, &trial);
+        if (backend == NULL) {
+            give_back_arena(ollama, &arena);
+            free(body.data);
+            return false;
+        }
+        tried |= 1u << backend->index;
+        upstream_pool_t *upstream = backend->upstream;
+        
+        request_vector_t http_request;
+        if (!format_request(&arena, body_length, upstream, "POST", "/api/embed", &http_request)) {
+            backend_pool_release_unjudged(ollama->backends, backend, trial);
+            give_back_arena(ollama, &arena);
+            free(body.data);
+            *error = "Memory allocation failed";
+            return false;
+        }
+        
+        // The reply is one JSON object; read all of it
+        body.length = 0;
+        if (!exchange_blocking(upstream, &http_request, EMBED_TIMEOUT_MS, -1, &parser, &body)) {
+            backend_pool_release(ollama->backends, backend, trial, false);
+            *error = "Failed to connect to Ollama server";
+            continue;
+        }
+        
+        bool answered = http_parser_headers_done(&parser) && parser.status_code < 500;
+        backend_pool_release(ollama->backends, backend, trial, answered);
+        if (answered && http_parser_complete(&parser)) {
+            break;
+        }
+        *error = answered ? "Ollama embedding response was incomplete" : "Ollama could not compute the embeddings";
+    }
+    give_back_arena(ollama, &arena);
+    
+    bool ok = false;
+    if (parser.status_code != 200) {
+        if (config->verbose) {
+            printf("Ollama answered /api/embed with HTTP status %d: %s\n",
+                   parser.status_code, body.data ? body.data : "");
+        }
+        *error = "Ollama rejected the embedding request";
+    } else if (body.data == NULL || !parse_embeddings(body.data, body.length, count, out)) {
+        *error = "Ollama sent a malformed embedding response";
+    } else {
+        ok = true;
+    }
+    
+    free(body.data);
+    return ok;
+}
+
+// Loading is not a generation: it takes no backend slot, and it goes to
+// every backend, since each instance holds its own copy of the model
+static bool ollama_load_model(void *state, const char *model, int keep_alive, int cancel_fd,
+                              const char **error) {
+    ollama_backend_t *ollama = state;
+    const llm_config_t *config = &ollama->config;
+    
+    // An empty generation loads the model; keep_alive 0 unloads it
+    arena_t arena;
+    take_arena(ollama, &arena);
+    if (!arena_append_string(&arena, "{\"model\":") || !arena_append_json_string(&arena, model) ||
+        !arena_printf(&arena, ",\"stream\":false,\"keep_alive\":%d}", keep_alive)) {
+        give_back_arena(ollama, &arena);
+        *error = "Memory allocation failed";
+        return false;
+    }
+    size_t body_length = arena.length;
+    
+    int loaded = 0;
+    *error = llm_unavailable_error;
+    for (int i = 0; i < backend_pool_count(ollama->backends); i++) {
+        upstream_pool_t *upstream = backend_pool_get(ollama->backends, i)->upstream;
+        request_vector_t http_request;
+        if (!format_request(&arena, body_length, upstream, "POST", "/api/generate", &http_request)) {
+            *error = "Memory allocation failed";
+            break;
+        }
+        
+        body_buffer_t body = { NULL, 0, 0 };
+        http_parser_t parser;
+        bool sent = exchange_blocking(upstream, &http_request, MODEL_LOAD_TIMEOUT_MS, cancel_fd,
+                                      &parser, &body);
+        
+        if (!sent) {
+            *error = "Failed to connect to Ollama server";
+        } else if (!http_parser_complete(&parser)) {
+            *error = "Ollama did not finish loading the model";
+        } else if (parser.status_code != 200) {
+            if (config->verbose) {
+                printf("Ollama answered a load of %s with HTTP status %d: %s\n",
+                       model, parser.status_code, body.data ? body.data : "");
+            }
+            *error = "Ollama could not load the model";
+        } else {
+            loaded++;
+        }
+        free(body.data);
+    }
+    
+    give_back_arena(ollama, &arena);
+    return loaded > 0;
+}
+
+// Add a model to out; one already listed keeps the larger size
+static void merge_model(llm_model_list_t *out, const llm_model_info_t *model) {
+    size_t i = 0;
+    while (i < out->count && strcmp(out->models[i].name, model->name) != 0) {
+        i++;
+    }
+    if (i == out->count) {
+        if (out->count < LLM_MAX_MODELS) {
+            out->models[out->count++] = *model;
+        }
+    } else if (model->size > out->models[i].size) {
+        out->models[i].size = model->size;
+    }
+}
+
+// Read one entry of "models": its "name" and "size"
+static bool parse_model_entry(json_reader_t *reader, llm_model_info_t *model) {
+    json_token_t token;
+    
+    while (json_reader_next(reader, &token) && token.type == JSON_KEY) {
+        bool name = json_token_is(&token, "name");
+        bool size = json_token_is(&token, "size");
+        if (!name && !size) {
+            if (!json_reader_skip_value(reader)) {
+                return false;
+            }
+            continue;
+        }
+        
+        if (!json_reader_next(reader, &token)) {
+            return false;
+        }
+        if (name && token.type == JSON_STRING) {
+            json_token_string(&token, model->name, sizeof(model->name));
+        } else if (size && token.type == JSON_NUMBER) {
+            double value = json_token_number(&token);
+            model->size = value > 0 ? (uint64_t)value : 0;
+        } else if (token.type == JSON_OBJECT_START || token.type == JSON_ARRAY_START) {
+            return false;
+        }
+    }
+    return token.type == JSON_OBJECT_END;
+}
+
+// Merge the models of an /api/ps or /api/tags reply into out. Returns
+// false, leaving out as it was, if the reply is not the JSON we expect.
+static bool parse_model_list(const char *json, size_t length, llm_model_list_t *out) {
+    json_reader_t reader;
+    json_token_t token;
+    llm_model_list_t merged = *out;
+    
+    json_reader_init(&reader, json, length);
+    if (!json_reader_next(&reader, &token) || token.type != JSON_OBJECT_START) {
+        return false;
+    }
+    
+    while (json_reader_next(&reader, &token) && token.type == JSON_KEY) {
+        if (!json_token_is(&token, "models")) {
+            if (!json_reader_skip_value(&reader)) {
+                return false;
+            }
+            continue;
+        }
+        
+        if (!json_reader_next(&reader, &token) || token.type != JSON_ARRAY_START) {
+            return false;
+        }
+        while (json_reader_next(&reader, &token) && token.type == JSON_OBJECT_START) {
+            llm_model_info_t model = {0};
+            if (!parse_model_entry(&reader, &model)) {
+                return false;
+            }
+            if (model.name[0] != '\0') {
+                merge_model(&merged, &model);
+            }
+        }
+        if (token.type != JSON_ARRAY_END) {
+            return false;
+        }
+    }
+    if (token.type != JSON_OBJECT_END || !json_reader_next(&reader, &token)) {
+        return false;
+    }
+    *out = merged;
+    return true;
+}
+
+// Running models are merged over every backend; available ones come
+// from the first backend that answers
+static bool ollama_list_models(void *state, bool running, llm_model_list_t *out, int cancel_fd,
+                               const char **error) {
+    ollama_backend_t *ollama = state;
+    bool listed = false;
+    
+    arena_t arena;
+    take_arena(ollama, &arena);
+    memset(out, 0, sizeof(*out));
+    *error = llm_unavailable_error;
+    for (int i = 0; i < backend_pool_count(ollama->backends) && (running || !listed); i++) {
+        upstream_pool_t *upstream = backend_pool_get(ollama->backends, i)->upstream;
+        request_vector_t http_request;
+        if (!format_request(&arena, 0, upstream, "GET", running ? "/api/ps" : "/api/tags", &http_request)) {
+            *error = "Memory allocation failed";
+            break;
+        }
+        
+        body_buffer_t body = { NULL, 0, 0 };
+        http_parser_t parser;
+        bool sent = exchange_blocking(upstream, &http_request, MODEL_LIST_TIMEOUT_MS, cancel_fd,
+                                      &parser, &body);
+        
+        if (!sent) {
+            *error = "Failed to connect to Ollama server";
+        } else if (!http_parser_complete(&parser) || parser.status_code != 200 || body.data == NULL) {
+            *error = "Ollama could not list its models";
+        } else if (!parse_model_list(body.data, body.length, out)) {
+            *error = "Ollama sent a malformed model list";
+        } else {
+            listed = true;
+        }
+        free(body.data);
+    }
+    
+    give_back_arena(ollama, &arena);
+    return listed;
+}
+
+static bool ollama_available(void *state) {
+    ollama_backend_t *ollama = state;
+    return backend_pool_available(ollama->backends);
+}
+
+const llm_backend_ops_t ollama_backend_ops = {
+    .name = "ollama",
+    .init = ollama_init,
+    .generate_stream = ollama_generate_stream,
+    .start_stream = ollama_start_stream,
+    .cancel = NULL,
+    .embed = ollama_embed,
+    .load_model = ollama_load_model,
+    .list_models = ollama_list_models,
+    .available = ollama_available,
+    .cleanup = ollama_cleanup
+};
@@ -0,0 +1,87 @@
+#include "request_queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+bool request_queue_init(request_queue_t *queue, size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    queue->cells = malloc(size * sizeof(request_queue_cell_t));
+    if (queue->cells == NULL) {
+        fprintf(stderr, "Error: Failed to allocate request queue\n");
+        return false;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&queue->cells[i].sequence, i);
+        queue->cells[i].data = NULL;
+    }
+
+    queue->mask = size - 1;
+    atomic_init(&queue->enqueue_pos, 0);
+    atomic_init(&queue->dequeue_pos, 0);
+    return true;
+}
+
+void request_queue_destroy(request_queue_t *queue) {
+    free(queue->cells);
+    queue->cells = NULL;
+}
+
+bool request_queue_push(request_queue_t *queue, void *data) {
+    size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+
+    while (true) {
+        request_queue_cell_t *cell = &queue->cells[pos & queue->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+        if (diff == 0) {
+            // Cell is free for this lap; claim it by advancing the position
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                cell->data = data;
+                atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            // Consumer has not freed this cell yet: queue is full
+            return false;
+        } else {
+            pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+bool request_queue_pop(request_queue_t *queue, void **data) {
+    size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+
+    while (true) {
+        request_queue_cell_t *cell = &queue->cells[pos & queue->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *data = cell->data;
+                // Hand the cell back to producers for the next lap
+                atomic_store_explicit(&cell->sequence, pos + queue->mask + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+size_t request_queue_size(request_queue_t *queue) {
+    size_t head = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
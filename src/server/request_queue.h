@@ -0,0 +1,37 @@
+#ifndef REQUEST_QUEUE_H
+#define REQUEST_QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Bounded lock-free multi-producer/multi-consumer queue of pointers.
+//
+// Each cell carries a sequence number that tells producers and consumers
+// whether it is free for the current lap, so enqueue and dequeue only
+// contend on a single CAS of their own position counter.
+typedef struct {
+    atomic_size_t sequence;
+    void *data;
+} request_queue_cell_t;
+
+typedef struct {
+    request_queue_cell_t *cells;
+    size_t mask;
+    // Keep producers and consumers on separate cache lines
+    _Alignas(64) atomic_size_t enqueue_pos;
+    _Alignas(64) atomic_size_t dequeue_pos;
+} request_queue_t;
+
+// Capacity is rounded up to a power of two
+bool request_queue_init(request_queue_t *queue, size_t capacity);
+void request_queue_destroy(request_queue_t *queue);
+
+// Both return false instead of blocking (queue full / empty)
+bool request_queue_push(request_queue_t *queue, void *data);
+bool request_queue_pop(request_queue_t *queue, void **data);
+
+// Approximate number of queued items
+size_t request_queue_size(request_queue_t *queue);
+
+#endif /* REQUEST_QUEUE_H */
@@ -0,0 +1,306 @@
+#include "residency.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+// Demand at which a model is kept warm, or loaded before it is asked for
+#define WANTED_DEMAND 1.0
+
+typedef struct {
+    char name[128];
+    double demand;
+    unsigned int recent;        // requests since the last check
+    bool loaded;
+    uint64_t size;              // bytes, 0 until the engine has told us
+    bool pinned;                // the default model, always wanted
+    bool evicted;               // unloaded by this check, not to be loaded again by it
+} tracked_model_t;
+
+// What one check decided; carried out without the lock
+typedef struct {
+    char name[128];
+    int keep_alive;
+    const char *reason;
+} residency_action_t;
+
+struct residency {
+    llm_handle_t *llm;
+    int keep_alive;
+    bool warm_up;
+    int interval;
+    size_t budget;
+    bool verbose;
+
+    pthread_mutex_t mutex;
+    tracked_model_t models[RESIDENCY_MAX_MODELS];
+    int count;
+
+    int stop_fd;                // eventfd, readable once destroy starts
+    pthread_t thread;
+};
+
+// Caller holds the mutex. Finds the model, or starts tracking it in a
+// free entry or in place of the least wanted idle one; NULL if all are busy.
+static tracked_model_t* track_model(residency_t *residency, const char *name) {
+    tracked_model_t *victim = NULL;
+    for (int i = 0; i < residency->count; i++) {
+        tracked_model_t *model = &residency->models[i];
+        if (llm_same_model(model->name, name)) {
+            return model;
+        }
+        if (!model->loaded && !model->pinned && model->recent == 0 &&
+            (victim == NULL || model->demand < victim->demand)) {
+            victim = model;
+        }
+    }
+
+    if (residency->count < RESIDENCY_MAX_MODELS) {
+        victim = &residency->models[residency->count++];
+    } else if (victim == NULL) {
+        return NULL;
+    }
+
+    memset(victim, 0, sizeof(*victim));
+    strncpy(victim->name, name, sizeof(victim->name) - 1);
+    return victim;
+}
+
+static bool wanted(const tracked_model_t *model) {
+    return model->pinned || model->demand >= WANTED_DEMAND;
+}
+
+// Sleep up to timeout_ms; true once destroy has begun
+static bool wait_for_stop(residency_t *residency, int timeout_ms) {
+    struct pollfd pfd = { .fd = residency->stop_fd, .events = POLLIN };
+    return poll(&pfd, 1, timeout_ms) > 0;
+}
+
+static bool load(residency_t *residency, const char *name, int keep_alive, const char *reason) {
+    const char *error = NULL;
+    int64_t started = llm_monotonic_ms();
+    bool ok = llm_load_model(residency->llm, name, keep_alive, residency->stop_fd, &error);
+
+    if (residency->verbose) {
+        if (ok) {
+            printf("Residency: %s model %s in %lld ms\n", reason, name,
+                   (long long)(llm_monotonic_ms() - started));
+        } else {
+            printf("Residency: could not %s model %s: %s\n", keep_alive == 0 ? "unload" : "load",
+                   name, error);
+        }
+    }
+    return ok;
+}
+
+static void warm_up(residency_t *residency) {
+    const char *name = residency->models[0].name;
+    const char *error = NULL;
+    int64_t started = llm_monotonic_ms();
+
+    if (llm_load_model(residency->llm, name, residency->keep_alive, residency->stop_fd, &error)) {
+        printf("Model %s warmed up in %lld ms\n", name, (long long)(llm_monotonic_ms() - started));
+    } else if (!wait_for_stop(residency, 0)) {
+        fprintf(stderr, "Warning: Could not warm up model %s: %s\n", name, error);
+    }
+}
+
+// Caller holds the mutex. Decide what to ping, unload and load, given
+// the loaded set and sizes the engine just reported.
+static int plan(residency_t *residency, const llm_model_list_t *running, const llm_model_list_t *available,
+                residency_action_t *actions) {
+    int count = 0;
+
+    for (int i = 0; i < residency->count; i++) {
+        residency->models[i].loaded = false;
+        residency->models[i].evicted = false;
+    }
+    for (size_t i = 0; i < running->count; i++) {
+        // Models loaded by someone else count against the budget too
+        tracked_model_t *model = track_model(residency, running->models[i].name);
+        if (model != NULL) {
+            model->loaded = true;
+            model->size = running->models[i].size;
+        }
+    }
+
+    uint64_t total = 0;
+    for (int i = 0; i < residency->count; i++) {
+        tracked_model_t *model = &residency->models[i];
+        model->demand = model->demand / 2 + model->recent;
+        if (model->loaded) {
+            total += model->size;
+        } else if (model->size == 0) {
+            for (size_t j = 0; j < available->count; j++) {
+                if (llm_same_model(model->name, available->models[j].name)) {
+                    model->size = available->models[j].size;
+                }
+            }
+        }
+    }
+
+    // Over budget: unload the least wanted first, but nothing in use
+    while (residency->budget > 0 && total > residency->budget) {
+        tracked_model_t *victim = NULL;
+        for (int i = 0; i < residency->count; i++) {
+            tracked_model_t *model = &residency->models[i];
+            if (model->loaded && !model->pinned && model->recent == 0 &&
+                (victim == NULL || model->demand < victim->demand)) {
+                victim = model;
+            }
+        }
+        if (victim == NULL) {
+            if (residency->verbose) {
+                printf("Residency: %llu MB loaded, over budget, but every model is in use\n",
+                       (unsigned long long)(total >> 20));
+            }
+            break;
+        }
+        victim->loaded = false;
+        victim->evicted = true;
+        total -= victim->size;
+        actions[count++] = (residency_action_t){ .keep_alive = 0, .reason = "unloaded" };
+        strcpy(actions[count - 1].name, victim->name);
+    }
+
+    // Traffic renews a model's keep_alive; quiet wanted models get a ping
+    for (int i = 0; i < residency->count; i++) {
+        tracked_model_t *model = &residency->models[i];
+        if (model->loaded && model->recent == 0 && wanted(model)) {
+            actions[count++] = (residency_action_t){ .keep_alive = residency->keep_alive, .reason = "pinged" };
+            strcpy(actions[count - 1].name, model->name);
+        }
+    }
+
+    // Load wanted models that fit, most wanted first
+    while (true) {
+        tracked_model_t *best = NULL;
+        for (int i = 0; i < residency->count; i++) {
+            tracked_model_t *model = &residency->models[i];
+            if (model->loaded || model->evicted || !wanted(model) ||
+                (residency->budget > 0 && total + model->size > residency->budget)) {
+                continue;
+            }
+            if (best == NULL || model->pinned || (!best->pinned && model->demand > best->demand)) {
+                best = model;
+            }
+        }
+        if (best == NULL) {
+            break;
+        }
+        best->loaded = true;
+        total += best->size;
+        actions[count++] = (residency_action_t){ .keep_alive = residency->keep_alive, .reason = "preloaded" };
+        strcpy(actions[count - 1].name, best->name);
+    }
+
+    for (int i = 0; i < residency->count; i++) {
+        residency->models[i].recent = 0;
+    }
+    return count;
+}
+
+static void check(residency_t *residency) {
+    llm_model_list_t running;
+    llm_model_list_t available = {0};
+    const char *error = NULL;
+
+    if (!llm_list_models(residency->llm, true, &running, residency->stop_fd, &error)) {
+        if (residency->verbose) {
+            printf("Residency: could not list loaded models: %s\n", error);
+        }
+        return;
+    }
+    // Sizes of models not loaded yet only matter against a budget
+    if (residency->budget > 0) {
+        llm_list_models(residency->llm, false, &available, residency->stop_fd, &error);
+    }
+
+    // A model is unloaded or pinged, then maybe loaded: two actions at most
+    residency_action_t actions[RESIDENCY_MAX_MODELS * 2];
+    pthread_mutex_lock(&residency->mutex);
+    int count = plan(residency, &running, &available, actions);
+    pthread_mutex_unlock(&residency->mutex);
+
+    for (int i = 0; i < count && !wait_for_stop(residency, 0); i++) {
+        load(residency, actions[i].name, actions[i].keep_alive, actions[i].reason);
+    }
+}
+
+static void* residency_main(void *arg) {
+    residency_t *residency = arg;
+
+    if (residency->warm_up) {
+        warm_up(residency);
+    }
+    while (residency->interval > 0 && !wait_for_stop(residency, residency->interval * 1000)) {
+        check(residency);
+    }
+    return NULL;
+}
+
+residency_t* residency_create(llm_handle_t *llm, const char *default_model, const llm_config_t *config) {
+    residency_t *residency = calloc(1, sizeof(residency_t));
+    if (residency == NULL) {
+        fprintf(stderr, "Error: Failed to allocate model residency manager\n");
+        return NULL;
+    }
+
+    residency->llm = llm;
+    residency->keep_alive = config->keep_alive;
+    residency->warm_up = config->warm_up;
+    residency->interval = config->keep_warm_interval > 0 ? config->keep_warm_interval : 0;
+    residency->budget = config->model_memory_bytes;
+    residency->verbose = config->verbose;
+
+    strncpy(residency->models[0].name, default_model, sizeof(residency->models[0].name) - 1);
+    residency->models[0].pinned = true;
+    residency->count = 1;
+
+    pthread_mutex_init(&residency->mutex, NULL);
+    residency->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (residency->stop_fd < 0 ||
+        pthread_create(&residency->thread, NULL, residency_main, residency) != 0) {
+        fprintf(stderr, "Error: Failed to start model residency manager\n");
+        if (residency->stop_fd >= 0) {
+            close(residency->stop_fd);
+        }
+        pthread_mutex_destroy(&residency->mutex);
+        free(residency);
+        return NULL;
+    }
+
+    return residency;
+}
+
+void residency_destroy(residency_t *residency) {
+    if (residency == NULL) {
+        return;
+    }
+
+    // Also abandons a load in progress
+    uint64_t one = 1;
+    ssize_t written = write(residency->stop_fd, &one, sizeof(one));
+    (void)written;
+    pthread_join(residency->thread, NULL);
+
+    close(residency->stop_fd);
+    pthread_mutex_destroy(&residency->mutex);
+    free(residency);
+}
+
+void residency_note_demand(residency_t *residency, const char *model) {
+    if (residency == NULL || model == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&residency->mutex);
+    tracked_model_t *tracked = track_model(residency, model);
+    if (tracked != NULL) {
+        tracked->recent++;
+    }
+    pthread_mutex_unlock(&residency->mutex);
+}
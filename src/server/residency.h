@@ -0,0 +1,28 @@
+#ifndef RESIDENCY_H
+#define RESIDENCY_H
+
+#include <stdbool.h>
+#include "llm_interface.h"
+
+// Models tracked at once; the least wanted unloaded one makes room
+#define RESIDENCY_MAX_MODELS 32
+
+// Model residency
+//
+// Keeps the models clients use loaded in the engine, so no request pays
+// for loading one. At startup the default model is loaded with an empty
+// prompt. Every interval after that the manager asks which models are
+// loaded, pings the wanted ones to renew their keep_alive, unloads the
+// least wanted ones while the loaded set exceeds the memory budget, and
+// loads wanted ones that fit. A model's demand is its request count,
+// halved every interval; the default model is always wanted.
+typedef struct residency residency_t;
+
+// Starts a background thread; the handle must outlive the manager
+residency_t* residency_create(llm_handle_t *llm, const char *default_model, const llm_config_t *config);
+void residency_destroy(residency_t *residency);
+
+// Count a request for the model; cheap enough for every request
+void residency_note_demand(residency_t *residency, const char *model);
+
+#endif /* RESIDENCY_H */
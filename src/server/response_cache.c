@@ -0,0 +1,280 @@
+#include "response_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define INITIAL_BUCKETS 256
+
+// Padded so shards on different cores do not share cache lines
+typedef struct {
+    pthread_mutex_t mutex;
+    response_cache_entry_t **buckets;
+    size_t bucket_count;
+    response_cache_entry_t *lru_head;   // most recently used
+    response_cache_entry_t *lru_tail;   // next to evict
+    size_t entries;
+    size_t bytes;
+    size_t max_bytes;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t insertions;
+    uint64_t evictions;
+} __attribute__((aligned(64))) cache_shard_t;
+
+struct response_cache {
+    cache_shard_t shards[RESPONSE_CACHE_SHARDS];
+};
+
+// FNV-1a, good enough to spread prompts over shards and buckets
+static uint64_t hash_bytes(const char *data, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static cache_shard_t* shard_for(response_cache_t *cache, uint64_t hash) {
+    return &cache->shards[(hash >> 56) % RESPONSE_CACHE_SHARDS];
+}
+
+response_cache_t* response_cache_create(size_t max_bytes) {
+    response_cache_t *cache = aligned_alloc(64, sizeof(response_cache_t));
+    if (cache == NULL) {
+        fprintf(stderr, "Error: Failed to allocate response cache\n");
+        return NULL;
+    }
+    memset(cache, 0, sizeof(response_cache_t));
+
+    for (int i = 0; i < RESPONSE_CACHE_SHARDS; i++) {
+        cache_shard_t *shard = &cache->shards[i];
+        pthread_mutex_init(&shard->mutex, NULL);
+        shard->max_bytes = max_bytes / RESPONSE_CACHE_SHARDS;
+        shard->bucket_count = INITIAL_BUCKETS;
+        shard->buckets = calloc(INITIAL_BUCKETS, sizeof(response_cache_entry_t *));
+        if (shard->buckets == NULL) {
+            fprintf(stderr, "Error: Failed to allocate response cache\n");
+            response_cache_destroy(cache);
+            return NULL;
+        }
+    }
+
+    return cache;
+}
+
+void response_cache_destroy(response_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < RESPONSE_CACHE_SHARDS; i++) {
+        cache_shard_t *shard = &cache->shards[i];
+        response_cache_entry_t *entry = shard->lru_head;
+        while (entry) {
+            response_cache_entry_t *next = entry->lru_next;
+            response_cache_entry_release(entry);
+            entry = next;
+        }
+        free(shard->buckets);
+        pthread_mutex_destroy(&shard->mutex);
+    }
+    free(cache);
+}
+
+bool response_cache_key_init(response_cache_key_t *key, const char *model, float temperature,
+                             int max_tokens, int context_size, int seed, const char *prompt) {
+    char parameters[384];
+    int parameters_length = snprintf(parameters, sizeof(parameters), "%s\n%.4f\n%d\n%d\n%d\n",
+                                     model, temperature, max_tokens, context_size, seed);
+    if (parameters_length < 0 || parameters_length >= (int)sizeof(parameters)) {
+        return false;
+    }
+
+    size_t prompt_length = strlen(prompt);
+    key->length = parameters_length + prompt_length;
+    key->data = malloc(key->length);
+    if (key->data == NULL) {
+        return false;
+    }
+
+    memcpy(key->data, parameters, parameters_length);
+    memcpy(key->data + parameters_length, prompt, prompt_length);
+    key->hash = hash_bytes(key->data, key->length);
+    return true;
+}
+
+void response_cache_key_free(response_cache_key_t *key) {
+    free(key->data);
+    key->data = NULL;
+    key->length = 0;
+}
+
+void response_cache_entry_release(response_cache_entry_t *entry) {
+    if (entry != NULL && atomic_fetch_sub(&entry->refcount, 1) == 1) {
+        free(entry);
+    }
+}
+
+static bool key_equal(const response_cache_key_t *a, const response_cache_key_t *b) {
+    return a->hash == b->hash && a->length == b->length && memcmp(a->data, b->data, a->length) == 0;
+}
+
+static response_cache_entry_t** find_slot(cache_shard_t *shard, const response_cache_key_t *key) {
+    response_cache_entry_t **slot = &shard->buckets[key->hash & (shard->bucket_count - 1)];
+    while (*slot && !key_equal(&(*slot)->key, key)) {
+        slot = &(*slot)->hash_next;
+    }
+    return slot;
+}
+
+static void lru_unlink(cache_shard_t *shard, response_cache_entry_t *entry) {
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        shard->lru_head = entry->lru_next;
+    }
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        shard->lru_tail = entry->lru_prev;
+    }
+}
+
+static void lru_push_front(cache_shard_t *shard, response_cache_entry_t *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = shard->lru_head;
+    if (shard->lru_head) {
+        shard->lru_head->lru_prev = entry;
+    } else {
+        shard->lru_tail = entry;
+    }
+    shard->lru_head = entry;
+}
+
+// Drop an entry from the shard; readers still holding it keep it alive
+static void remove_entry(cache_shard_t *shard, response_cache_entry_t *entry) {
+    response_cache_entry_t **slot = find_slot(shard, &entry->key);
+    *slot = entry->hash_next;
+    lru_unlink(shard, entry);
+    shard->entries--;
+    shard->bytes -= entry->size;
+    response_cache_entry_release(entry);
+}
+
+static void grow_buckets(cache_shard_t *shard) {
+    size_t new_count = shard->bucket_count * 2;
+    response_cache_entry_t **new_buckets = calloc(new_count, sizeof(response_cache_entry_t *));
+    if (new_buckets == NULL) {
+        return;     // keep the longer chains
+    }
+
+    for (response_cache_entry_t *entry = shard->lru_head; entry; entry = entry->lru_next) {
+        size_t index = entry->key.hash & (new_count - 1);
+        entry->hash_next = new_buckets[index];
+        new_buckets[index] = entry;
+    }
+    free(shard->buckets);
+    shard->buckets = new_buckets;
+    shard->bucket_count = new_count;
+}
+
+response_cache_entry_t* response_cache_lookup(response_cache_t *cache, const response_cache_key_t *key) {
+    cache_shard_t *shard = shard_for(cache, key->hash);
+
+    pthread_mutex_lock(&shard->mutex);
+    response_cache_entry_t *entry = *find_slot(shard, key);
+    if (entry) {
+        lru_unlink(shard, entry);
+        lru_push_front(shard, entry);
+        atomic_fetch_add(&entry->refcount, 1);
+        shard->hits++;
+    } else {
+        shard->misses++;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+
+    return entry;
+}
+
+bool response_cache_insert(response_cache_t *cache, const response_cache_key_t *key,
+                           const char *text, size_t text_length,
+                           const uint32_t *token_ends, size_t token_count) {
+    cache_shard_t *shard = shard_for(cache, key->hash);
+
+    // One allocation per entry: header, token offsets, key, text
+    size_t size = sizeof(response_cache_entry_t) + token_count * sizeof(uint32_t) +
+                  key->length + text_length + 1;
+    if (size > shard->max_bytes) {
+        return false;
+    }
+
+    response_cache_entry_t *entry = malloc(size);
+    if (entry == NULL) {
+        return false;
+    }
+
+    uint32_t *ends = (uint32_t *)(entry + 1);
+    char *key_data = (char *)(ends + token_count);
+    char *text_copy = key_data + key->length;
+
+    memcpy(ends, token_ends, token_count * sizeof(uint32_t));
+    memcpy(key_data, key->data, key->length);
+    memcpy(text_copy, text, text_length);
+    text_copy[text_length] = '\0';
+
+    entry->text = text_copy;
+    entry->text_length = text_length;
+    entry->token_ends = ends;
+    entry->token_count = token_count;
+    entry->key.hash = key->hash;
+    entry->key.data = key_data;
+    entry->key.length = key->length;
+    entry->size = size;
+    atomic_init(&entry->refcount, 1);
+
+    pthread_mutex_lock(&shard->mutex);
+
+    // A concurrent miss may have produced the same response already
+    response_cache_entry_t *existing = *find_slot(shard, key);
+    if (existing) {
+        remove_entry(shard, existing);
+    }
+
+    while (shard->bytes + size > shard->max_bytes && shard->lru_tail) {
+        remove_entry(shard, shard->lru_tail);
+        shard->evictions++;
+    }
+
+    if (shard->entries >= shard->bucket_count) {
+        grow_buckets(shard);
+    }
+
+    response_cache_entry_t **slot = &shard->buckets[key->hash & (shard->bucket_count - 1)];
+    entry->hash_next = *slot;
+    *slot = entry;
+    lru_push_front(shard, entry);
+    shard->entries++;
+    shard->bytes += size;
+    shard->insertions++;
+
+    pthread_mutex_unlock(&shard->mutex);
+    return true;
+}
+
+void response_cache_get_stats(response_cache_t *cache, response_cache_stats_t *stats) {
+    memset(stats, 0, sizeof(response_cache_stats_t));
+
+    for (int i = 0; i < RESPONSE_CACHE_SHARDS; i++) {
+        cache_shard_t *shard = &cache->shards[i];
+        pthread_mutex_lock(&shard->mutex);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->insertions += shard->insertions;
+        stats->evictions += shard->evictions;
+        stats->entries += shard->entries;
+        stats->bytes += shard->bytes;
+        pthread_mutex_unlock(&shard->mutex);
+    }
+}
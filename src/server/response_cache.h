@@ -0,0 +1,68 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Independent LRU shards; a lookup only locks the shard its key hashes to
+#define RESPONSE_CACHE_SHARDS 16
+
+// Identity of a generation: every input that changes the output
+typedef struct {
+    uint64_t hash;
+    char *data;         // serialized parameters followed by the prompt
+    size_t length;
+} response_cache_key_t;
+
+// A cached response. Entries are immutable and reference counted, so a
+// hit can be replayed without holding any lock or copying the text.
+typedef struct response_cache_entry {
+    const char *text;
+    size_t text_length;
+    const uint32_t *token_ends;     // end offset of each streamed token
+    size_t token_count;
+
+    // Internal
+    response_cache_key_t key;
+    size_t size;
+    atomic_int refcount;
+    struct response_cache_entry *hash_next;
+    struct response_cache_entry *lru_prev;
+    struct response_cache_entry *lru_next;
+} response_cache_entry_t;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t insertions;
+    uint64_t evictions;
+    size_t entries;
+    size_t bytes;
+} response_cache_stats_t;
+
+typedef struct response_cache response_cache_t;
+
+// Cache lifecycle; max_bytes bounds the memory held by entries
+response_cache_t* response_cache_create(size_t max_bytes);
+void response_cache_destroy(response_cache_t *cache);
+
+// Build the key for one generation. Returns false if out of memory.
+bool response_cache_key_init(response_cache_key_t *key, const char *model, float temperature,
+                             int max_tokens, int context_size, int seed, const char *prompt);
+void response_cache_key_free(response_cache_key_t *key);
+
+// Returns a retained entry, or NULL on a miss. Release it when done.
+response_cache_entry_t* response_cache_lookup(response_cache_t *cache, const response_cache_key_t *key);
+void response_cache_entry_release(response_cache_entry_t *entry);
+
+// Store a finished response, evicting least recently used entries to
+// stay within budget. token_ends holds the end offset of each token.
+bool response_cache_insert(response_cache_t *cache, const response_cache_key_t *key,
+                           const char *text, size_t text_length,
+                           const uint32_t *token_ends, size_t token_count);
+
+void response_cache_get_stats(response_cache_t *cache, response_cache_stats_t *stats);
+
+#endif /* RESPONSE_CACHE_H */
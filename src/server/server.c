@@ -1,16 +1,115 @@
 #include "server.h"
 #include <signal.h>
 #include <unistd.h>
-#include <sys/select.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <endian.h>
+#include <sys/eventfd.h>
+#include "worker_pool.h"
+#include "response_cache.h"
+#include "disk_cache.h"
+#include "session.h"
+#include "inflight.h"
+#include "embed_batcher.h"
+#include "model_scheduler.h"
+#include "model_stats.h"
+#include "metrics.h"
+#include "admin_server.h"
+#include "trace.h"
 #include "../common/config.h"
 
+// Queued prompts allowed per worker before new ones are rejected
+#define JOBS_PER_WORKER 64
+
 // Global variables
 static int server_socket = -1;
-static bool running = false;
+static volatile bool running = false;
 static server_config_t current_config;
-static client_connection_t *clients = NULL;
+static event_loop_t *loop = NULL;
+static client_connection_t **clients = NULL;
+static int *free_slots = NULL;
+static int free_slot_count = 0;
 static int client_count = 0;
-static pthread_mutex_t clients_mutex = PTHREAD_MUTEX_INITIALIZER;
+static llm_handle_t *llm = NULL;
+static response_cache_t *cache = NULL;
+static disk_cache_t *disk_cache = NULL;
+static session_table_t *sessions = NULL;
+static inflight_table_t *inflight = NULL;
+static model_stats_t *model_stats = NULL;
+static embed_batcher_t *embedder = NULL;
+static model_scheduler_t *scheduler = NULL;
+static admin_server_t *admin = NULL;
+static int dispatch_fd = -1;                   // eventfd, written when a generation ends
+static int async_jobs = 0;                     // generations running on the loop
+static session_t **client_sessions = NULL;     // by connection slot
+
+// A cache hit, served from memory or from the cache file
+typedef struct {
+    const char *text;
+    size_t text_length;
+    const uint32_t *token_ends;
+    size_t token_count;
+    response_cache_entry_t *entry;
+    disk_cache_hit_t disk;
+} cached_response_t;
+
+// Generation request queued for the LLM worker pool
+typedef struct generation_job {
+    client_connection_t *client;
+    uint32_t request_id;
+    llm_request_t *request;
+    
+    // Cache hit to replay instead of generating
+    bool hit;
+    cached_response_t cached;
+    
+    // Cacheable miss: the streamed tokens are recorded under cache_key
+    bool recording;
+    response_cache_key_t cache_key;
+    char *text;
+    size_t text_length;
+    size_t text_capacity;
+    uint32_t *token_ends;
+    size_t token_count;
+    size_t token_capacity;
+    
+    // Identical prompts that arrived while this one runs share its output
+    flight_t *flight;
+    
+    // Conversation this prompt continues; turn_open until its context is stored
+    session_t *session;
+    bool turn_open;
+    
+    // Model the client asked for, NULL for the configured one
+    char *model;
+    
+    // Running on the event loop rather than a worker
+    bool async;
+    
+    // Dispatched by the scheduler, whose slot it holds until it ends
+    bool scheduled;
+    
+    // For the latency histograms, metrics_now_us() clock
+    int64_t arrived_us;
+    int64_t last_token_us;          // 0 until the first token
+    
+    // For tracing: when the current wait began, and the time spent
+    // handing tokens to the connection
+    int64_t phase_us;
+    int64_t send_us;
+    
+    // Linked into active_jobs until the job finishes
+    struct generation_job *prev;
+    struct generation_job *next;
+} generation_job_t;
+
+// Queued and running jobs, so a disconnect can cancel the client's work
+static pthread_mutex_t jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static generation_job_t *active_jobs = NULL;
+
+static void generate_response(void *arg);
+static void on_dispatch(event_loop_t *event_loop, int fd, uint32_t events, void *user_data);
+static void abandon_queued_jobs(void);
 
 // Signal handler for graceful shutdown
 static void handle_signal(int sig) {
@@ -30,228 +129,1221 @@ bool server_initialize(server_config_t *config) {
     memcpy(&current_config, config, sizeof(server_config_t));
     
     // Initialize LLM
-    if (!llm_initialize(&config->llm_config)) {
+    llm = llm_handle_create(&config->llm_config);
+    if (llm == NULL) {
         fprintf(stderr, "Failed to initialize LLM\n");
         return false;
     }
     
-    // Allocate client connection array
-    clients = calloc(config->max_connections, sizeof(client_connection_t));
-    if (clients == NULL) {
+    if (config->llm_workers <= 0) {
+        current_config.llm_workers = 1;
+    }
+    if (config->embed_batch_size <= 0) {
+        current_config.embed_batch_size = 1;
+    }
+    if (config->embed_batch_wait_us < 0) {
+        current_config.embed_batch_wait_us = 0;
+    }
+    
+    if (config->cache_bytes > 0) {
+        cache = response_cache_create(config->cache_bytes);
+        if (cache == NULL) {
+            llm_handle_destroy(llm);
+            llm = NULL;
+            return false;
+        }
+    }
+    
+    if (config->disk_cache_path[0] && config->disk_cache_bytes > 0) {
+        disk_cache = disk_cache_open(config->disk_cache_path, config->disk_cache_bytes, config->verbose);
+        if (disk_cache == NULL) {
+            response_cache_destroy(cache);
+            cache = NULL;
+            llm_handle_destroy(llm);
+            llm = NULL;
+            return false;
+        }
+    }
+    
+    inflight = inflight_create();
+    model_stats = model_stats_create();
+    trace_configure(config->trace_sample_percent);
+    
+    if (config->max_sessions > 0) {
+        size_t max_context = config->llm_config.context_size > 0 ? config->llm_config.context_size : 2048;
+        sessions = session_table_create(config->max_sessions, config->session_ttl, max_context);
+    }
+    
+    // Allocate client connection table and its free slot stack
+    clients = calloc(config->max_connections, sizeof(client_connection_t *));
+    free_slots = calloc(config->max_connections, sizeof(int));
+    client_sessions = calloc(config->max_connections, sizeof(session_t *));
+    if (clients == NULL || free_slots == NULL || client_sessions == NULL || inflight == NULL ||
+        model_stats == NULL || (config->max_sessions > 0 && sessions == NULL)) {
         fprintf(stderr, "Failed to allocate memory for client connections\n");
-        llm_cleanup();
+        free(clients);
+        free(free_slots);
+        free(client_sessions);
+        clients = NULL;
+        free_slots = NULL;
+        client_sessions = NULL;
+        session_table_destroy(sessions);
+        sessions = NULL;
+        inflight_destroy(inflight);
+        inflight = NULL;
+        model_stats_destroy(model_stats);
+        model_stats = NULL;
+        disk_cache_close(disk_cache);
+        disk_cache = NULL;
+        response_cache_destroy(cache);
+        cache = NULL;
+        llm_handle_destroy(llm);
+        llm = NULL;
         return false;
     }
     
+    free_slot_count = 0;
+    for (int i = config->max_connections - 1; i >= 0; i--) {
+        free_slots[free_slot_count++] = i;
+    }
+    
     // Set up signal handlers
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
+    signal(SIGPIPE, SIG_IGN);
     
     printf("Server initialized with port %d and max %d connections\n", 
            config->port, config->max_connections);
     return true;
 }
 
-bool server_start(void) {
-    if (running) {
-        fprintf(stderr, "Server is already running\n");
-        return false;
+static void track_job(generation_job_t *job) {
+    pthread_mutex_lock(&jobs_mutex);
+    job->prev = NULL;
+    job->next = active_jobs;
+    if (active_jobs) {
+        active_jobs->prev = job;
     }
-    
-    // Create server socket
-    server_socket = create_server_socket(current_config.port);
-    if (server_socket < 0) {
-        fprintf(stderr, "Failed to create server socket\n");
-        return false;
+    active_jobs = job;
+    pthread_mutex_unlock(&jobs_mutex);
+}
+
+static void untrack_job(generation_job_t *job) {
+    pthread_mutex_lock(&jobs_mutex);
+    if (job->prev) {
+        job->prev->next = job->next;
+    } else {
+        active_jobs = job->next;
+    }
+    if (job->next) {
+        job->next->prev = job->prev;
     }
+    pthread_mutex_unlock(&jobs_mutex);
+}
+
+// Abort every generation still running for a client, unless other
+// clients are subscribed to its output
+static void cancel_client_jobs(client_connection_t *client) {
+    pthread_mutex_lock(&jobs_mutex);
+    for (generation_job_t *job = active_jobs; job; job = job->next) {
+        if (job->client == client && (job->flight == NULL || flight_abandon(inflight, job->flight))) {
+            llm_request_cancel(job->request);
+        }
+    }
+    pthread_mutex_unlock(&jobs_mutex);
+}
+
+// Stop the generations on the loop; they finish on its next rounds
+static void cancel_async_jobs(void) {
+    pthread_mutex_lock(&jobs_mutex);
+    for (generation_job_t *job = active_jobs; job; job = job->next) {
+        if (job->async) {
+            llm_request_cancel(job->request);
+        }
+    }
+    pthread_mutex_unlock(&jobs_mutex);
+}
+
+// Unregister a client and drop the event loop's reference to it
+static void disconnect_client(client_connection_t *client) {
+    event_loop_remove(loop, client->client_socket);
+    connection_close(client);
+    cancel_client_jobs(client);
     
-    running = true;
-    printf("Server started on port %d\n", current_config.port);
+    // The session outlives the connection so it can be resumed by id
+    session_release(client_sessions[client->slot]);
+    client_sessions[client->slot] = NULL;
     
-    // Main server loop
+    clients[client->slot] = NULL;
+    free_slots[free_slot_count++] = client->slot;
+    client_count--;
+    metrics_add(METRIC_CONNECTIONS_CLOSED, 1);
+    
+    printf("Client disconnected. Active clients: %d\n", client_count);
+    connection_release(client);
+}
+
+static void accept_clients(event_loop_t *event_loop, int fd, uint32_t events, void *user_data) {
+    (void)events;
+    (void)user_data;
+    
+    // Edge-triggered: keep accepting until the backlog is empty
     while (running) {
-        int client_socket = accept_client_connection(server_socket);
+        int64_t accept_started = metrics_now_us();
+        int client_socket = accept_client_connection(fd);
         if (client_socket < 0) {
-            if (running) {
-                fprintf(stderr, "Failed to accept client connection\n");
-            }
-            continue;
-        }
-        
-        // Find an available slot for the new client
-        pthread_mutex_lock(&clients_mutex);
-        int slot = -1;
-        for (int i = 0; i < current_config.max_connections; i++) {
-            if (!clients[i].active) {
-                slot = i;
-                break;
-            }
+            break;
         }
         
-        if (slot == -1) {
-            pthread_mutex_unlock(&clients_mutex);
+        if (free_slot_count == 0) {
             fprintf(stderr, "Maximum number of clients reached\n");
+            metrics_add(METRIC_CONNECTIONS_REFUSED, 1);
             close(client_socket);
             continue;
         }
         
-        // Create a thread to handle the client
-        clients[slot].client_socket = client_socket;
-        clients[slot].active = true;
-        client_count++;
+        if (!set_socket_nonblocking(client_socket) || !set_socket_nodelay(client_socket)) {
+            close(client_socket);
+            continue;
+        }
         
-        if (pthread_create(&clients[slot].thread_id, NULL, handle_client, &clients[slot]) != 0) {
-            fprintf(stderr, "Failed to create thread for client\n");
-            clients[slot].active = false;
-            client_count--;
+        int slot = free_slots[free_slot_count - 1];
+        client_connection_t *client = connection_create(client_socket, slot);
+        if (client == NULL) {
             close(client_socket);
-            pthread_mutex_unlock(&clients_mutex);
             continue;
         }
+        client->trace_id = trace_connection_id();
         
-        // Detach the thread so it can clean up itself
-        pthread_detach(clients[slot].thread_id);
-        pthread_mutex_unlock(&clients_mutex);
+        if (!event_loop_add(event_loop, client_socket, EVENT_READ | EVENT_WRITE, handle_client, client)) {
+            fprintf(stderr, "Failed to register client connection\n");
+            connection_release(client);
+            continue;
+        }
         
+        free_slot_count--;
+        clients[slot] = client;
+        client_count++;
+        metrics_add(METRIC_CONNECTIONS_ACCEPTED, 1);
         printf("Client connected. Active clients: %d\n", client_count);
+        
+        // Send welcome message
+        const char *welcome_msg = "Connected to LLM Chat Server. Type your message and press Enter.";
+        if (connection_send_message(client, MSG_INFO, 0, welcome_msg, strlen(welcome_msg)) < 0) {
+            printf("Failed to send welcome message to client\n");
+            disconnect_client(client);
+        } else if (trace_enabled()) {
+            // The connection's own spans go in row 0 of its process
+            trace_span((uint64_t)client->trace_id << 32, "accept", accept_started, metrics_now_us());
+        }
+    }
+}
+
+// Generations the backends can run at once: the sum of their limits,
+// unless one has none or the configuration says otherwise
+static int generation_capacity(void) {
+    const llm_config_t *llm_config = &current_config.llm_config;
+    if (current_config.max_generations > 0 || llm_config->engine != LLM_ENGINE_OLLAMA) {
+        return current_config.max_generations;
     }
     
-    return true;
+    int total = 0;
+    for (int i = 0; i < llm_config->backend_count; i++) {
+        if (llm_config->backends[i].max_concurrency <= 0) {
+            return 0;
+        }
+        total += llm_config->backends[i].max_concurrency;
+    }
+    return total;
 }
 
-void server_stop(void) {
-    if (!running) {
-        return;
+// Per-model scheduler, with the limits from "NAME=MAX,NAME=MAX"
+static model_scheduler_t* create_scheduler(void) {
+    model_scheduler_t *created = model_scheduler_create(current_config.model_concurrency,
+                                                        generation_capacity(), current_config.model_batch);
+    char limits[sizeof(current_config.model_limits)];
+    strcpy(limits, current_config.model_limits);
+    
+    char *saveptr = NULL;
+    for (char *item = strtok_r(limits, ",", &saveptr); created && item; item = strtok_r(NULL, ",", &saveptr)) {
+        char *equals = strrchr(item, '=');
+        if (equals == NULL || equals == item || atoi(equals + 1) <= 0) {
+            fprintf(stderr, "Warning: Ignoring invalid model limit %s\n", item);
+            continue;
+        }
+        *equals = '\0';
+        model_scheduler_set_limit(created, item, atoi(equals + 1));
+    }
+    return created;
+}
+
+static void release_dispatch(void) {
+    model_scheduler_destroy(scheduler);
+    scheduler = NULL;
+    if (dispatch_fd >= 0) {
+        close(dispatch_fd);
+        dispatch_fd = -1;
+    }
+}
+
+// Pages of the admin listener: /metrics and /trace. Runs on the loop
+// thread like everything that touches client_count.
+static int serve_admin(const char *path, arena_t *body, const char **content_type) {
+    if (strcmp(path, "/trace") == 0) {
+        *content_type = TRACE_CONTENT_TYPE;
+        return trace_render(body) ? 200 : 500;
+    }
+    if (strcmp(path, "/metrics") != 0) {
+        return 404;
     }
     
-    running = false;
-    printf("Stopping server...\n");
+    model_scheduler_stats_t stats;
+    model_scheduler_get_stats(scheduler, &stats);
+    metrics_gauges_t gauges = {
+        .connections = client_count,
+        .queued = stats.queued,
+        .running = stats.running,
+        .worker_queue = worker_pool_queue_depth()
+    };
+    *content_type = METRICS_CONTENT_TYPE;
+    return metrics_render(body, &gauges) && model_stats_render(model_stats, body) ? 200 : 500;
+}
+
+bool server_start(void) {
+    if (running) {
+        fprintf(stderr, "Server is already running\n");
+        return false;
+    }
     
-    // Close server socket to stop accept() from blocking
-    if (server_socket >= 0) {
+    // Create server socket
+    server_socket = create_server_socket(current_config.port);
+    if (server_socket < 0) {
+        fprintf(stderr, "Failed to create server socket\n");
+        return false;
+    }
+    
+    // Generations wait for their model's turn; the loop dispatches the next
+    // ones whenever dispatch_fd says a generation has ended
+    scheduler = create_scheduler();
+    dispatch_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    
+    loop = event_loop_create(256);
+    if (loop == NULL || scheduler == NULL || dispatch_fd < 0 || !set_socket_nonblocking(server_socket) ||
+        !event_loop_add(loop, server_socket, EVENT_READ, accept_clients, NULL) ||
+        !event_loop_add(loop, dispatch_fd, EVENT_READ, on_dispatch, NULL)) {
+        fprintf(stderr, "Failed to set up event loop\n");
+        release_dispatch();
+        event_loop_destroy(loop);
+        loop = NULL;
+        close(server_socket);
+        server_socket = -1;
+        return false;
+    }
+    
+    // Generation runs on a fixed pool so upstream parallelism stays bounded
+    // no matter how many clients are connected
+    if (!worker_pool_start(current_config.llm_workers,
+                           (size_t)current_config.llm_workers * JOBS_PER_WORKER, generate_response)) {
+        fprintf(stderr, "Failed to start LLM worker pool\n");
+        release_dispatch();
+        event_loop_destroy(loop);
+        loop = NULL;
         close(server_socket);
         server_socket = -1;
+        return false;
     }
     
-    // Wait for all client threads to finish
-    pthread_mutex_lock(&clients_mutex);
+    // Embedding requests are gathered into batches on a thread of their own
+    embedder = embed_batcher_create(llm, (size_t)current_config.embed_batch_size,
+                                    current_config.embed_batch_wait_us, current_config.verbose);
+    if (embedder == NULL) {
+        fprintf(stderr, "Failed to start embedding batcher\n");
+        worker_pool_stop();
+        release_dispatch();
+        event_loop_destroy(loop);
+        loop = NULL;
+        close(server_socket);
+        server_socket = -1;
+        return false;
+    }
+    
+    // Scrapes are answered on the loop, between client events
+    if (current_config.metrics_port > 0) {
+        admin = admin_server_create(loop, current_config.metrics_port, serve_admin, current_config.verbose);
+        if (admin == NULL) {
+            embed_batcher_destroy(embedder);
+            embedder = NULL;
+            worker_pool_stop();
+            release_dispatch();
+            event_loop_destroy(loop);
+            loop = NULL;
+            close(server_socket);
+            server_socket = -1;
+            return false;
+        }
+    }
+    
+    running = true;
+    printf("Server started on port %d\n", current_config.port);
+    
+    // Main server loop: sleeps in epoll until a socket is actually ready
+    bool ok = event_loop_run(loop);
+    running = false;
+    
+    printf("Stopping server...\n");
+    
+    // Close the listener and every remaining client
+    event_loop_remove(loop, server_socket);
+    close(server_socket);
+    server_socket = -1;
+    
     for (int i = 0; i < current_config.max_connections; i++) {
-        if (clients[i].active) {
-            close(clients[i].client_socket);
+        if (clients[i] != NULL) {
+            disconnect_client(clients[i]);
         }
     }
-    pthread_mutex_unlock(&clients_mutex);
     
-    // Give threads a moment to clean up
-    sleep(1);
+    // Queued generations never start; those on the loop need it to run
+    // until they have wound down
+    abandon_queued_jobs();
+    cancel_async_jobs();
+    while (async_jobs > 0 && event_loop_run_once(loop, -1)) {
+    }
+    
+    admin_server_destroy(admin);
+    admin = NULL;
+    event_loop_destroy(loop);
+    loop = NULL;
+    
+    // Let in-flight generations finish before the LLM goes away
+    worker_pool_stop();
+    embed_batcher_destroy(embedder);
+    embedder = NULL;
+    
+    if (current_config.verbose) {
+        model_scheduler_stats_t stats;
+        model_scheduler_get_stats(scheduler, &stats);
+        printf("Scheduler: %llu generations dispatched, %llu model switches\n",
+               (unsigned long long)stats.dispatched, (unsigned long long)stats.switches);
+    }
+    release_dispatch();
     
     // Clean up resources
     free(clients);
+    free(free_slots);
+    free(client_sessions);
     clients = NULL;
+    free_slots = NULL;
+    client_sessions = NULL;
     client_count = 0;
     
+    if (current_config.verbose) {
+        printf("Coalesced %llu prompts into generations already running\n",
+               (unsigned long long)inflight_joined(inflight));
+    }
+    inflight_destroy(inflight);
+    inflight = NULL;
+    
+    if (current_config.verbose) {
+        model_stats_print(model_stats);
+    }
+    model_stats_destroy(model_stats);
+    model_stats = NULL;
+    
+    if (sessions != NULL) {
+        if (current_config.verbose) {
+            printf("Sessions: %zu kept at shutdown\n", session_table_count(sessions));
+        }
+        session_table_destroy(sessions);
+        sessions = NULL;
+    }
+    
+    if (cache != NULL) {
+        if (current_config.verbose) {
+            response_cache_stats_t stats;
+            response_cache_get_stats(cache, &stats);
+            printf("Response cache: %llu hits, %llu misses, %llu insertions, %llu evictions, "
+                   "%zu entries in %zu bytes\n",
+                   (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+                   (unsigned long long)stats.insertions, (unsigned long long)stats.evictions,
+                   stats.entries, stats.bytes);
+        }
+        response_cache_destroy(cache);
+        cache = NULL;
+    }
+    
+    if (disk_cache != NULL) {
+        if (current_config.verbose) {
+            disk_cache_stats_t stats;
+            disk_cache_get_stats(disk_cache, &stats);
+            printf("Disk cache: %llu hits, %llu misses, %llu appends, %llu compactions, "
+                   "%zu entries, %zu of %zu bytes live\n",
+                   (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+                   (unsigned long long)stats.appends, (unsigned long long)stats.compactions,
+                   stats.entries, stats.live_bytes, stats.file_bytes);
+        }
+        disk_cache_close(disk_cache);
+        disk_cache = NULL;
+    }
+    
     // Clean up LLM
-    llm_cleanup();
+    llm_handle_destroy(llm);
+    llm = NULL;
     
     printf("Server stopped\n");
+    return ok;
+}
+
+void server_stop(void) {
+    if (!running) {
+        return;
+    }
+    
+    // Only flag the loop here; teardown happens on the loop thread once
+    // server_start() returns, which keeps this safe to call from a signal handler
+    running = false;
+    event_loop_stop(loop);
 }
 
 bool server_is_running(void) {
     return running;
 }
 
-void* handle_client(void *arg) {
-    client_connection_t *client = (client_connection_t *)arg;
-    int client_socket = client->client_socket;
-    char buffer[BUFFER_SIZE];
-    int consecutive_timeouts = 0;
-    const int max_consecutive_timeouts = 10; // Allow up to 10 consecutive timeouts
+// Keep a copy of each streamed token so the response can be cached
+static void record_token(generation_job_t *job, const char *token, size_t length) {
+    if (job->text_length + length > job->text_capacity) {
+        size_t new_capacity = job->text_capacity ? job->text_capacity * 2 : 4096;
+        while (new_capacity < job->text_length + length) {
+            new_capacity *= 2;
+        }
+        char *new_text = realloc(job->text, new_capacity);
+        if (new_text == NULL) {
+            job->recording = false;
+            return;
+        }
+        job->text = new_text;
+        job->text_capacity = new_capacity;
+    }
     
-    // Send welcome message
-    const char *welcome_msg = "Connected to LLM Chat Server. Type your message and press Enter.";
-    if (send_message(client_socket, welcome_msg) < 0) {
-        printf("Failed to send welcome message to client\n");
-        goto cleanup;
+    if (job->token_count == job->token_capacity) {
+        size_t new_capacity = job->token_capacity ? job->token_capacity * 2 : 256;
+        uint32_t *new_ends = realloc(job->token_ends, new_capacity * sizeof(uint32_t));
+        if (new_ends == NULL) {
+            job->recording = false;
+            return;
+        }
+        job->token_ends = new_ends;
+        job->token_capacity = new_capacity;
     }
     
-    // Handle client messages
-    while (running && client->active) {
-        int bytes_received = receive_message(client_socket, buffer, BUFFER_SIZE);
-        
-        if (bytes_received < 0) {
-            // Real error occurred
-            if (current_config.verbose) {
-                printf("Error receiving from client, closing connection\n");
-            }
-            break;
-        } else if (bytes_received == 0) {
-            // Just a timeout, not a real error in our improved receive function
-            consecutive_timeouts++;
-            if (consecutive_timeouts > max_consecutive_timeouts) {
-                // Only print this message once in a while to avoid log spam
-                if (consecutive_timeouts % 100 == 0 && current_config.verbose) {
-                    printf("Client idle for extended period (%d timeouts)\n", consecutive_timeouts);
-                }
-            }
-            
-            // Don't break the connection on timeouts, just continue waiting
-            usleep(50000); // 50ms wait to prevent CPU hogging
-            continue;
+    memcpy(job->text + job->text_length, token, length);
+    job->text_length += length;
+    job->token_ends[job->token_count++] = (uint32_t)job->text_length;
+}
+
+// Report a failed request, flagged when the same request may succeed later
+static int send_error(client_connection_t *client, uint32_t request_id, const char *error) {
+    uint8_t flags = error == llm_unavailable_error ? MESSAGE_FLAG_UNAVAILABLE : 0;
+    return connection_send_flagged(client, MSG_ERROR, flags, request_id, error, strlen(error));
+}
+
+// Forward one generated token to the client that asked for it
+static bool forward_token(const char *token, size_t length, void *user_data) {
+    generation_job_t *job = (generation_job_t *)user_data;
+    
+    int64_t now = metrics_now_us();
+    metrics_add(METRIC_TOKENS, 1);
+    if (job->last_token_us == 0) {
+        metrics_observe(HISTOGRAM_TTFT, now - job->arrived_us);
+    } else {
+        metrics_observe(HISTOGRAM_INTER_TOKEN, now - job->last_token_us);
+    }
+    job->last_token_us = now;
+    
+    if (job->recording) {
+        record_token(job, token, length);
+    }
+    
+    // A failed send means the client is gone; keep generating only while
+    // a subscriber is still listening
+    bool listening = connection_send_message(job->client, MSG_TOKEN, job->request_id, token, length) >= 0;
+    if (job->request->trace_id != 0) {
+        job->send_us += metrics_now_us() - now;
+    }
+    if (job->flight != NULL && flight_publish(job->flight, token, length)) {
+        listening = true;
+    }
+    return listening;
+}
+
+// Tell the client where the generation's time went, and add it to its
+// model's totals
+static void report_stats(generation_job_t *job, const generation_stats_t *stats) {
+    uint8_t payload[GENERATION_STATS_SIZE];
+    generation_stats_encode(payload, stats);
+    connection_send_message(job->client, MSG_STATS, job->request_id, payload, sizeof(payload));
+    model_stats_record(model_stats, job->request->model, stats);
+}
+
+static void finish_generation(const llm_result_t *result, void *user_data) {
+    generation_job_t *job = (generation_job_t *)user_data;
+    
+    // Nobody is listening for the outcome of a cancelled request
+    if (result->cancelled) {
+        return;
+    }
+    
+    int64_t finish_started = metrics_now_us();
+    metrics_add(result->success ? METRIC_GENERATIONS : METRIC_GENERATION_ERRORS, 1);
+    metrics_observe(HISTOGRAM_TOTAL, finish_started - job->arrived_us);
+    
+    // Store the conversation before the client hears DONE, so a follow-up
+    // sent right away finds the session free
+    if (job->turn_open) {
+        session_end_turn(job->session, result->success ? result->context : NULL, result->context_length);
+        job->turn_open = false;
+    }
+    
+    int sent;
+    if (result->success) {
+        if (job->recording && cache != NULL) {
+            response_cache_insert(cache, &job->cache_key, job->text, job->text_length,
+                                  job->token_ends, job->token_count);
         }
-        
-        // Reset timeout counter since we got a real message
-        consecutive_timeouts = 0;
-        
+        if (job->recording && disk_cache != NULL) {
+            disk_cache_append(disk_cache, &job->cache_key, job->text, job->text_length,
+                              job->token_ends, job->token_count);
+        }
+        report_stats(job, &result->stats);
+        sent = connection_send_message(job->client, MSG_DONE, job->request_id, NULL, 0);
+    } else {
         if (current_config.verbose) {
-            printf("Received from client: %s\n", buffer);
+            printf("Failed to generate LLM response: %s\n", result->error);
+        }
+        sent = send_error(job->client, job->request_id, result->error);
+    }
+    
+    // Subscribers are answered once the caches hold the response, so a
+    // repeat arriving from now on is a hit rather than a new generation
+    if (job->flight != NULL) {
+        flight_finish(inflight, job->flight, &result->stats, result->success ? NULL : result->error);
+        job->flight = NULL;
+    }
+    
+    if (sent < 0 && current_config.verbose) {
+        printf("Failed to send response to client\n");
+    }
+    trace_span_arg(job->request->trace_id, "finish", finish_started, metrics_now_us(),
+                   "token_send_us", job->send_us);
+}
+
+// Play a cached response back token by token at the configured pace
+static void replay_cached(generation_job_t *job) {
+    const cached_response_t *entry = &job->cached;
+    uint32_t start = 0;
+    int64_t replay_started = metrics_now_us();
+    
+    for (size_t i = 0; i < entry->token_count; i++) {
+        // Sleeping on the cancel fd lets a disconnect cut the replay short
+        struct pollfd pfd = { .fd = job->request->cancel_fd, .events = POLLIN };
+        if (i > 0 && poll(&pfd, 1, current_config.cache_replay_ms) != 0) {
+            return;
         }
         
+        uint32_t end = entry->token_ends[i];
+        if (connection_send_message(job->client, MSG_TOKEN, job->request_id,
+                                    entry->text + start, end - start) < 0) {
+            return;
+        }
+        start = end;
+    }
+    
+    connection_send_message(job->client, MSG_DONE, job->request_id, NULL, 0);
+    trace_span_arg(job->request->trace_id, "replay", replay_started, metrics_now_us(),
+                   "tokens", (int64_t)entry->token_count);
+}
+
+// Look the job up in memory first, then on disk. Disk hits are copied
+// into the memory cache so hot responses stop touching the file.
+static bool lookup_cached(generation_job_t *job) {
+    cached_response_t *cached = &job->cached;
+    
+    if (cache != NULL) {
+        cached->entry = response_cache_lookup(cache, &job->cache_key);
+        if (cached->entry) {
+            cached->text = cached->entry->text;
+            cached->text_length = cached->entry->text_length;
+            cached->token_ends = cached->entry->token_ends;
+            cached->token_count = cached->entry->token_count;
+            return true;
+        }
+    }
+    
+    if (disk_cache != NULL && disk_cache_lookup(disk_cache, &job->cache_key, &cached->disk)) {
+        cached->text = cached->disk.text;
+        cached->text_length = cached->disk.text_length;
+        cached->token_ends = cached->disk.token_ends;
+        cached->token_count = cached->disk.token_count;
+        if (cache != NULL) {
+            response_cache_insert(cache, &job->cache_key, cached->text, cached->text_length,
+                                  cached->token_ends, cached->token_count);
+        }
+        return true;
+    }
+    
+    return false;
+}
+
+static void free_job(generation_job_t *job) {
+    if (job->flight != NULL) {
+        flight_finish(inflight, job->flight, NULL, "Generation cancelled");
+    }
+    if (job->turn_open) {
+        session_end_turn(job->session, NULL, 0);
+    }
+    session_release(job->session);
+    response_cache_entry_release(job->cached.entry);
+    if (job->cached.disk.mapping) {
+        disk_cache_hit_release(&job->cached.disk);
+    }
+    response_cache_key_free(&job->cache_key);
+    free(job->text);
+    free(job->token_ends);
+    llm_request_free(job->request);
+    free(job->model);
+    free(job);
+}
+
+// Give the job's model slot back and have the loop dispatch what it
+// frees; a generation may end on any thread, and inside a dispatch
+static void end_scheduled(generation_job_t *job) {
+    if (!job->scheduled) {
+        return;
+    }
+    model_scheduler_finish(scheduler, job->request->model);
+    job->scheduled = false;
+    
+    uint64_t one = 1;
+    ssize_t written = write(dispatch_fd, &one, sizeof(one));
+    (void)written;
+}
+
+static void generate_response(void *arg) {
+    generation_job_t *job = (generation_job_t *)arg;
+    client_connection_t *client = job->client;
+    
+    trace_span(job->request->trace_id, "worker queue", job->phase_us, metrics_now_us());
+    
+    // Skip work for clients that left while the job was queued, unless
+    // someone else is waiting for the same output
+    if ((!atomic_load(&client->active) && (job->flight == NULL || flight_abandon(inflight, job->flight))) ||
+        llm_request_is_cancelled(job->request)) {
+        goto done;
+    }
+    
+    if (job->hit) {
+        replay_cached(job);
+        goto done;
+    }
+    
+    if (current_config.verbose) {
+        printf("Generating LLM response for: '%s'\n", job->request->prompt);
+    }
+    metrics_observe(HISTOGRAM_QUEUE_WAIT, metrics_now_us() - job->arrived_us);
+    
+    // Tokens go out to the client as they are generated
+    llm_generate_stream(llm, job->request, forward_token, finish_generation, job);
+    
+done:
+    end_scheduled(job);
+    untrack_job(job);
+    free_job(job);
+    connection_release(client);
+}
+
+// End of a generation that ran on the event loop
+static void finish_async_generation(const llm_result_t *result, void *user_data) {
+    generation_job_t *job = (generation_job_t *)user_data;
+    client_connection_t *client = job->client;
+    
+    finish_generation(result, job);
+    end_scheduled(job);
+    untrack_job(job);
+    free_job(job);
+    connection_release(client);
+    async_jobs--;
+}
+
+// Whether a prompt may share its answer with identical ones: through the
+// response caches, or by joining a generation that is already running
+static bool shareable(const llm_request_t *request, uint8_t flags) {
+    // A session turn depends on the conversation so far
+    if (flags & (MESSAGE_FLAG_NO_CACHE | MESSAGE_FLAG_SESSION)) {
+        return false;
+    }
+    
+    // Sampled output differs run to run unless the seed is pinned
+    return !current_config.cache_deterministic_only ||
+           request->temperature == 0.0f || request->seed >= 0;
+}
+
+// Attach the client's session to the job, opening one if the client has
+// none yet. Replies with an error and returns false if that is impossible.
+static bool begin_session_turn(client_connection_t *client, generation_job_t *job, uint32_t request_id) {
+    const char *error_msg = NULL;
+    session_t **session = &client_sessions[client->slot];
+    bool created = false;
+    
+    if (sessions != NULL && *session == NULL) {
+        *session = session_create(sessions);
+        created = *session != NULL;
+    }
+    
+    if (sessions == NULL) {
+        error_msg = "Sessions are disabled on this server";
+    } else if (*session == NULL) {
+        error_msg = "Too many active sessions, please try again later";
+    } else if (!session_begin_turn(*session, &job->request->context, &job->request->context_length)) {
+        error_msg = "The session is still answering another prompt";
+    }
+    
+    if (error_msg != NULL) {
+        connection_send_message(client, MSG_ERROR, request_id, error_msg, strlen(error_msg));
+        return false;
+    }
+    
+    session_retain(*session);
+    job->session = *session;
+    job->turn_open = true;
+    
+    // Ollama keeps the conversation's KV cache warm on the instance that
+    // served the previous turn
+    if (current_config.llm_config.sticky_sessions) {
+        job->request->affinity = session_affinity(*session);
+    }
+    
+    // Let the client know which id to resume the conversation with
+    if (created) {
+        connection_send_message(client, MSG_SESSION, request_id, session_id(*session), SESSION_ID_LENGTH);
+    }
+    return true;
+}
+
+// Start a new session for the client, or attach it to an existing one
+static void handle_session(client_connection_t *client, const message_t *message) {
+    session_t *session = NULL;
+    const char *error_msg = NULL;
+    
+    if (sessions == NULL) {
+        error_msg = "Sessions are disabled on this server";
+    } else if (message->length == 0) {
+        session = session_create(sessions);
+        if (session == NULL) {
+            error_msg = "Too many active sessions, please try again later";
+        }
+    } else {
+        session = session_find(sessions, message->payload, message->length);
+        if (session == NULL) {
+            error_msg = "Unknown or expired session";
+        }
+    }
+    
+    if (error_msg != NULL) {
+        connection_send_message(client, MSG_ERROR, message->request_id, error_msg, strlen(error_msg));
+        return;
+    }
+    
+    session_release(client_sessions[client->slot]);
+    client_sessions[client->slot] = session;
+    if (current_config.verbose) {
+        printf("Client is now in session %s\n", session_id(session));
+    }
+    connection_send_message(client, MSG_SESSION, message->request_id, session_id(session), SESSION_ID_LENGTH);
+}
+
+// Answer a job that cannot run with an error
+static void reject_job(generation_job_t *job) {
+    client_connection_t *client = job->client;
+    const char *busy_msg = "Server is busy, please try again later";
+    connection_send_message(client, MSG_ERROR, job->request_id, busy_msg, strlen(busy_msg));
+    metrics_add(METRIC_REJECTED, 1);
+    
+    end_scheduled(job);
+    untrack_job(job);
+    free_job(job);
+    connection_release(client);
+}
+
+// Engines that can wait on the event loop need no thread; paced cache
+// replays and blocking engines go to the workers
+static void start_job(generation_job_t *job) {
+    if (!job->hit && current_config.async_upstream) {
         if (current_config.verbose) {
-            printf("Generating LLM response for: '%s'\n", buffer);
+            printf("Generating LLM response for: '%s'\n", job->request->prompt);
+        }
+        metrics_observe(HISTOGRAM_QUEUE_WAIT, metrics_now_us() - job->arrived_us);
+        job->async = true;
+        async_jobs++;
+        if (llm_generate_async(llm, loop, job->request, forward_token, finish_async_generation, job)) {
+            return;
+        }
+        job->async = false;
+        async_jobs--;
+    }
+    
+    job->phase_us = metrics_now_us();
+    if (!worker_pool_submit(job)) {
+        reject_job(job);
+    }
+}
+
+// Start every queued generation the scheduler lets run now
+static void dispatch_jobs(void) {
+    generation_job_t *job;
+    while ((job = model_scheduler_next(scheduler)) != NULL) {
+        job->scheduled = true;
+        if (job->request->trace_id != 0) {
+            int64_t now = metrics_now_us();
+            trace_span(job->request->trace_id, "model queue", job->phase_us, now);
+            job->phase_us = now;
         }
         
-        // Generate response using LLM
-        char *response = llm_generate_response(buffer);
+        // Nobody is waiting for it any more
+        client_connection_t *client = job->client;
+        if (!atomic_load(&client->active) && (job->flight == NULL || flight_abandon(inflight, job->flight))) {
+            end_scheduled(job);
+            untrack_job(job);
+            free_job(job);
+            connection_release(client);
+            continue;
+        }
+        start_job(job);
+    }
+}
+
+// Drop the generations still waiting for their turn
+static void abandon_queued_jobs(void) {
+    generation_job_t *job;
+    while ((job = model_scheduler_take_any(scheduler)) != NULL) {
+        client_connection_t *client = job->client;
+        untrack_job(job);
+        free_job(job);
+        connection_release(client);
+    }
+}
+
+static void on_dispatch(event_loop_t *event_loop, int fd, uint32_t events, void *user_data) {
+    (void)event_loop;
+    (void)events;
+    (void)user_data;
+    
+    uint64_t count;
+    while (read(fd, &count, sizeof(count)) > 0) {
+    }
+    dispatch_jobs();
+}
+
+// Split off the model name that precedes the text of a MESSAGE_FLAG_MODEL
+// message, as a new string. Returns false if it is malformed.
+static bool take_model_name(const char **text, size_t *length, char **model) {
+    if (*length < 1 || (uint8_t)(*text)[0] == 0 || *length < 1 + (size_t)(uint8_t)(*text)[0]) {
+        return false;
+    }
+    size_t name_length = (uint8_t)(*text)[0];
+    const char *name = *text + 1;
+    
+    for (size_t i = 0; i < name_length; i++) {
+        if ((unsigned char)name[i] < 0x20) {
+            return false;
+        }
+    }
+    
+    *model = strndup(name, name_length);
+    *text += 1 + name_length;
+    *length -= 1 + name_length;
+    return *model != NULL;
+}
+
+// Queue a prompt for generation
+static void handle_prompt(client_connection_t *client, const message_t *message) {
+    const char *text = message->payload;
+    size_t text_length = message->length;
+    uint32_t budget_ms = 0;
+    int64_t arrived_us = metrics_now_us();
+    
+    metrics_add(METRIC_PROMPTS, 1);
+    
+    // The client's deadline precedes the text
+    if (message->flags & MESSAGE_FLAG_DEADLINE) {
+        if (text_length < sizeof(budget_ms)) {
+            const char *error_msg = "Malformed deadline";
+            connection_send_message(client, MSG_ERROR, message->request_id, error_msg, strlen(error_msg));
+            return;
+        }
+        memcpy(&budget_ms, text, sizeof(budget_ms));
+        budget_ms = ntohl(budget_ms);
+        text += sizeof(budget_ms);
+        text_length -= sizeof(budget_ms);
+    }
+    
+    // Then the model, if the client names one
+    char *model = NULL;
+    if ((message->flags & MESSAGE_FLAG_MODEL) && !take_model_name(&text, &text_length, &model)) {
+        const char *error_msg = "Malformed model name";
+        connection_send_message(client, MSG_ERROR, message->request_id, error_msg, strlen(error_msg));
+        return;
+    }
+    
+    if (current_config.verbose) {
+        printf("Received prompt %u from client (%zu bytes): %.*s\n", message->request_id,
+               text_length, (int)text_length, text);
+        if (budget_ms > 0) {
+            printf("Prompt %u must be answered within %u ms\n", message->request_id, budget_ms);
+        }
+    }
+    
+    if (text_length == 0) {
+        free(model);
+        const char *error_msg = "Empty prompt";
+        connection_send_message(client, MSG_ERROR, message->request_id, error_msg, strlen(error_msg));
+        return;
+    }
+    
+    generation_job_t *job = calloc(1, sizeof(generation_job_t));
+    char *prompt = strndup(text, text_length);
+    llm_request_t *request = prompt ? llm_request_create(prompt) : NULL;
+    free(prompt);
+    if (job == NULL || request == NULL) {
+        free(job);
+        free(model);
+        llm_request_free(request);
+        const char *error_msg = "Failed to generate response";
+        connection_send_message(client, MSG_ERROR, message->request_id, error_msg, strlen(error_msg));
+        return;
+    }
+    
+    job->client = client;
+    job->request_id = message->request_id;
+    job->request = request;
+    job->model = model;
+    job->arrived_us = arrived_us;
+    request->model = model;
+    request->trace_id = trace_request_id(client->trace_id, message->request_id);
+    
+    // Counted from arrival, so time spent queued comes off the budget
+    if (budget_ms > 0) {
+        llm_request_set_timeout(request, budget_ms);
+    }
+    llm_request_resolve(llm, request);
+    
+    if ((message->flags & MESSAGE_FLAG_SESSION) && !begin_session_turn(client, job, message->request_id)) {
+        free_job(job);
+        return;
+    }
+    
+    if (shareable(request, message->flags) &&
+        response_cache_key_init(&job->cache_key, request->model, request->temperature,
+                                request->max_tokens, request->context_size, request->seed,
+                                request->prompt)) {
+        job->hit = lookup_cached(job);
+        job->recording = !job->hit && (cache != NULL || disk_cache != NULL);
+        if (job->hit) {
+            metrics_add(METRIC_CACHE_HITS, 1);
+        }
         
-        if (current_config.verbose) {
-            if (response) {
-                printf("LLM response generated (first 50 chars): %.50s%s\n", 
-                       response, strlen(response) > 50 ? "..." : "");
-            } else {
-                printf("Failed to generate LLM response\n");
+        // Unpaced hits are answered right here on the loop thread
+        if (job->hit && current_config.cache_replay_ms <= 0) {
+            if (current_config.verbose) {
+                printf("Answering prompt %u from the response cache\n", message->request_id);
+            }
+            if (job->cached.text_length > 0) {
+                connection_send_text(client, message->request_id, job->cached.text, job->cached.text_length);
             }
+            connection_send_message(client, MSG_DONE, message->request_id, NULL, 0);
+            trace_span(request->trace_id, "cache hit", arrived_us, metrics_now_us());
+            free_job(job);
+            return;
         }
         
-        // Send response back to client
-        if (response) {
+        // A burst of the same prompt costs one generation. A prompt with
+        // its own deadline could cut a shared generation short, so it runs alone.
+        if (!job->hit && request->deadline_ms == 0 && inflight_join(inflight, &job->cache_key, client, message->request_id, &job->flight)) {
             if (current_config.verbose) {
-                printf("Sending response to client...\n");
-            }
-            if (send_message(client_socket, response) < 0) {
-                printf("Failed to send response to client\n");
-                free(response);
-                break;
+                printf("Prompt %u joined an identical generation in progress\n", message->request_id);
             }
-            free(response);
-        } else {
-            if (send_message(client_socket, "Error: Failed to generate response") < 0) {
-                printf("Failed to send error message to client\n");
-                break;
+            metrics_add(METRIC_COALESCED, 1);
+            trace_span(request->trace_id, "coalesced", arrived_us, metrics_now_us());
+            free_job(job);
+            return;
+        }
+    }
+    
+    // With every backend's breaker open the generation would only fail
+    // after a connect attempt or a timeout; say so now
+    if (!job->hit && !llm_available(llm)) {
+        if (current_config.verbose) {
+            printf("No backend can take prompt %u right now\n", message->request_id);
+        }
+        send_error(client, message->request_id, llm_unavailable_error);
+        metrics_add(METRIC_REJECTED, 1);
+        free_job(job);
+        return;
+    }
+    
+    connection_retain(client);
+    track_job(job);
+    job->phase_us = metrics_now_us();
+    trace_span(request->trace_id, "admit", arrived_us, job->phase_us);
+    
+    // Replays need no model; generations wait for their model's turn
+    if (job->hit) {
+        start_job(job);
+    } else if (model_scheduler_push(scheduler, request->model, request->deadline_ms, job)) {
+        dispatch_jobs();
+    } else {
+        reject_job(job);
+    }
+}
+
+// Reply address of a queued embedding
+typedef struct {
+    client_connection_t *client;
+    uint32_t request_id;
+} embed_reply_t;
+
+// Runs on the batcher thread
+static void send_embedding(const float *vector, size_t dimensions, const char *error, void *user_data) {
+    embed_reply_t *reply = user_data;
+    uint32_t *payload = vector ? malloc(dimensions * sizeof(uint32_t)) : NULL;
+    
+    if (payload != NULL) {
+        for (size_t i = 0; i < dimensions; i++) {
+            uint32_t bits;
+            memcpy(&bits, &vector[i], sizeof(bits));
+            payload[i] = htole32(bits);
+        }
+        connection_send_message(reply->client, MSG_EMBEDDING, reply->request_id,
+                                payload, dimensions * sizeof(uint32_t));
+        free(payload);
+    } else {
+        send_error(reply->client, reply->request_id, error ? error : "Failed to embed text");
+    }
+    
+    connection_release(reply->client);
+    free(reply);
+}
+
+// Queue a text for the next embedding batch
+static void handle_embed(client_connection_t *client, const message_t *message) {
+    const char *text = message->payload;
+    size_t text_length = message->length;
+    const char *error_msg = NULL;
+    char *model = NULL;
+    
+    metrics_add(METRIC_EMBEDDINGS, 1);
+    if (current_config.verbose) {
+        printf("Received embedding request %u from client (%u bytes)\n",
+               message->request_id, message->length);
+    }
+    
+    if ((message->flags & MESSAGE_FLAG_MODEL) && !take_model_name(&text, &text_length, &model)) {
+        error_msg = "Malformed model name";
+    } else if (text_length == 0) {
+        error_msg = "Empty text";
+    } else if (memchr(text, '\0', text_length) != NULL) {
+        // The text goes upstream as a C string; it would be cut short
+        error_msg = "Text contains a NUL byte";
+    } else if (!llm_available(llm)) {
+        error_msg = llm_unavailable_error;
+    }
+    
+    embed_reply_t *reply = error_msg ? NULL : malloc(sizeof(embed_reply_t));
+    if (reply == NULL) {
+        free(model);
+        send_error(client, message->request_id, error_msg ? error_msg : "Failed to embed text");
+        return;
+    }
+    reply->client = client;
+    reply->request_id = message->request_id;
+    
+    connection_retain(client);
+    bool queued = embed_batcher_submit(embedder, model, text, text_length, send_embedding, reply);
+    free(model);
+    if (!queued) {
+        connection_release(client);
+        free(reply);
+        const char *busy_msg = "Server is busy, please try again later";
+        connection_send_message(client, MSG_ERROR, message->request_id, busy_msg, strlen(busy_msg));
+    }
+}
+
+// Dispatch one complete message from a client
+static void handle_client_message(client_connection_t *client, const message_t *message) {
+    switch (message->type) {
+        case MSG_PROMPT:
+            handle_prompt(client, message);
+            break;
+        case MSG_SESSION:
+            handle_session(client, message);
+            break;
+        case MSG_EMBED:
+            handle_embed(client, message);
+            break;
+        default: {
+            const char *error_msg = "Unsupported message type";
+            if (current_config.verbose) {
+                printf("Ignoring %s message from client\n", message_type_to_string(message->type));
             }
+            connection_send_message(client, MSG_ERROR, message->request_id, error_msg, strlen(error_msg));
+            break;
         }
     }
+}
+
+void handle_client(event_loop_t *event_loop, int fd, uint32_t events, void *user_data) {
+    client_connection_t *client = (client_connection_t *)user_data;
     
-cleanup:
-    // Clean up
-    close(client_socket);
+    if (events & EVENT_WRITE) {
+        connection_flush(client);
+    }
     
-    pthread_mutex_lock(&clients_mutex);
-    client->active = false;
-    client_count--;
-    pthread_mutex_unlock(&clients_mutex);
+    if (events & EVENT_READ) {
+        connection_read_t status = connection_read_available(client);
+        bool open = status != CONNECTION_CLOSED;
+        
+        // One read round may carry several messages, or only part of one
+        message_t message;
+        int result;
+        while ((result = message_buffer_next(&client->read_buffer, &message)) > 0) {
+            handle_client_message(client, &message);
+        }
+        
+        if (result < 0) {
+            fprintf(stderr, "Malformed message from client, closing connection\n");
+            disconnect_client(client);
+            return;
+        }
+        
+        if (!open) {
+            if (current_config.verbose) {
+                printf("Client closed the connection\n");
+            }
+            disconnect_client(client);
+            return;
+        }
+        
+        // The rest waits in the socket; have the loop call back after the
+        // other ready connections had their turn
+        if (status == CONNECTION_MORE && !event_loop_rearm(event_loop, fd, EVENT_READ | EVENT_WRITE)) {
+            disconnect_client(client);
+            return;
+        }
+    }
     
-    printf("Client disconnected. Active clients: %d\n", client_count);
-    return NULL;
+    // A responder thread may have failed and shut the socket down
+    if (!atomic_load(&client->active) || (events & EVENT_ERROR)) {
+        disconnect_client(client);
+    }
 }
 
 // Main function to demonstrate server usage
@@ -284,12 +1376,71 @@ int main(int argc, char *argv[]) {
         printf("  --config FILE           Configuration file (default: config.json)\n");
         printf("  --host HOST             Server host (default: %s)\n", app_config.server_host);
         printf("  --port PORT             Server port (default: %d)\n", app_config.server_port);
+        printf("  --metrics-port PORT     Serve /metrics and /trace over HTTP on this port, 0 for none (default: %d)\n",
+               app_config.metrics_port);
+        printf("  --trace-sample PERCENT  Prompts to trace, kept for /trace (default: %d)\n",
+               app_config.trace_sample_percent);
+        printf("  --engine NAME           ollama, or synthetic for load tests without a model (default: %s)\n",
+               llm_engine_to_string(app_config.engine));
         printf("  --model TYPE            Model type (llama, mistral, gptj, custom)\n");
         printf("  --model-path PATH       Path to model file\n");
         printf("  --temperature VALUE     Temperature for generation (default: %.1f)\n", app_config.temperature);
         printf("  --max-tokens VALUE      Maximum tokens to generate (default: %d)\n", app_config.max_tokens);
         printf("  --context-size VALUE    Context size for LLM (default: %d)\n", app_config.context_size);
+        printf("  --seed VALUE            Fixed sampling seed, -1 for random (default: %d)\n", app_config.seed);
+        printf("  --ollama-host HOST      Ollama host (default: %s)\n", app_config.ollama_host);
+        printf("  --ollama-port PORT      Ollama port (default: %d)\n", app_config.ollama_port);
+        printf("  --ollama-socket PATH    Reach Ollama over a unix socket instead of TCP\n");
+        printf("  --backend ADDR[@MAX]    Ollama instance HOST:PORT or /SOCKET, at most MAX generations\n");
+        printf("                          at once; repeat to balance over several\n");
+        printf("  --health-interval SECONDS Backend health check interval, 0 for passive only (default: %d)\n",
+               app_config.backend_health_interval);
+        printf("  --no-sticky-sessions    Let each turn of a conversation go to any backend\n");
+        printf("  --connect-timeout MS    Limit for connecting to Ollama, 0 for none (default: %d)\n",
+               app_config.connect_timeout_ms);
+        printf("  --first-token-timeout MS Limit for the first token to arrive (default: %d)\n",
+               app_config.first_token_timeout_ms);
+        printf("  --stall-timeout MS      Limit between two tokens (default: %d)\n", app_config.stall_timeout_ms);
+        printf("  --generation-timeout MS Limit for a whole generation, 0 for none (default: %d)\n",
+               app_config.generation_timeout_ms);
+        printf("  --hedge-percentile P    Also send a generation to another backend once its first token\n");
+        printf("                          is later than the Pth percentile, 0 for never (default: %d)\n",
+               app_config.hedge_percentile);
+        printf("  --hedge-budget PERCENT  Most generations to hedge (default: %d)\n", app_config.hedge_budget_percent);
+        printf("  --breaker-slow MS       Count a backend as failing when it takes longer to start\n");
+        printf("                          answering, 0 for never (default: %d)\n", app_config.breaker_slow_ms);
+        printf("  --keep-alive SECONDS    Keep a used model loaded this long, -1 for ever (default: %d)\n",
+               app_config.keep_alive);
+        printf("  --no-warm-up            Do not load the model at startup\n");
+        printf("  --keep-warm SECONDS     Interval of keep-warm pings and residency checks, 0 for none (default: %d)\n",
+               app_config.keep_warm_interval);
+        printf("  --model-memory MB       Memory for loaded models, 0 for no limit (default: %d)\n",
+               app_config.model_memory_mb);
+        printf("  --synthetic-rate VALUE  Synthetic tokens per second, 0 for no delay (default: %d)\n",
+               app_config.synthetic_tokens_per_second);
+        printf("  --synthetic-latency MS  Mean synthetic time to first token (default: %d)\n",
+               app_config.synthetic_latency_ms);
+        printf("  --synthetic-jitter VALUE Exponential share of synthetic delays, 0 to 1 (default: %.2f)\n",
+               app_config.synthetic_jitter);
         printf("  --max-connections VALUE Maximum client connections (default: %d)\n", app_config.max_connections);
+        printf("  --llm-workers VALUE     Threads for generations that block (default: %d)\n", app_config.llm_workers);
+        printf("  --no-async-upstream     Give every generation a worker thread instead of the event loop\n");
+        printf("  --cache-size MB         Response cache size, 0 to disable (default: %d)\n", app_config.cache_size_mb);
+        printf("  --cache-replay-ms MS    Delay between replayed cached tokens (default: %d)\n", app_config.cache_replay_ms);
+        printf("  --cache-deterministic-only Only cache output of temperature 0 or a fixed seed\n");
+        printf("  --disk-cache PATH       Keep cached responses in PATH across restarts\n");
+        printf("  --disk-cache-size MB    Size of the on-disk response cache (default: %d)\n", app_config.disk_cache_size_mb);
+        printf("  --max-sessions VALUE    Conversations kept, 0 to disable (default: %d)\n", app_config.max_sessions);
+        printf("  --session-ttl SECONDS   Drop conversations idle this long (default: %d)\n", app_config.session_ttl);
+        printf("  --embed-batch SIZE      Most texts per embedding call (default: %d)\n", app_config.embed_batch_size);
+        printf("  --embed-wait US         Time a text waits to share an embedding call (default: %d)\n",
+               app_config.embed_batch_wait_us);
+        printf("  --model-concurrency N   Generations of one model at once, 0 for no limit (default: %d)\n",
+               app_config.model_concurrency);
+        printf("  --model-limits LIST     Own limits for some models, as NAME=MAX,NAME=MAX\n");
+        printf("  --max-generations N     Generations at once over all models, 0 for the backends' total\n");
+        printf("  --model-batch N         Prompts of one model started in a row while others wait (default: %d)\n",
+               app_config.model_batch);
         printf("  --verbose               Enable verbose output\n");
         printf("  --help                  Show this help message\n");
         return 0;
@@ -299,25 +1450,73 @@ int main(int argc, char *argv[]) {
     if (app_config.verbose) {
         config_print(&app_config);
     }
+    const char *no_hedging = config_hedging_unavailable(&app_config);
+    if (no_hedging != NULL) {
+        fprintf(stderr, "Warning: Ignoring --hedge-percentile: %s\n", no_hedging);
+    }
     
     // Convert to server_config_t
     server_config_t server_config = {
         .port = app_config.server_port,
+        .metrics_port = app_config.metrics_port,
+        .trace_sample_percent = app_config.trace_sample_percent,
         .llm_config = {
+            .engine = app_config.engine,
             .type = app_config.llm_type,
             .model_path = "",
             .context_size = app_config.context_size,
             .temperature = app_config.temperature,
             .max_tokens = app_config.max_tokens,
-            .verbose = app_config.verbose
+            .seed = app_config.seed,
+            .verbose = app_config.verbose,
+            .ollama_port = app_config.ollama_port,
+            .backend_count = app_config.backend_count,
+            .health_interval = app_config.backend_health_interval,
+            .sticky_sessions = app_config.backend_sticky_sessions,
+            .breaker_slow_ms = app_config.breaker_slow_ms,
+            .connect_timeout_ms = app_config.connect_timeout_ms,
+            .first_token_timeout_ms = app_config.first_token_timeout_ms,
+            .stall_timeout_ms = app_config.stall_timeout_ms,
+            .generation_timeout_ms = app_config.generation_timeout_ms,
+            .hedge_percentile = app_config.hedge_percentile,
+            .hedge_budget_percent = app_config.hedge_budget_percent,
+            .keep_alive = app_config.keep_alive,
+            .warm_up = app_config.warm_up,
+            .keep_warm_interval = app_config.keep_warm_interval,
+            .model_memory_bytes = app_config.model_memory_mb > 0 ? (size_t)app_config.model_memory_mb * 1024 * 1024 : 0,
+            .synthetic_tokens_per_second = app_config.synthetic_tokens_per_second,
+            .synthetic_latency_ms = app_config.synthetic_latency_ms,
+            .synthetic_jitter = app_config.synthetic_jitter
         },
         .verbose = app_config.verbose,
-        .max_connections = app_config.max_connections
+        .max_connections = app_config.max_connections,
+        .llm_workers = app_config.llm_workers,
+        .async_upstream = app_config.async_upstream,
+        .cache_bytes = app_config.cache_size_mb > 0 ? (size_t)app_config.cache_size_mb * 1024 * 1024 : 0,
+        .cache_replay_ms = app_config.cache_replay_ms,
+        .cache_deterministic_only = app_config.cache_deterministic_only,
+        .disk_cache_bytes = app_config.disk_cache_size_mb > 0 ? (size_t)app_config.disk_cache_size_mb * 1024 * 1024 : 0,
+        .max_sessions = app_config.max_sessions,
+        .session_ttl = app_config.session_ttl,
+        .embed_batch_size = app_config.embed_batch_size,
+        .embed_batch_wait_us = app_config.embed_batch_wait_us,
+        .model_concurrency = app_config.model_concurrency,
+        .max_generations = app_config.max_generations,
+        .model_batch = app_config.model_batch
     };
     
     // Copy model path
     strncpy(server_config.llm_config.model_path, app_config.model_path, 
             sizeof(server_config.llm_config.model_path) - 1);
+    strncpy(server_config.llm_config.ollama_host, app_config.ollama_host,
+            sizeof(server_config.llm_config.ollama_host) - 1);
+    strncpy(server_config.llm_config.ollama_socket, app_config.ollama_socket,
+            sizeof(server_config.llm_config.ollama_socket) - 1);
+    memcpy(server_config.llm_config.backends, app_config.backends, sizeof(app_config.backends));
+    strncpy(server_config.disk_cache_path, app_config.disk_cache_path,
+            sizeof(server_config.disk_cache_path) - 1);
+    strncpy(server_config.model_limits, app_config.model_limits,
+            sizeof(server_config.model_limits) - 1);
     
     // Initialize and start server
     if (!server_initialize(&server_config)) {
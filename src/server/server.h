@@ -8,22 +8,34 @@
 #include <pthread.h>
 #include "../common/socket_utils.h"
 #include "llm_interface.h"
+#include "event_loop.h"
+#include "connection.h"
 
 // Server configuration
 typedef struct {
     int port;
+    int metrics_port;               // admin HTTP listener for /metrics and /trace, 0 disables it
+    int trace_sample_percent;       // share of prompts traced
     llm_config_t llm_config;
     bool verbose;
     int max_connections;
+    int llm_workers;
+    bool async_upstream;            // run generations on the event loop when the engine can
+    size_t cache_bytes;             // response cache budget, 0 disables it
+    int cache_replay_ms;            // pace of replayed cache hits, 0 = instant
+    bool cache_deterministic_only;  // only cache temperature 0 or fixed-seed output
+    char disk_cache_path[256];      // persistent cache file, empty disables it
+    size_t disk_cache_bytes;        // live data kept in the cache file
+    int max_sessions;               // conversations kept, 0 disables sessions
+    int session_ttl;                // seconds an idle session is kept
+    int embed_batch_size;           // texts per embedding call to the engine
+    int embed_batch_wait_us;        // how long a text waits for others to batch with
+    int model_concurrency;          // generations of one model at once, 0 = unlimited
+    char model_limits[256];         // "NAME=MAX,..." overriding model_concurrency
+    int max_generations;            // over all models, 0 = the backends' combined limit
+    int model_batch;                // prompts of one model dispatched in a row
 } server_config_t;
 
-// Client connection data
-typedef struct {
-    int client_socket;
-    pthread_t thread_id;
-    bool active;
-} client_connection_t;
-
 // Server functions
 bool server_initialize(server_config_t *config);
 bool server_start(void);
@@ -31,6 +43,6 @@ void server_stop(void);
 bool server_is_running(void);
 
 // Client handling functions
-void* handle_client(void *client_socket_ptr);
+void handle_client(event_loop_t *loop, int fd, uint32_t events, void *user_data);
 
 #endif /* SERVER_H */
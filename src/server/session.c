@@ -0,0 +1,294 @@
+#include "session.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/random.h>
+
+struct session {
+    uint64_t key;
+    char id[SESSION_ID_LENGTH + 1];
+    session_table_t *table;
+    atomic_int refcount;
+
+    // Guarded by the table mutex
+    int *context;
+    size_t context_length;
+    bool busy;
+    bool listed;                // still reachable through the table
+    long long last_used;
+    struct session *hash_next;
+    struct session *lru_prev;
+    struct session *lru_next;
+};
+
+struct session_table {
+    pthread_mutex_t mutex;
+    session_t **buckets;
+    size_t bucket_count;
+    session_t *lru_head;        // most recently used
+    session_t *lru_tail;
+    size_t count;
+    size_t max_sessions;
+    int ttl_seconds;
+    size_t max_context;
+};
+
+static long long monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+session_table_t* session_table_create(size_t max_sessions, int ttl_seconds, size_t max_context) {
+    session_table_t *table = calloc(1, sizeof(session_table_t));
+    if (table == NULL) {
+        return NULL;
+    }
+
+    table->bucket_count = 64;
+    while (table->bucket_count < max_sessions) {
+        table->bucket_count *= 2;
+    }
+    table->buckets = calloc(table->bucket_count, sizeof(session_t *));
+    if (table->buckets == NULL) {
+        free(table);
+        return NULL;
+    }
+
+    pthread_mutex_init(&table->mutex, NULL);
+    table->max_sessions = max_sessions;
+    table->ttl_seconds = ttl_seconds;
+    table->max_context = max_context;
+    return table;
+}
+
+void session_retain(session_t *session) {
+    atomic_fetch_add(&session->refcount, 1);
+}
+
+void session_release(session_t *session) {
+    if (session != NULL && atomic_fetch_sub(&session->refcount, 1) == 1) {
+        free(session->context);
+        free(session);
+    }
+}
+
+const char* session_id(const session_t *session) {
+    return session->id;
+}
+
+uint64_t session_affinity(const session_t *session) {
+    return session->key != 0 ? session->key : 1;
+}
+
+static void lru_unlink(session_table_t *table, session_t *session) {
+    if (session->lru_prev) {
+        session->lru_prev->lru_next = session->lru_next;
+    } else {
+        table->lru_head = session->lru_next;
+    }
+    if (session->lru_next) {
+        session->lru_next->lru_prev = session->lru_prev;
+    } else {
+        table->lru_tail = session->lru_prev;
+    }
+}
+
+static void lru_push_front(session_table_t *table, session_t *session) {
+    session->lru_prev = NULL;
+    session->lru_next = table->lru_head;
+    if (table->lru_head) {
+        table->lru_head->lru_prev = session;
+    } else {
+        table->lru_tail = session;
+    }
+    table->lru_head = session;
+}
+
+static void touch(session_table_t *table, session_t *session) {
+    session->last_used = monotonic_seconds();
+    if (session->listed) {
+        lru_unlink(table, session);
+        lru_push_front(table, session);
+    }
+}
+
+// Take a session out of the table; holders of a reference can keep using it
+static void remove_session(session_table_t *table, session_t *session) {
+    session_t **slot = &table->buckets[session->key & (table->bucket_count - 1)];
+    while (*slot != session) {
+        slot = &(*slot)->hash_next;
+    }
+    *slot = session->hash_next;
+    lru_unlink(table, session);
+    session->listed = false;
+    table->count--;
+    session_release(session);
+}
+
+static bool expired(const session_table_t *table, const session_t *session, long long now) {
+    return !session->busy && table->ttl_seconds > 0 && now - session->last_used > table->ttl_seconds;
+}
+
+void session_table_destroy(session_table_t *table) {
+    if (table == NULL) {
+        return;
+    }
+
+    while (table->lru_head) {
+        remove_session(table, table->lru_head);
+    }
+    free(table->buckets);
+    pthread_mutex_destroy(&table->mutex);
+    free(table);
+}
+
+size_t session_table_count(session_table_t *table) {
+    pthread_mutex_lock(&table->mutex);
+    size_t count = table->count;
+    pthread_mutex_unlock(&table->mutex);
+    return count;
+}
+
+static uint64_t random_key(void) {
+    uint64_t key;
+    if (getrandom(&key, sizeof(key), 0) != sizeof(key)) {
+        // Ids only need to be hard to guess, not perfect
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        key = ((uint64_t)now.tv_sec << 32) ^ (uint64_t)now.tv_nsec ^ ((uint64_t)rand() << 16);
+    }
+    return key;
+}
+
+static session_t* find_locked(session_table_t *table, uint64_t key) {
+    session_t *session = table->buckets[key & (table->bucket_count - 1)];
+    while (session && session->key != key) {
+        session = session->hash_next;
+    }
+    return session;
+}
+
+session_t* session_create(session_table_t *table) {
+    session_t *session = calloc(1, sizeof(session_t));
+    if (session == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&table->mutex);
+
+    long long now = monotonic_seconds();
+    while (table->lru_tail && expired(table, table->lru_tail, now)) {
+        remove_session(table, table->lru_tail);
+    }
+
+    // Make room by dropping the least recently used conversation not in a turn
+    if (table->count >= table->max_sessions) {
+        session_t *victim = table->lru_tail;
+        while (victim && victim->busy) {
+            victim = victim->lru_prev;
+        }
+        if (victim == NULL) {
+            pthread_mutex_unlock(&table->mutex);
+            free(session);
+            return NULL;
+        }
+        remove_session(table, victim);
+    }
+
+    do {
+        session->key = random_key();
+    } while (find_locked(table, session->key) != NULL);
+    snprintf(session->id, sizeof(session->id), "%016llx", (unsigned long long)session->key);
+
+    session->table = table;
+    session->last_used = now;
+    session->listed = true;
+    atomic_init(&session->refcount, 2);     // the table's and the caller's
+
+    session_t **slot = &table->buckets[session->key & (table->bucket_count - 1)];
+    session->hash_next = *slot;
+    *slot = session;
+    lru_push_front(table, session);
+    table->count++;
+
+    pthread_mutex_unlock(&table->mutex);
+    return session;
+}
+
+session_t* session_find(session_table_t *table, const char *id, size_t length) {
+    if (length != SESSION_ID_LENGTH) {
+        return NULL;
+    }
+
+    char text[SESSION_ID_LENGTH + 1];
+    memcpy(text, id, SESSION_ID_LENGTH);
+    text[SESSION_ID_LENGTH] = '\0';
+    char *end;
+    uint64_t key = strtoull(text, &end, 16);
+    if (*end != '\0') {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&table->mutex);
+    session_t *session = find_locked(table, key);
+    if (session && expired(table, session, monotonic_seconds())) {
+        remove_session(table, session);
+        session = NULL;
+    }
+    if (session) {
+        touch(table, session);
+        session_retain(session);
+    }
+    pthread_mutex_unlock(&table->mutex);
+
+    return session;
+}
+
+bool session_begin_turn(session_t *session, const int **context, size_t *length) {
+    session_table_t *table = session->table;
+
+    pthread_mutex_lock(&table->mutex);
+    bool started = !session->busy;
+    if (started) {
+        session->busy = true;
+        *context = session->context;
+        *length = session->context_length;
+        touch(table, session);
+    }
+    pthread_mutex_unlock(&table->mutex);
+
+    return started;
+}
+
+void session_end_turn(session_t *session, const int *context, size_t length) {
+    session_table_t *table = session->table;
+
+    // Past the budget only the most recent tokens are worth sending back
+    if (context != NULL && length > table->max_context) {
+        context += length - table->max_context;
+        length = table->max_context;
+    }
+
+    int *copy = NULL;
+    if (context != NULL && length > 0) {
+        copy = malloc(length * sizeof(int));
+        if (copy != NULL) {
+            memcpy(copy, context, length * sizeof(int));
+        }
+    }
+
+    pthread_mutex_lock(&table->mutex);
+    if (context != NULL && (copy != NULL || length == 0)) {
+        free(session->context);
+        session->context = copy;
+        session->context_length = length;
+    }
+    session->busy = false;
+    touch(table, session);
+    pthread_mutex_unlock(&table->mutex);
+}
@@ -0,0 +1,50 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Hex characters in a session id
+#define SESSION_ID_LENGTH 16
+
+// Multi-turn conversations
+//
+// A session keeps the "context" tokens Ollama returns at the end of a
+// generation and hands them back with the next prompt, so a follow-up
+// only pays prefill for its own tokens. Sessions are looked up by id,
+// which lets a client pick a conversation up again after reconnecting,
+// and are dropped once idle for longer than the table's TTL.
+
+typedef struct session session_t;
+typedef struct session_table session_table_t;
+
+// max_context bounds the tokens kept per session; the oldest are trimmed
+session_table_t* session_table_create(size_t max_sessions, int ttl_seconds, size_t max_context);
+void session_table_destroy(session_table_t *table);
+size_t session_table_count(session_table_t *table);
+
+// Start an empty session, retained for the caller. Expired sessions are
+// dropped first, then the least recently used idle one if the table is
+// full. Returns NULL when every session is busy.
+session_t* session_create(session_table_t *table);
+
+// Retained session with this id, or NULL if it is unknown or expired
+session_t* session_find(session_table_t *table, const char *id, size_t length);
+
+void session_retain(session_t *session);
+void session_release(session_t *session);
+const char* session_id(const session_t *session);
+
+// Stable non-zero key for routing every turn to the same backend
+uint64_t session_affinity(const session_t *session);
+
+// A session runs one turn at a time. On success the caller borrows the
+// stored context until it calls session_end_turn(). Returns false while
+// another turn is in progress.
+bool session_begin_turn(session_t *session, const int **context, size_t *length);
+
+// Store the context of a finished turn; NULL keeps the previous one
+void session_end_turn(session_t *session, const int *context, size_t length);
+
+#endif /* SESSION_H */
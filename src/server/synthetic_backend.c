@@ -0,0 +1,355 @@
+#define _GNU_SOURCE
+#include "llm_backend.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <poll.h>
+#include <time.h>
+#include <stdint.h>
+
+// Length of the synthetic embedding vectors
+#define SYNTHETIC_EMBED_DIMENSIONS 64
+
+// Vocabulary of the synthetic text
+static const char *const words[] = {
+    "the", "model", "server", "token", "stream", "cache", "request", "answer",
+    "quick", "local", "prompt", "context", "latency", "socket", "worker", "queue",
+    "of", "and", "to", "in", "is", "for", "with", "on",
+    "a", "fast", "small", "large", "every", "each", "reply", "batch",
+    "memory", "thread", "event", "loop", "buffer", "client", "message", "frame",
+    "runs", "sends", "reads", "keeps", "waits", "builds", "returns", "holds",
+    "while", "after", "before", "when", "then", "so", "but", "or",
+    "data", "text", "line", "word", "time", "rate", "load", "test"
+};
+#define WORD_COUNT (sizeof(words) / sizeof(words[0]))
+
+typedef struct {
+    bool verbose;
+    int tokens_per_second;
+    int latency_ms;
+    double jitter;
+} synthetic_backend_t;
+
+static uint64_t splitmix64(uint64_t *state) {
+    uint64_t x = (*state += 0x9E3779B97F4A7C15ULL);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// FNV-1a, chained over several fields
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static int64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// A delay with the given mean: a fixed (1 - jitter) share plus an
+// exponentially distributed rest, which gives the long tail of real engines
+static int64_t sample_delay(const synthetic_backend_t *synthetic, double mean_ns, uint64_t *rng) {
+    double uniform = (splitmix64(rng) >> 11) * (1.0 / 9007199254740992.0);
+    double tail = -log(1.0 - uniform) * mean_ns * synthetic->jitter;
+    return (int64_t)(mean_ns * (1.0 - synthetic->jitter) + tail);
+}
+
+// Sleep until the deadline; false if the request was cancelled meanwhile
+static bool wait_until(llm_request_t *request, int64_t deadline) {
+    for (;;) {
+        if (atomic_load(&request->cancelled)) {
+            return false;
+        }
+        int64_t remaining = deadline - monotonic_ns();
+        if (remaining <= 0) {
+            return true;
+        }
+
+        struct pollfd pfd = { .fd = request->cancel_fd, .events = POLLIN };
+        struct timespec timeout = { remaining / 1000000000LL, remaining % 1000000000LL };
+        ppoll(&pfd, 1, &timeout, NULL);
+    }
+}
+
+static void* synthetic_init(const llm_config_t *config) {
+    synthetic_backend_t *synthetic = calloc(1, sizeof(synthetic_backend_t));
+    if (synthetic == NULL) {
+        return NULL;
+    }
+
+    synthetic->verbose = config->verbose;
+    synthetic->tokens_per_second = config->synthetic_tokens_per_second > 0 ? config->synthetic_tokens_per_second : 0;
+    synthetic->latency_ms = config->synthetic_latency_ms > 0 ? config->synthetic_latency_ms : 0;
+    synthetic->jitter = config->synthetic_jitter < 0.0f ? 0.0 :
+                        config->synthetic_jitter > 1.0f ? 1.0 : config->synthetic_jitter;
+
+    printf("Synthetic engine: %d tokens/s, first token after %d ms, jitter %.2f\n",
+           synthetic->tokens_per_second, synthetic->latency_ms, synthetic->jitter);
+    return synthetic;
+}
+
+static void synthetic_cleanup(void *state) {
+    free(state);
+}
+
+// One generation in progress
+typedef struct {
+    const synthetic_backend_t *synthetic;
+    llm_request_t *request;
+    llm_token_callback_t on_token;
+    llm_done_callback_t on_done;
+    void *user_ctx;
+    
+    int count;
+    int emitted;
+    int *context;
+    size_t context_length;
+    uint64_t text_rng;
+    uint64_t pace_rng;
+    double token_ns;
+    int64_t deadline;           // of the next token
+    int64_t limit;              // the request's own deadline
+    int64_t first_token;
+} synthetic_run_t;
+
+static bool begin_run(synthetic_run_t *run, const synthetic_backend_t *synthetic, llm_request_t *request,
+                      llm_token_callback_t on_token, llm_done_callback_t on_done, void *user_ctx) {
+    llm_result_t result = { .stats = GENERATION_STATS_UNKNOWN };
+    
+    if (request->prompt[0] == '\0') {
+        result.error = "Empty prompt";
+        on_done(&result, user_ctx);
+        return false;
+    }
+    
+    memset(run, 0, sizeof(*run));
+    run->synthetic = synthetic;
+    run->request = request;
+    run->on_token = on_token;
+    run->on_done = on_done;
+    run->user_ctx = user_ctx;
+    run->count = request->max_tokens > 0 ? request->max_tokens : 1;
+    
+    // The returned context is the previous one followed by the word
+    // indices generated, like Ollama's token ids
+    run->context = malloc((request->context_length + run->count) * sizeof(int));
+    if (run->context == NULL) {
+        result.error = "Memory allocation failed";
+        on_done(&result, user_ctx);
+        return false;
+    }
+    if (request->context_length > 0) {
+        memcpy(run->context, request->context, request->context_length * sizeof(int));
+    }
+    run->context_length = request->context_length;
+    
+    // The text depends only on what was asked, so repeated prompts
+    // produce the same answer; the pacing is random
+    run->text_rng = 0xCBF29CE484222325ULL;
+    run->text_rng = hash_bytes(run->text_rng, request->model, strlen(request->model) + 1);
+    run->text_rng = hash_bytes(run->text_rng, request->prompt, strlen(request->prompt) + 1);
+    run->text_rng = hash_bytes(run->text_rng, &request->seed, sizeof(request->seed));
+    run->text_rng = hash_bytes(run->text_rng, request->context, request->context_length * sizeof(int));
+    run->pace_rng = (uint64_t)monotonic_ns() ^ (uintptr_t)request;
+    
+    run->token_ns = synthetic->tokens_per_second > 0 ? 1e9 / synthetic->tokens_per_second : 0.0;
+    run->deadline = monotonic_ns() + sample_delay(synthetic, synthetic->latency_ms * 1e6, &run->pace_rng);
+    
+    // The request's own deadline, in the same units
+    run->limit = request->deadline_ms > 0 ? request->deadline_ms * 1000000LL : INT64_MAX;
+    return true;
+}
+
+// Produce the token that is due; false if the caller stopped listening
+static bool emit_token(synthetic_run_t *run) {
+    char token[32];
+    
+    if (run->emitted == 0) {
+        run->first_token = monotonic_ns();
+    }
+    
+    size_t word = splitmix64(&run->text_rng) % WORD_COUNT;
+    int length = snprintf(token, sizeof(token), "%s%s", run->emitted > 0 ? " " : "", words[word]);
+    run->context[run->context_length++] = (int)word;
+    run->emitted++;
+    
+    if (!run->on_token(token, length, run->user_ctx)) {
+        return false;
+    }
+    run->deadline += sample_delay(run->synthetic, run->token_ns, &run->pace_rng);
+    return true;
+}
+
+static void end_run(synthetic_run_t *run, bool expired, bool stopped) {
+    llm_result_t result = { .stats = GENERATION_STATS_UNKNOWN };
+    
+    result.stats.eval_count = run->emitted;
+    result.stats.eval_duration = run->emitted > 0 ? monotonic_ns() - run->first_token : 0;
+    if (expired) {
+        result.error = "Generation deadline exceeded";
+    } else if (stopped) {
+        result.error = "Generation cancelled";
+    } else {
+        result.success = true;
+        result.context = run->context;
+        result.context_length = run->context_length;
+        if (run->synthetic->verbose) {
+            printf("Synthetic engine generated %d tokens in %.3f s\n", run->emitted, result.stats.eval_duration / 1e9);
+        }
+    }
+    
+    run->on_done(&result, run->user_ctx);
+    free(run->context);
+}
+
+static bool synthetic_generate_stream(void *state, llm_request_t *request,
+                                      llm_token_callback_t on_token, llm_done_callback_t on_done,
+                                      void *user_ctx) {
+    synthetic_run_t run;
+    if (!begin_run(&run, state, request, on_token, on_done, user_ctx)) {
+        return false;
+    }
+    
+    bool stopped = false;
+    bool expired = false;
+    while (run.emitted < run.count) {
+        if (run.deadline > run.limit) {
+            expired = wait_until(request, run.limit);
+            stopped = true;
+            break;
+        }
+        if (!wait_until(request, run.deadline) || !emit_token(&run)) {
+            stopped = true;
+            break;
+        }
+    }
+    
+    bool success = !stopped;
+    end_run(&run, expired, stopped);
+    return success;
+}
+
+// The same paced by a timer on the event loop
+typedef struct {
+    synthetic_run_t run;
+    event_loop_t *loop;
+    event_timer_t *timer;
+} synthetic_async_t;
+
+static void finish_async(synthetic_async_t *async, bool expired, bool stopped) {
+    event_loop_cancel_timer(async->loop, async->timer);
+    event_loop_remove(async->loop, async->run.request->cancel_fd);
+    end_run(&async->run, expired, stopped);
+    free(async);
+}
+
+static void on_async_cancel(event_loop_t *loop, int fd, uint32_t events, void *user_data) {
+    (void)loop;
+    (void)fd;
+    (void)events;
+    finish_async(user_data, false, true);
+}
+
+static void on_async_timer(event_loop_t *loop, void *user_data) {
+    synthetic_async_t *async = user_data;
+    synthetic_run_t *run = &async->run;
+    
+    async->timer = NULL;
+    
+    // Everything that fell due since the last round goes out now
+    int64_t now = monotonic_ns();
+    while (run->emitted < run->count && run->deadline <= now && run->deadline <= run->limit) {
+        if (!emit_token(run)) {
+            finish_async(async, false, true);
+            return;
+        }
+    }
+    if (run->emitted == run->count) {
+        finish_async(async, false, false);
+        return;
+    }
+    if (now >= run->limit) {
+        finish_async(async, true, true);
+        return;
+    }
+    
+    // Timers count whole milliseconds; round up so we never wake early
+    int64_t wake = run->deadline < run->limit ? run->deadline : run->limit;
+    async->timer = event_loop_add_timer(loop, (wake + 999999) / 1000000, on_async_timer, async);
+    if (async->timer == NULL) {
+        finish_async(async, false, true);
+    }
+}
+
+static void synthetic_start_stream(void *state, event_loop_t *loop, llm_request_t *request,
+                                   llm_token_callback_t on_token, llm_done_callback_t on_done,
+                                   void *user_ctx) {
+    synthetic_async_t *async = calloc(1, sizeof(synthetic_async_t));
+    if (async == NULL) {
+        llm_result_t result = { .error = "Memory allocation failed", .stats = GENERATION_STATS_UNKNOWN };
+        on_done(&result, user_ctx);
+        return;
+    }
+    if (!begin_run(&async->run, state, request, on_token, on_done, user_ctx)) {
+        free(async);
+        return;
+    }
+    async->loop = loop;
+    
+    if (!event_loop_add(loop, request->cancel_fd, EVENT_READ, on_async_cancel, async)) {
+        finish_async(async, false, true);
+        return;
+    }
+    on_async_timer(loop, async);
+}
+
+// Unit vectors that depend only on the input text
+static bool synthetic_embed(void *state, const char *model, const char *const *inputs, size_t count,
+                            llm_embeddings_t *out, const char **error) {
+    (void)state;
+
+    float *vectors = malloc(count * SYNTHETIC_EMBED_DIMENSIONS * sizeof(float));
+    if (vectors == NULL) {
+        *error = "Memory allocation failed";
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t rng = 0xCBF29CE484222325ULL;
+        rng = hash_bytes(rng, model, strlen(model) + 1);
+        rng = hash_bytes(rng, inputs[i], strlen(inputs[i]));
+
+        float *vector = vectors + i * SYNTHETIC_EMBED_DIMENSIONS;
+        double norm = 0.0;
+        for (int d = 0; d < SYNTHETIC_EMBED_DIMENSIONS; d++) {
+            vector[d] = (float)((splitmix64(&rng) >> 11) * (2.0 / 9007199254740992.0) - 1.0);
+            norm += (double)vector[d] * vector[d];
+        }
+        norm = sqrt(norm);
+        for (int d = 0; d < SYNTHETIC_EMBED_DIMENSIONS; d++) {
+            vector[d] = (float)(vector[d] / norm);
+        }
+    }
+
+    out->vectors = vectors;
+    out->count = count;
+    out->dimensions = SYNTHETIC_EMBED_DIMENSIONS;
+    return true;
+}
+
+const llm_backend_ops_t synthetic_backend_ops = {
+    .name = "synthetic",
+    .init = synthetic_init,
+    .generate_stream = synthetic_generate_stream,
+    .start_stream = synthetic_start_stream,
+    .cancel = NULL,
+    .embed = synthetic_embed,
+    .cleanup = synthetic_cleanup
+};
@@ -0,0 +1,173 @@
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+typedef struct {
+    _Atomic uint64_t id;
+    _Atomic(const char *) name;
+    _Atomic int64_t start_us;
+    _Atomic int64_t duration_us;
+    _Atomic(const char *) arg_name;     // NULL for none
+    _Atomic int64_t arg;
+} trace_event_t;
+
+// Plain copy of an event, taken by the renderer
+typedef struct {
+    uint64_t id;
+    const char *name;
+    int64_t start_us;
+    int64_t duration_us;
+    const char *arg_name;
+    int64_t arg;
+} trace_copy_t;
+
+// One thread's spans. Only that thread writes; head counts every span
+// it ever recorded, so slot head % TRACE_RING_EVENTS is the next to go.
+typedef struct trace_ring {
+    struct trace_ring *next;
+    _Atomic uint64_t head;
+    trace_event_t events[TRACE_RING_EVENTS];
+} trace_ring_t;
+
+static atomic_int sample_percent = 0;
+static atomic_uint next_connection = 1;
+
+static pthread_mutex_t rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static trace_ring_t *rings = NULL;
+static __thread trace_ring_t *local_ring = NULL;
+
+void trace_configure(int percent) {
+    atomic_store(&sample_percent, percent < 0 ? 0 : percent > 100 ? 100 : percent);
+}
+
+bool trace_enabled(void) {
+    return atomic_load_explicit(&sample_percent, memory_order_relaxed) > 0;
+}
+
+uint32_t trace_connection_id(void) {
+    uint32_t id = atomic_fetch_add(&next_connection, 1);
+    return id != 0 ? id : atomic_fetch_add(&next_connection, 1);
+}
+
+uint64_t trace_request_id(uint32_t connection, uint32_t request_id) {
+    int percent = atomic_load_explicit(&sample_percent, memory_order_relaxed);
+    uint64_t id = (uint64_t)connection << 32 | request_id;
+    if (percent <= 0) {
+        return 0;
+    }
+
+    // A multiplicative hash spreads consecutive ids over the percentiles
+    uint64_t hash = (id * 0x9E3779B97F4A7C15ULL) >> 32;
+    return hash % 100 < (uint64_t)percent ? id : 0;
+}
+
+// The calling thread's ring, made and registered on first use
+static trace_ring_t* get_ring(void) {
+    if (local_ring != NULL) {
+        return local_ring;
+    }
+
+    trace_ring_t *ring = calloc(1, sizeof(trace_ring_t));
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&rings_mutex);
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&rings_mutex);
+
+    local_ring = ring;
+    return ring;
+}
+
+void trace_span_arg(uint64_t id, const char *name, int64_t start_us, int64_t end_us,
+                    const char *arg_name, int64_t arg) {
+    trace_ring_t *ring = id != 0 ? get_ring() : NULL;
+    if (ring == NULL) {
+        return;
+    }
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    trace_event_t *event = &ring->events[head % TRACE_RING_EVENTS];
+
+    // A renderer that sees any of the stores below also sees the head
+    // that says this slot is being reused
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&event->id, id, memory_order_relaxed);
+    atomic_store_explicit(&event->name, name, memory_order_relaxed);
+    atomic_store_explicit(&event->start_us, start_us, memory_order_relaxed);
+    atomic_store_explicit(&event->duration_us, end_us > start_us ? end_us - start_us : 0, memory_order_relaxed);
+    atomic_store_explicit(&event->arg_name, arg_name, memory_order_relaxed);
+    atomic_store_explicit(&event->arg, arg, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void trace_span(uint64_t id, const char *name, int64_t start_us, int64_t end_us) {
+    trace_span_arg(id, name, start_us, end_us, NULL, 0);
+}
+
+// Copy the ring's spans into out, oldest first, leaving out any the
+// owner overwrote while they were being copied. Returns how many.
+static size_t copy_ring(trace_ring_t *ring, trace_copy_t *out) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t first = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+
+    for (uint64_t i = first; i < head; i++) {
+        trace_event_t *event = &ring->events[i % TRACE_RING_EVENTS];
+        trace_copy_t *copy = &out[i - first];
+        copy->id = atomic_load_explicit(&event->id, memory_order_relaxed);
+        copy->name = atomic_load_explicit(&event->name, memory_order_relaxed);
+        copy->start_us = atomic_load_explicit(&event->start_us, memory_order_relaxed);
+        copy->duration_us = atomic_load_explicit(&event->duration_us, memory_order_relaxed);
+        copy->arg_name = atomic_load_explicit(&event->arg_name, memory_order_relaxed);
+        copy->arg = atomic_load_explicit(&event->arg, memory_order_relaxed);
+    }
+
+    // Slots of spans recorded since may hold a mix of old and new
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t now = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint64_t valid = now >= TRACE_RING_EVENTS ? now - TRACE_RING_EVENTS + 1 : 0;
+    if (valid <= first) {
+        return head - first;
+    }
+    if (valid >= head) {
+        return 0;
+    }
+    memmove(out, out + (valid - first), (head - valid) * sizeof(trace_copy_t));
+    return head - valid;
+}
+
+bool trace_render(arena_t *out) {
+    trace_copy_t *copies = malloc(TRACE_RING_EVENTS * sizeof(trace_copy_t));
+    if (copies == NULL || !arena_append_string(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[")) {
+        free(copies);
+        return false;
+    }
+
+    bool ok = true;
+    bool first = true;
+    pthread_mutex_lock(&rings_mutex);
+    for (trace_ring_t *ring = rings; ring != NULL && ok; ring = ring->next) {
+        size_t count = copy_ring(ring, copies);
+        for (size_t i = 0; i < count && ok; i++) {
+            const trace_copy_t *span = &copies[i];
+            ok = arena_printf(out, "%s\n{\"name\":\"%s\",\"cat\":\"request\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,"
+                              "\"pid\":%u,\"tid\":%u", first ? "" : ",", span->name,
+                              (long long)span->start_us, (long long)span->duration_us,
+                              (unsigned)(span->id >> 32), (unsigned)(span->id & 0xffffffffu));
+            if (ok && span->arg_name != NULL) {
+                ok = arena_printf(out, ",\"args\":{\"%s\":%lld}", span->arg_name, (long long)span->arg);
+            }
+            ok = ok && arena_append_string(out, "}");
+            first = false;
+        }
+    }
+    pthread_mutex_unlock(&rings_mutex);
+
+    free(copies);
+    return ok && arena_append_string(out, "\n]}\n");
+}
@@ -0,0 +1,47 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "arena.h"
+
+// Spans each thread keeps; older ones are overwritten
+#define TRACE_RING_EVENTS 4096
+
+// Row of the hedge leg of a traced request, next to the request's own
+#define TRACE_HEDGE(id) ((id) | 0x80000000u)
+
+// Content type of trace_render() output
+#define TRACE_CONTENT_TYPE "application/json"
+
+// Per-request tracing
+//
+// Every connection gets an id at accept, and a prompt's trace id is that
+// id with the prompt's request_id, so 0 never names a request. Only a
+// sampled share of prompts get a non-zero id; the server and the engine
+// record spans for those alone. Spans go into a ring buffer of the
+// recording thread, without locks, and trace_render() dumps what the
+// rings hold in Chrome's trace_event format: one process per connection,
+// one thread per request, which chrome://tracing and Perfetto open as is.
+// All calls are thread-safe.
+
+// Share of prompts to trace, 0 to 100
+void trace_configure(int sample_percent);
+bool trace_enabled(void);
+
+uint32_t trace_connection_id(void);
+
+// Trace id of a prompt, or 0 if it is not sampled
+uint64_t trace_request_id(uint32_t connection, uint32_t request_id);
+
+// Record a span of the request, metrics_now_us() clock. Ignored for id 0.
+void trace_span(uint64_t id, const char *name, int64_t start_us, int64_t end_us);
+
+// The same with one numeric argument; names must be static strings
+void trace_span_arg(uint64_t id, const char *name, int64_t start_us, int64_t end_us,
+                    const char *arg_name, int64_t arg);
+
+// Append every span still held as a trace_event JSON document
+bool trace_render(arena_t *out);
+
+#endif /* TRACE_H */
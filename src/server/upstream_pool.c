@@ -0,0 +1,342 @@
+#include "upstream_pool.h"
+#include "http_parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define HEALTH_CHECK_TIMEOUT_MS 2000
+
+static time_t monotonic_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+static bool resolve_upstream(upstream_pool_t *pool) {
+    const upstream_config_t *config = &pool->config;
+
+    if (config->socket_path[0] != '\0') {
+        struct sockaddr_un *addr = (struct sockaddr_un *)&pool->address;
+        memset(addr, 0, sizeof(*addr));
+        addr->sun_family = AF_UNIX;
+        strncpy(addr->sun_path, config->socket_path, sizeof(addr->sun_path) - 1);
+        pool->address_length = sizeof(*addr);
+        snprintf(pool->host_header, sizeof(pool->host_header), "localhost");
+        return true;
+    }
+
+    // getaddrinfo is thread-safe, and we only call it once anyway
+    char port[16];
+    snprintf(port, sizeof(port), "%d", config->port);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *result = NULL;
+    int rc = getaddrinfo(config->host, port, &hints, &result);
+    if (rc != 0 || result == NULL) {
+        fprintf(stderr, "Error: Could not resolve upstream host %s: %s\n", config->host, gai_strerror(rc));
+        return false;
+    }
+
+    memcpy(&pool->address, result->ai_addr, result->ai_addrlen);
+    pool->address_length = result->ai_addrlen;
+    freeaddrinfo(result);
+
+    snprintf(pool->host_header, sizeof(pool->host_header), "%s:%d", config->host, config->port);
+    return true;
+}
+
+upstream_pool_t* upstream_pool_create(const upstream_config_t *config) {
+    upstream_pool_t *pool = calloc(1, sizeof(upstream_pool_t));
+    if (pool == NULL) {
+        fprintf(stderr, "Error: Failed to allocate upstream pool\n");
+        return NULL;
+    }
+
+    memcpy(&pool->config, config, sizeof(upstream_config_t));
+    pthread_mutex_init(&pool->mutex, NULL);
+
+    if (!resolve_upstream(pool)) {
+        upstream_pool_destroy(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+void upstream_pool_destroy(upstream_pool_t *pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    upstream_connection_t *conn = pool->idle;
+    while (conn) {
+        upstream_connection_t *next = conn->next;
+        close(conn->fd);
+        free(conn);
+        conn = next;
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+}
+
+// connect() bounded by the configured timeout; on failure errno says why
+static bool connect_within(int fd, const upstream_pool_t *pool) {
+    int timeout_ms = pool->config.connect_timeout_ms;
+    if (timeout_ms <= 0) {
+        return connect(fd, (struct sockaddr *)&pool->address, pool->address_length) == 0;
+    }
+
+    // Connect without blocking, wait for the outcome, then go back to
+    // blocking mode, which the request code expects
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    bool connected = connect(fd, (struct sockaddr *)&pool->address, pool->address_length) == 0;
+    if (!connected && errno == EINPROGRESS) {
+        struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+        int ready;
+        do {
+            ready = poll(&pfd, 1, timeout_ms);
+        } while (ready < 0 && errno == EINTR);
+
+        if (ready == 0) {
+            errno = ETIMEDOUT;
+        } else if (ready > 0) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            connected = error == 0;
+            errno = error;
+        }
+    }
+
+    fcntl(fd, F_SETFL, flags);
+    return connected;
+}
+
+static const char* upstream_name(const upstream_pool_t *pool) {
+    return pool->config.socket_path[0] ? pool->config.socket_path : pool->host_header;
+}
+
+static upstream_connection_t* open_connection(upstream_pool_t *pool, bool nonblocking) {
+    int fd = socket(pool->address.ss_family, SOCK_STREAM | SOCK_CLOEXEC | (nonblocking ? SOCK_NONBLOCK : 0), 0);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Failed to create socket: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    bool connecting = false;
+    if (nonblocking) {
+        if (connect(fd, (struct sockaddr *)&pool->address, pool->address_length) < 0) {
+            connecting = errno == EINPROGRESS;
+            if (!connecting) {
+                fprintf(stderr, "Error: Failed to connect to %s: %s\n", upstream_name(pool), strerror(errno));
+                close(fd);
+                return NULL;
+            }
+        }
+    } else if (!connect_within(fd, pool)) {
+        fprintf(stderr, "Error: Failed to connect to %s: %s\n", upstream_name(pool), strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    if (pool->address.ss_family != AF_UNIX) {
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    }
+
+    upstream_connection_t *conn = calloc(1, sizeof(upstream_connection_t));
+    if (conn == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    conn->fd = fd;
+    conn->nonblocking = nonblocking;
+    conn->connecting = connecting;
+    conn->last_used = monotonic_seconds();
+    return conn;
+}
+
+upstream_connection_t* upstream_pool_connect(upstream_pool_t *pool) {
+    return open_connection(pool, false);
+}
+
+upstream_connection_t* upstream_pool_connect_nonblocking(upstream_pool_t *pool) {
+    return open_connection(pool, true);
+}
+
+bool upstream_pool_finish_connect(upstream_pool_t *pool, upstream_connection_t *conn) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0) {
+        error = errno;
+    }
+
+    conn->connecting = false;
+    if (error != 0) {
+        fprintf(stderr, "Error: Failed to connect to %s: %s\n", upstream_name(pool), strerror(error));
+        errno = error;
+        return false;
+    }
+    return true;
+}
+
+// An idle keep-alive socket is healthy if the upstream has not closed it
+// and has not sent anything unsolicited
+static bool idle_connection_alive(upstream_connection_t *conn, time_t now) {
+    if (now - conn->last_used > UPSTREAM_POOL_IDLE_TIMEOUT) {
+        return false;
+    }
+
+    char byte;
+    ssize_t result = recv(conn->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+// Pop the most recently used idle connection that is still healthy
+static upstream_connection_t* take_idle(upstream_pool_t *pool) {
+    time_t now = monotonic_seconds();
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->idle) {
+        upstream_connection_t *conn = pool->idle;
+        pool->idle = conn->next;
+        pool->idle_count--;
+
+        if (idle_connection_alive(conn, now)) {
+            pthread_mutex_unlock(&pool->mutex);
+            conn->next = NULL;
+            conn->reused = true;
+            return conn;
+        }
+
+        close(conn->fd);
+        free(conn);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+upstream_connection_t* upstream_pool_acquire(upstream_pool_t *pool) {
+    upstream_connection_t *conn = take_idle(pool);
+    return conn != NULL ? conn : upstream_pool_connect(pool);
+}
+
+upstream_connection_t* upstream_pool_acquire_nonblocking(upstream_pool_t *pool) {
+    upstream_connection_t *conn = take_idle(pool);
+    if (conn == NULL) {
+        return upstream_pool_connect_nonblocking(pool);
+    }
+
+    int flags = fcntl(conn->fd, F_GETFL, 0);
+    fcntl(conn->fd, F_SETFL, flags | O_NONBLOCK);
+    conn->nonblocking = true;
+    return conn;
+}
+
+void upstream_pool_release(upstream_pool_t *pool, upstream_connection_t *conn, bool reusable) {
+    if (conn == NULL) {
+        return;
+    }
+
+    conn->requests++;
+    conn->last_used = monotonic_seconds();
+
+    // Blocking callers expect blocking sockets from the pool
+    if (reusable && conn->nonblocking) {
+        int flags = fcntl(conn->fd, F_GETFL, 0);
+        fcntl(conn->fd, F_SETFL, flags & ~O_NONBLOCK);
+        conn->nonblocking = false;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    if (reusable && pool->idle_count < UPSTREAM_POOL_MAX_IDLE) {
+        conn->next = pool->idle;
+        pool->idle = conn;
+        pool->idle_count++;
+        pthread_mutex_unlock(&pool->mutex);
+        return;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    close(conn->fd);
+    free(conn);
+}
+
+// Sends GET /api/version on conn and gives conn back to the pool
+static bool probe_version(upstream_pool_t *pool, upstream_connection_t *conn) {
+    char request[512];
+    int request_length = snprintf(request, sizeof(request),
+        "GET /api/version HTTP/1.1\r\n"
+        "Host: %s\r\n"
+        "Accept: application/json\r\n\r\n",
+        pool->host_header);
+
+    if (send(conn->fd, request, request_length, MSG_NOSIGNAL) != request_length) {
+        upstream_pool_release(pool, conn, false);
+        return false;
+    }
+
+    // The version answer is tiny; the parser tells us when it is complete
+    http_parser_t parser;
+    http_parser_init(&parser);
+    char response[2048];
+
+    while (!http_parser_complete(&parser)) {
+        struct pollfd pfd = { .fd = conn->fd, .events = POLLIN };
+        if (poll(&pfd, 1, HEALTH_CHECK_TIMEOUT_MS) <= 0) {
+            break;
+        }
+
+        ssize_t bytes = recv(conn->fd, response, sizeof(response), 0);
+        if (bytes <= 0) {
+            if (bytes == 0) {
+                http_parser_finish(&parser);
+            }
+            break;
+        }
+        if (http_parser_feed(&parser, response, bytes, NULL, NULL) < 0) {
+            break;
+        }
+    }
+
+    bool complete = http_parser_complete(&parser);
+    upstream_pool_release(pool, conn, complete && parser.keep_alive);
+    return complete && parser.status_code == 200;
+}
+
+bool upstream_pool_health_check(upstream_pool_t *pool) {
+    upstream_connection_t *conn = upstream_pool_acquire(pool);
+    if (conn == NULL) {
+        return false;
+    }
+
+    // An idle connection the backend has since closed fails without
+    // saying anything about the backend; only a fresh one counts
+    bool reused = conn->reused;
+    if (probe_version(pool, conn)) {
+        return true;
+    }
+    if (!reused) {
+        return false;
+    }
+
+    conn = upstream_pool_connect(pool);
+    return conn != NULL && probe_version(pool, conn);
+}
@@ -0,0 +1,76 @@
+#ifndef UPSTREAM_POOL_H
+#define UPSTREAM_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+// Idle keep-alive connections kept per upstream
+#define UPSTREAM_POOL_MAX_IDLE 32
+
+// Idle connections older than this are closed instead of reused, so we
+// never race the upstream's own keep-alive timeout
+#define UPSTREAM_POOL_IDLE_TIMEOUT 30
+
+// Where the LLM backend listens: a TCP host/port, or a unix socket path
+// when socket_path is set
+typedef struct {
+    char host[256];
+    int port;
+    char socket_path[108];
+    int connect_timeout_ms;     // 0 = the kernel's own limit
+} upstream_config_t;
+
+// One persistent HTTP/1.1 connection to the upstream
+typedef struct upstream_connection {
+    int fd;
+    bool reused;                 // came from the idle list
+    bool nonblocking;            // handed out for use on the event loop
+    bool connecting;             // non-blocking connect() still in progress
+    time_t last_used;            // CLOCK_MONOTONIC seconds
+    unsigned long requests;      // requests served on this socket
+    struct upstream_connection *next;
+} upstream_connection_t;
+
+typedef struct {
+    upstream_config_t config;
+    char host_header[300];
+
+    // Resolved once at creation; connect() reuses it with no resolver calls
+    struct sockaddr_storage address;
+    socklen_t address_length;
+
+    pthread_mutex_t mutex;
+    upstream_connection_t *idle;
+    int idle_count;
+} upstream_pool_t;
+
+// Pool lifecycle
+upstream_pool_t* upstream_pool_create(const upstream_config_t *config);
+void upstream_pool_destroy(upstream_pool_t *pool);
+
+// Take an idle connection if a healthy one exists, otherwise connect a
+// new one. Returns NULL if the upstream cannot be reached.
+upstream_connection_t* upstream_pool_acquire(upstream_pool_t *pool);
+upstream_connection_t* upstream_pool_connect(upstream_pool_t *pool);
+
+// The same for callers on the event loop: never blocks, and the socket
+// is non-blocking. While conn->connecting is set, wait for the socket to
+// become writable and then call upstream_pool_finish_connect(), which
+// returns false (errno set) if the connection was refused.
+upstream_connection_t* upstream_pool_acquire_nonblocking(upstream_pool_t *pool);
+upstream_connection_t* upstream_pool_connect_nonblocking(upstream_pool_t *pool);
+bool upstream_pool_finish_connect(upstream_pool_t *pool, upstream_connection_t *conn);
+
+// Give a connection back. Only pass reusable=true when the previous
+// response was read completely and the upstream did not ask to close.
+// Pooled connections go back to blocking mode.
+void upstream_pool_release(upstream_pool_t *pool, upstream_connection_t *conn, bool reusable);
+
+// Active health check: GET /api/version must answer 200. A probe that
+// fails on a pooled connection is retried once on a fresh one.
+bool upstream_pool_health_check(upstream_pool_t *pool);
+
+#endif /* UPSTREAM_POOL_H */
@@ -0,0 +1,129 @@
+#include "worker_pool.h"
+#include "request_queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+// Internal state
+static request_queue_t queue;
+static sem_t queue_items;
+static pthread_t *workers = NULL;
+static int worker_count = 0;
+static worker_job_handler_t job_handler = NULL;
+static atomic_bool pool_running = false;
+
+static void* worker_main(void *arg) {
+    (void)arg;
+
+    while (true) {
+        // Each posted item is matched by exactly one successful wait
+        if (sem_wait(&queue_items) != 0) {
+            continue;
+        }
+
+        // The pop can still come up empty: with several producers, an
+        // earlier cell may be claimed but not filled yet. The job behind
+        // this post is on its way, so wait for it instead of losing the post.
+        void *job;
+        bool popped;
+        while (!(popped = request_queue_pop(&queue, &job))) {
+            // Woken by worker_pool_stop() with nothing left to do
+            if (!atomic_load(&pool_running) && request_queue_size(&queue) == 0) {
+                break;
+            }
+            sched_yield();
+        }
+        if (!popped) {
+            break;
+        }
+
+        job_handler(job);
+    }
+
+    return NULL;
+}
+
+bool worker_pool_start(int count, size_t queue_capacity, worker_job_handler_t handler) {
+    if (count <= 0 || handler == NULL) {
+        fprintf(stderr, "Error: Invalid worker pool configuration\n");
+        return false;
+    }
+
+    if (!request_queue_init(&queue, queue_capacity)) {
+        return false;
+    }
+
+    if (sem_init(&queue_items, 0, 0) != 0) {
+        fprintf(stderr, "Error: Failed to initialize worker semaphore\n");
+        request_queue_destroy(&queue);
+        return false;
+    }
+
+    workers = calloc(count, sizeof(pthread_t));
+    if (workers == NULL) {
+        fprintf(stderr, "Error: Failed to allocate worker threads\n");
+        sem_destroy(&queue_items);
+        request_queue_destroy(&queue);
+        return false;
+    }
+
+    job_handler = handler;
+    atomic_store(&pool_running, true);
+
+    for (worker_count = 0; worker_count < count; worker_count++) {
+        if (pthread_create(&workers[worker_count], NULL, worker_main, NULL) != 0) {
+            fprintf(stderr, "Error: Failed to create worker thread %d\n", worker_count);
+            worker_pool_stop();
+            return false;
+        }
+    }
+
+    printf("Started %d LLM worker%s\n", worker_count, worker_count == 1 ? "" : "s");
+    return true;
+}
+
+void worker_pool_stop(void) {
+    if (!atomic_exchange(&pool_running, false)) {
+        return;
+    }
+
+    // Wake every worker; queued jobs are still drained before they exit
+    for (int i = 0; i < worker_count; i++) {
+        sem_post(&queue_items);
+    }
+
+    for (int i = 0; i < worker_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    free(workers);
+    workers = NULL;
+    worker_count = 0;
+    sem_destroy(&queue_items);
+    request_queue_destroy(&queue);
+}
+
+bool worker_pool_submit(void *job) {
+    if (!atomic_load(&pool_running)) {
+        return false;
+    }
+
+    if (!request_queue_push(&queue, job)) {
+        return false;
+    }
+
+    sem_post(&queue_items);
+    return true;
+}
+
+size_t worker_pool_queue_depth(void) {
+    return atomic_load(&pool_running) ? request_queue_size(&queue) : 0;
+}
+
+int worker_pool_size(void) {
+    return worker_count;
+}
@@ -0,0 +1,22 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Runs one queued job on a worker thread; owns and frees the job
+typedef void (*worker_job_handler_t)(void *job);
+
+// Fixed-size pool of worker threads fed by a bounded lock-free queue.
+// Workers sleep on a semaphore while the queue is empty.
+bool worker_pool_start(int worker_count, size_t queue_capacity, worker_job_handler_t handler);
+void worker_pool_stop(void);
+
+// Returns false if the queue is full or the pool is not running
+bool worker_pool_submit(void *job);
+
+// Pool statistics
+size_t worker_pool_queue_depth(void);
+int worker_pool_size(void);
+
+#endif /* WORKER_POOL_H */